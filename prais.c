@@ -26,9 +26,11 @@
 #include <string.h>	/* For memset() */
 #include <stdio.h>	/* For printf(...) */
 #include <arpa/inet.h> 	/* For htons */
-#include <termios.h>	/* For tcflush() */
 #include "rds.h"
 #include "prais.h"
+#include "rds_fcache.h"
+#include "rds_charset.h"
+#include "rds_af.h"
 
 
 /**********************\
@@ -36,13 +38,15 @@
 \**********************/
 
 /**
- * prais_get_frame_from_enc - Get a pending data frame from a Prais encoder
+ * prais_read_frame - Get a pending data frame from a Prais encoder
  * @enc: pointer to &struct rds_encoder
  * @data: pointer to a pre-allocated &struct prais_data_frame to fill
+ * @keep: keep any input after the frame (the next unit's reply
+ *	when pipelining reads), else it's flushed
  */
 static int
-prais_get_frame_from_enc(struct rds_encoder *enc,
-			struct prais_data_frame *data)
+prais_read_frame(struct rds_encoder *enc, struct prais_data_frame *data,
+							uint8_t keep)
 {
 	unsigned char buf[PRAIS_DF_MAX_LEN];
 	struct prais_message *msg = &data->msg;
@@ -51,6 +55,7 @@ prais_get_frame_from_enc(struct rds_encoder *enc,
 	int got_ack = 0;
 	uint16_t csum_calculated = 0;
 	uint16_t csum_received = 0;
+	uint16_t reply_addr = 0;
 	char csum_ascii[2];
 
 	ret = rds_get_byte(enc);
@@ -113,7 +118,7 @@ prais_get_frame_from_enc(struct rds_encoder *enc,
 
 	if(ret & (PRAIS_DF_NO_REPLY >> 8))
 		data->no_reply = 1;
-	enc->addr |= ret << 8;
+	reply_addr = (ret << 8) & ~PRAIS_DF_NO_REPLY;
 
 	ret = rds_get_byte(enc);
 	if(ret < 0) {
@@ -121,7 +126,10 @@ prais_get_frame_from_enc(struct rds_encoder *enc,
 		goto finished;
 	}
 
-	enc->addr |= ret;
+	/* Don't touch enc->addr here, it's our
+	 * target address, not the sender's */
+	reply_addr |= ret;
+	data->addr = reply_addr;
 
 	/* Sequence number */
 	ret = rds_get_byte(enc);
@@ -209,10 +217,23 @@ prais_get_frame_from_enc(struct rds_encoder *enc,
 		ret = msg->len;
 
 finished:
-	tcflush(enc->serial_fd, TCIFLUSH);
+	if(ret < 0 || !keep)
+		rds_flush_input(enc);
 	return ret;
 }
 
+/**
+ * prais_get_frame_from_enc - Get a pending data frame from a Prais encoder
+ * @enc: pointer to &struct rds_encoder
+ * @data: pointer to a pre-allocated &struct prais_data_frame to fill
+ */
+static int
+prais_get_frame_from_enc(struct rds_encoder *enc,
+			struct prais_data_frame *data)
+{
+	return prais_read_frame(enc, data, 0);
+}
+
 /**
  * prais_send_frame_to_enc - Send a data frame to a Prais encoder
  * @enc: pointer to &struct rds_encoder
@@ -222,52 +243,75 @@ static int
 prais_send_frame_to_enc(struct rds_encoder *enc,
 			struct prais_data_frame *data)
 {
-	unsigned char buf[PRAIS_DF_MAX_LEN];
+	uint8_t buf[PRAIS_DF_MAX_WIRE_LEN];
 	int len = 0;
+	int i = 0;
 	uint8_t csum_char = 0;
+	uint16_t addr = enc->addr;
+	struct rds_fcache_key key;
+	struct rds_fcache_entry *entry = NULL;
+	uint8_t cache = 0;
 	data->msg.checksum = 0;
 
-	/* Add the no reply flag if needed */
+	/* Add the no reply flag if needed (only on the
+	 * frame, enc->addr stays as is) */
 	if(data->no_reply)
-		enc->addr |= PRAIS_DF_NO_REPLY;
+		addr |= PRAIS_DF_NO_REPLY;
+
+	/* Frames only differ in their sequence number
+	 * when we send the same message again, so if
+	 * we've serialized it before, just patch that.
+	 * RTC payloads never repeat, don't let them push
+	 * the rest out of the cache. */
+	cache = (data->msg.type != PRAIS_MT_RTC);
+	rds_fcache_key_init(&key, enc, data->msg.type, data->no_reply, 0,
+				data->msg.data, data->msg.len < PRAIS_MT_MAX_LEN ?
+				data->msg.len : PRAIS_MT_MAX_LEN);
+	if(cache)
+		entry = rds_fcache_lookup(enc, &key);
+	if(entry) {
+		memcpy(buf, entry->frame, entry->len);
+		len = entry->len;
+		goto seq;
+	}
 
 	/* Start header with two SYNs and SOH */
-	rds_send_byte(enc, PRAIS_DL_SYN);
-	rds_send_byte(enc, PRAIS_DL_SYN);
-	rds_send_byte(enc, PRAIS_DL_SOH);
+	buf[len++] = PRAIS_DL_SYN;
+	buf[len++] = PRAIS_DL_SYN;
+	buf[len++] = PRAIS_DL_SOH;
 
 	/* Send address and sequence number as ASCII text */
-	rds_send_byte(enc, (enc->addr & 0xFF00) >> 8);
-	rds_send_byte(enc, enc->addr & 0x00FF);
-	rds_send_byte(enc, enc->seq + 0x30);
+	buf[len++] = (addr & 0xFF00) >> 8;
+	buf[len++] = addr & 0x00FF;
+	buf[len++] = enc->seq + 0x30;
 
 	/* Send DLE and STX to mark msg start */
-	rds_send_byte(enc, PRAIS_DL_DLE);
-	rds_send_byte(enc, PRAIS_DL_STX);
+	buf[len++] = PRAIS_DL_DLE;
+	buf[len++] = PRAIS_DL_STX;
 
 	/* Send mesage type, length and body, in case
 	 * a byte is the same as DLE, escape it by
 	 * adding a DLE before it (so output 2 DLEs) */
 
-	rds_send_byte(enc, data->msg.type);
+	buf[len++] = data->msg.type;
 	data->msg.checksum += data->msg.type;
 
-	rds_send_byte(enc, data->msg.len);
+	buf[len++] = data->msg.len;
 	data->msg.checksum += data->msg.len;
 
-	for(len = 0; len < data->msg.len && len < PRAIS_MT_MAX_LEN; len++) {
-		if(data->msg.data[len] == 0x10) {
-			rds_send_byte(enc, PRAIS_DL_DLE);
+	for(i = 0; i < data->msg.len && i < PRAIS_MT_MAX_LEN; i++) {
+		if(data->msg.data[i] == 0x10) {
+			buf[len++] = PRAIS_DL_DLE;
 			data->msg.checksum += PRAIS_DL_DLE;
 		}
 
-		rds_send_byte(enc, data->msg.data[len]);
-		data->msg.checksum += data->msg.data[len];
+		buf[len++] = data->msg.data[i];
+		data->msg.checksum += data->msg.data[i];
 	}
 
 	/* Send DLE and ETX to mark msg end */
-	rds_send_byte(enc, PRAIS_DL_DLE);
-	rds_send_byte(enc, PRAIS_DL_ETX);
+	buf[len++] = PRAIS_DL_DLE;
+	buf[len++] = PRAIS_DL_ETX;
 
 	/* Calculate checksum: grab the LSB of checksum
 	 * and send it out as ASCII text */
@@ -277,7 +321,7 @@ prais_send_frame_to_enc(struct rds_encoder *enc,
 	else
 		csum_char = csum_char + 0x30;
 
-	rds_send_byte(enc, csum_char);
+	buf[len++] = csum_char;
 
 	csum_char = data->msg.checksum & 0x0F;
 	if(csum_char >= 10)
@@ -285,16 +329,10 @@ prais_send_frame_to_enc(struct rds_encoder *enc,
 	else
 		csum_char = csum_char + 0x30;
 
-	rds_send_byte(enc, csum_char);
+	buf[len++] = csum_char;
 
 	/* Finaly send a SYNC to end the message */
-	rds_send_byte(enc, PRAIS_DL_SYN);
-
-	/* And increase the sequence counter */
-	if(enc->seq < 9)
-		enc->seq++;
-	else
-		enc->seq = 0; /* Reset */
+	buf[len++] = PRAIS_DL_SYN;
 
 	/* Prais's programm sends 1220 (4c4) ETXes
 	 * when broadcasting or on satelite mode.
@@ -304,9 +342,27 @@ prais_send_frame_to_enc(struct rds_encoder *enc,
 	 * that. It's crap, I'll leave it to 64
 	 * and if you see any issues, increase it.
 	 */
-	if(data->no_reply)
-		for(len = 0; len < 64; len++)
-			rds_send_byte(enc, PRAIS_DL_ETX);
+	if(data->no_reply) {
+		memset(buf + len, PRAIS_DL_ETX, PRAIS_DF_NO_REPLY_PAD);
+		len += PRAIS_DF_NO_REPLY_PAD;
+	}
+
+	if(cache)
+		rds_fcache_store(enc, &key, buf, len);
+
+ seq:
+	/* Sequence number is at a fixed offset, after
+	 * SYN, SYN, SOH and the address */
+	buf[5] = enc->seq + 0x30;
+
+	/* And increase the sequence counter */
+	if(enc->seq < 9)
+		enc->seq++;
+	else
+		enc->seq = 0; /* Reset */
+
+	/* Send the whole frame at once */
+	return rds_send_buf(enc, buf, len);
 }
 
 /**
@@ -316,14 +372,78 @@ prais_send_frame_to_enc(struct rds_encoder *enc,
 static int
 prais_send_ack_to_enc(struct rds_encoder *enc)
 {
-	rds_send_byte(enc, PRAIS_DL_SYN);
-	rds_send_byte(enc, PRAIS_DL_SYN);
-	rds_send_byte(enc, PRAIS_DL_ACK);
-	rds_send_byte(enc, PRAIS_DL_SYN);
-	rds_send_byte(enc, 0);
+	static const uint8_t ack[] = { PRAIS_DL_SYN, PRAIS_DL_SYN,
+					PRAIS_DL_ACK, PRAIS_DL_SYN, 0 };
+
+	rds_send_buf(enc, ack, sizeof(ack));
 	return 0;
 }
 
+/**
+ * prais_rx_split - Find where the first reply on a buffer ends
+ * @buf: bytes received
+ * @len: how many
+ * @addr: filled with the address of the unit that sent it, -1
+ *	for a bare ACK
+ *
+ * Same layout prais_read_frame() parses, for the bus to route
+ * replies on a shared port (see rds_bus.c).
+ *
+ * Returns: the reply's length, 0 if it's not all there yet, or
+ * minus the length of garbage before it
+ */
+static int
+prais_rx_split(const uint8_t *buf, int len, int *addr)
+{
+	int pos = 0;
+	int i = 0;
+
+	*addr = -1;
+
+	while(pos < len && buf[pos] != PRAIS_DL_SYN)
+		pos++;
+	if(pos)
+		return -pos;
+
+	while(pos < len && buf[pos] == PRAIS_DL_SYN)
+		pos++;
+
+	/* ACK, SYN, then 0 for ACK only or SYN, SYN, SOH */
+	if(pos + 3 > len)
+		return 0;
+	if(buf[pos] != PRAIS_DL_ACK || buf[pos + 1] != PRAIS_DL_SYN)
+		return -pos;
+	if(buf[pos + 2] == 0)
+		return pos + 3;
+	pos += 3;
+
+	/* SYN, SOH, address, sequence, DLE, STX,
+	 * type and length */
+	if(pos + 9 > len)
+		return 0;
+	if(buf[pos + 1] != PRAIS_DL_SOH)
+		return -pos;
+	*addr = (buf[pos + 2] << 8 | buf[pos + 3]) & ~PRAIS_DF_NO_REPLY;
+	i = buf[pos + 8];
+	pos += 9;
+
+	/* Data, DLE-escaped */
+	while(i > 0) {
+		if(pos >= len)
+			return 0;
+		if(buf[pos] == PRAIS_DL_DLE)
+			pos++;
+		pos++;
+		i--;
+	}
+
+	/* DLE, ETX, checksum and SYN */
+	if(pos + 5 > len)
+		return 0;
+
+	return pos + 5;
+}
+
 
 /*****************\
 * COMMAND HELPERS *
@@ -605,7 +725,7 @@ prais_get_pi(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, struct rds_pi *p
 	if(ret < 0)
 		return ret;
 
-	prais_get_frame_from_enc(enc, &reply);
+	ret = prais_get_frame_from_enc(enc, &reply);
 	if(ret < 0)
 		return ret;
 
@@ -771,8 +891,8 @@ prais_set_ps(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, char* ps)
 
 	/* P.S. is 8 chars long */
 	for(i = 0; i < pslen; i++) {
-		/* Non-ASCII character */
-		if (ps[i] < 0x20 || ps[i] > 0x7E)
+		/* Control code */
+		if (!RDS_G0_PRINTABLE(ps[i]))
 			msg->data[len++] = ' ';
 		else
 			msg->data[len++] = ps[i];
@@ -881,8 +1001,8 @@ prais_set_rt(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, struct rds_rt *r
 			c = 4 * i;
 
 			for(j = 0; j < 4; j++, c++) {
-				/* Non-ASCII character */
-				if (rt->msg[c] < 0x20 || rt->msg[c] > 0x7E) {
+				/* Control code */
+				if (!RDS_G0_PRINTABLE(rt->msg[c])) {
 					msg->data[j] = ' ';
 				} else
 					msg->data[j] = rt->msg[c];
@@ -1304,6 +1424,59 @@ prais_set_pty(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t pty)
 	return ret;
 }
 
+/**
+ * prais_set_af - Set the Alternative Frequencies list of a Prais encoder
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: 0 (only one Programme supported)
+ * @psn: 0 (only one Programme supported)
+ * @af: the change (see rds_af.h)
+ *
+ * There's a single method A list and no way to change parts of
+ * it, so the whole list goes out (as it goes on air) every time.
+ */
+static int
+prais_set_af(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+				const struct rds_af_wire *af)
+{
+	struct prais_data_frame data_frame;
+	struct prais_message *msg = &data_frame.msg;
+	struct prais_data_frame reply;
+	int ret = 0;
+
+	/* Only one active programme is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	if(af->method != RDS_AF_METHOD_A)
+		return -EOPNOTSUPP;
+
+	if(af->op != RDS_AF_OP_CLEAR && af->len > PRAIS_MT_MAX_LEN)
+		return -E2BIG;
+
+	memset(&data_frame, 0, sizeof(struct prais_data_frame));
+
+	if(enc->addr == PRAIS_DF_ADDR_BCAST)
+		data_frame.no_reply = 1;
+
+	msg->type = PRAIS_MT_AF;
+	if(af->op == RDS_AF_OP_CLEAR) {
+		msg->len = 2;
+		msg->data[0] = RDS_AF_CODE_NONE;
+		msg->data[1] = RDS_AF_CODE_FILLER;
+	} else {
+		msg->len = af->len;
+		memcpy(msg->data, af->codes, af->len);
+	}
+
+	prais_send_frame_to_enc(enc, &data_frame);
+
+	if(data_frame.no_reply != 1) {
+		ret = prais_get_frame_from_enc(enc, &reply);
+		prais_send_ack_to_enc(enc);
+	}
+	return ret;
+}
+
 
 /**
  * prais_set_rtc - Set Real Time Clock settings on a Prais encoder
@@ -1426,6 +1599,292 @@ prais_set_rds_on(struct rds_encoder *enc, uint8_t on)
 	return ret;
 }
 
+/**
+ * prais_get_lock - Get the lock status of a Prais encoder
+ * @enc: pointer to &struct rds_encoder
+ *
+ * Returns: 1 if it's locked, 0 if it's not, or -errno
+ */
+static int
+prais_get_lock(struct rds_encoder *enc)
+{
+	struct prais_data_frame request;
+	struct prais_message *msg = &request.msg;
+	struct prais_data_frame reply;
+	int ret = 0;
+
+	if(enc->addr == PRAIS_DF_ADDR_BCAST)
+		return -EOPNOTSUPP;
+
+	memset(&request, 0, sizeof(struct prais_data_frame));
+	memset(&reply, 0, sizeof(struct prais_data_frame));
+
+	msg->type = PRAIS_MT_LOCK_STATUS;
+	msg->len = 0;
+
+	ret = prais_send_frame_to_enc(enc, &request);
+	if(ret < 0)
+		return ret;
+
+	ret = prais_get_frame_from_enc(enc, &reply);
+	if(ret < 0)
+		return ret;
+
+	prais_send_ack_to_enc(enc);
+
+	if(reply.msg.type != PRAIS_MT_LOCK_STATUS || reply.msg.len < 1)
+		return -EPROTO;
+
+	return (reply.msg.data[0] & 0x01) ? 1 : 0;
+}
+
+
+/*****************\
+* PIPELINED READS *
+\*****************/
+
+/**
+ * prais_read_send - Request a field from a Prais encoder, without
+ *		     waiting for the reply
+ * @enc: pointer to &struct rds_encoder
+ * @cmd: the get &struct rds_cmd
+ *
+ * Only the single-message reads, the ones that need a
+ * conversation (e.g. RT) are not supported.
+ */
+static int
+prais_read_send(struct rds_encoder *enc, const struct rds_cmd *cmd)
+{
+	struct prais_data_frame request;
+	struct prais_message *msg = &request.msg;
+
+	/* Only one active programme is supported */
+	if(cmd->dsn != 0 || cmd->psn != 0 ||
+	enc->addr == PRAIS_DF_ADDR_BCAST)
+		return -EOPNOTSUPP;
+
+	memset(&request, 0, sizeof(struct prais_data_frame));
+
+	switch(cmd->op) {
+	case RDS_CMD_GET_PI:
+		msg->type = PRAIS_MT_PI;
+		break;
+	case RDS_CMD_GET_PS:
+		msg->type = PRAIS_MT_PS;
+		msg->len = 2;
+		msg->data[0] = 1;
+		msg->data[1] = 0;
+		break;
+	case RDS_CMD_GET_DI:
+	case RDS_CMD_GET_DYNPTY:
+	case RDS_CMD_GET_TA_TP:
+	case RDS_CMD_GET_MS:
+		msg->type = PRAIS_MT_TAMSDI;
+		break;
+	case RDS_CMD_GET_PTY:
+		msg->type = PRAIS_MT_PTY;
+		break;
+	case RDS_CMD_GET_RDS_ON:
+		msg->type = PRAIS_MT_RDSON;
+		break;
+	default:
+		return -EOPNOTSUPP;
+	}
+
+	return prais_send_frame_to_enc(enc, &request);
+}
+
+/**
+ * prais_read_recv - Get the next reply to prais_read_send()
+ * @enc: pointer to &struct rds_encoder
+ * @addr: filled with the address of the unit that replied
+ * @cmd: the get &struct rds_cmd that was sent, results go here
+ *
+ * Returns: what the matching get method returns
+ */
+static int
+prais_read_recv(struct rds_encoder *enc, uint16_t *addr, struct rds_cmd *cmd)
+{
+	struct prais_data_frame reply;
+	struct prais_message *msg = &reply.msg;
+	uint8_t tamsdi = 0;
+	int ret = 0;
+	int i = 0;
+
+	memset(&reply, 0, sizeof(struct prais_data_frame));
+
+	ret = prais_read_frame(enc, &reply, 1);
+	if(ret < 0)
+		return ret;
+
+	prais_send_ack_to_enc(enc);
+	*addr = reply.addr;
+
+	tamsdi = msg->data[0] & 0x7F;
+
+	switch(cmd->op) {
+	case RDS_CMD_GET_PI:
+		if(msg->type != PRAIS_MT_PI)
+			return -EPROTO;
+		memset(&cmd->arg.pi, 0, sizeof(struct rds_pi));
+		cmd->arg.pi.ccode = msg->data[2] & 0xFF;
+		cmd->arg.pi.ccode |= ((msg->data[0] & 0xF0) >> 4) << 8;
+		cmd->arg.pi.coverage = msg->data[0] & 0x0F;
+		cmd->arg.pi.prn = msg->data[1];
+		return 0;
+	case RDS_CMD_GET_PS:
+		if(msg->type != PRAIS_MT_PS)
+			return -EPROTO;
+		memset(cmd->arg.ps, 0, sizeof(cmd->arg.ps));
+		/* On empty message only the index field
+		 * is present */
+		ret = (msg->len < 3) ? 1 : 2;
+		for(i = 0; i < msg->len - ret && i < RDS_PS_LEN; i++)
+			cmd->arg.ps[i] = msg->data[i + ret];
+		return i;
+	case RDS_CMD_GET_DI:
+		if(msg->type != PRAIS_MT_TAMSDI)
+			return -EPROTO;
+		ret = 0;
+		if(tamsdi & PRAIS_TAMSDI_DI_STEREO)
+			ret |= RDS_DI_STEREO;
+		if(tamsdi & PRAIS_TAMSDI_DI_ART_HEAD)
+			ret |= RDS_DI_ARTIFICIAL_HEAD;
+		if(tamsdi & PRAIS_TAMSDI_DI_COMPRESSED)
+			ret |= RDS_DI_COMPRESSED;
+		return ret;
+	case RDS_CMD_GET_DYNPTY:
+		if(msg->type != PRAIS_MT_TAMSDI)
+			return -EPROTO;
+		return (tamsdi & PRAIS_TAMSDI_DYNPTY) ? 1 : 0;
+	case RDS_CMD_GET_TA_TP:
+		if(msg->type != PRAIS_MT_TAMSDI)
+			return -EPROTO;
+		ret = 0;
+		if(tamsdi & PRAIS_TAMSDI_TA_ON)
+			ret |= RDS_TATP_TA_ON;
+		if(tamsdi & PRAIS_TAMSDI_TP_ON)
+			ret |= RDS_TATP_TP_ON;
+		return ret;
+	case RDS_CMD_GET_MS:
+		if(msg->type != PRAIS_MT_TAMSDI)
+			return -EPROTO;
+		return (tamsdi & PRAIS_TAMSDI_MS_MUSIC) ? RDS_MS_MUSIC :
+							RDS_MS_SPEECH;
+	case RDS_CMD_GET_PTY:
+		if(msg->type != PRAIS_MT_PTY)
+			return -EPROTO;
+		return msg->data[0];
+	case RDS_CMD_GET_RDS_ON:
+		if(msg->type != PRAIS_MT_RDSON)
+			return -EPROTO;
+		return msg->data[0];
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+/**
+ * prais_serial_send - Ask a Prais encoder for its serial number,
+ *		       without waiting for the reply
+ * @enc: pointer to &struct rds_encoder
+ *
+ * An empty PRAIS_MT_SERIAL_NUM message is the request.
+ */
+static int
+prais_serial_send(struct rds_encoder *enc)
+{
+	struct prais_data_frame request;
+
+	/* Everyone would answer at once */
+	if(enc->addr == PRAIS_DF_ADDR_BCAST)
+		return -EOPNOTSUPP;
+
+	memset(&request, 0, sizeof(struct prais_data_frame));
+	request.msg.type = PRAIS_MT_SERIAL_NUM;
+
+	return prais_send_frame_to_enc(enc, &request);
+}
+
+/**
+ * prais_serial_recv - Get the next reply to prais_serial_send()
+ * @enc: pointer to &struct rds_encoder
+ * @addr: filled with the address of the unit that replied
+ * @serial: filled with its serial number (RDS_SERIAL_LEN + 1 bytes)
+ *
+ * Returns: the serial number's length or -errno
+ */
+static int
+prais_serial_recv(struct rds_encoder *enc, uint16_t *addr, char *serial)
+{
+	struct prais_data_frame reply;
+	struct prais_message *msg = &reply.msg;
+	int ret = 0;
+	int i = 0;
+
+	memset(&reply, 0, sizeof(struct prais_data_frame));
+
+	ret = prais_read_frame(enc, &reply, 1);
+	if(ret < 0)
+		return ret;
+
+	prais_send_ack_to_enc(enc);
+	*addr = reply.addr;
+
+	if(msg->type != PRAIS_MT_SERIAL_NUM || !msg->len)
+		return -EPROTO;
+
+	for(i = 0; i < msg->len && i < RDS_SERIAL_LEN; i++)
+		serial[i] = msg->data[i];
+	serial[i] = '\0';
+
+	return i;
+}
+
+/**
+ * prais_set_serial_addr - Give a new address to the Prais encoder
+ *			   with a given serial number
+ * @enc: pointer to &struct rds_encoder
+ * @serial: the unit's serial number
+ * @addr: its new address
+ *
+ * The serial number followed by the new address on a
+ * PRAIS_MT_SERIAL_NUM message, broadcasted so that it reaches
+ * the unit whatever its address is (e.g. when two units share
+ * one). There's no reply, check with prais_serial_send() at the
+ * new address.
+ */
+static int
+prais_set_serial_addr(struct rds_encoder *enc, const char *serial,
+							uint16_t addr)
+{
+	struct prais_data_frame data_frame;
+	struct prais_message *msg = &data_frame.msg;
+	uint16_t target = enc->addr;
+	int len = 0;
+	int ret = 0;
+
+	len = strnlen(serial, RDS_SERIAL_LEN + 1);
+	if(!len || len > RDS_SERIAL_LEN || addr == PRAIS_DF_ADDR_BCAST ||
+	(addr & PRAIS_DF_NO_REPLY))
+		return -EINVAL;
+
+	memset(&data_frame, 0, sizeof(struct prais_data_frame));
+	data_frame.no_reply = 1;
+
+	msg->type = PRAIS_MT_SERIAL_NUM;
+	memcpy(msg->data, serial, len);
+	msg->data[len++] = (addr & 0xFF00) >> 8;
+	msg->data[len++] = addr & 0x00FF;
+	msg->len = len;
+
+	enc->addr = PRAIS_DF_ADDR_BCAST;
+	ret = prais_send_frame_to_enc(enc, &data_frame);
+	enc->addr = target;
+
+	return (ret < 0) ? ret : 0;
+}
+
 
 /**************\
 * ENTRY POINTS *
@@ -1458,6 +1917,14 @@ prais_init(struct rds_encoder *enc)
 	enc->set_rtc = &prais_set_rtc;
 	enc->get_rds_on = &prais_get_rds_on;
 	enc->set_rds_on = &prais_set_rds_on;
+	enc->get_lock = &prais_get_lock;
+	enc->set_af = &prais_set_af;
+	enc->read_send = &prais_read_send;
+	enc->read_recv = &prais_read_recv;
+	enc->serial_send = &prais_serial_send;
+	enc->serial_recv = &prais_serial_recv;
+	enc->set_serial_addr = &prais_set_serial_addr;
+	enc->rx_split = &prais_rx_split;
 
 	return 0;
 }
@@ -78,6 +78,7 @@ struct prais_message {
 /* A data frame for Prais Coder mod. 735 */
 struct prais_data_frame {
 	uint8_t no_reply;		/* Set the no reply flag */
+	uint16_t addr;			/* Sender's address (received frames only) */
 	struct prais_message msg;
 };
 
@@ -94,6 +95,19 @@ struct prais_data_frame {
 
 #define PRAIS_DF_MAX_LEN	48
 
+/* Number of ETXes we pad no-reply frames with (see prais.c) */
+#define PRAIS_DF_NO_REPLY_PAD	64
+
+/* SYN SYN SOH, address, sequence number, DLE STX */
+#define PRAIS_DF_HDR_LEN	8
+/* DLE ETX, checksum, SYN */
+#define PRAIS_DF_TRAILER_LEN	5
+
+/* Worst case on the wire: header + message type and length +
+ * every data byte DLE-escaped + trailer + padding */
+#define PRAIS_DF_MAX_WIRE_LEN	(PRAIS_DF_HDR_LEN + 2 + 2 * PRAIS_MT_MAX_LEN + \
+				PRAIS_DF_TRAILER_LEN + PRAIS_DF_NO_REPLY_PAD)
+
 /**********\
 * COMMANDS *
 \**********/
@@ -26,17 +26,29 @@
 #include <fcntl.h>	/* For O_* macros */
 #include <unistd.h>	/* For read/write etc */
 #include <poll.h>	/* For poll() */
+#include <time.h>	/* For clock_nanosleep() */
+#include <pthread.h>	/* For pthread_mutex_t (soft.h) */
 #include "rds.h"
 #include "rds_ccodes.h"
 #include "uecp.h"
 #include "prais.h"
+#include "rds_af.h"
+#include "soft.h"
+#include "rds_uring.h"
+#include "rds_thread.h"
+#include "rds_shm.h"
+#include "rds_bus.h"
+#include "rds_rtplus.h"
+#include "rds_eon.h"
+#include "rds_dsn.h"
+#include "rds_schedule.h"
 
 
 /***************\
 * I/O FUNCTIONS *
 \***************/
 
-static int
+int
 rds_open_serial(const unsigned char* port)
 {
 	int fd = 0;
@@ -53,7 +65,7 @@ rds_open_serial(const unsigned char* port)
 	if(ret < 0)
 		return -EIO;
 
-	/* Set baud rate to 9600 */
+	/* Set baud rate to 9600 (RDS_SERIAL_BAUD) */
 	cfsetispeed(&tty, B9600);
 	cfsetospeed(&tty, B9600);
 
@@ -101,425 +113,526 @@ rds_open_serial(const unsigned char* port)
 static int
 rds_close_serial(struct rds_encoder *enc)
 {
+	rds_uring_detach(enc);
+
+	/* No port (software encoder), or the
+	 * bus' port (see rds_bus.c) */
+	if(enc->serial_fd < 0 || enc->bus)
+		return 0;
+
 	return close(enc->serial_fd);
 }
 
-int
-rds_get_byte(struct rds_encoder *enc)
+/**
+ * rds_fill_rx - Refill the receive buffer of an encoder
+ * @enc: pointer to &struct rds_encoder
+ *
+ * Grabs whatever is pending on the port (up to RDS_RX_BUF_LEN bytes)
+ * with a single read, instead of doing a poll/read pair per byte.
+ */
+static int
+rds_fill_rx(struct rds_encoder *enc)
 {
 	struct pollfd fds;
-	uint8_t in_byte = 0;
 	int ret = 0;
 
-	memset(&fds, 0, sizeof(struct pollfd));
+	enc->rx_pos = 0;
+	enc->rx_len = 0;
 
-	fds.fd = enc->serial_fd;
-	fds.events = POLLIN|POLLPRI;
-	ret = poll(&fds,1, 1000);	/* 1 second timeout */
-	if(ret <= 0)
-		return -ETIME;
-
-	ret = read(enc->serial_fd, &in_byte, 1);
-	if(ret < 0)
-		return ret;
+	/* Other units answer on the same port, get
+	 * what's ours through the bus */
+	if(enc->bus)
+		return rds_bus_fill_rx(enc);
 
-	//printf("In: 0x%02X (%c)\n", in_byte, in_byte);
-	return in_byte;
-}
+	if(enc->uring) {
+		ret = rds_uring_read(enc, enc->rx_buf, RDS_RX_BUF_LEN,
+							enc->timeout_ms);
+		if(ret != -EINVAL && ret != -EOPNOTSUPP)
+			goto done;
 
-int
-rds_send_byte(struct rds_encoder *enc, char byte)
-{
-	struct pollfd fds;
-	char out_byte = byte;
-	int ret = 0;
+		/* Kernel doesn't support the ops we need,
+		 * fall back to the poll() path for good */
+		rds_uring_detach(enc);
+	}
 
 	memset(&fds, 0, sizeof(struct pollfd));
 
 	fds.fd = enc->serial_fd;
-	fds.events = POLLOUT;
-	ret = poll(&fds,1,1000); /* 1 second timeout */
+	fds.events = POLLIN|POLLPRI;
+	ret = poll(&fds,1, enc->timeout_ms);
 	if(ret <= 0)
 		return -ETIME;
 
-	ret = write(enc->serial_fd, &out_byte, 1);
+	ret = read(enc->serial_fd, enc->rx_buf, RDS_RX_BUF_LEN);
+
+done:
+	if(ret == 0)
+		return -ETIME;
 	if(ret < 0)
 		return ret;
 
-	//printf("Out: 0x%02X (%c)\n", out_byte, out_byte);
-
-	tcdrain(enc->serial_fd);
+	enc->rx_len = ret;
 	return ret;
 }
 
-
-/**********\
-* COMMANDS *
-\**********/
-
-/**
- * rds_get_pi -	Get Programme Identifier information
- * @enc: pointer to &struct rds_encoder
- * @dsn: Data Segment Number
- * @psn: Programme Service Number
- * @pi: pointer to &struct rds_pi to fill
- */
 int
-rds_get_pi(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, struct rds_pi *pi)
+rds_get_byte(struct rds_encoder *enc)
 {
-	if(enc->get_pi == NULL)
-		return -EOPNOTSUPP;
+	uint8_t in_byte = 0;
+	int ret = 0;
 
-	return enc->get_pi(enc, dsn, psn, pi);
-}
+	if(enc->rx_pos >= enc->rx_len) {
+		ret = rds_fill_rx(enc);
+		if(ret < 0)
+			return ret;
+	}
 
-/**
- * rds_set_pi -	Set Programme Identifier information
- * @enc: pointer to &struct rds_encoder
- * @dsn: Data Segment Number
- * @psn: Programme Service Number
- * @pi: pointer to &struct rds_pi containing the infos
- */
-int
-rds_set_pi(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, struct rds_pi *pi)
-{
-	if(enc->set_pi == NULL)
-		return -EOPNOTSUPP;
+	in_byte = enc->rx_buf[enc->rx_pos++];
 
-	return enc->set_pi(enc, dsn, psn, pi);
+	//printf("In: 0x%02X (%c)\n", in_byte, in_byte);
+	return in_byte;
 }
 
 /**
- * rds_get_ps -	Get Programme Service name
+ * rds_flush_input - Drop any pending input of an encoder
  * @enc: pointer to &struct rds_encoder
- * @dsn: message group (1-2)
- * @psn: message id (0-14) (only one supported so always 0)
- * @ps: a pre-allocated 8byte char array to fill
  */
-int
-rds_get_ps(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, char* ps)
+void
+rds_flush_input(struct rds_encoder *enc)
 {
-	if(enc->get_ps == NULL)
-		return -EOPNOTSUPP;
+	enc->rx_pos = 0;
+	enc->rx_len = 0;
+
+	/* What's pending on a shared port may be for
+	 * someone else, the bus routes it */
+	if(enc->bus) {
+		rds_bus_flush_rx(enc);
+		return;
+	}
 
-	return enc->get_ps(enc, dsn, psn, ps);
+	tcflush(enc->serial_fd, TCIFLUSH);
 }
 
 /**
- * rds_set_ps -	Set Programme Service name
+ * rds_send_hold - Wait until a frame should go out
  * @enc: pointer to &struct rds_encoder
- * @dsn: message group (1-2)
- * @psn: message id (0-14) (only one supported so always 0)
- * @ps: PS name to set
+ * @len: the frame's length
+ *
+ * The frame's last byte should hit the wire at enc->send_at_ns,
+ * so we start writing its wire time earlier. The hold is for
+ * this frame only.
+ *
+ * Returns: when its last byte should go out, 0 if it's too late
+ * to hold it
  */
-int
-rds_set_ps(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, char* ps)
+static uint64_t
+rds_send_hold(struct rds_encoder *enc, int len)
 {
-	if(enc->set_ps == NULL)
-		return -EOPNOTSUPP;
-
-	return enc->set_ps(enc, dsn, psn, ps);
-}
+	struct timespec at;
+	struct timespec now;
+	uint64_t ns = enc->send_at_ns;
+	uint64_t wire_ns = 0;
 
-/**
- * rds_get_rt -	Get RadioText message
- * @enc: pointer to &struct rds_encoder
- * @dsn: Data Segment Number
- * @psn: Programme Service Number
- * @rt: the &struct rds_rt to fill
- */
-int
-rds_get_rt(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, struct rds_rt *rt)
-{
-	if(enc->get_rt == NULL)
-		return -EOPNOTSUPP;
+	enc->send_at_ns = 0;
 
-	return enc->get_rt(enc, dsn, psn, rt);
-}
+	wire_ns = (uint64_t) len * RDS_SERIAL_CHAR_BITS * 1000000000ULL /
+							RDS_SERIAL_BAUD;
+	if(wire_ns < ns)
+		ns -= wire_ns;
 
-/**
- * rds_set_rt -	Set RadioText message
- * @enc: pointer to &struct rds_encoder
- * @dsn: Data Segment Number
- * @psn: Programme Service Number
- * @rt: the &struct rds_rt to send
- */
-int
-rds_set_rt(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, struct rds_rt *rt)
-{
-	if(enc->set_rt == NULL)
-		return -EOPNOTSUPP;
+	at.tv_sec = ns / 1000000000;
+	at.tv_nsec = ns % 1000000000;
 
-	return enc->set_rt(enc, dsn, psn, rt);
-}
+	clock_gettime(CLOCK_REALTIME, &now);
+	if(now.tv_sec > at.tv_sec ||
+	(now.tv_sec == at.tv_sec && now.tv_nsec >= at.tv_nsec))
+		return 0;
 
-/**
- * rds_get_di - Get decoder info field
- * @enc: pointer to &struct rds_encoder
- * @dsn: Data Segment Number
- * @psn: Programme Service Number
- */
-int
-rds_get_di(struct rds_encoder *enc, uint8_t dsn, uint8_t psn)
-{
-	if(enc->get_di == NULL)
-		return -EOPNOTSUPP;
+	while(clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &at,
+							NULL) == EINTR);
 
-	return enc->get_di(enc, dsn, psn);
+	return ns + wire_ns;
 }
 
 /**
- * rds_set_di - Set decoder info field
+ * rds_send_buf - Send a fully serialized frame to an encoder
  * @enc: pointer to &struct rds_encoder
- * @dsn: Data Segment Number
- * @psn: Programme Service Number
- * @di: RDS_DI_* flags
+ * @buf: the buffer to send
+ * @len: the buffer's length
+ *
+ * Backends build the whole frame on a buffer and push it
+ * here, so that we do one write (and one tcdrain) per frame
+ * instead of one per byte.
  */
 int
-rds_set_di(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t di)
+rds_send_buf(struct rds_encoder *enc, const uint8_t *buf, int len)
 {
-	if(enc->set_di == NULL)
-		return -EOPNOTSUPP;
+	struct pollfd fds;
+	struct timespec now;
+	uint64_t held_ns = 0;
+	int sent = 0;
+	int ret = 0;
 
-	return enc->set_di(enc, dsn, psn, di);
-}
+	/* So that others can tell the link is busy (see rds_health.c) */
+	__atomic_add_fetch(&enc->tx_frames, 1, __ATOMIC_RELAXED);
+
+	if(enc->send_at_ns)
+		held_ns = rds_send_hold(enc, len);
+
+	if(enc->uring) {
+		ret = rds_uring_write(enc, buf, len, enc->timeout_ms);
+		if(ret != -EINVAL && ret != -EOPNOTSUPP) {
+			/* The write completes when the tty has the frame,
+			 * wait for it to hit the wire like the poll()
+			 * path does, so that frames are timed the same
+			 * way on both */
+			if(ret >= 0)
+				tcdrain(enc->serial_fd);
+			goto done;
+		}
+
+		rds_uring_detach(enc);
+	}
 
-/**
- * rds_get_dynpty - Get dynamic PTY indicator
- * @enc: pointer to &struct rds_encoder
- * @dsn: Data Segment Number
- * @psn: Programme Service Number
- */
-int
-rds_get_dynpty(struct rds_encoder *enc, uint8_t dsn, uint8_t psn)
-{
-	if(enc->get_dynpty == NULL)
-		return -EOPNOTSUPP;
+	memset(&fds, 0, sizeof(struct pollfd));
 
-	return enc->get_dynpty(enc, dsn, psn);
-}
+	fds.fd = enc->serial_fd;
+	fds.events = POLLOUT;
 
-/**
- * rds_set_dynpty - Set dynamic PTY indicator
- * @enc: pointer to &struct rds_encoder
- * @dsn: Data Segment Number
- * @psn: Programme Service Number
- * @dynpty: 1 -> Enabled, 0 -> Disabled
- */
-int
-rds_set_dynpty(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t dynpty)
-{
-	if(enc->set_dynpty == NULL)
-		return -EOPNOTSUPP;
+	while(sent < len) {
+		ret = poll(&fds,1,enc->timeout_ms);
+		if(ret <= 0)
+			return -ETIME;
 
-	return enc->set_dynpty(enc, dsn, psn, dynpty);
-}
+		ret = write(enc->serial_fd, buf + sent, len - sent);
+		if(ret < 0 && errno != EAGAIN)
+			return -errno;
+		else if(ret > 0)
+			sent += ret;
+	}
 
-/**
- * rds_set_ta_tp - Get TA/TP status
- * @enc: pointer to &struct rds_encoder
- * @dsn: Data Segment Number
- * @psn: Programme Service Number
- */
-int
-rds_get_ta_tp(struct rds_encoder *enc, uint8_t dsn, uint8_t psn)
-{
-	if(enc->get_ta_tp == NULL)
-		return -EOPNOTSUPP;
+	tcdrain(enc->serial_fd);
+	ret = sent;
+
+ done:
+	/* How late it went out, for the link latency model
+	 * (see rds_schedule.c) */
+	if(held_ns) {
+		clock_gettime(CLOCK_REALTIME, &now);
+		enc->send_late_us = ((int64_t) now.tv_sec * 1000000000 +
+					now.tv_nsec - (int64_t) held_ns) / 1000;
+	}
 
-	return enc->get_ta_tp(enc, dsn, psn);
+	return ret;
 }
 
-/**
- * rds_set_ta_tp - Set TA/TP status
- * @enc: pointer to &struct rds_encoder
- * @dsn: Data Segment Number
- * @psn: Programme Service Number
- * @ta_tp: RDS_TATP_* status flags
- */
 int
-rds_set_ta_tp(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t ta_tp)
+rds_send_byte(struct rds_encoder *enc, char byte)
 {
-	if(enc->set_ta_tp == NULL)
-		return -EOPNOTSUPP;
+	uint8_t out_byte = byte;
 
-	return enc->set_ta_tp(enc, dsn, psn, ta_tp);
+	//printf("Out: 0x%02X (%c)\n", out_byte, out_byte);
+	return rds_send_buf(enc, &out_byte, 1);
 }
 
 /**
- * rds_get_ms - Get M/S switch status
+ * rds_set_io_uring - Switch an encoder to/from the io_uring transport
  * @enc: pointer to &struct rds_encoder
- * @dsn: Data Segment Number
- * @psn: Programme Service Number
+ * @on: 1 -> Use io_uring, 0 -> Use poll()
+ *
+ * Returns -EOPNOTSUPP if io_uring is not available, in which
+ * case the encoder stays on the poll() path.
  */
 int
-rds_get_ms(struct rds_encoder *enc, uint8_t dsn, uint8_t psn)
+rds_set_io_uring(struct rds_encoder *enc, uint8_t on)
 {
-	if(enc->get_ms == NULL)
-		return -EOPNOTSUPP;
-
-	return enc->get_ms(enc, dsn, psn);
-}
+	if(!on) {
+		rds_uring_detach(enc);
+		return 0;
+	}
 
-/**
- * rds_set_ms - Set M/S switch status
- * @enc: pointer to &struct rds_encoder
- * @dsn: Data Segment Number
- * @psn: Programme Service Number
- * @ms: RDS_MS_* status flags
- */
-int
-rds_set_ms(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t ms)
-{
-	if(enc->set_ms == NULL)
-		return -EOPNOTSUPP;
+	if(enc->uring)
+		return 0;
 
-	return enc->set_ms(enc, dsn, psn, ms);
+	return rds_uring_attach(enc);
 }
 
 /**
- * rds_get_pty - Get Programme Type
+ * rds_set_timeout - Set the timeout for a single read / write on the port
  * @enc: pointer to &struct rds_encoder
- * @dsn: Data Segment Number
- * @psn: Programme Service Number
+ * @timeout_ms: timeout in msecs, 0 for the default
+ *
+ * A dead encoder costs (at least) one such timeout per command, so
+ * setting this to about a frame's time lets callers notice quickly.
  */
 int
-rds_get_pty(struct rds_encoder *enc, uint8_t dsn, uint8_t psn)
+rds_set_timeout(struct rds_encoder *enc, uint16_t timeout_ms)
 {
-	if(enc->get_pty == NULL)
-		return -EOPNOTSUPP;
-
-	return enc->get_pty(enc, dsn, psn);
+	enc->timeout_ms = timeout_ms ? timeout_ms : RDS_IO_TIMEOUT_MS_DEFAULT;
+	return 0;
 }
 
-/**
- * rds_set_pty - Set Programme Type
- * @enc: pointer to &struct rds_encoder
- * @dsn: Data Segment Number
- * @psn: Programme Service Number
- * @pty: The pty (0 - 19) to set
- */
-int
-rds_set_pty(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t pty)
-{
-	if(enc->set_pty == NULL)
-		return -EOPNOTSUPP;
-
-	return enc->set_pty(enc, dsn, psn, pty);
-}
 
-/**
- * rds_get_ptyn - Get Programme Type Name
- * @enc: pointer to &struct rds_encoder
- * @dsn: Data Segment Number
- * @psn: Programme Service Number
- * @ptyn: pre-allocated PTY name string to fill
- */
-int
-rds_get_ptyn(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, char* ptyn)
-{
-	if(enc->get_ptyn == NULL)
-		return -EOPNOTSUPP;
+/**********\
+* COMMANDS *
+\**********/
 
-	return enc->get_ptyn(enc, dsn, psn, ptyn);
-}
+/* Call a device specific method if it's there */
+#define RDS_CMD_CALL(_method, ...) \
+	(((_method) == NULL) ? -EOPNOTSUPP : (_method)(__VA_ARGS__))
 
 /**
- * rds_set_ptyn - Set Programme Type Name
- * @enc: pointer to &struct rds_encoder
- * @dsn: Data Segment Number
- * @psn: Programme Service Number
- * @ptyn: PTY name string to set
+ * rds_addr_swap - Fix endianess of an address if needed
+ * @addr: the address
  */
-int
-rds_set_ptyn(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, char* ptyn)
+static inline uint16_t
+rds_addr_swap(uint16_t addr)
 {
-	if(enc->set_ptyn == NULL)
-		return -EOPNOTSUPP;
+	if(ntohs(1) == 1)
+		return (addr & 0x00FF) << 8 | (addr & 0xFF00) >> 8;
 
-	return enc->set_ptyn(enc, dsn, psn, ptyn);
+	return addr;
 }
 
 /**
- * rds_get_ct - Get transmission status of RTC
- * @enc: pointer to &struct rds_encoder
+ * rds_addr_make - Build the address frames go to (enc->addr)
+ * @type: encoder type
+ * @site_addr: site address (UECP)
+ * @enc_addr: encoder address
  */
-int
-rds_get_ct(struct rds_encoder *enc)
+uint16_t
+rds_addr_make(uint8_t type, uint16_t site_addr, uint16_t enc_addr)
 {
-	if(enc->get_ct == NULL)
-		return -EOPNOTSUPP;
-
-	return enc->get_ct(enc);
+	switch(type) {
+	case RDS_ENCODER_TYPE_PRAIS:
+		return rds_addr_swap(enc_addr);
+	case RDS_ENCODER_TYPE_UECP:
+		return ((rds_addr_swap(site_addr) & 0x3FF) << 6) |
+			(rds_addr_swap(enc_addr) & 0x3F);
+	default:
+		return 0;
+	}
 }
 
 /**
- * rds_set_ct - Enable/disable transmission of RTC
- * @enc: pointer to &struct rds_encoder
- * @ct: 0 -> disable, 1 -> enable
+ * rds_addr_covers - Check if frames to an address reach a unit
+ * @type: encoder type
+ * @group: the address frames go to, from rds_addr_make()
+ * @addr: the unit's address, from rds_addr_make()
  */
 int
-rds_set_ct(struct rds_encoder *enc, uint8_t ct)
+rds_addr_covers(uint8_t type, uint16_t group, uint16_t addr)
 {
-	if(enc->set_ct == NULL)
-		return -EOPNOTSUPP;
-
-	return enc->set_ct(enc, ct);
+	switch(type) {
+	case RDS_ENCODER_TYPE_PRAIS:
+		return group == PRAIS_DF_ADDR_BCAST || group == addr;
+	case RDS_ENCODER_TYPE_UECP:
+		return (!(group & UECP_DF_SITE_ADDR_MASK) ||
+			(group & UECP_DF_SITE_ADDR_MASK) ==
+			(addr & UECP_DF_SITE_ADDR_MASK)) &&
+			(!(group & UECP_DF_ENC_ADDR_MASK) ||
+			(group & UECP_DF_ENC_ADDR_MASK) ==
+			(addr & UECP_DF_ENC_ADDR_MASK));
+	default:
+		return group == addr;
+	}
 }
 
 /**
- * rds_get_rtc - Set Real Time Clock settings on the device
+ * rds_cmd_addr - Get / change where frames go, or the addresses
+ *		units answer to
  * @enc: pointer to &struct rds_encoder
- * @rtc: the &struct rds_rtc to fill
+ * @cmd: a RDS_CMD_GET_ADDR / RDS_CMD_SET_ADDR &struct rds_cmd
  */
-int
-rds_get_rtc(struct rds_encoder *enc, struct rds_rtc *rtc)
+static int
+rds_cmd_addr(struct rds_encoder *enc, struct rds_cmd *cmd)
 {
-	if(enc->get_rtc == NULL)
+	struct rds_addr *addr = &cmd->arg.addr;
+
+	if(enc->type != RDS_ENCODER_TYPE_PRAIS &&
+	enc->type != RDS_ENCODER_TYPE_UECP)
 		return -EOPNOTSUPP;
 
-	return enc->get_rtc(enc, rtc);
+	if(cmd->op == RDS_CMD_GET_ADDR) {
+		if(enc->type == RDS_ENCODER_TYPE_PRAIS) {
+			addr->site = 0;
+			addr->enc = rds_addr_swap(enc->addr);
+		} else {
+			addr->site = rds_addr_swap((enc->addr >> 6) & 0x3FF);
+			addr->enc = rds_addr_swap(enc->addr & 0x3F);
+		}
+		return 0;
+	}
+
+	switch(addr->op) {
+	case RDS_ADDR_OP_TARGET:
+		if(enc->type == RDS_ENCODER_TYPE_UECP &&
+		(addr->site > UECP_SITE_ADDRESS_MAX ||
+		addr->enc > UECP_ENC_ADDRESS_MAX))
+			return -EINVAL;
+		enc->addr = rds_addr_make(enc->type, addr->site, addr->enc);
+		return 0;
+	case RDS_ADDR_OP_ADD_SITE:
+	case RDS_ADDR_OP_DEL_SITE:
+		return RDS_CMD_CALL(enc->set_unit_addr, enc, addr->op,
+								addr->site);
+	case RDS_ADDR_OP_ADD_ENC:
+	case RDS_ADDR_OP_DEL_ENC:
+		return RDS_CMD_CALL(enc->set_unit_addr, enc, addr->op,
+								addr->enc);
+	default:
+		return -EINVAL;
+	}
 }
 
 /**
- * rds_set_rtc - Set Real Time Clock settings on the device
+ * rds_cmd_dispatch - Call the device specific method for a command
  * @enc: pointer to &struct rds_encoder
- * @rtc: the &struct rds_rtc to send
+ * @cmd: the &struct rds_cmd to run
+ *
+ * Same as rds_cmd_exec() but the shadow state is left alone,
+ * for commands that go to some other unit than the target.
  */
 int
-rds_set_rtc(struct rds_encoder *enc, struct rds_rtc *rtc)
+rds_cmd_dispatch(struct rds_encoder *enc, struct rds_cmd *cmd)
 {
-	if(enc->set_rtc == NULL)
+	switch(cmd->op) {
+	case RDS_CMD_GET_PI:
+		return RDS_CMD_CALL(enc->get_pi, enc, cmd->dsn,
+						cmd->psn, &cmd->arg.pi);
+	case RDS_CMD_SET_PI:
+		return RDS_CMD_CALL(enc->set_pi, enc, cmd->dsn,
+						cmd->psn, &cmd->arg.pi);
+	case RDS_CMD_GET_PS:
+		return RDS_CMD_CALL(enc->get_ps, enc, cmd->dsn,
+						cmd->psn, cmd->arg.ps);
+	case RDS_CMD_SET_PS:
+		return RDS_CMD_CALL(enc->set_ps, enc, cmd->dsn,
+						cmd->psn, cmd->arg.ps);
+	case RDS_CMD_GET_RT:
+		return RDS_CMD_CALL(enc->get_rt, enc, cmd->dsn,
+						cmd->psn, &cmd->arg.rt);
+	case RDS_CMD_SET_RT:
+		return RDS_CMD_CALL(enc->set_rt, enc, cmd->dsn,
+						cmd->psn, &cmd->arg.rt);
+	case RDS_CMD_GET_DI:
+		return RDS_CMD_CALL(enc->get_di, enc, cmd->dsn, cmd->psn);
+	case RDS_CMD_SET_DI:
+		return RDS_CMD_CALL(enc->set_di, enc, cmd->dsn,
+						cmd->psn, cmd->arg.val);
+	case RDS_CMD_GET_DYNPTY:
+		return RDS_CMD_CALL(enc->get_dynpty, enc, cmd->dsn, cmd->psn);
+	case RDS_CMD_SET_DYNPTY:
+		return RDS_CMD_CALL(enc->set_dynpty, enc, cmd->dsn,
+						cmd->psn, cmd->arg.val);
+	case RDS_CMD_GET_TA_TP:
+		return RDS_CMD_CALL(enc->get_ta_tp, enc, cmd->dsn, cmd->psn);
+	case RDS_CMD_SET_TA_TP:
+		return RDS_CMD_CALL(enc->set_ta_tp, enc, cmd->dsn,
+						cmd->psn, cmd->arg.val);
+	case RDS_CMD_GET_MS:
+		return RDS_CMD_CALL(enc->get_ms, enc, cmd->dsn, cmd->psn);
+	case RDS_CMD_SET_MS:
+		return RDS_CMD_CALL(enc->set_ms, enc, cmd->dsn,
+						cmd->psn, cmd->arg.val);
+	case RDS_CMD_GET_PTY:
+		return RDS_CMD_CALL(enc->get_pty, enc, cmd->dsn, cmd->psn);
+	case RDS_CMD_SET_PTY:
+		return RDS_CMD_CALL(enc->set_pty, enc, cmd->dsn,
+						cmd->psn, cmd->arg.val);
+	case RDS_CMD_GET_PTYN:
+		return RDS_CMD_CALL(enc->get_ptyn, enc, cmd->dsn,
+						cmd->psn, cmd->arg.ptyn);
+	case RDS_CMD_SET_PTYN:
+		return RDS_CMD_CALL(enc->set_ptyn, enc, cmd->dsn,
+						cmd->psn, cmd->arg.ptyn);
+	case RDS_CMD_GET_CT:
+		return RDS_CMD_CALL(enc->get_ct, enc);
+	case RDS_CMD_SET_CT:
+		return RDS_CMD_CALL(enc->set_ct, enc, cmd->arg.val);
+	case RDS_CMD_GET_RTC:
+		return RDS_CMD_CALL(enc->get_rtc, enc, &cmd->arg.rtc);
+	case RDS_CMD_SET_RTC:
+		return RDS_CMD_CALL(enc->set_rtc, enc, &cmd->arg.rtc);
+	case RDS_CMD_GET_RDS_ON:
+		return RDS_CMD_CALL(enc->get_rds_on, enc);
+	case RDS_CMD_SET_RDS_ON:
+		return RDS_CMD_CALL(enc->set_rds_on, enc, cmd->arg.val);
+	case RDS_CMD_GET_RTPLUS:
+		return RDS_CMD_CALL(enc->get_rtplus, enc, cmd->dsn,
+						cmd->psn, &cmd->arg.rtplus);
+	case RDS_CMD_SET_RTPLUS:
+		/* Tags that point outside the text */
+		if(rds_rtplus_check(&cmd->arg.rtplus) < 0)
+			return -EINVAL;
+		return RDS_CMD_CALL(enc->set_rtplus, enc, cmd->dsn,
+						cmd->psn, &cmd->arg.rtplus);
+	case RDS_CMD_GET_AF:
+	case RDS_CMD_SET_AF:
+		return rds_af_exec(enc, cmd);
+	case RDS_CMD_GET_EON:
+	case RDS_CMD_SET_EON:
+		return rds_eon_exec(enc, cmd);
+	case RDS_CMD_GET_DSN:
+	case RDS_CMD_SET_DSN:
+		return rds_dsn_exec(enc, cmd);
+	case RDS_CMD_GET_PSN_ON:
 		return -EOPNOTSUPP;
-
-	return enc->set_rtc(enc, rtc);
+	case RDS_CMD_SET_PSN_ON:
+		return RDS_CMD_CALL(enc->set_psn_on, enc, cmd->dsn,
+						cmd->psn, cmd->arg.val);
+	case RDS_CMD_GET_ADDR:
+	case RDS_CMD_SET_ADDR:
+		return rds_cmd_addr(enc, cmd);
+	default:
+		return -EINVAL;
+	}
 }
 
 /**
- * rds_get_rds_on - Get the encoder's RDS output status
+ * rds_cmd_exec - Run a command on the encoder's backend
  * @enc: pointer to &struct rds_encoder
+ * @cmd: the &struct rds_cmd to run, results are stored back here
+ *
+ * This calls the device specific method directly, from the
+ * caller's context. It's used by whoever owns the port (e.g.
+ * the I/O thread), everyone else should use rds_cmd_run().
+ * Successful sets on the main service are recorded on the
+ * encoder's shadow state (and published, see rds_shm.c).
  */
 int
-rds_get_rds_on(struct rds_encoder *enc)
+rds_cmd_exec(struct rds_encoder *enc, struct rds_cmd *cmd)
 {
-	if(enc->get_rds_on == NULL)
-		return -EOPNOTSUPP;
+	int ret = 0;
+
+	ret = rds_cmd_dispatch(enc, cmd);
+	if(ret >= 0 && RDS_CMD_IS_SET(cmd->op) &&
+	cmd->dsn == 0 && cmd->psn == 0) {
+		/* rds_dsn_select() already recorded what
+		 * it knows about the new data set */
+		if(cmd->op != RDS_CMD_SET_DSN)
+			rds_state_update(&enc->state, cmd);
+		rds_shm_publish(enc);
+	}
 
-	return enc->get_rds_on(enc);
+	return ret;
 }
 
 /**
- * rds_set_rds_on - Set encoder's RDS output status
+ * rds_cmd_run - Run a command on an encoder
  * @enc: pointer to &struct rds_encoder
- * @on: 1 -> Enable, 0 -> Disable
+ * @cmd: the &struct rds_cmd to run, results are stored back here
+ *
+ * If the encoder is owned by an I/O thread the command is
+ * queued there and we wait for it, else it's run directly.
  */
 int
-rds_set_rds_on(struct rds_encoder *enc, uint8_t on)
+rds_cmd_run(struct rds_encoder *enc, struct rds_cmd *cmd)
 {
-	if(enc->set_rds_on == NULL)
-		return -EOPNOTSUPP;
+	if((enc->io_thread || enc->bus) && !rds_thread_is_self(enc))
+		return rds_thread_call(enc, cmd);
 
-	return enc->set_rds_on(enc, on);
+	return rds_cmd_exec(enc, cmd);
 }
 
 
@@ -532,41 +645,41 @@ rds_init(uint8_t type, uint16_t site_addr, uint16_t enc_addr,
 					const unsigned char* port)
 {
 	struct rds_encoder *enc = NULL;
-	uint16_t site_addr_le = 0;
-	uint16_t enc_addr_le = 0;
 	int fd = 0;
 
-	/* Fix endianess if needed */
-	if(ntohs(1) == 1) {
-		site_addr_le = (site_addr & 0x00FF) << 8 |
-				(site_addr & 0xFF00) >> 8;
-
-		enc_addr_le = (enc_addr & 0x00FF) << 8 |
-				(enc_addr & 0xFF00) >> 8;
-	} else {
-		site_addr_le = site_addr;
-		enc_addr_le = enc_addr;
-	}
-
 	enc = malloc(sizeof(struct rds_encoder));
 	if(!enc)
 		return NULL;
 	memset(enc, 0, sizeof(struct rds_encoder));
+	enc->type = type;
+	enc->timeout_ms = RDS_IO_TIMEOUT_MS_DEFAULT;
 
 	switch(type){
 		case RDS_ENCODER_TYPE_PRAIS:
-			enc->addr = enc_addr_le;
+			enc->addr = rds_addr_make(type, site_addr, enc_addr);
 			prais_init(enc);
 			break;
 		case RDS_ENCODER_TYPE_UECP:
-			enc->addr |= (site_addr_le & 0x3FF) << 6;
-			enc->addr |= enc_addr_le & 0x3F;
+			enc->addr = rds_addr_make(type, site_addr, enc_addr);
 			uecp_init(enc);
 			break;
+		case RDS_ENCODER_TYPE_SOFT:
+			enc->serial_fd = -1;
+			if(soft_init(enc) < 0) {
+				free(enc);
+				return NULL;
+			}
+			return enc;
 		default:
 			return NULL;
 	}
 
+	/* The caller provides the port (see rds_bus.c) */
+	if(!port) {
+		enc->serial_fd = -1;
+		return enc;
+	}
+
 	fd = rds_open_serial(port);
 	if(fd < 0)
 		return NULL;
@@ -578,7 +691,17 @@ rds_init(uint8_t type, uint16_t site_addr, uint16_t enc_addr,
 int
 rds_exit(struct rds_encoder *enc)
 {
+	rds_schedule_free(enc);
+	rds_thread_stop(enc);
+	rds_bus_detach(enc);
+	rds_set_frame_cache(enc, 0);
+	rds_shm_detach(enc);
+	rds_af_free(enc);
+	rds_eon_free(enc);
+	rds_dsn_free(enc);
 	rds_close_serial(enc);
+	if(enc->exit)
+		enc->exit(enc);
 	free(enc);
 	return 0;
 }
@@ -78,6 +78,98 @@ struct rds_rt {
 #define RDS_RT_METHOD_A			0x1
 #define RDS_RT_METHOD_B			0x2
 
+/* RadioText Plus tag, marks a part of the RT message */
+#define RDS_RTPLUS_TAGS_MAX		2
+
+struct rds_rtplus_tag {
+	uint8_t type;			/* Content type (see below) */
+	uint8_t start;			/* Position of its first char on the message */
+	uint8_t len;			/* Number of chars, 0 for an unused tag */
+};
+
+/* RadioText with RT+ tags, they are set together (see rds_rtplus.h) */
+struct rds_rtplus {
+	struct rds_rt rt;		/* G0 text the tags point into */
+	uint8_t running;		/* Item running bit */
+	uint8_t toggle;			/* Item toggle bit, maintained by the
+					 * backend (returned here) */
+	struct rds_rtplus_tag tags[RDS_RTPLUS_TAGS_MAX];
+};
+
+/* A part of the text given to rds_rtplus_build() */
+struct rds_rtplus_field {
+	uint8_t type;			/* Content type, RDS_RTPLUS_NONE for text
+					 * that shouldn't be tagged */
+	const char *text;		/* UTF-8 */
+};
+
+/* RadioText Plus */
+#define RDS_RTPLUS_TAG1_LEN_MAX		64	/* 6bit length marker */
+#define RDS_RTPLUS_TAG2_LEN_MAX		32	/* 5bit length marker */
+
+/* RT+ content types (some of them) */
+#define RDS_RTPLUS_NONE			0	/* DUMMY_CLASS */
+#define RDS_RTPLUS_ITEM_TITLE		1
+#define RDS_RTPLUS_ITEM_ALBUM		2
+#define RDS_RTPLUS_ITEM_TRACKNUMBER	3
+#define RDS_RTPLUS_ITEM_ARTIST		4
+#define RDS_RTPLUS_ITEM_COMPOSITION	5
+#define RDS_RTPLUS_ITEM_MOVEMENT	6
+#define RDS_RTPLUS_ITEM_CONDUCTOR	7
+#define RDS_RTPLUS_ITEM_COMPOSER	8
+#define RDS_RTPLUS_ITEM_BAND		9
+#define RDS_RTPLUS_ITEM_COMMENT		10
+#define RDS_RTPLUS_ITEM_GENRE		11
+#define RDS_RTPLUS_INFO_NEWS		12
+#define RDS_RTPLUS_INFO_WEATHER		25
+#define RDS_RTPLUS_INFO_TRAFFIC		26
+#define RDS_RTPLUS_INFO_ADVERTISEMENT	28
+#define RDS_RTPLUS_INFO_URL		29
+#define RDS_RTPLUS_STATIONNAME_LONG	32
+#define RDS_RTPLUS_PROGRAMME_NOW	33
+#define RDS_RTPLUS_PROGRAMME_NEXT	34
+#define RDS_RTPLUS_PROGRAMME_HOST	36
+#define RDS_RTPLUS_PROGRAMME_HOMEPAGE	39
+#define RDS_RTPLUS_PHONE_HOTLINE	41
+#define RDS_RTPLUS_EMAIL_HOTLINE	46
+#define RDS_RTPLUS_TYPE_MAX		63
+
+/* An Alternative Frequencies list. Method A has a single one,
+ * method B has one per transmitter of the programme, each with
+ * the transmitter's own frequency on tuned_khz */
+#define RDS_AF_LIST_MAX			25	/* Frequencies per list */
+
+struct rds_af_list {
+	uint32_t tuned_khz;		/* Method B only */
+	uint32_t regional;		/* Method B only, one bit per khz[]
+					 * entry that carries a regional variant */
+	uint8_t num;
+	uint32_t khz[RDS_AF_LIST_MAX];	/* FM (87.6 - 107.9MHz), or LF / MF
+					 * (153 - 279KHz / 531 - 1602KHz, 9KHz
+					 * steps, method A only) */
+};
+
+/* An AF change (see rds_af.h) */
+struct rds_af {
+	uint8_t method;			/* RDS_AF_METHOD_* */
+	uint8_t idx;			/* Which list, 0 on method A */
+	uint8_t op;			/* RDS_AF_OP_* */
+	struct rds_af_list list;	/* SET: the list, ADD / DEL: the
+					 * frequency on khz[0] */
+};
+
+/* Alternative Frequencies */
+#define RDS_AF_METHOD_A			0x1
+#define RDS_AF_METHOD_B			0x2
+#define RDS_AF_METHOD_B_LIST_MAX	12	/* AFs per method B list */
+#define RDS_AF_LISTS_MAX		12	/* Method B lists per service */
+#define RDS_AF_ALL			0xFF	/* All lists (RDS_AF_OP_CLEAR) */
+
+#define RDS_AF_OP_SET			0x0	/* Replace a list */
+#define RDS_AF_OP_ADD			0x1	/* Add a frequency to a list */
+#define RDS_AF_OP_DEL			0x2	/* Remove a frequency from a list */
+#define RDS_AF_OP_CLEAR			0x3	/* Remove a list, or all of them */
+
 /* A struct to hold RTC data */
 struct rds_rtc {
 	uint16_t year;
@@ -90,11 +182,216 @@ struct rds_rtc {
 	int8_t offset;
 };
 
+/* Programme Service name / Programme Type Name */
+#define RDS_PS_LEN			8
+#define RDS_PTYN_LEN			8
+
+/* Unit serial number, as reported on discovery (see rds_discover.h) */
+#define RDS_SERIAL_LEN			16
+
+/* A service of another network, linked through EON. Each one
+ * has its own PSN (see rds_eon.h) */
+struct rds_eon {
+	uint8_t set;			/* RDS_EON_* fields to set, on gets
+					 * the ones we know */
+	uint8_t push;			/* Push all pending changes now */
+	struct rds_pi pi;
+	char ps[RDS_PS_LEN + 1];
+	uint8_t pty;
+	uint8_t ta_tp;			/* RDS_TATP_* */
+	struct rds_af_list af;		/* Method A list, or with tuned_khz
+					 * set, the frequencies mapped to
+					 * our tuned_khz */
+};
+
+/* Enhanced Other Networks fields */
+#define RDS_EON_PI			0x01
+#define RDS_EON_PS			0x02
+#define RDS_EON_PTY			0x04
+#define RDS_EON_TA_TP			0x08	/* Pushed right away */
+#define RDS_EON_AF			0x10
+#define RDS_EON_ALL			0x1F
+#define RDS_EON_REMOVE			0x80	/* Unlink the service */
+
+/* A station profile, preloaded on a data set (see rds_dsn.h) */
+struct rds_profile {
+	uint8_t set;			/* RDS_PROFILE_* fields it has */
+	struct rds_pi pi;
+	char ps[RDS_PS_LEN + 1];
+	struct rds_rt rt;
+	uint8_t pty;
+	uint8_t ta_tp;
+	uint8_t ms;
+	uint8_t di;
+	struct rds_af_list af;		/* Method A */
+};
+
+#define RDS_PROFILE_PI			0x01
+#define RDS_PROFILE_PS			0x02
+#define RDS_PROFILE_RT			0x04
+#define RDS_PROFILE_PTY			0x08
+#define RDS_PROFILE_TA_TP		0x10
+#define RDS_PROFILE_MS			0x20
+#define RDS_PROFILE_DI			0x40
+#define RDS_PROFILE_AF			0x80
+
+/* Addresses of the units on a link. Frames go to one target,
+ * UECP units also answer to any site / encoder addresses they
+ * were given, so a group of them can share one */
+struct rds_addr {
+	uint8_t op;			/* RDS_ADDR_OP_* */
+	uint16_t site;			/* UECP only */
+	uint16_t enc;
+};
+
+#define RDS_ADDR_OP_TARGET		0x0	/* Send to site / enc from now on */
+#define RDS_ADDR_OP_ADD_SITE		0x1	/* Give the target a site address */
+#define RDS_ADDR_OP_DEL_SITE		0x2	/* Take it back */
+#define RDS_ADDR_OP_ADD_ENC		0x3	/* Give the target an encoder address */
+#define RDS_ADDR_OP_DEL_ENC		0x4	/* Take it back */
+
+
+/**********\
+* REQUESTS *
+\**********/
+
+/* A command, used when commands need to be queued or
+ * passed around instead of being called directly (e.g. by
+ * the I/O thread). Each rds_get_* / rds_set_* call maps to
+ * one of these, results of get commands are returned on
+ * the arg field. Text (PS, RT, PTYN) is G0 encoded here,
+ * use rds_charset_encode() when filling it directly */
+struct rds_cmd {
+	uint8_t op;			/* RDS_CMD_* */
+	uint8_t dsn;			/* Data Segment Number */
+	uint8_t psn;			/* Programme Service Number */
+	union {
+		struct rds_pi pi;
+		char ps[RDS_PS_LEN + 1];
+		struct rds_rt rt;
+		struct rds_rtplus rtplus;
+		struct rds_af af;
+		struct rds_eon eon;
+		struct rds_addr addr;
+		char ptyn[RDS_PTYN_LEN + 1];
+		struct rds_rtc rtc;
+		uint8_t val;		/* DI, dynamic PTY, TA/TP, M/S, PTY,
+					 * CT and RDS on/off */
+	} arg;
+};
+
+/* Command codes, gets are even, sets are odd */
+#define RDS_CMD_GET_PI			0x00
+#define RDS_CMD_SET_PI			0x01
+#define RDS_CMD_GET_PS			0x02
+#define RDS_CMD_SET_PS			0x03
+#define RDS_CMD_GET_RT			0x04
+#define RDS_CMD_SET_RT			0x05
+#define RDS_CMD_GET_DI			0x06
+#define RDS_CMD_SET_DI			0x07
+#define RDS_CMD_GET_DYNPTY		0x08
+#define RDS_CMD_SET_DYNPTY		0x09
+#define RDS_CMD_GET_TA_TP		0x0A
+#define RDS_CMD_SET_TA_TP		0x0B
+#define RDS_CMD_GET_MS			0x0C
+#define RDS_CMD_SET_MS			0x0D
+#define RDS_CMD_GET_PTY			0x0E
+#define RDS_CMD_SET_PTY			0x0F
+#define RDS_CMD_GET_PTYN		0x10
+#define RDS_CMD_SET_PTYN		0x11
+#define RDS_CMD_GET_CT			0x12
+#define RDS_CMD_SET_CT			0x13
+#define RDS_CMD_GET_RTC			0x14
+#define RDS_CMD_SET_RTC			0x15
+#define RDS_CMD_GET_RDS_ON		0x16
+#define RDS_CMD_SET_RDS_ON		0x17
+#define RDS_CMD_GET_RTPLUS		0x18
+#define RDS_CMD_SET_RTPLUS		0x19	/* RT and its RT+ tags */
+#define RDS_CMD_GET_AF			0x1A
+#define RDS_CMD_SET_AF			0x1B	/* Any RDS_AF_OP_* */
+#define RDS_CMD_GET_EON			0x1C
+#define RDS_CMD_SET_EON			0x1D	/* PSN 0: push only */
+#define RDS_CMD_GET_DSN			0x1E
+#define RDS_CMD_SET_DSN			0x1F	/* Select the data set on val */
+#define RDS_CMD_GET_PSN_ON		0x20
+#define RDS_CMD_SET_PSN_ON		0x21	/* Enable / disable a service */
+#define RDS_CMD_GET_ADDR		0x22	/* The target */
+#define RDS_CMD_SET_ADDR		0x23	/* Any RDS_ADDR_OP_* */
+#define RDS_CMD_MAX			RDS_CMD_SET_ADDR
+
+#define RDS_CMD_IS_SET(_op)		((_op) & 0x1)
+
+
+/**************\
+* SHADOW STATE *
+\**************/
+
+/* The last values successfully set on the main service
+ * (dsn 0, psn 0) of an encoder, so that we can answer
+ * reads without touching the link, or push everything
+ * again to an encoder that lost its config */
+struct rds_state {
+	uint32_t valid;			/* RDS_STATE_* of fields that are set */
+	struct rds_pi pi;
+	char ps[RDS_PS_LEN + 1];
+	struct rds_rt rt;
+	uint8_t di;
+	uint8_t dynpty;
+	uint8_t ta_tp;
+	uint8_t ms;
+	uint8_t pty;
+	char ptyn[RDS_PTYN_LEN + 1];
+	uint8_t ct;
+	uint8_t rds_on;
+	uint8_t rtplus_running;		/* RT+ of the RT above */
+	uint8_t rtplus_toggle;
+	struct rds_rtplus_tag rtplus_tags[RDS_RTPLUS_TAGS_MAX];
+};
+
+/* One bit per get/set command pair */
+#define RDS_STATE_BIT(_op)		(1 << ((_op) >> 1))
+#define RDS_STATE_PI			RDS_STATE_BIT(RDS_CMD_SET_PI)
+#define RDS_STATE_PS			RDS_STATE_BIT(RDS_CMD_SET_PS)
+#define RDS_STATE_RT			RDS_STATE_BIT(RDS_CMD_SET_RT)
+#define RDS_STATE_DI			RDS_STATE_BIT(RDS_CMD_SET_DI)
+#define RDS_STATE_DYNPTY		RDS_STATE_BIT(RDS_CMD_SET_DYNPTY)
+#define RDS_STATE_TA_TP			RDS_STATE_BIT(RDS_CMD_SET_TA_TP)
+#define RDS_STATE_MS			RDS_STATE_BIT(RDS_CMD_SET_MS)
+#define RDS_STATE_PTY			RDS_STATE_BIT(RDS_CMD_SET_PTY)
+#define RDS_STATE_PTYN			RDS_STATE_BIT(RDS_CMD_SET_PTYN)
+#define RDS_STATE_CT			RDS_STATE_BIT(RDS_CMD_SET_CT)
+#define RDS_STATE_RDS_ON		RDS_STATE_BIT(RDS_CMD_SET_RDS_ON)
+#define RDS_STATE_RTPLUS		RDS_STATE_BIT(RDS_CMD_SET_RTPLUS)
+#define RDS_STATE_ALL			(RDS_STATE_PI | RDS_STATE_PS |\
+					RDS_STATE_RT | RDS_STATE_DI |\
+					RDS_STATE_DYNPTY | RDS_STATE_TA_TP |\
+					RDS_STATE_MS | RDS_STATE_PTY |\
+					RDS_STATE_PTYN | RDS_STATE_CT |\
+					RDS_STATE_RDS_ON | RDS_STATE_RTPLUS)
+
 
 /*************\
 * MAIN HANDLE *
 \*************/
 
+/* Size of the per-encoder receive buffer, big enough
+ * to hold a full reply frame from any backend */
+#define RDS_RX_BUF_LEN			64
+
+/* Default timeout for a single read / write on the port */
+#define RDS_IO_TIMEOUT_MS_DEFAULT	1000
+
+/* Serial link settings (see rds_open_serial()), 8N1 so
+ * each byte takes 10 bits on the wire */
+#define RDS_SERIAL_BAUD			9600
+#define RDS_SERIAL_CHAR_BITS		10
+
+/* An AF change as passed to the backends (see rds_af.h) */
+struct rds_af_wire;
+
+/* An EON service as passed to the backends (see rds_eon.h) */
+struct rds_eon_service;
+
 /* An encoder */
 struct rds_encoder {
 	uint8_t type;			/* Encoder type */
@@ -103,6 +400,44 @@ struct rds_encoder {
 	int serial_fd;			/* File descriptor of the opened serial port */
 	uint8_t seq;			/* Sequence number of last packet */
 	uint8_t	rt_num;			/* Number of radiotext buffers */
+	uint16_t timeout_ms;		/* Timeout for a single read / write */
+	uint32_t tx_frames;		/* Frames sent so far */
+	uint64_t send_at_ns;		/* Hold the next frame so that its last
+					 * byte goes out then (CLOCK_REALTIME,
+					 * see rds_clock.c), 0 to send now */
+	int32_t send_late_us;		/* How late the last held frame's last
+					 * byte went out (see rds_schedule.c) */
+	struct rds_state state;		/* Shadow of what's applied on the
+					 * main service (see rds_state.c) */
+
+	/* Receive buffer, rds_get_byte() serves bytes from here
+	 * and only hits the port when it runs empty */
+	uint8_t rx_buf[RDS_RX_BUF_LEN];
+	uint16_t rx_pos;
+	uint16_t rx_len;
+
+	void *uring;			/* io_uring transport state (see rds_uring.c),
+					 * NULL when using the poll() path */
+	void *io_thread;		/* I/O thread that owns this encoder (see
+					 * rds_thread.c), NULL when not threaded */
+	void *fcache;			/* Serialized frame cache (see rds_fcache.c),
+					 * NULL when disabled */
+	void *shm;			/* Slot its state is published on (see
+					 * rds_shm.c), NULL when not published */
+	void *af;			/* AF lists as sent (see rds_af.c), NULL
+					 * until AFs are set */
+	void *eon;			/* EON services (see rds_eon.c), NULL
+					 * until one is linked */
+	void *dsets;			/* Preloaded data sets (see rds_dsn.c),
+					 * NULL until one is preloaded */
+	void *bus;			/* Bus it shares its port on (see
+					 * rds_bus.c), NULL when it has its own */
+	void *sched;			/* Scheduled commands (see rds_schedule.c),
+					 * NULL until one is scheduled */
+	void *priv;			/* Backend's private state, if any */
+
+	/* Called from rds_exit() to release priv (optional) */
+	void (*exit)(struct rds_encoder *enc);
 
 	/* Device specific methods, used internaly */
 	int (*get_pi)(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
@@ -142,11 +477,72 @@ struct rds_encoder {
 	int (*set_rtc)(struct rds_encoder *enc, struct rds_rtc *rtc);
 	int (*get_rds_on)(struct rds_encoder *enc);
 	int (*set_rds_on)(struct rds_encoder *enc, uint8_t on);
+	/* 1 if locked to the pilot / external clock, 0 if not */
+	int (*get_lock)(struct rds_encoder *enc);
+	int (*get_rtplus)(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+						struct rds_rtplus *rtplus);
+	int (*set_rtplus)(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+						struct rds_rtplus *rtplus);
+	int (*set_af)(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+					const struct rds_af_wire *af);
+	int (*set_dsn)(struct rds_encoder *enc, uint8_t dsn);
+	int (*set_psn_on)(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+							uint8_t on);
+	/* Add / remove a unit address (RDS_ADDR_OP_*) on the target */
+	int (*set_unit_addr)(struct rds_encoder *enc, uint8_t op,
+							uint16_t addr);
+	/* Returns how many of svcs it sent */
+	int (*set_eon)(struct rds_encoder *enc, uint8_t dsn,
+			struct rds_eon_service *const *svcs, int num);
+
+	/* Pipelined reads (see rds_fanout.c): send the request of a
+	 * get command to enc->addr without waiting for the reply, then
+	 * collect replies as they come, from whichever unit (its
+	 * address goes on addr). read_recv() fills cmd (its op says
+	 * what was asked) and returns what the get would */
+	int (*read_send)(struct rds_encoder *enc, const struct rds_cmd *cmd);
+	int (*read_recv)(struct rds_encoder *enc, uint16_t *addr,
+							struct rds_cmd *cmd);
+
+	/* Discovery (see rds_discover.c): ask the unit at enc->addr for
+	 * its serial number without waiting, then collect replies like
+	 * read_recv() (serial gets RDS_SERIAL_LEN + 1 bytes, returns its
+	 * length). set_serial_addr() moves the unit with that serial to
+	 * addr (as on the wire), whatever its address was */
+	int (*serial_send)(struct rds_encoder *enc);
+	int (*serial_recv)(struct rds_encoder *enc, uint16_t *addr,
+							char *serial);
+	int (*set_serial_addr)(struct rds_encoder *enc, const char *serial,
+							uint16_t addr);
+
+	/* For sharing a port (see rds_bus.c): find where the first
+	 * frame the units sent on buf ends, and whose it is (addr,
+	 * -1 if it doesn't say). Returns its length, 0 if it's not
+	 * all there yet, or minus the length of garbage before it */
+	int (*rx_split)(const uint8_t *buf, int len, int *addr);
+};
+
+/* An Open Data Application on a software encoder, announced
+ * on 3A groups and carrying its data on groups of type code */
+struct rds_soft_oda {
+	uint16_t aid;			/* Application IDentifier */
+	uint8_t code;			/* Group type code of the data groups,
+					 * RDS_GROUP_CODE() (see rds_block.h) */
+	uint16_t msg;			/* Message bits of the 3A group */
+	uint8_t weight;			/* Air time share of the data groups */
+
+	/* Fill the 5 low bits of info[1] and info[2], info[3] of the
+	 * next data group, return 0 or -ENODATA if there's nothing to
+	 * send. Called with the encoder locked, don't call rds_*
+	 * functions on the same encoder from here */
+	int (*fill)(struct rds_encoder *enc, uint16_t *info, void *arg);
+	void *arg;
 };
 
 /* Type */
 #define RDS_ENCODER_TYPE_UECP	0x01
 #define RDS_ENCODER_TYPE_PRAIS	0x02
+#define RDS_ENCODER_TYPE_SOFT	0x03	/* Software encoder, no port (see soft.h) */
 
 /* Flags */
 #define RDS_ENCODER_FLAGS_PRAIS_HW_DYNPS	0x01	/* Support dynamic PS on hardware for
@@ -157,15 +553,67 @@ struct rds_encoder {
 \************/
 
 /* Input / Output -used internaly- */
+int
+rds_open_serial(const unsigned char* port);
+
 int
 rds_get_byte(struct rds_encoder *enc);
 
 int
 rds_send_byte(struct rds_encoder *enc, char byte);
 
+int
+rds_send_buf(struct rds_encoder *enc, const uint8_t *buf, int len);
+
+void
+rds_flush_input(struct rds_encoder *enc);
+
+/* Transport */
+int
+rds_set_io_uring(struct rds_encoder *enc, uint8_t on);
+
+int
+rds_set_timeout(struct rds_encoder *enc, uint16_t timeout_ms);
+
+int
+rds_set_frame_cache(struct rds_encoder *enc, uint8_t entries);
+
+
+/* Shadow state */
+void
+rds_state_update(struct rds_state *state, const struct rds_cmd *cmd);
+
+int
+rds_state_get(const struct rds_state *state, struct rds_cmd *cmd);
+
+uint32_t
+rds_state_diff(const struct rds_state *a, const struct rds_state *b);
+
+int
+rds_state_apply(struct rds_encoder *enc, const struct rds_state *state,
+							uint32_t mask);
+
 
 /* Commands */
 
+uint16_t
+rds_addr_make(uint8_t type, uint16_t site_addr, uint16_t enc_addr);
+
+int
+rds_addr_covers(uint8_t type, uint16_t group, uint16_t addr);
+
+void
+rds_cmd_init(struct rds_cmd *cmd, uint8_t op, uint8_t dsn, uint8_t psn);
+
+int
+rds_cmd_dispatch(struct rds_encoder *enc, struct rds_cmd *cmd);
+
+int
+rds_cmd_exec(struct rds_encoder *enc, struct rds_cmd *cmd);
+
+int
+rds_cmd_run(struct rds_encoder *enc, struct rds_cmd *cmd);
+
 int
 rds_get_pi(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, struct rds_pi *pi);
 
@@ -238,6 +686,113 @@ rds_get_rds_on(struct rds_encoder *enc);
 int
 rds_set_rds_on(struct rds_encoder *enc, uint8_t on);
 
+int
+rds_get_rtplus(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+					struct rds_rtplus *rtplus);
+
+int
+rds_set_rtplus(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+					struct rds_rtplus *rtplus);
+
+
+int
+rds_get_af(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t idx,
+					struct rds_af_list *list);
+
+int
+rds_set_af(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t method,
+				uint8_t idx, const struct rds_af_list *list);
+
+int
+rds_add_af(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t idx,
+					uint32_t khz, uint8_t regional);
+
+int
+rds_del_af(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t idx,
+					uint32_t khz);
+
+int
+rds_clear_af(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t idx);
+
+
+/* Enhanced Other Networks */
+int
+rds_get_eon(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+					struct rds_eon *eon);
+
+int
+rds_set_eon(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+					const struct rds_eon *eon);
+
+int
+rds_set_eon_ta_tp(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+					uint8_t ta_tp);
+
+int
+rds_del_eon(struct rds_encoder *enc, uint8_t dsn, uint8_t psn);
+
+int
+rds_push_eon(struct rds_encoder *enc, uint8_t dsn);
+
+
+/* Data sets */
+int
+rds_get_dsn(struct rds_encoder *enc);
+
+int
+rds_select_dsn(struct rds_encoder *enc, uint8_t dsn);
+
+int
+rds_preload_profile(struct rds_encoder *enc, uint8_t dsn,
+				const struct rds_profile *profile);
+
+int
+rds_preload_status(struct rds_encoder *enc, uint8_t dsn);
+
+
+/* Services and addressing */
+int
+rds_set_psn_on(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t on);
+
+int
+rds_get_addr(struct rds_encoder *enc, uint16_t *site_addr, uint16_t *enc_addr);
+
+int
+rds_set_addr(struct rds_encoder *enc, uint16_t site_addr, uint16_t enc_addr);
+
+int
+rds_add_site_addr(struct rds_encoder *enc, uint16_t site_addr);
+
+int
+rds_del_site_addr(struct rds_encoder *enc, uint16_t site_addr);
+
+int
+rds_add_enc_addr(struct rds_encoder *enc, uint16_t enc_addr);
+
+int
+rds_del_enc_addr(struct rds_encoder *enc, uint16_t enc_addr);
+
+
+/* RadioText Plus */
+int
+rds_rtplus_build(struct rds_rtplus *rtplus,
+		const struct rds_rtplus_field *fields, int num_fields);
+
+
+/* Software encoder */
+int
+rds_soft_get_groups(struct rds_encoder *enc, uint32_t *blocks,
+						int num_groups);
+
+int
+rds_soft_set_weight(struct rds_encoder *enc, uint8_t code, uint8_t weight);
+
+int
+rds_soft_add_oda(struct rds_encoder *enc, const struct rds_soft_oda *oda);
+
+int
+rds_soft_remove_oda(struct rds_encoder *enc, int id);
+
 
 /* Init / Exit */
 struct rds_encoder *
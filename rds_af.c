@@ -0,0 +1,445 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_af.c -	Alternative Frequencies lists
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <stdlib.h>	/* For malloc/free */
+#include <string.h>	/* For memset() / memcmp() */
+#include "rds.h"
+#include "rds_af.h"
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+/**
+ * rds_af_code - Get the AF code of a frequency
+ * @khz: the frequency
+ * @lfmf: set if it's an LF / MF one
+ *
+ * Returns: the code or -EINVAL if it's not on the RDS grid
+ */
+int
+rds_af_code(uint32_t khz, uint8_t *lfmf)
+{
+	*lfmf = 0;
+
+	if(khz >= RDS_AF_FM_MIN_KHZ && khz <= RDS_AF_FM_MAX_KHZ) {
+		if(khz % RDS_AF_FM_STEP_KHZ)
+			return -EINVAL;
+		return (khz - RDS_AF_FM_BASE_KHZ) / RDS_AF_FM_STEP_KHZ;
+	}
+
+	*lfmf = 1;
+
+	if(khz >= RDS_AF_LF_MIN_KHZ && khz <= RDS_AF_LF_MAX_KHZ) {
+		if((khz - RDS_AF_LF_MIN_KHZ) % RDS_AF_LFMF_STEP_KHZ)
+			return -EINVAL;
+		return (khz - RDS_AF_LF_MIN_KHZ) / RDS_AF_LFMF_STEP_KHZ + 1;
+	}
+
+	if(khz >= RDS_AF_MF_MIN_KHZ && khz <= RDS_AF_MF_MAX_KHZ) {
+		if((khz - RDS_AF_MF_MIN_KHZ) % RDS_AF_LFMF_STEP_KHZ)
+			return -EINVAL;
+		return (khz - RDS_AF_MF_MIN_KHZ) / RDS_AF_LFMF_STEP_KHZ +
+							RDS_AF_MF_FIRST_CODE;
+	}
+
+	return -EINVAL;
+}
+
+/**
+ * rds_af_entry - Encode a list entry
+ * @method: RDS_AF_METHOD_*
+ * @list: the &struct rds_af_list
+ * @i: the entry on list->khz[]
+ * @out: where to put it, 2 bytes
+ *
+ * Method A: the code, after RDS_AF_CODE_LFMF for LF / MF ones.
+ * Method B: the (tuned, AF) pair, ascending for the same programme
+ * and descending for a regional variant.
+ *
+ * Returns: the entry's length or -EINVAL
+ */
+static int
+rds_af_entry(uint8_t method, const struct rds_af_list *list, uint8_t i,
+							uint8_t *out)
+{
+	uint8_t lfmf = 0;
+	uint8_t tuned = 0;
+	int code = 0;
+	int ret = 0;
+
+	code = rds_af_code(list->khz[i], &lfmf);
+	if(code < 0)
+		return code;
+
+	if(method == RDS_AF_METHOD_A) {
+		if(!lfmf) {
+			out[0] = code;
+			return 1;
+		}
+		out[0] = RDS_AF_CODE_LFMF;
+		out[1] = code;
+		return 2;
+	}
+
+	/* Method B is FM only */
+	ret = rds_af_code(list->tuned_khz, &lfmf);
+	if(ret < 0 || lfmf)
+		return -EINVAL;
+	tuned = ret;
+
+	code = rds_af_code(list->khz[i], &lfmf);
+	if(lfmf || code == tuned)
+		return -EINVAL;
+
+	if((code > tuned) == !(list->regional & (1 << i))) {
+		out[0] = tuned;
+		out[1] = code;
+	} else {
+		out[0] = code;
+		out[1] = tuned;
+	}
+
+	return 2;
+}
+
+/**
+ * rds_af_encode - Encode a list as it goes on block C of 0A groups
+ * @method: RDS_AF_METHOD_*
+ * @list: the &struct rds_af_list
+ * @codes: where to put it, RDS_AF_CODES_MAX bytes
+ *
+ * Returns: the list's length (even) or -EINVAL
+ */
+int
+rds_af_encode(uint8_t method, const struct rds_af_list *list,
+							uint8_t *codes)
+{
+	uint8_t lfmf = 0;
+	int len = 0;
+	int ret = 0;
+	int i = 0;
+	int j = 0;
+
+	if(list->num > (method == RDS_AF_METHOD_A ? RDS_AF_LIST_MAX :
+					RDS_AF_METHOD_B_LIST_MAX))
+		return -EINVAL;
+
+	/* No duplicates */
+	for(i = 0; i < list->num; i++)
+		for(j = i + 1; j < list->num; j++)
+			if(list->khz[i] == list->khz[j])
+				return -EINVAL;
+
+	if(method == RDS_AF_METHOD_A) {
+		codes[len++] = RDS_AF_CODE_COUNT + list->num;
+	} else {
+		/* The tuned frequency counts too */
+		codes[len++] = RDS_AF_CODE_COUNT + 2 * list->num + 1;
+		ret = rds_af_code(list->tuned_khz, &lfmf);
+		if(ret < 0 || lfmf)
+			return -EINVAL;
+		codes[len++] = ret;
+	}
+
+	for(i = 0; i < list->num; i++) {
+		ret = rds_af_entry(method, list, i, &codes[len]);
+		if(ret < 0)
+			return ret;
+		len += ret;
+	}
+
+	if(len % 2)
+		codes[len++] = RDS_AF_CODE_FILLER;
+
+	return len;
+}
+
+/**
+ * rds_af_find - Find the index of a frequency on a list
+ * @list: the &struct rds_af_list
+ * @khz: the frequency
+ *
+ * Returns: the index or -ENOENT
+ */
+static int
+rds_af_find(const struct rds_af_list *list, uint32_t khz)
+{
+	int i = 0;
+
+	for(i = 0; i < list->num; i++)
+		if(list->khz[i] == khz)
+			return i;
+
+	return -ENOENT;
+}
+
+/**
+ * rds_af_table_get - Get the AF table of a service
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @create: allocate it if it's not there
+ *
+ * Returns: the &struct rds_af_table or NULL and errno set
+ */
+static struct rds_af_table *
+rds_af_table_get(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+							uint8_t create)
+{
+	struct rds_af_cache *cache = enc->af;
+	struct rds_af_table *table = NULL;
+	int free_slot = -1;
+	int i = 0;
+
+	if(!cache) {
+		if(!create) {
+			errno = ENOENT;
+			return NULL;
+		}
+
+		cache = malloc(sizeof(struct rds_af_cache));
+		if(!cache) {
+			errno = ENOMEM;
+			return NULL;
+		}
+		memset(cache, 0, sizeof(struct rds_af_cache));
+		enc->af = cache;
+	}
+
+	for(i = 0; i < RDS_AF_TABLES_MAX; i++) {
+		table = cache->tables[i];
+		if(!table) {
+			if(free_slot < 0)
+				free_slot = i;
+			continue;
+		}
+		if(table->dsn == dsn && table->psn == psn)
+			return table;
+	}
+
+	if(!create) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	if(free_slot < 0) {
+		errno = ENOSPC;
+		return NULL;
+	}
+
+	table = malloc(sizeof(struct rds_af_table));
+	if(!table) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(table, 0, sizeof(struct rds_af_table));
+	table->dsn = dsn;
+	table->psn = psn;
+	cache->tables[free_slot] = table;
+
+	return table;
+}
+
+
+/**************\
+* ENTRY POINTS *
+\**************/
+
+/**
+ * rds_af_exec - Run an AF command
+ * @enc: pointer to &struct rds_encoder
+ * @cmd: a RDS_CMD_GET_AF / RDS_CMD_SET_AF &struct rds_cmd
+ *
+ * Gets are served from the tables, sets are checked / encoded here
+ * and the backend only gets what changed. The tables are updated
+ * after the backend accepts the change.
+ */
+int
+rds_af_exec(struct rds_encoder *enc, struct rds_cmd *cmd)
+{
+	struct rds_af *af = &cmd->arg.af;
+	struct rds_af_table *table = NULL;
+	struct rds_af_wire wire;
+	struct rds_af_list list;
+	uint8_t codes[RDS_AF_CODES_MAX];
+	uint32_t low = 0;
+	uint8_t regional = 0;
+	int len = 0;
+	int ret = 0;
+	int i = 0;
+
+	if(af->idx >= RDS_AF_LISTS_MAX &&
+	!(af->op == RDS_AF_OP_CLEAR && af->idx == RDS_AF_ALL))
+		return -EINVAL;
+
+	table = rds_af_table_get(enc, cmd->dsn, cmd->psn,
+			cmd->op == RDS_CMD_SET_AF && af->op == RDS_AF_OP_SET);
+	if(!table)
+		return -errno;
+
+	if(cmd->op == RDS_CMD_GET_AF) {
+		if(!(table->used & (1 << af->idx)))
+			return -ENOENT;
+		af->method = table->method;
+		af->list = table->lists[af->idx];
+		return table->method;
+	}
+
+	if(!enc->set_af)
+		return -EOPNOTSUPP;
+
+	memset(&wire, 0, sizeof(struct rds_af_wire));
+	wire.op = af->op;
+	wire.idx = af->idx;
+
+	if(af->op == RDS_AF_OP_CLEAR) {
+		if(af->idx != RDS_AF_ALL && !(table->used & (1 << af->idx)))
+			return 0;
+
+		wire.method = table->method;
+		if(table->method == RDS_AF_METHOD_B && af->idx != RDS_AF_ALL)
+			wire.tuned = table->codes[af->idx][1];
+		ret = enc->set_af(enc, cmd->dsn, cmd->psn, &wire);
+		if(ret < 0)
+			return ret;
+
+		if(af->idx == RDS_AF_ALL)
+			table->used = 0;
+		else
+			table->used &= ~(1 << af->idx);
+		if(!table->used)
+			table->method = 0;
+		return ret;
+	}
+
+	if(af->op == RDS_AF_OP_SET) {
+		if(af->method != RDS_AF_METHOD_A &&
+		af->method != RDS_AF_METHOD_B)
+			return -EINVAL;
+		if(af->method == RDS_AF_METHOD_A && af->idx)
+			return -EINVAL;
+
+		/* Clear the old lists first */
+		if(table->used && table->method != af->method)
+			return -EBUSY;
+
+		list = af->list;
+	} else if(af->op == RDS_AF_OP_ADD || af->op == RDS_AF_OP_DEL) {
+		if(!(table->used & (1 << af->idx)))
+			return -ENOENT;
+		if(af->list.num != 1)
+			return -EINVAL;
+
+		list = table->lists[af->idx];
+		i = rds_af_find(&list, af->list.khz[0]);
+
+		/* Regional variants only make sense on method B */
+		regional = table->method == RDS_AF_METHOD_B &&
+						af->list.regional;
+
+		if(af->op == RDS_AF_OP_ADD) {
+			/* Already there, but as the other kind (same
+			 * programme / regional variant) */
+			if(i >= 0 && !(list.regional & (1 << i)) != !regional)
+				return -EEXIST;
+			else if(i >= 0)
+				return 0;
+
+			i = list.num++;
+			if(list.num > (table->method == RDS_AF_METHOD_A ?
+				RDS_AF_LIST_MAX : RDS_AF_METHOD_B_LIST_MAX))
+				return -ENOSPC;
+			list.khz[i] = af->list.khz[0];
+			if(regional)
+				list.regional |= (1 << i);
+		}
+
+		if(i < 0)
+			return i;
+
+		ret = rds_af_entry(table->method, &list, i, wire.delta);
+		if(ret < 0)
+			return ret;
+		wire.delta_len = ret;
+
+		if(af->op == RDS_AF_OP_DEL) {
+			/* Shift the rest (and their regional bits) down */
+			low = list.regional & ((1 << i) - 1);
+			list.regional = ((list.regional >> (i + 1)) << i) | low;
+			list.num--;
+			memmove(&list.khz[i], &list.khz[i + 1],
+				(list.num - i) * sizeof(uint32_t));
+			list.khz[list.num] = 0;
+		}
+	} else
+		return -EINVAL;
+
+	wire.method = af->op == RDS_AF_OP_SET ? af->method : table->method;
+
+	len = rds_af_encode(wire.method, &list, codes);
+	if(len < 0)
+		return len;
+
+	/* Same as what's there, nothing to do */
+	if(table->used & (1 << af->idx) && table->len[af->idx] == len &&
+	!memcmp(table->codes[af->idx], codes, len))
+		return 0;
+
+	wire.tuned = wire.method == RDS_AF_METHOD_B ? codes[1] : 0;
+	wire.codes = codes;
+	wire.len = len;
+
+	ret = enc->set_af(enc, cmd->dsn, cmd->psn, &wire);
+	if(ret < 0)
+		return ret;
+
+	table->method = wire.method;
+	table->used |= (1 << af->idx);
+	table->lists[af->idx] = list;
+	memcpy(table->codes[af->idx], codes, len);
+	table->len[af->idx] = len;
+
+	return ret;
+}
+
+/**
+ * rds_af_free - Release an encoder's AF tables
+ * @enc: pointer to &struct rds_encoder
+ */
+void
+rds_af_free(struct rds_encoder *enc)
+{
+	struct rds_af_cache *cache = enc->af;
+	int i = 0;
+
+	if(!cache)
+		return;
+
+	for(i = 0; i < RDS_AF_TABLES_MAX; i++)
+		free(cache->tables[i]);
+	free(cache);
+	enc->af = NULL;
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_af.h -	Alternative Frequencies lists
+ */
+
+/**
+ * DOC: Alternative Frequencies
+ *
+ * AFs tell receivers where else the programme can be received. They
+ * go out on block C of 0A groups, two codes per group, as lists that
+ * start with a count code (RDS_AF_CODE_COUNT + number of frequencies):
+ *
+ * Method A: a single list with all the network's frequencies, LF/MF
+ * ones follow an RDS_AF_CODE_LFMF code, padded with a filler code to
+ * an even length.
+ *
+ * Method B: one list per transmitter, headed by that transmitter's
+ * frequency, and then pairs of (tuned, AF), ascending when the AF
+ * carries the same programme and descending when it's a regional
+ * variant. For big networks that's a lot of lists.
+ *
+ * We keep the lists of each service (DSN / PSN) as they were sent,
+ * together with their encoded form, on enc->af, and pass the
+ * backends only what changed, as a &struct rds_af_wire:
+ *
+ * - Setting a list that's already there costs nothing, no encoding
+ *   and no I/O.
+ * - Setting a list only re-encodes / resends that list, the rest
+ *   of a method B table stays as is.
+ * - Adding / removing a single frequency (rds_add_af() /
+ *   rds_del_af()) gives the backend the entry that changed, so that
+ *   it can send just that when the protocol allows it.
+ *
+ * These are not part of the shadow state (see rds_state.c), the
+ * tables here are their own shadow.
+ */
+
+/* AF codes */
+#define RDS_AF_CODE_FILLER	205
+#define RDS_AF_CODE_COUNT	224	/* + number of frequencies (0 - 25) */
+#define RDS_AF_CODE_NONE	RDS_AF_CODE_COUNT	/* No AFs */
+#define RDS_AF_CODE_LFMF	250	/* An LF / MF frequency follows */
+
+/* FM: 87.6 - 107.9MHz on 100KHz steps, codes 1 - 204 */
+#define RDS_AF_FM_MIN_KHZ	87600
+#define RDS_AF_FM_MAX_KHZ	107900
+#define RDS_AF_FM_BASE_KHZ	87500
+#define RDS_AF_FM_STEP_KHZ	100
+
+/* LF: 153 - 279KHz, codes 1 - 15, MF: 531 - 1602KHz,
+ * codes 16 - 135, both on 9KHz steps */
+#define RDS_AF_LF_MIN_KHZ	153
+#define RDS_AF_LF_MAX_KHZ	279
+#define RDS_AF_MF_MIN_KHZ	531
+#define RDS_AF_MF_MAX_KHZ	1602
+#define RDS_AF_LFMF_STEP_KHZ	9
+#define RDS_AF_MF_FIRST_CODE	16
+
+/* Count code + a code for each frequency + an LF/MF
+ * code for each one of those, padded to pairs */
+#define RDS_AF_CODES_MAX	(2 * RDS_AF_LIST_MAX + 2)
+
+/* Services we keep AF tables for */
+#define RDS_AF_TABLES_MAX	8
+
+/* An AF change, as passed to the backends */
+struct rds_af_wire {
+	uint8_t method;			/* RDS_AF_METHOD_* */
+	uint8_t op;			/* RDS_AF_OP_* */
+	uint8_t idx;			/* The list that changed (or RDS_AF_ALL
+					 * on RDS_AF_OP_CLEAR) */
+	uint8_t tuned;			/* Method B, code of the list's tuned
+					 * frequency */
+	const uint8_t *codes;		/* The new list, encoded (NULL on
+					 * RDS_AF_OP_CLEAR) */
+	uint8_t len;
+	uint8_t delta[2];		/* ADD / DEL: the entry that changed, as
+					 * it is on the list (method A: the code,
+					 * after RDS_AF_CODE_LFMF for LF / MF,
+					 * method B: the pair) */
+	uint8_t delta_len;
+};
+
+/* The AF lists of a service */
+struct rds_af_table {
+	uint8_t dsn;
+	uint8_t psn;
+	uint8_t method;
+	uint16_t used;			/* One bit per list */
+	struct rds_af_list lists[RDS_AF_LISTS_MAX];
+	uint8_t codes[RDS_AF_LISTS_MAX][RDS_AF_CODES_MAX];
+	uint8_t len[RDS_AF_LISTS_MAX];
+};
+
+/* On enc->af */
+struct rds_af_cache {
+	struct rds_af_table *tables[RDS_AF_TABLES_MAX];
+};
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+/* Used internaly by rds_cmd_exec() / rds_exit() */
+int rds_af_exec(struct rds_encoder *enc, struct rds_cmd *cmd);
+void rds_af_free(struct rds_encoder *enc);
+
+/* Used internaly by rds_eon.c */
+int rds_af_code(uint32_t khz, uint8_t *lfmf);
+int rds_af_encode(uint8_t method, const struct rds_af_list *list,
+							uint8_t *codes);
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_block.c -	RDS blocks, offset words and checkwords
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include "rds_block.h"
+
+
+/*
+ * The checkword is linear on the information word, so
+ * check(info) = check(info & 0xFF00) ^ check(info & 0x00FF)
+ * and two 256 entry tables cover all of them. They hold
+ * (m(x) * x^10) mod g(x) for each byte, on the high and
+ * on the low half of the information word respectively.
+ */
+static const uint16_t rds_check_hi[256] = {
+	0x000, 0x0DC, 0x1B8, 0x164, 0x370, 0x3AC, 0x2C8, 0x214,
+	0x359, 0x385, 0x2E1, 0x23D, 0x029, 0x0F5, 0x191, 0x14D,
+	0x30B, 0x3D7, 0x2B3, 0x26F, 0x07B, 0x0A7, 0x1C3, 0x11F,
+	0x052, 0x08E, 0x1EA, 0x136, 0x322, 0x3FE, 0x29A, 0x246,
+	0x3AF, 0x373, 0x217, 0x2CB, 0x0DF, 0x003, 0x167, 0x1BB,
+	0x0F6, 0x02A, 0x14E, 0x192, 0x386, 0x35A, 0x23E, 0x2E2,
+	0x0A4, 0x078, 0x11C, 0x1C0, 0x3D4, 0x308, 0x26C, 0x2B0,
+	0x3FD, 0x321, 0x245, 0x299, 0x08D, 0x051, 0x135, 0x1E9,
+	0x2E7, 0x23B, 0x35F, 0x383, 0x197, 0x14B, 0x02F, 0x0F3,
+	0x1BE, 0x162, 0x006, 0x0DA, 0x2CE, 0x212, 0x376, 0x3AA,
+	0x1EC, 0x130, 0x054, 0x088, 0x29C, 0x240, 0x324, 0x3F8,
+	0x2B5, 0x269, 0x30D, 0x3D1, 0x1C5, 0x119, 0x07D, 0x0A1,
+	0x148, 0x194, 0x0F0, 0x02C, 0x238, 0x2E4, 0x380, 0x35C,
+	0x211, 0x2CD, 0x3A9, 0x375, 0x161, 0x1BD, 0x0D9, 0x005,
+	0x243, 0x29F, 0x3FB, 0x327, 0x133, 0x1EF, 0x08B, 0x057,
+	0x11A, 0x1C6, 0x0A2, 0x07E, 0x26A, 0x2B6, 0x3D2, 0x30E,
+	0x077, 0x0AB, 0x1CF, 0x113, 0x307, 0x3DB, 0x2BF, 0x263,
+	0x32E, 0x3F2, 0x296, 0x24A, 0x05E, 0x082, 0x1E6, 0x13A,
+	0x37C, 0x3A0, 0x2C4, 0x218, 0x00C, 0x0D0, 0x1B4, 0x168,
+	0x025, 0x0F9, 0x19D, 0x141, 0x355, 0x389, 0x2ED, 0x231,
+	0x3D8, 0x304, 0x260, 0x2BC, 0x0A8, 0x074, 0x110, 0x1CC,
+	0x081, 0x05D, 0x139, 0x1E5, 0x3F1, 0x32D, 0x249, 0x295,
+	0x0D3, 0x00F, 0x16B, 0x1B7, 0x3A3, 0x37F, 0x21B, 0x2C7,
+	0x38A, 0x356, 0x232, 0x2EE, 0x0FA, 0x026, 0x142, 0x19E,
+	0x290, 0x24C, 0x328, 0x3F4, 0x1E0, 0x13C, 0x058, 0x084,
+	0x1C9, 0x115, 0x071, 0x0AD, 0x2B9, 0x265, 0x301, 0x3DD,
+	0x19B, 0x147, 0x023, 0x0FF, 0x2EB, 0x237, 0x353, 0x38F,
+	0x2C2, 0x21E, 0x37A, 0x3A6, 0x1B2, 0x16E, 0x00A, 0x0D6,
+	0x13F, 0x1E3, 0x087, 0x05B, 0x24F, 0x293, 0x3F7, 0x32B,
+	0x266, 0x2BA, 0x3DE, 0x302, 0x116, 0x1CA, 0x0AE, 0x072,
+	0x234, 0x2E8, 0x38C, 0x350, 0x144, 0x198, 0x0FC, 0x020,
+	0x16D, 0x1B1, 0x0D5, 0x009, 0x21D, 0x2C1, 0x3A5, 0x379,
+};
+
+static const uint16_t rds_check_lo[256] = {
+	0x000, 0x1B9, 0x372, 0x2CB, 0x35D, 0x2E4, 0x02F, 0x196,
+	0x303, 0x2BA, 0x071, 0x1C8, 0x05E, 0x1E7, 0x32C, 0x295,
+	0x3BF, 0x206, 0x0CD, 0x174, 0x0E2, 0x15B, 0x390, 0x229,
+	0x0BC, 0x105, 0x3CE, 0x277, 0x3E1, 0x258, 0x093, 0x12A,
+	0x2C7, 0x37E, 0x1B5, 0x00C, 0x19A, 0x023, 0x2E8, 0x351,
+	0x1C4, 0x07D, 0x2B6, 0x30F, 0x299, 0x320, 0x1EB, 0x052,
+	0x178, 0x0C1, 0x20A, 0x3B3, 0x225, 0x39C, 0x157, 0x0EE,
+	0x27B, 0x3C2, 0x109, 0x0B0, 0x126, 0x09F, 0x254, 0x3ED,
+	0x037, 0x18E, 0x345, 0x2FC, 0x36A, 0x2D3, 0x018, 0x1A1,
+	0x334, 0x28D, 0x046, 0x1FF, 0x069, 0x1D0, 0x31B, 0x2A2,
+	0x388, 0x231, 0x0FA, 0x143, 0x0D5, 0x16C, 0x3A7, 0x21E,
+	0x08B, 0x132, 0x3F9, 0x240, 0x3D6, 0x26F, 0x0A4, 0x11D,
+	0x2F0, 0x349, 0x182, 0x03B, 0x1AD, 0x014, 0x2DF, 0x366,
+	0x1F3, 0x04A, 0x281, 0x338, 0x2AE, 0x317, 0x1DC, 0x065,
+	0x14F, 0x0F6, 0x23D, 0x384, 0x212, 0x3AB, 0x160, 0x0D9,
+	0x24C, 0x3F5, 0x13E, 0x087, 0x111, 0x0A8, 0x263, 0x3DA,
+	0x06E, 0x1D7, 0x31C, 0x2A5, 0x333, 0x28A, 0x041, 0x1F8,
+	0x36D, 0x2D4, 0x01F, 0x1A6, 0x030, 0x189, 0x342, 0x2FB,
+	0x3D1, 0x268, 0x0A3, 0x11A, 0x08C, 0x135, 0x3FE, 0x247,
+	0x0D2, 0x16B, 0x3A0, 0x219, 0x38F, 0x236, 0x0FD, 0x144,
+	0x2A9, 0x310, 0x1DB, 0x062, 0x1F4, 0x04D, 0x286, 0x33F,
+	0x1AA, 0x013, 0x2D8, 0x361, 0x2F7, 0x34E, 0x185, 0x03C,
+	0x116, 0x0AF, 0x264, 0x3DD, 0x24B, 0x3F2, 0x139, 0x080,
+	0x215, 0x3AC, 0x167, 0x0DE, 0x148, 0x0F1, 0x23A, 0x383,
+	0x059, 0x1E0, 0x32B, 0x292, 0x304, 0x2BD, 0x076, 0x1CF,
+	0x35A, 0x2E3, 0x028, 0x191, 0x007, 0x1BE, 0x375, 0x2CC,
+	0x3E6, 0x25F, 0x094, 0x12D, 0x0BB, 0x102, 0x3C9, 0x270,
+	0x0E5, 0x15C, 0x397, 0x22E, 0x3B8, 0x201, 0x0CA, 0x173,
+	0x29E, 0x327, 0x1EC, 0x055, 0x1C3, 0x07A, 0x2B1, 0x308,
+	0x19D, 0x024, 0x2EF, 0x356, 0x2C0, 0x379, 0x1B2, 0x00B,
+	0x121, 0x098, 0x253, 0x3EA, 0x27C, 0x3C5, 0x10E, 0x0B7,
+	0x222, 0x39B, 0x150, 0x0E9, 0x17F, 0x0C6, 0x20D, 0x3B4,
+};
+
+/* Offset words by block position, C is replaced by C' on
+ * version B groups */
+static const uint16_t rds_offsets[RDS_GROUP_BLOCKS] = {
+	RDS_OFFSET_A, RDS_OFFSET_B, RDS_OFFSET_C, RDS_OFFSET_D
+};
+
+
+/**
+ * rds_block_check - Get the checkword of an information word
+ * @info: the 16bit information word
+ *
+ * Returns: the 10bit checkword, without the offset word
+ */
+uint16_t
+rds_block_check(uint16_t info)
+{
+	return rds_check_hi[info >> 8] ^ rds_check_lo[info & 0xFF];
+}
+
+/**
+ * rds_block_encode - Build a 26bit block
+ * @info: the 16bit information word
+ * @offset: the offset word (RDS_OFFSET_*)
+ *
+ * Returns: the block, information word on bits 25 - 10
+ */
+uint32_t
+rds_block_encode(uint16_t info, uint16_t offset)
+{
+	return ((uint32_t) info << 10) | (rds_block_check(info) ^ offset);
+}
+
+/**
+ * rds_block_encode_group - Build the 4 blocks of a group
+ * @info: the 4 information words of the group
+ * @blocks: the 4 blocks to fill
+ *
+ * Version (and so C or C' for the third block) comes from
+ * the group type code on the second information word.
+ */
+void
+rds_block_encode_group(const uint16_t info[RDS_GROUP_BLOCKS],
+				uint32_t blocks[RDS_GROUP_BLOCKS])
+{
+	int i = 0;
+
+	for(i = 0; i < RDS_GROUP_BLOCKS; i++)
+		blocks[i] = rds_block_encode(info[i], rds_offsets[i]);
+
+	if(RDS_GROUP_IS_B(info[1] >> 11))
+		blocks[2] = rds_block_encode(info[2], RDS_OFFSET_CP);
+}
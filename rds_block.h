@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_block.h -	RDS blocks, offset words and checkwords
+ */
+
+/**
+ * DOC: Baseband coding
+ *
+ * On air an RDS group is 4 blocks of 26 bits, each one carrying a
+ * 16bit information word followed by a 10bit checkword. The checkword
+ * is the CRC of the information word (generator polynomial
+ * x^10 + x^8 + x^7 + x^5 + x^4 + x^3 + 1) XORed with the offset word
+ * of the block's position, so that receivers can find block and
+ * group boundaries on the bitstream (IEC 62106 Annex B).
+ *
+ * The information words of a group go like this:
+ *
+ * A: PI code
+ * B: group type (4 bits), version (1 bit), TP, PTY (5 bits) and
+ *    5 bits that depend on the group type
+ * C: group data (or PI again on version B groups, with offset C')
+ * D: group data
+ */
+
+/* Offset words */
+#define RDS_OFFSET_A		0x0FC
+#define RDS_OFFSET_B		0x198
+#define RDS_OFFSET_C		0x168
+#define RDS_OFFSET_CP		0x350	/* C' (version B groups) */
+#define RDS_OFFSET_D		0x1B4
+
+#define RDS_BLOCK_BITS		26
+#define RDS_GROUP_BLOCKS	4
+#define RDS_GROUP_BITS		(RDS_BLOCK_BITS * RDS_GROUP_BLOCKS)
+
+/* Group type codes as they go on bits 15 - 11 of block B,
+ * (type << 1) | version */
+#define RDS_GROUP_CODE(_type, _b)	(((_type) << 1) | ((_b) & 0x1))
+#define RDS_GROUP_0A		RDS_GROUP_CODE(0, 0)
+#define RDS_GROUP_1A		RDS_GROUP_CODE(1, 0)
+#define RDS_GROUP_2A		RDS_GROUP_CODE(2, 0)
+#define RDS_GROUP_2B		RDS_GROUP_CODE(2, 1)
+#define RDS_GROUP_3A		RDS_GROUP_CODE(3, 0)
+#define RDS_GROUP_4A		RDS_GROUP_CODE(4, 0)
+#define RDS_GROUP_10A		RDS_GROUP_CODE(10, 0)
+
+#define RDS_GROUP_IS_B(_code)	((_code) & 0x1)
+
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+uint16_t
+rds_block_check(uint16_t info);
+
+uint32_t
+rds_block_encode(uint16_t info, uint16_t offset);
+
+void
+rds_block_encode_group(const uint16_t info[RDS_GROUP_BLOCKS],
+				uint32_t blocks[RDS_GROUP_BLOCKS]);
@@ -0,0 +1,581 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_bus.c -	Several units sharing one port (multi-drop line)
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <stdlib.h>	/* For malloc/free */
+#include <string.h>	/* For memset() / memmove() */
+#include <unistd.h>	/* For read() / close() */
+#include <poll.h>	/* For poll() */
+#include <pthread.h>	/* For pthread_* */
+#include "rds.h"
+#include "rds_thread.h"
+#include "rds_bus.h"
+#include "rds_dsn.h"
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+/**
+ * rds_bus_unit_of - Find a handle's unit on its bus
+ * @bus: the &struct rds_bus
+ * @enc: the handle
+ */
+static struct rds_bus_unit *
+rds_bus_unit_of(struct rds_bus *bus, struct rds_encoder *enc)
+{
+	int i = 0;
+
+	for(i = 0; i < bus->num_units; i++)
+		if(bus->units[i].enc == enc)
+			return &bus->units[i];
+
+	return NULL;
+}
+
+/**
+ * rds_bus_unit_at - Find the unit of an address (as on the wire)
+ * @bus: the &struct rds_bus
+ * @addr: the address
+ */
+static struct rds_bus_unit *
+rds_bus_unit_at(struct rds_bus *bus, int addr)
+{
+	int i = 0;
+
+	for(i = 0; i < bus->num_units; i++)
+		if(bus->units[i].enc->addr == addr)
+			return &bus->units[i];
+
+	return NULL;
+}
+
+/**
+ * rds_bus_route - Split what we received into frames and route them
+ * @bus: the &struct rds_bus (locked)
+ * @flush: nothing more is coming, hand over partial frames too
+ */
+static void
+rds_bus_route(struct rds_bus *bus, uint8_t flush)
+{
+	struct rds_bus_unit *unit = NULL;
+	struct rds_encoder *enc = bus->current;
+	int addr = 0;
+	int len = 0;
+
+	while(bus->rx_len) {
+		if(enc->rx_split)
+			len = enc->rx_split(bus->rx, bus->rx_len, &addr);
+		else {
+			len = bus->rx_len;
+			addr = -1;
+		}
+
+		if(!len && !flush)
+			break;
+
+		/* Garbage / partial frame, let the
+		 * reader make sense of it */
+		if(len <= 0) {
+			len = len ? -len : bus->rx_len;
+			addr = -1;
+		}
+
+		unit = (addr < 0 || bus->promisc) ? NULL :
+					rds_bus_unit_at(bus, addr);
+		if(unit && unit->enc != enc)
+			unit->stray++;
+		else if(bus->inbox_len + len <= RDS_BUS_RX_LEN) {
+			memcpy(bus->inbox + bus->inbox_len, bus->rx, len);
+			bus->inbox_len += len;
+		}
+
+		bus->rx_len -= len;
+		memmove(bus->rx, bus->rx + len, bus->rx_len);
+	}
+}
+
+/**
+ * rds_bus_next - Grab the next transaction, taking turns between units
+ * @bus: the &struct rds_bus (locked)
+ * @enc: filled with the handle it's for
+ */
+static struct rds_future *
+rds_bus_next(struct rds_bus *bus, struct rds_encoder **enc)
+{
+	struct rds_bus_unit *unit = NULL;
+	struct rds_future *fut = NULL;
+	int i = 0;
+
+	for(i = 0; i < bus->num_units; i++) {
+		unit = &bus->units[(bus->next + i) % bus->num_units];
+		if(!unit->len)
+			continue;
+
+		fut = unit->queue[unit->head];
+		unit->head = (unit->head + 1) % RDS_BUS_QUEUE_LEN;
+		unit->len--;
+		unit->done++;
+
+		bus->next = (bus->next + i + 1) % bus->num_units;
+		*enc = unit->enc;
+		return fut;
+	}
+
+	return NULL;
+}
+
+/**
+ * rds_bus_begin - Give the port to a transaction
+ * @bus: the &struct rds_bus (locked)
+ * @enc: the handle it's for
+ * @promisc: it talks to other units too
+ */
+static void
+rds_bus_begin(struct rds_bus *bus, struct rds_encoder *enc, uint8_t promisc)
+{
+	/* Whatever the last one didn't read is stale */
+	bus->inbox_len = 0;
+	bus->current = enc;
+	bus->promisc = promisc;
+}
+
+/**
+ * rds_bus_end - Take the port back from a transaction
+ * @bus: the &struct rds_bus (locked)
+ */
+static void
+rds_bus_end(struct rds_bus *bus)
+{
+	bus->current = NULL;
+	bus->promisc = 0;
+	pthread_cond_broadcast(&bus->idle);
+}
+
+/**
+ * rds_bus_background - Give each unit a chance to do background work
+ * @bus: the &struct rds_bus (locked)
+ *
+ * Returns: how many units did something
+ */
+static int
+rds_bus_background(struct rds_bus *bus)
+{
+	struct rds_encoder *enc = NULL;
+	int done = 0;
+	int i = 0;
+
+	for(i = 0; i < bus->num_units; i++) {
+		enc = bus->units[i].enc;
+		if(!enc->dsets)
+			continue;
+
+		rds_bus_begin(bus, enc, 0);
+		pthread_mutex_unlock(&bus->lock);
+
+		if(rds_dsn_step(enc, 0) > 0)
+			done++;
+
+		pthread_mutex_lock(&bus->lock);
+		rds_bus_end(bus);
+	}
+
+	return done;
+}
+
+/**
+ * rds_bus_pending - Check if any unit has something queued
+ * @bus: the &struct rds_bus (locked)
+ */
+static int
+rds_bus_pending(struct rds_bus *bus)
+{
+	int i = 0;
+
+	for(i = 0; i < bus->num_units; i++)
+		if(bus->units[i].len)
+			return 1;
+
+	return 0;
+}
+
+/**
+ * rds_bus_thread_fn - Main loop of the bus' thread
+ * @arg: pointer to &struct rds_bus
+ */
+static void *
+rds_bus_thread_fn(void *arg)
+{
+	struct rds_bus *bus = arg;
+	struct rds_encoder *enc = NULL;
+	struct rds_future *fut = NULL;
+	int ret = 0;
+
+	pthread_mutex_lock(&bus->lock);
+
+	for(;;) {
+		fut = rds_bus_next(bus, &enc);
+		if(fut) {
+			rds_bus_begin(bus, enc, fut->fn != NULL);
+			pthread_mutex_unlock(&bus->lock);
+
+			if(fut->fn)
+				ret = fut->fn(enc, fut->fn_arg);
+			else
+				ret = rds_cmd_exec(enc, &fut->cmd);
+			rds_future_complete(enc, fut, ret);
+
+			pthread_mutex_lock(&bus->lock);
+			rds_bus_end(bus);
+			continue;
+		}
+
+		if(bus->stop)
+			break;
+
+		bus->kicked = 0;
+		if(rds_bus_background(bus) > 0)
+			continue;
+
+		if(!bus->kicked && !bus->stop && !rds_bus_pending(bus))
+			pthread_cond_wait(&bus->work, &bus->lock);
+	}
+
+	pthread_mutex_unlock(&bus->lock);
+
+	return NULL;
+}
+
+
+/****************\
+* USED INTERNALY *
+\****************/
+
+/**
+ * rds_bus_submit - Queue a command on a handle's queue
+ * @enc: the handle
+ * @fut: an initialized &struct rds_future (see rds_submit())
+ *
+ * Returns: 0 on success, -EAGAIN if the handle's queue is full,
+ * -ESHUTDOWN if it's detached
+ */
+int
+rds_bus_submit(struct rds_encoder *enc, struct rds_future *fut)
+{
+	struct rds_bus *bus = enc->bus;
+	struct rds_bus_unit *unit = NULL;
+	int ret = 0;
+
+	fut->done = 0;
+
+	pthread_mutex_lock(&bus->lock);
+
+	unit = rds_bus_unit_of(bus, enc);
+	if(!unit || bus->stop)
+		ret = -ESHUTDOWN;
+	else if(unit->len >= RDS_BUS_QUEUE_LEN)
+		ret = -EAGAIN;
+	else {
+		unit->queue[(unit->head + unit->len) % RDS_BUS_QUEUE_LEN] = fut;
+		unit->len++;
+		pthread_cond_signal(&bus->work);
+	}
+
+	pthread_mutex_unlock(&bus->lock);
+
+	return ret;
+}
+
+/**
+ * rds_bus_is_self - Check if we are running on the bus' thread
+ * @enc: the handle
+ */
+int
+rds_bus_is_self(struct rds_encoder *enc)
+{
+	struct rds_bus *bus = enc->bus;
+
+	return pthread_equal(pthread_self(), bus->tid);
+}
+
+/**
+ * rds_bus_kick - Wake up the bus' thread for background work
+ * @enc: the handle
+ */
+void
+rds_bus_kick(struct rds_encoder *enc)
+{
+	struct rds_bus *bus = enc->bus;
+
+	pthread_mutex_lock(&bus->lock);
+	bus->kicked = 1;
+	pthread_cond_signal(&bus->work);
+	pthread_mutex_unlock(&bus->lock);
+}
+
+/**
+ * rds_bus_fill_rx - Refill a handle's receive buffer (see rds_fill_rx())
+ * @enc: the handle, its transaction is running
+ *
+ * Serves what was routed to the running transaction, reading
+ * more from the port when there's nothing left.
+ */
+int
+rds_bus_fill_rx(struct rds_encoder *enc)
+{
+	struct rds_bus *bus = enc->bus;
+	struct pollfd fds;
+	int pending = 0;
+	int ret = 0;
+
+	for(;;) {
+		pthread_mutex_lock(&bus->lock);
+		if(bus->inbox_len) {
+			ret = bus->inbox_len < RDS_RX_BUF_LEN ?
+					bus->inbox_len : RDS_RX_BUF_LEN;
+			memcpy(enc->rx_buf, bus->inbox, ret);
+			bus->inbox_len -= ret;
+			memmove(bus->inbox, bus->inbox + ret, bus->inbox_len);
+			pthread_mutex_unlock(&bus->lock);
+
+			enc->rx_pos = 0;
+			enc->rx_len = ret;
+			return ret;
+		}
+		pthread_mutex_unlock(&bus->lock);
+
+		memset(&fds, 0, sizeof(struct pollfd));
+		fds.fd = bus->fd;
+		fds.events = POLLIN|POLLPRI;
+
+		ret = poll(&fds, 1, enc->timeout_ms);
+		if(ret > 0)
+			ret = read(bus->fd, bus->rx + bus->rx_len,
+					RDS_BUS_RX_LEN - bus->rx_len);
+		if(ret < 0 && errno != EAGAIN && errno != EINTR)
+			return -errno;
+
+		pthread_mutex_lock(&bus->lock);
+		if(ret > 0)
+			bus->rx_len += ret;
+
+		/* Nothing more is coming (or we can't take more),
+		 * hand over what we have as is */
+		rds_bus_route(bus, ret <= 0 || bus->rx_len == RDS_BUS_RX_LEN);
+		pending = bus->inbox_len;
+		pthread_mutex_unlock(&bus->lock);
+
+		if(!pending && ret <= 0)
+			return -ETIME;
+	}
+}
+
+/**
+ * rds_bus_flush_rx - Drop what the running transaction didn't read
+ * @enc: the handle, its transaction is running
+ *
+ * Only what was routed to it, the port is left alone.
+ */
+void
+rds_bus_flush_rx(struct rds_encoder *enc)
+{
+	struct rds_bus *bus = enc->bus;
+
+	pthread_mutex_lock(&bus->lock);
+	bus->inbox_len = 0;
+	pthread_mutex_unlock(&bus->lock);
+}
+
+/**
+ * rds_bus_detach - Remove a handle from its bus
+ * @enc: the handle
+ *
+ * Waits for its transaction if one is running, commands
+ * still queued fail with -ESHUTDOWN.
+ */
+void
+rds_bus_detach(struct rds_encoder *enc)
+{
+	struct rds_bus *bus = enc->bus;
+	struct rds_bus_unit *unit = NULL;
+	struct rds_future *queued[RDS_BUS_QUEUE_LEN];
+	int num = 0;
+	int i = 0;
+
+	if(!bus)
+		return;
+
+	pthread_mutex_lock(&bus->lock);
+
+	while(bus->current == enc)
+		pthread_cond_wait(&bus->idle, &bus->lock);
+
+	unit = rds_bus_unit_of(bus, enc);
+	if(unit) {
+		for(i = 0; i < unit->len; i++)
+			queued[num++] = unit->queue[(unit->head + i) %
+							RDS_BUS_QUEUE_LEN];
+
+		bus->num_units--;
+		*unit = bus->units[bus->num_units];
+		if(bus->next >= bus->num_units)
+			bus->next = 0;
+	}
+
+	pthread_mutex_unlock(&bus->lock);
+
+	for(i = 0; i < num; i++)
+		rds_future_complete(enc, queued[i], -ESHUTDOWN);
+
+	enc->bus = NULL;
+	enc->serial_fd = -1;
+}
+
+
+/**************\
+* ENTRY POINTS *
+\**************/
+
+/**
+ * rds_bus_open - Open a port that several units share
+ * @type: RDS_ENCODER_TYPE_PRAIS or RDS_ENCODER_TYPE_UECP
+ * @port: the serial port
+ *
+ * Returns: a &struct rds_bus or NULL and errno set
+ */
+struct rds_bus *
+rds_bus_open(uint8_t type, const unsigned char *port)
+{
+	struct rds_bus *bus = NULL;
+	int ret = 0;
+
+	if(type != RDS_ENCODER_TYPE_PRAIS && type != RDS_ENCODER_TYPE_UECP) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	bus = malloc(sizeof(struct rds_bus));
+	if(!bus) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(bus, 0, sizeof(struct rds_bus));
+	bus->type = type;
+
+	bus->fd = rds_open_serial(port);
+	if(bus->fd < 0) {
+		ret = -bus->fd;
+		free(bus);
+		errno = ret;
+		return NULL;
+	}
+
+	pthread_mutex_init(&bus->lock, NULL);
+	pthread_cond_init(&bus->work, NULL);
+	pthread_cond_init(&bus->idle, NULL);
+
+	ret = pthread_create(&bus->tid, NULL, rds_bus_thread_fn, bus);
+	if(ret != 0) {
+		close(bus->fd);
+		free(bus);
+		errno = ret;
+		return NULL;
+	}
+
+	return bus;
+}
+
+/**
+ * rds_bus_attach - Get a handle for a unit on the bus
+ * @bus: the &struct rds_bus
+ * @site_addr: site address (UECP)
+ * @enc_addr: encoder address
+ *
+ * Returns: the handle or NULL and errno set (EEXIST if there
+ * is one for that address already)
+ */
+struct rds_encoder *
+rds_bus_attach(struct rds_bus *bus, uint16_t site_addr, uint16_t enc_addr)
+{
+	struct rds_encoder *enc = NULL;
+	struct rds_bus_unit *unit = NULL;
+	int ret = 0;
+
+	enc = rds_init(bus->type, site_addr, enc_addr, NULL);
+	if(!enc)
+		return NULL;
+
+	pthread_mutex_lock(&bus->lock);
+
+	if(bus->num_units >= RDS_BUS_UNITS_MAX)
+		ret = ENOSPC;
+	else if(rds_bus_unit_at(bus, enc->addr))
+		ret = EEXIST;
+	else {
+		unit = &bus->units[bus->num_units++];
+		memset(unit, 0, sizeof(struct rds_bus_unit));
+		unit->enc = enc;
+		enc->serial_fd = bus->fd;
+		enc->bus = bus;
+	}
+
+	pthread_mutex_unlock(&bus->lock);
+
+	if(ret) {
+		rds_exit(enc);
+		errno = ret;
+		return NULL;
+	}
+
+	return enc;
+}
+
+/**
+ * rds_bus_close - Close a shared port
+ * @bus: the &struct rds_bus
+ *
+ * Returns: 0, or -EBUSY if there are handles still attached
+ */
+int
+rds_bus_close(struct rds_bus *bus)
+{
+	pthread_mutex_lock(&bus->lock);
+	if(bus->num_units) {
+		pthread_mutex_unlock(&bus->lock);
+		return -EBUSY;
+	}
+	bus->stop = 1;
+	pthread_cond_signal(&bus->work);
+	pthread_mutex_unlock(&bus->lock);
+
+	pthread_join(bus->tid, NULL);
+
+	pthread_cond_destroy(&bus->idle);
+	pthread_cond_destroy(&bus->work);
+	pthread_mutex_destroy(&bus->lock);
+	close(bus->fd);
+	free(bus);
+
+	return 0;
+}
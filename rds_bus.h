@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_bus.h -	Several units sharing one port (multi-drop line)
+ */
+
+/**
+ * DOC: Shared port
+ *
+ * On an RS-485 line many units hang off the same serial port, each
+ * on its own address. Opening the port once per unit with rds_init()
+ * gets them fighting over it, and each one flushes what the others
+ * receive. Instead open it once with rds_bus_open() and get a handle
+ * per unit with rds_bus_attach(). Handles work like any other
+ * &struct rds_encoder (rds_exit() detaches them).
+ *
+ * The bus has a thread that owns the port. Commands of each handle
+ * go on that handle's own queue (rds_submit() / rds_cmd_run() route
+ * them there), and the thread runs one transaction at a time, taking
+ * turns between handles that have something queued, so a busy unit
+ * can't starve the others and the line never sits idle while there's
+ * work for someone.
+ *
+ * Replies are read from the port by the bus and split into frames
+ * (through the backend's rx_split method) instead of flushing the
+ * port after each one. Since transactions don't overlap, a frame
+ * from a unit that has its own handle but whose transaction is not
+ * the one running can only be a late reply, it's dropped (and
+ * counted) without touching the rest of the input. Everything else
+ * (frames of the running unit, bare ACKs, units we have no handle
+ * for) goes to the running transaction, and what is left of it when
+ * the next one starts is dropped. Work run with rds_thread_run()
+ * (e.g. rds_fanout()) talks to other units on purpose, it gets all
+ * frames.
+ */
+
+#define RDS_BUS_UNITS_MAX	16
+#define RDS_BUS_QUEUE_LEN	16	/* Per unit */
+#define RDS_BUS_RX_LEN		256	/* A few replies */
+
+struct rds_bus_unit {
+	struct rds_encoder *enc;
+	struct rds_future *queue[RDS_BUS_QUEUE_LEN];
+	uint8_t head;
+	uint8_t len;
+
+	uint32_t done;			/* Transactions run */
+	uint32_t stray;			/* Late replies dropped */
+};
+
+struct rds_bus {
+	uint8_t type;			/* RDS_ENCODER_TYPE_* of all units */
+	int fd;
+	pthread_t tid;
+	pthread_mutex_t lock;
+	pthread_cond_t work;		/* Something got queued */
+	pthread_cond_t idle;		/* A transaction completed */
+	uint8_t stop;
+	uint8_t kicked;			/* Background work (see rds_dsn.c) */
+
+	struct rds_encoder *current;	/* Whose transaction is running */
+	uint8_t promisc;		/* It gets all frames */
+	uint8_t next;			/* Whose turn it is */
+
+	/* Received, not split into frames yet */
+	uint8_t rx[RDS_BUS_RX_LEN];
+	uint16_t rx_len;
+
+	/* Frames for the running transaction, not read yet */
+	uint8_t inbox[RDS_BUS_RX_LEN];
+	uint16_t inbox_len;
+
+	uint8_t num_units;
+	struct rds_bus_unit units[RDS_BUS_UNITS_MAX];
+};
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+struct rds_bus *rds_bus_open(uint8_t type, const unsigned char *port);
+int rds_bus_close(struct rds_bus *bus);
+struct rds_encoder *rds_bus_attach(struct rds_bus *bus, uint16_t site_addr,
+							uint16_t enc_addr);
+
+/* Used internaly by rds.c / rds_thread.c */
+void rds_bus_detach(struct rds_encoder *enc);
+int rds_bus_submit(struct rds_encoder *enc, struct rds_future *fut);
+int rds_bus_is_self(struct rds_encoder *enc);
+void rds_bus_kick(struct rds_encoder *enc);
+int rds_bus_fill_rx(struct rds_encoder *enc);
+void rds_bus_flush_rx(struct rds_encoder *enc);
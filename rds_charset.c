@@ -0,0 +1,412 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_charset.c -	UTF-8 to RDS character set conversion
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <stdlib.h>	/* For bsearch() */
+#include <string.h>	/* For memcpy() */
+#include <pthread.h>	/* For pthread_once() */
+#include "rds_charset.h"
+
+
+/*************\
+* CODE TABLES *
+\*************/
+
+/* G0 code table (IEC 62106 Annex E, figure E.1), 0 -> unused */
+static const uint16_t g0_to_ucs[256] = {
+	/* 0x00 - 0x1F are control codes */
+	[0x20] = 0x0020, 0x0021, 0x0022, 0x0023, 0x00A4, 0x0025, 0x0026, 0x0027,
+	0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x002D, 0x002E, 0x002F,
+	0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037,
+	0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F,
+	0x0040, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047,
+	0x0048, 0x0049, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F,
+	0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057,
+	0x0058, 0x0059, 0x005A, 0x005B, 0x005C, 0x005D, 0x2015, 0x005F,
+	0x2016, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067,
+	0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F,
+	0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077,
+	0x0078, 0x0079, 0x007A, 0x007B, 0x007C, 0x007D, 0x203E, 0,
+	/* 0x80 */
+	0x00E1, 0x00E0, 0x00E9, 0x00E8, 0x00ED, 0x00EC, 0x00F3, 0x00F2,
+	0x00FA, 0x00F9, 0x00D1, 0x00C7, 0x015E, 0x00DF, 0x00A1, 0x0132,
+	/* 0x90 */
+	0x00E2, 0x00E4, 0x00EA, 0x00EB, 0x00EE, 0x00EF, 0x00F4, 0x00F6,
+	0x00FB, 0x00FC, 0x00F1, 0x00E7, 0x015F, 0x01E7, 0x0131, 0x0133,
+	/* 0xA0 */
+	0x00AA, 0x03B1, 0x00A9, 0x2030, 0x01E6, 0x011B, 0x0148, 0x0151,
+	0x03C0, 0x20AC, 0x00A3, 0x0024, 0x2190, 0x2191, 0x2192, 0x2193,
+	/* 0xB0 */
+	0x00BA, 0x00B9, 0x00B2, 0x00B3, 0x00B1, 0x0130, 0x0144, 0x0171,
+	0x00B5, 0x00BF, 0x00F7, 0x00B0, 0x00BC, 0x00BD, 0x00BE, 0x00A7,
+	/* 0xC0 */
+	0x00C1, 0x00C0, 0x00C9, 0x00C8, 0x00CD, 0x00CC, 0x00D3, 0x00D2,
+	0x00DA, 0x00D9, 0x0158, 0x010C, 0x0160, 0x017D, 0x00D0, 0x013F,
+	/* 0xD0 */
+	0x00C2, 0x00C4, 0x00CA, 0x00CB, 0x00CE, 0x00CF, 0x00D4, 0x00D6,
+	0x00DB, 0x00DC, 0x0159, 0x010D, 0x0161, 0x017E, 0x0111, 0x0140,
+	/* 0xE0 */
+	0x00C3, 0x00C5, 0x00C6, 0x0152, 0x0177, 0x00DD, 0x00D5, 0x00D8,
+	0x00DE, 0x014A, 0x0154, 0x0106, 0x015A, 0x0179, 0x0166, 0x00F0,
+	/* 0xF0 */
+	0x00E3, 0x00E5, 0x00E6, 0x0153, 0x0175, 0x00FD, 0x00F5, 0x00F8,
+	0x00FE, 0x014B, 0x0155, 0x0107, 0x015B, 0x017A, 0x0167, 0
+};
+
+/*
+ * Reverse lookup, one 256 entry page for each block of the
+ * BMP G0 has characters from, built from g0_to_ucs on first use.
+ */
+#define G0_PAGE_NONE	0xFF
+#define G0_NUM_PAGES	5
+
+static uint8_t g0_pages[G0_NUM_PAGES][256];
+static pthread_once_t g0_pages_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Transliterations for code points that are not on G0, sorted
+ * by code point (we bsearch it). Strings are G0 encoded and must
+ * not be longer than the code point's UTF-8 form, so that the
+ * output never grows.
+ */
+struct g0_translit {
+	uint16_t ucs;
+	char str[4];
+};
+
+static const struct g0_translit g0_translit[] = {
+	{0x005E, " "},
+	{0x0060, "'"},
+	{0x007E, "-"},
+	{0x00A0, " "},
+	{0x00A2, "c"},
+	{0x00A5, "Y"},
+	{0x00A6, "|"},
+	{0x00A8, "\""},
+	{0x00AB, "<<"},
+	{0x00AC, "-"},
+	{0x00AD, "-"},
+	{0x00AE, "R"},
+	{0x00AF, "-"},
+	{0x00B4, "'"},
+	{0x00B6, "P"},
+	{0x00B7, "."},
+	{0x00B8, ","},
+	{0x00BB, ">>"},
+	{0x00D7, "x"},
+	{0x00FF, "y"},
+	{0x0100, "A"}, {0x0101, "a"}, {0x0102, "A"}, {0x0103, "a"},
+	{0x0104, "A"}, {0x0105, "a"},
+	{0x0108, "C"}, {0x0109, "c"}, {0x010A, "C"}, {0x010B, "c"},
+	{0x010E, "D"}, {0x010F, "d"}, {0x0110, "\xCE"},
+	{0x0112, "E"}, {0x0113, "e"}, {0x0114, "E"}, {0x0115, "e"},
+	{0x0116, "E"}, {0x0117, "e"}, {0x0118, "E"}, {0x0119, "e"},
+	{0x011A, "E"},
+	{0x011C, "G"}, {0x011D, "g"},
+	{0x011E, "\xA4"}, {0x011F, "\x9D"},	/* Turkish ğ -> ǧ */
+	{0x0120, "G"}, {0x0121, "g"}, {0x0122, "G"}, {0x0123, "g"},
+	{0x0124, "H"}, {0x0125, "h"}, {0x0126, "H"}, {0x0127, "h"},
+	{0x0128, "I"}, {0x0129, "i"}, {0x012A, "I"}, {0x012B, "i"},
+	{0x012C, "I"}, {0x012D, "i"}, {0x012E, "I"}, {0x012F, "i"},
+	{0x0134, "J"}, {0x0135, "j"}, {0x0136, "K"}, {0x0137, "k"},
+	{0x0139, "L"}, {0x013A, "l"}, {0x013B, "L"}, {0x013C, "l"},
+	{0x013D, "L"}, {0x013E, "l"}, {0x0141, "L"}, {0x0142, "l"},
+	{0x0143, "N"}, {0x0145, "N"}, {0x0146, "n"}, {0x0147, "N"},
+	{0x014C, "O"}, {0x014D, "o"}, {0x014E, "O"}, {0x014F, "o"},
+	{0x0150, "\xD7"},			/* Ő -> Ö */
+	{0x0156, "R"}, {0x0157, "r"},
+	{0x015C, "S"}, {0x015D, "s"},
+	{0x0162, "T"}, {0x0163, "t"}, {0x0164, "T"}, {0x0165, "t"},
+	{0x0168, "U"}, {0x0169, "u"}, {0x016A, "U"}, {0x016B, "u"},
+	{0x016C, "U"}, {0x016D, "u"}, {0x016E, "U"}, {0x016F, "u"},
+	{0x0170, "\xD9"},			/* Ű -> Ü */
+	{0x0172, "U"}, {0x0173, "u"},
+	{0x0174, "W"}, {0x0176, "Y"}, {0x0178, "Y"},
+	{0x017B, "Z"}, {0x017C, "z"},
+	/* Greek, ELOT 743 */
+	{0x0386, "A"}, {0x0388, "E"}, {0x0389, "I"}, {0x038A, "I"},
+	{0x038C, "O"}, {0x038E, "Y"}, {0x038F, "O"}, {0x0390, "i"},
+	{0x0391, "A"}, {0x0392, "V"}, {0x0393, "G"}, {0x0394, "D"},
+	{0x0395, "E"}, {0x0396, "Z"}, {0x0397, "I"}, {0x0398, "TH"},
+	{0x0399, "I"}, {0x039A, "K"}, {0x039B, "L"}, {0x039C, "M"},
+	{0x039D, "N"}, {0x039E, "X"}, {0x039F, "O"}, {0x03A0, "P"},
+	{0x03A1, "R"}, {0x03A3, "S"}, {0x03A4, "T"}, {0x03A5, "Y"},
+	{0x03A6, "F"}, {0x03A7, "CH"}, {0x03A8, "PS"}, {0x03A9, "O"},
+	{0x03AA, "I"}, {0x03AB, "Y"}, {0x03AC, "a"}, {0x03AD, "e"},
+	{0x03AE, "i"}, {0x03AF, "i"}, {0x03B0, "y"},
+	{0x03B1, "a"}, {0x03B2, "v"}, {0x03B3, "g"}, {0x03B4, "d"},
+	{0x03B5, "e"}, {0x03B6, "z"}, {0x03B7, "i"}, {0x03B8, "th"},
+	{0x03B9, "i"}, {0x03BA, "k"}, {0x03BB, "l"}, {0x03BC, "m"},
+	{0x03BD, "n"}, {0x03BE, "x"}, {0x03BF, "o"}, {0x03C0, "p"},
+	{0x03C1, "r"}, {0x03C2, "s"}, {0x03C3, "s"}, {0x03C4, "t"},
+	{0x03C5, "y"}, {0x03C6, "f"}, {0x03C7, "ch"}, {0x03C8, "ps"},
+	{0x03C9, "o"}, {0x03CA, "i"}, {0x03CB, "y"}, {0x03CC, "o"},
+	{0x03CD, "y"}, {0x03CE, "o"},
+	/* Punctuation */
+	{0x2010, "-"}, {0x2011, "-"}, {0x2012, "-"}, {0x2013, "-"},
+	{0x2014, "-"},
+	{0x2018, "'"}, {0x2019, "'"}, {0x201A, ","}, {0x201B, "'"},
+	{0x201C, "\""}, {0x201D, "\""}, {0x201E, "\""}, {0x201F, "\""},
+	{0x2022, "."}, {0x2026, "..."},
+	{0x2039, "<"}, {0x203A, ">"},
+	{0x2122, "TM"},
+};
+
+#define G0_NUM_TRANSLIT	(int) (sizeof(g0_translit) / sizeof(g0_translit[0]))
+
+
+/**
+ * g0_page - Get the reverse lookup page of a code point
+ * @ucs: the code point
+ */
+static inline uint8_t
+g0_page(uint32_t ucs)
+{
+	switch(ucs >> 8) {
+	case 0x00:	/* Basic Latin / Latin-1 */
+		return 0;
+	case 0x01:	/* Latin Extended-A/B */
+		return 1;
+	case 0x03:	/* Greek */
+		return 2;
+	case 0x20:	/* General punctuation / currency */
+		return 3;
+	case 0x21:	/* Letterlike / arrows */
+		return 4;
+	default:
+		return G0_PAGE_NONE;
+	}
+}
+
+/**
+ * g0_pages_init - Build the reverse lookup pages
+ *
+ * Single character transliterations go on the pages
+ * too, so only the multi-character ones need a search.
+ */
+static void
+g0_pages_init(void)
+{
+	uint16_t ucs = 0;
+	int i = 0;
+
+	for(i = 0; i < G0_NUM_TRANSLIT; i++) {
+		if(g0_translit[i].str[1] != '\0')
+			continue;
+		ucs = g0_translit[i].ucs;
+		g0_pages[g0_page(ucs)][ucs & 0xFF] = g0_translit[i].str[0];
+	}
+
+	for(i = 0; i < 256; i++) {
+		ucs = g0_to_ucs[i];
+		if(ucs == 0)
+			continue;
+
+		/* Greek α and π are there as symbols, if we
+		 * mapped them on Greek text we'd end up with
+		 * a mix of latin and greek letters, let them
+		 * go through transliteration instead */
+		if(ucs == 0x03B1 || ucs == 0x03C0)
+			continue;
+
+		g0_pages[g0_page(ucs)][ucs & 0xFF] = i;
+	}
+}
+
+/**
+ * g0_translit_cmp - bsearch() comparator for g0_translit
+ */
+static int
+g0_translit_cmp(const void *key, const void *entry)
+{
+	uint16_t ucs = *(const uint16_t *) key;
+	const struct g0_translit *tr = entry;
+
+	return (int) ucs - (int) tr->ucs;
+}
+
+/**
+ * utf8_decode - Decode a UTF-8 sequence
+ * @in: the input buffer
+ * @len: bytes available on @in
+ * @ucs: decoded code point, 0xFFFD on invalid input
+ *
+ * Returns: number of bytes consumed (always > 0)
+ */
+static int
+utf8_decode(const uint8_t *in, int len, uint32_t *ucs)
+{
+	uint32_t cp = 0;
+	int need = 0;
+	int i = 0;
+
+	if(in[0] < 0x80) {
+		*ucs = in[0];
+		return 1;
+	} else if((in[0] & 0xE0) == 0xC0) {
+		cp = in[0] & 0x1F;
+		need = 1;
+	} else if((in[0] & 0xF0) == 0xE0) {
+		cp = in[0] & 0x0F;
+		need = 2;
+	} else if((in[0] & 0xF8) == 0xF0) {
+		cp = in[0] & 0x07;
+		need = 3;
+	} else {
+		*ucs = 0xFFFD;
+		return 1;
+	}
+
+	for(i = 1; i <= need; i++) {
+		if(i >= len || (in[i] & 0xC0) != 0x80) {
+			*ucs = 0xFFFD;
+			return i;
+		}
+		cp = (cp << 6) | (in[i] & 0x3F);
+	}
+
+	/* Overlong forms */
+	if((need == 1 && cp < 0x80) || (need == 2 && cp < 0x800) ||
+	(need == 3 && cp < 0x10000))
+		cp = 0xFFFD;
+
+	*ucs = cp;
+	return need + 1;
+}
+
+/**
+ * rds_charset_encode - Convert UTF-8 text to RDS G0
+ * @out: output buffer
+ * @out_len: size of @out
+ * @in: UTF-8 input
+ * @in_len: bytes on @in, conversion also stops on NULL
+ *
+ * Output is not NULL terminated and never longer than the input.
+ * Control codes and anything we can't map become spaces.
+ *
+ * Returns: number of bytes written on @out
+ */
+int
+rds_charset_encode(uint8_t *out, int out_len, const char *in, int in_len)
+{
+	const uint8_t *src = (const uint8_t *) in;
+	const struct g0_translit *tr = NULL;
+	const uint8_t *ascii = NULL;
+	uint64_t word = 0;
+	uint32_t ucs = 0;
+	uint32_t next = 0;
+	uint16_t key = 0;
+	uint8_t page = 0;
+	uint8_t c = 0;
+	int ilen = 0;
+	int olen = 0;
+	int step = 0;
+	int i = 0;
+
+	pthread_once(&g0_pages_once, g0_pages_init);
+	ascii = g0_pages[0];
+
+	while(ilen < in_len && olen < out_len) {
+		/*
+		 * ASCII fast path: check 8 bytes at a time for
+		 * NULL or anything with the high bit set, if
+		 * there is none it's a plain table lookup
+		 */
+		if(in_len - ilen >= 8 && out_len - olen >= 8) {
+			memcpy(&word, src + ilen, 8);
+			if(!(word & 0x8080808080808080ULL) &&
+			!((word - 0x0101010101010101ULL) & ~word &
+						0x8080808080808080ULL)) {
+				for(i = 0; i < 8; i++) {
+					c = ascii[src[ilen + i]];
+					out[olen + i] = c ? c : ' ';
+				}
+				ilen += 8;
+				olen += 8;
+				continue;
+			}
+		}
+
+		if(src[ilen] == '\0')
+			break;
+
+		ilen += utf8_decode(src + ilen, in_len - ilen, &ucs);
+
+		/* Combining diacritics, just drop them */
+		if(ucs >= 0x0300 && ucs <= 0x036F)
+			continue;
+
+		/* Peek at the next one for Greek digraphs */
+		next = 0;
+		step = 0;
+		if(ucs >= 0x0386 && ucs <= 0x03CE && ilen < in_len)
+			step = utf8_decode(src + ilen, in_len - ilen, &next);
+
+		/* ELOT 743 writes ου as "ou", not "oy" */
+		if((ucs == 0x039F || ucs == 0x03BF) &&
+		(next == 0x03A5 || next == 0x038E ||
+		next == 0x03C5 || next == 0x03CD)) {
+			out[olen++] = (ucs == 0x039F) ? 'O' : 'o';
+			if(olen < out_len)
+				out[olen++] = (next < 0x03AC) ? 'U' : 'u';
+			ilen += step;
+			continue;
+		}
+
+		page = g0_page(ucs);
+		if(page != G0_PAGE_NONE) {
+			if(g0_pages[page][ucs & 0xFF]) {
+				out[olen++] = g0_pages[page][ucs & 0xFF];
+				continue;
+			}
+
+			key = ucs;
+			tr = bsearch(&key, g0_translit, G0_NUM_TRANSLIT,
+				sizeof(struct g0_translit), g0_translit_cmp);
+			if(tr) {
+				for(i = 0; tr->str[i] && olen < out_len; i++)
+					out[olen++] = tr->str[i];
+
+				/* Θέα -> Thea, not THea */
+				if(i == 2 && next >= 0x03AC && next <= 0x03CE)
+					out[olen - 1] |= 0x20;
+				continue;
+			}
+		}
+
+		out[olen++] = ' ';
+	}
+
+	return olen;
+}
+
+/**
+ * rds_charset_g0_to_ucs - Get the Unicode code point of a G0 character
+ * @c: the G0 character
+ *
+ * Returns: the code point or 0 if @c is a control code / unused
+ */
+uint16_t
+rds_charset_g0_to_ucs(uint8_t c)
+{
+	return g0_to_ucs[c];
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_charset.h -	UTF-8 to RDS character set conversion
+ */
+
+/**
+ * DOC: Character set
+ *
+ * Text fields (PS, RT, PTYN) are transmitted using the RDS basic
+ * character set, the "G0" table of IEC 62106 Annex E (a.k.a EBU
+ * Latin). It's mostly ASCII on 0x20 - 0x7D plus accented latin
+ * letters and a few symbols on 0x80 - 0xFE.
+ *
+ * The rds_set_ps / rds_set_rt / rds_set_ptyn calls accept UTF-8
+ * and convert it here, so &struct rds_cmd and the shadow state
+ * always hold G0 encoded text (that's also what the rds_get_*
+ * calls return). Code points that are not on G0 get transliterated
+ * (e.g. Greek goes to ELOT 743 latin) or replaced with a space.
+ *
+ * We don't switch to the G1/G2 tables, that needs in-band escape
+ * sequences that eat up characters from the 8 char PS and most
+ * receivers out there don't understand them anyway.
+ */
+
+/* Unused / control positions of G0 */
+#define RDS_G0_PRINTABLE(_c)	((uint8_t)(_c) >= 0x20 && \
+				(uint8_t)(_c) != 0x7F && \
+				(uint8_t)(_c) != 0xFF)
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+int
+rds_charset_encode(uint8_t *out, int out_len, const char *in, int in_len);
+
+uint16_t
+rds_charset_g0_to_ucs(uint8_t c);
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_client.c -	rdsd client, link with this (plus rds_cmd.c,
+ *			rds_charset.c and rds_rtplus.c) instead of rds.c
+ *			and the backends to control an encoder owned by
+ *			rdsd (see rdsd.h)
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <stdlib.h>	/* For malloc/free / getenv() */
+#include <string.h>	/* For memset() / strncpy() */
+#include <unistd.h>	/* For close() */
+#include <pthread.h>	/* For pthread_mutex_* */
+#include <sys/socket.h>	/* For socket() / send() / recv() */
+#include <sys/un.h>	/* For struct sockaddr_un */
+#include "rds.h"
+#include "rdsd.h"
+
+/* Per connection state, on enc->priv */
+struct rds_client {
+	pthread_mutex_t lock;		/* One request at a time */
+};
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+/**
+ * rds_client_call - Send a request to rdsd and wait for the reply
+ * @enc: pointer to &struct rds_encoder
+ * @req: the &struct rdsd_req
+ * @rep: the &struct rdsd_rep to fill
+ */
+static int
+rds_client_call(struct rds_encoder *enc, const struct rdsd_req *req,
+						struct rdsd_rep *rep)
+{
+	struct rds_client *cl = enc->priv;
+	ssize_t ret = 0;
+
+	pthread_mutex_lock(&cl->lock);
+
+	do {
+		ret = send(enc->serial_fd, req, sizeof(struct rdsd_req),
+							MSG_NOSIGNAL);
+	} while(ret < 0 && errno == EINTR);
+
+	if(ret < 0) {
+		ret = -errno;
+		goto out;
+	}
+
+	do {
+		ret = recv(enc->serial_fd, rep, sizeof(struct rdsd_rep), 0);
+	} while(ret < 0 && errno == EINTR);
+
+	if(ret < 0)
+		ret = -errno;
+	else if(ret != sizeof(struct rdsd_rep))
+		ret = -EPIPE;
+	else
+		ret = 0;
+
+ out:
+	pthread_mutex_unlock(&cl->lock);
+	return ret;
+}
+
+
+/**************\
+* ENTRY POINTS *
+\**************/
+
+/**
+ * rds_cmd_run - Run a command on the encoder, through rdsd
+ * @enc: pointer to &struct rds_encoder
+ * @cmd: the &struct rds_cmd to run, results are stored back here
+ */
+int
+rds_cmd_run(struct rds_encoder *enc, struct rds_cmd *cmd)
+{
+	struct rdsd_req req;
+	struct rdsd_rep rep;
+	int ret = 0;
+
+	memset(&req, 0, sizeof(struct rdsd_req));
+	req.type = RDSD_REQ_CMD;
+	req.cmd = *cmd;
+
+	ret = rds_client_call(enc, &req, &rep);
+	if(ret < 0)
+		return ret;
+
+	if(rep.ret >= 0 && !RDS_CMD_IS_SET(cmd->op))
+		*cmd = rep.cmd;
+
+	return rep.ret;
+}
+
+/**
+ * rds_init - Connect to the encoder rdsd has on a port
+ * @type: ignored, rdsd knows it
+ * @site_addr: ignored
+ * @enc_addr: ignored
+ * @port: the port the encoder is on, as given to rdsd
+ *
+ * The socket is RDSD_SOCKET_PATH, or what RDSD_SOCKET_ENV says.
+ */
+struct rds_encoder *
+rds_init(uint8_t type, uint16_t site_addr, uint16_t enc_addr,
+				const unsigned char* port)
+{
+	struct rds_encoder *enc = NULL;
+	struct rds_client *cl = NULL;
+	struct sockaddr_un sun;
+	struct rdsd_req req;
+	struct rdsd_rep rep;
+	const char *path = NULL;
+	int ret = 0;
+
+	if(!port || strlen((const char *) port) >= RDSD_PORT_LEN) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	path = getenv(RDSD_SOCKET_ENV);
+	if(!path)
+		path = RDSD_SOCKET_PATH;
+
+	memset(&sun, 0, sizeof(struct sockaddr_un));
+	sun.sun_family = AF_UNIX;
+	strncpy(sun.sun_path, path, sizeof(sun.sun_path) - 1);
+
+	enc = malloc(sizeof(struct rds_encoder));
+	cl = malloc(sizeof(struct rds_client));
+	if(!enc || !cl) {
+		ret = ENOMEM;
+		goto cleanup;
+	}
+	memset(enc, 0, sizeof(struct rds_encoder));
+	enc->type = type;
+	enc->priv = cl;
+	pthread_mutex_init(&cl->lock, NULL);
+
+	enc->serial_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if(enc->serial_fd < 0) {
+		ret = errno;
+		goto cleanup;
+	}
+
+	if(connect(enc->serial_fd, (struct sockaddr *) &sun,
+				sizeof(struct sockaddr_un)) < 0) {
+		ret = errno;
+		goto cleanup;
+	}
+
+	memset(&req, 0, sizeof(struct rdsd_req));
+	req.type = RDSD_REQ_OPEN;
+	strcpy(req.port, (const char *) port);
+
+	ret = rds_client_call(enc, &req, &rep);
+	if(ret == 0)
+		ret = rep.ret;
+	if(ret < 0) {
+		ret = -ret;
+		goto cleanup;
+	}
+
+	return enc;
+
+ cleanup:
+	if(enc && enc->serial_fd > 0)
+		close(enc->serial_fd);
+	free(cl);
+	free(enc);
+	errno = ret;
+	return NULL;
+}
+
+int
+rds_exit(struct rds_encoder *enc)
+{
+	struct rds_client *cl = enc->priv;
+
+	close(enc->serial_fd);
+	pthread_mutex_destroy(&cl->lock);
+	free(cl);
+	free(enc);
+	return 0;
+}
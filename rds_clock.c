@@ -0,0 +1,491 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_clock.c -	Keeping the encoder's clock (CT) in sync
+ */
+
+#define _GNU_SOURCE	/* For timegm() / tm_gmtoff */
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <stdlib.h>	/* For malloc/free / llabs() */
+#include <string.h>	/* For memset() */
+#include <time.h>	/* For clock_gettime() / gmtime_r() */
+#include <pthread.h>	/* For pthread_* */
+#include "rds.h"
+#include "rds_thread.h"
+#include "rds_clock.h"
+
+
+/* What rds_clock_sync_fn() works on */
+struct rds_clock_req {
+	uint64_t at_ns;			/* Boundary (CLOCK_REALTIME) */
+	int8_t offset;
+	uint32_t latency_us;
+};
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+/**
+ * rds_clock_ns - Read a clock in ns
+ * @clk: CLOCK_REALTIME or CLOCK_MONOTONIC
+ */
+static uint64_t
+rds_clock_ns(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * rds_clock_sleep_until - Sleep until a CLOCK_REALTIME time
+ * @ns: the time
+ */
+static void
+rds_clock_sleep_until(uint64_t ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+	while(clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts,
+							NULL) == EINTR);
+}
+
+/**
+ * rds_clock_step_s - Get the boundaries an encoder's clock can be set on
+ * @enc: pointer to &struct rds_encoder
+ *
+ * Prais has no seconds field, its clock starts from hh:mm:00.
+ */
+static uint8_t
+rds_clock_step_s(struct rds_encoder *enc)
+{
+	return (enc->type == RDS_ENCODER_TYPE_PRAIS) ? 60 : 1;
+}
+
+/**
+ * rds_clock_plan - Find the next boundary that leaves us enough time
+ * @step_s: boundaries are on multiples of this
+ * @lead_ms: how much time we need
+ *
+ * Returns: the boundary (CLOCK_REALTIME ns)
+ */
+static uint64_t
+rds_clock_plan(uint8_t step_s, uint32_t lead_ms)
+{
+	uint64_t step_ns = (uint64_t) step_s * 1000000000;
+	uint64_t t = rds_clock_ns(CLOCK_REALTIME) + (uint64_t) lead_ms * 1000000;
+
+	return (t / step_ns + 1) * step_ns;
+}
+
+/**
+ * rds_clock_fill - Fill an RTC frame with a (whole second) time
+ * @rtc: the &struct rds_rtc to fill
+ * @at_ns: the time (CLOCK_REALTIME ns)
+ * @offset: local offset in hours, or RDS_CLOCK_OFFSET_LOCAL
+ */
+static void
+rds_clock_fill(struct rds_rtc *rtc, uint64_t at_ns, int8_t offset)
+{
+	time_t t = at_ns / 1000000000;
+	struct tm tm;
+
+	if(offset == RDS_CLOCK_OFFSET_LOCAL) {
+		localtime_r(&t, &tm);
+		offset = tm.tm_gmtoff / 3600;
+	}
+
+	gmtime_r(&t, &tm);
+
+	memset(rtc, 0, sizeof(struct rds_rtc));
+	rtc->year = tm.tm_year + 1900;
+	rtc->month = tm.tm_mon + 1;
+	rtc->day = tm.tm_mday;
+	rtc->hours = tm.tm_hour;
+	rtc->minutes = tm.tm_min;
+	rtc->seconds = tm.tm_sec;
+	rtc->offset = offset;
+}
+
+/**
+ * rds_clock_sync_fn - Send the time, so that it arrives on the boundary,
+ *		       with the encoder to ourselves
+ * @enc: pointer to &struct rds_encoder
+ * @arg: the &struct rds_clock_req
+ *
+ * Returns: 0, -EAGAIN if we got here too late for the boundary, or
+ * a negative error code
+ */
+static int
+rds_clock_sync_fn(struct rds_encoder *enc, void *arg)
+{
+	struct rds_clock_req *req = arg;
+	struct rds_cmd cmd;
+	uint64_t send_at_ns = 0;
+	int ret = 0;
+
+	send_at_ns = req->at_ns - (uint64_t) req->latency_us * 1000;
+	if(rds_clock_ns(CLOCK_REALTIME) + RDS_CLOCK_MARGIN_MS * 1000000ULL >
+								send_at_ns)
+		return -EAGAIN;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_RTC, 0, 0);
+	rds_clock_fill(&cmd.arg.rtc, req->at_ns, req->offset);
+
+	/* No port to hold the frame on, wait here */
+	if(enc->type == RDS_ENCODER_TYPE_SOFT)
+		rds_clock_sleep_until(send_at_ns);
+	else
+		enc->send_at_ns = send_at_ns;
+
+	ret = rds_cmd_exec(enc, &cmd);
+
+	/* In case it failed before sending anything */
+	enc->send_at_ns = 0;
+
+	return ret;
+}
+
+/**
+ * rds_clock_read_fn - Compare the encoder's clock with ours, with the
+ *		       encoder to ourselves
+ * @enc: pointer to &struct rds_encoder
+ * @arg: int32_t, filled with encoder - system in ms
+ */
+static int
+rds_clock_read_fn(struct rds_encoder *enc, void *arg)
+{
+	int32_t *error_ms = arg;
+	struct rds_cmd cmd;
+	struct tm tm;
+	int64_t enc_ms = 0;
+	int64_t now_ms = 0;
+	int ret = 0;
+
+	rds_cmd_init(&cmd, RDS_CMD_GET_RTC, 0, 0);
+	ret = rds_cmd_dispatch(enc, &cmd);
+	if(ret < 0)
+		return ret;
+	now_ms = rds_clock_ns(CLOCK_REALTIME) / 1000000;
+
+	memset(&tm, 0, sizeof(struct tm));
+	tm.tm_year = cmd.arg.rtc.year - 1900;
+	tm.tm_mon = cmd.arg.rtc.month - 1;
+	tm.tm_mday = cmd.arg.rtc.day;
+	tm.tm_hour = cmd.arg.rtc.hours;
+	tm.tm_min = cmd.arg.rtc.minutes;
+	tm.tm_sec = cmd.arg.rtc.seconds;
+
+	enc_ms = (int64_t) timegm(&tm) * 1000 + cmd.arg.rtc.centiseconds * 10;
+	*error_ms = enc_ms - now_ms;
+
+	return 0;
+}
+
+/**
+ * rds_clock_interval_ns - Get the time until the next sync
+ * @c: the &struct rds_clock
+ */
+static uint64_t
+rds_clock_interval_ns(struct rds_clock *c)
+{
+	uint64_t s = RDS_CLOCK_INTERVAL_MAX_S;
+
+	if(c->drift_ppm)
+		s = (uint64_t) c->tolerance_ms * 1000 / c->drift_ppm;
+
+	if(s < RDS_CLOCK_INTERVAL_MIN_S)
+		s = RDS_CLOCK_INTERVAL_MIN_S;
+	else if(s > RDS_CLOCK_INTERVAL_MAX_S)
+		s = RDS_CLOCK_INTERVAL_MAX_S;
+
+	return s * 1000000000;
+}
+
+/**
+ * rds_clock_measure - Measure the encoder's drift since the last sync
+ * @c: the &struct rds_clock
+ *
+ * Only if the backend can read the clock back, else we stay
+ * with the drift we were given.
+ */
+static void
+rds_clock_measure(struct rds_clock *c)
+{
+	uint64_t elapsed_ns = 0;
+	int32_t error_ms = 0;
+	uint64_t ppm = 0;
+
+	if(!c->enc->get_rtc || !c->last_sync_ns)
+		return;
+
+	if(rds_thread_run(c->enc, rds_clock_read_fn, &error_ms) < 0)
+		return;
+
+	elapsed_ns = rds_clock_ns(CLOCK_REALTIME) - c->last_sync_ns;
+	if(elapsed_ns < 1000000000)
+		return;
+
+	c->last_error_ms = error_ms;
+	ppm = (uint64_t) llabs(error_ms) * 1000000000 / elapsed_ns;
+	c->drift_ppm = (ppm > 0xFFFF) ? 0xFFFF : (ppm ? ppm : 1);
+}
+
+/**
+ * rds_clock_wait - Wait on the daemon's condition for some time
+ * @c: the &struct rds_clock (locked)
+ * @ns: how long
+ */
+static void
+rds_clock_wait(struct rds_clock *c, uint64_t ns)
+{
+	struct timespec deadline;
+
+	ns += rds_clock_ns(CLOCK_MONOTONIC);
+	deadline.tv_sec = ns / 1000000000;
+	deadline.tv_nsec = ns % 1000000000;
+
+	if(!c->stop)
+		pthread_cond_timedwait(&c->cond, &c->lock, &deadline);
+}
+
+/**
+ * rds_clock_thread_fn - Main loop of the daemon's thread
+ * @arg: the &struct rds_clock
+ */
+static void *
+rds_clock_thread_fn(void *arg)
+{
+	struct rds_clock *c = arg;
+	struct rds_clock_req req;
+	uint64_t lead_ns = RDS_CLOCK_LEAD_MS * 1000000ULL;
+	uint64_t now = 0;
+	int64_t base = 0;
+	int ret = 0;
+
+	pthread_mutex_lock(&c->lock);
+
+	while(!c->stop) {
+		now = rds_clock_ns(CLOCK_REALTIME);
+		base = now - rds_clock_ns(CLOCK_MONOTONIC);
+
+		/* System clock got stepped, the encoder is off now */
+		if(c->syncs && llabs(base - c->base_ns) >
+		(int64_t) c->tolerance_ms * 1000000) {
+			c->steps++;
+			c->base_ns = base;
+			c->next_sync_ns = 0;
+		}
+
+		if(now + lead_ns < c->next_sync_ns) {
+			now = c->next_sync_ns - lead_ns - now;
+			rds_clock_wait(c, now < RDS_CLOCK_CHECK_MS * 1000000ULL ?
+					now : RDS_CLOCK_CHECK_MS * 1000000ULL);
+			continue;
+		}
+
+		/* Wake up shortly before the boundary */
+		req.at_ns = rds_clock_plan(c->step_s, RDS_CLOCK_LEAD_MS +
+							RDS_CLOCK_MARGIN_MS);
+		req.offset = c->offset;
+		req.latency_us = c->latency_us;
+
+		now = rds_clock_ns(CLOCK_REALTIME);
+		if(req.at_ns - lead_ns > now)
+			rds_clock_wait(c, req.at_ns - lead_ns - now);
+		if(c->stop)
+			break;
+
+		pthread_mutex_unlock(&c->lock);
+		rds_clock_measure(c);
+		ret = rds_thread_run(c->enc, rds_clock_sync_fn, &req);
+		pthread_mutex_lock(&c->lock);
+
+		/* The I/O thread was busy, go for the next one */
+		if(ret == -EAGAIN)
+			continue;
+
+		if(ret < 0) {
+			c->failures++;
+			c->next_sync_ns = rds_clock_ns(CLOCK_REALTIME) +
+					RDS_CLOCK_RETRY_MS * 1000000ULL;
+			continue;
+		}
+
+		c->syncs++;
+		c->last_sync_ns = req.at_ns;
+		c->base_ns = rds_clock_ns(CLOCK_REALTIME) -
+				rds_clock_ns(CLOCK_MONOTONIC);
+		c->next_sync_ns = req.at_ns + rds_clock_interval_ns(c);
+	}
+
+	pthread_mutex_unlock(&c->lock);
+
+	return NULL;
+}
+
+
+/**************\
+* ENTRY POINTS *
+\**************/
+
+/**
+ * rds_clock_sync - Set the encoder's clock, once
+ * @enc: pointer to &struct rds_encoder
+ * @offset: local offset in hours, or RDS_CLOCK_OFFSET_LOCAL
+ * @latency_us: the encoder's processing time, if known
+ *
+ * Waits for the next boundary the encoder's clock can be set
+ * on (up to a minute on Prais).
+ */
+int
+rds_clock_sync(struct rds_encoder *enc, int8_t offset, uint32_t latency_us)
+{
+	struct rds_clock_req req;
+	int ret = -EAGAIN;
+	int i = 0;
+
+	if(!enc->set_rtc)
+		return -EOPNOTSUPP;
+
+	req.offset = offset;
+	req.latency_us = latency_us;
+
+	for(i = 0; i < 2 && ret == -EAGAIN; i++) {
+		req.at_ns = rds_clock_plan(rds_clock_step_s(enc),
+				RDS_CLOCK_LEAD_MS + RDS_CLOCK_MARGIN_MS);
+
+		rds_clock_sleep_until(req.at_ns -
+					RDS_CLOCK_LEAD_MS * 1000000ULL);
+
+		ret = rds_thread_run(enc, rds_clock_sync_fn, &req);
+	}
+
+	return ret;
+}
+
+/**
+ * rds_clock_start - Keep an encoder's clock in sync
+ * @enc: pointer to &struct rds_encoder
+ * @offset: local offset in hours, or RDS_CLOCK_OFFSET_LOCAL
+ * @latency_us: the encoder's processing time, if known
+ * @tolerance_ms: how far off we let it get, 0 for the default
+ * @drift_ppm: how fast its clock drifts (worst case), 0 for
+ *	the default
+ *
+ * The first sync happens on the first boundary.
+ *
+ * Returns: a &struct rds_clock or NULL and errno set
+ */
+struct rds_clock *
+rds_clock_start(struct rds_encoder *enc, int8_t offset, uint32_t latency_us,
+				uint16_t tolerance_ms, uint16_t drift_ppm)
+{
+	struct rds_clock *c = NULL;
+	pthread_condattr_t attr;
+	int ret = 0;
+
+	if(!enc) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if(!enc->set_rtc) {
+		errno = EOPNOTSUPP;
+		return NULL;
+	}
+
+	c = malloc(sizeof(struct rds_clock));
+	if(!c) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(c, 0, sizeof(struct rds_clock));
+
+	c->enc = enc;
+	c->step_s = rds_clock_step_s(enc);
+	c->offset = offset;
+	c->latency_us = latency_us;
+	c->tolerance_ms = tolerance_ms ? tolerance_ms :
+				RDS_CLOCK_TOLERANCE_MS_DEFAULT;
+	c->drift_ppm = drift_ppm ? drift_ppm : RDS_CLOCK_DRIFT_PPM_DEFAULT;
+
+	pthread_mutex_init(&c->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&c->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	if(!enc->io_thread && !enc->bus) {
+		ret = rds_thread_start(enc, 0);
+		if(ret < 0) {
+			ret = -ret;
+			goto cleanup;
+		}
+		c->started_thread = 1;
+	}
+
+	ret = pthread_create(&c->tid, NULL, rds_clock_thread_fn, c);
+	if(ret != 0)
+		goto cleanup;
+
+	return c;
+
+ cleanup:
+	if(c->started_thread)
+		rds_thread_stop(enc);
+	pthread_cond_destroy(&c->cond);
+	pthread_mutex_destroy(&c->lock);
+	free(c);
+	errno = ret;
+	return NULL;
+}
+
+/**
+ * rds_clock_stop - Stop keeping an encoder's clock in sync
+ * @c: the &struct rds_clock
+ *
+ * Waits for a sync in progress.
+ */
+void
+rds_clock_stop(struct rds_clock *c)
+{
+	if(!c)
+		return;
+
+	pthread_mutex_lock(&c->lock);
+	c->stop = 1;
+	pthread_cond_signal(&c->cond);
+	pthread_mutex_unlock(&c->lock);
+
+	pthread_join(c->tid, NULL);
+
+	if(c->started_thread)
+		rds_thread_stop(c->enc);
+
+	pthread_cond_destroy(&c->cond);
+	pthread_mutex_destroy(&c->lock);
+	free(c);
+}
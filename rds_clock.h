@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_clock.h -	Keeping the encoder's clock (CT) in sync
+ */
+
+/**
+ * DOC: Clock sync
+ *
+ * Receivers show the time the encoder sends on CT groups, so the
+ * encoder's clock must be right to the second. Setting it is not
+ * instant: the frame takes its wire time to go out (about 1ms per
+ * byte at 9600 baud, 20 - 70ms for an RTC frame) and the encoder
+ * takes some time to act on it.
+ *
+ * A clock sync reads the system clock (CLOCK_REALTIME, i.e. UTC),
+ * picks the next boundary the encoder's clock can be set on (a
+ * second, or a minute on Prais which has no seconds field), fills
+ * the RTC frame with that time and holds it (see rds_send_buf())
+ * so that its last byte goes out latency_us before the boundary.
+ *
+ * After that the encoder's clock drifts on its own. A clock sync
+ * daemon (rds_clock_start()) syncs it again before it can drift
+ * more than tolerance_ms: if the backend can read the clock back
+ * we measure the drift on every sync, else we assume drift_ppm.
+ * It also resyncs right away when the system clock is stepped
+ * (e.g. by NTP) by more than the tolerance.
+ *
+ * The encoder is put in threaded mode (if it isn't already), the
+ * daemon only waits on its own thread and hands the encoder the
+ * frame shortly before the boundary.
+ */
+
+#define RDS_CLOCK_TOLERANCE_MS_DEFAULT	100
+#define RDS_CLOCK_DRIFT_PPM_DEFAULT	50
+
+/* Limits on the time between syncs */
+#define RDS_CLOCK_INTERVAL_MIN_S	60
+#define RDS_CLOCK_INTERVAL_MAX_S	86400
+
+/* The frame goes to the I/O thread this long before the boundary,
+ * and needs at least RDS_CLOCK_MARGIN_MS left when it gets there
+ * (the worst case wire time, plus some) */
+#define RDS_CLOCK_LEAD_MS		1000
+#define RDS_CLOCK_MARGIN_MS		250
+
+/* How often we check for system clock steps, and how long we
+ * wait to try again after a failed sync */
+#define RDS_CLOCK_CHECK_MS		10000
+#define RDS_CLOCK_RETRY_MS		30000
+
+/* Take the local offset from the system's time zone */
+#define RDS_CLOCK_OFFSET_LOCAL		127
+
+struct rds_clock {
+	struct rds_encoder *enc;
+	uint8_t started_thread;		/* We put it in threaded mode */
+	uint8_t step_s;			/* Boundaries it can be set on */
+
+	/* Config */
+	int8_t offset;			/* Local offset in hours, or
+					 * RDS_CLOCK_OFFSET_LOCAL */
+	uint32_t latency_us;		/* Encoder's processing time */
+	uint16_t tolerance_ms;
+	uint16_t drift_ppm;		/* Measured, if we can */
+
+	pthread_t tid;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint8_t stop;
+
+	uint64_t last_sync_ns;		/* Boundary of the last sync (CLOCK_REALTIME) */
+	uint64_t next_sync_ns;
+	int64_t base_ns;		/* CLOCK_REALTIME - CLOCK_MONOTONIC then */
+
+	/* Stats */
+	uint32_t syncs;
+	uint32_t failures;
+	uint32_t steps;			/* System clock steps we resynced for */
+	int32_t last_error_ms;		/* Encoder - system, before the last
+					 * sync (if it can be read back) */
+};
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+int rds_clock_sync(struct rds_encoder *enc, int8_t offset,
+						uint32_t latency_us);
+
+struct rds_clock *rds_clock_start(struct rds_encoder *enc, int8_t offset,
+			uint32_t latency_us, uint16_t tolerance_ms,
+			uint16_t drift_ppm);
+void rds_clock_stop(struct rds_clock *c);
@@ -0,0 +1,931 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_cmd.c -	The rds_get_* / rds_set_* calls, on top of rds_cmd_run()
+ *		(shared by the library and the rdsd client, see rds_client.c)
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <string.h>	/* For memset() / memcpy() / strlen() */
+#include "rds.h"
+#include "rds_charset.h"
+
+
+/**********\
+* COMMANDS *
+\**********/
+
+/**
+ * rds_cmd_init - Initialize a command
+ * @cmd: the &struct rds_cmd to initialize
+ * @op: RDS_CMD_* command code
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ */
+void
+rds_cmd_init(struct rds_cmd *cmd, uint8_t op, uint8_t dsn, uint8_t psn)
+{
+	memset(cmd, 0, sizeof(struct rds_cmd));
+	cmd->op = op;
+	cmd->dsn = dsn;
+	cmd->psn = psn;
+}
+
+/**
+ * rds_get_pi -	Get Programme Identifier information
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @pi: pointer to &struct rds_pi to fill
+ */
+int
+rds_get_pi(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, struct rds_pi *pi)
+{
+	struct rds_cmd cmd;
+	int ret = 0;
+
+	rds_cmd_init(&cmd, RDS_CMD_GET_PI, dsn, psn);
+
+	ret = rds_cmd_run(enc, &cmd);
+	if(ret >= 0)
+		*pi = cmd.arg.pi;
+
+	return ret;
+}
+
+/**
+ * rds_set_pi -	Set Programme Identifier information
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @pi: pointer to &struct rds_pi containing the infos
+ */
+int
+rds_set_pi(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, struct rds_pi *pi)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_PI, dsn, psn);
+	cmd.arg.pi = *pi;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_get_ps -	Get Programme Service name
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: message group (1-2)
+ * @psn: message id (0-14) (only one supported so always 0)
+ * @ps: a pre-allocated 8byte char array to fill
+ */
+int
+rds_get_ps(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, char* ps)
+{
+	struct rds_cmd cmd;
+	int ret = 0;
+
+	rds_cmd_init(&cmd, RDS_CMD_GET_PS, dsn, psn);
+
+	ret = rds_cmd_run(enc, &cmd);
+	if(ret >= 0)
+		memcpy(ps, cmd.arg.ps, RDS_PS_LEN);
+
+	return ret;
+}
+
+/**
+ * rds_set_ps -	Set Programme Service name
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: message group (1-2)
+ * @psn: message id (0-14) (only one supported so always 0)
+ * @ps: PS name to set (UTF-8, see rds_charset.h)
+ */
+int
+rds_set_ps(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, char* ps)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_PS, dsn, psn);
+	rds_charset_encode((uint8_t *) cmd.arg.ps, RDS_PS_LEN, ps, strlen(ps));
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_get_rt -	Get RadioText message
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @rt: the &struct rds_rt to fill
+ */
+int
+rds_get_rt(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, struct rds_rt *rt)
+{
+	struct rds_cmd cmd;
+	int ret = 0;
+
+	rds_cmd_init(&cmd, RDS_CMD_GET_RT, dsn, psn);
+
+	ret = rds_cmd_run(enc, &cmd);
+	if(ret >= 0)
+		*rt = cmd.arg.rt;
+
+	return ret;
+}
+
+/**
+ * rds_set_rt -	Set RadioText message
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @rt: the &struct rds_rt to send (UTF-8 message, see rds_charset.h)
+ */
+int
+rds_set_rt(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, struct rds_rt *rt)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_RT, dsn, psn);
+	cmd.arg.rt.ab_flag = rt->ab_flag;
+	cmd.arg.rt.retransmissions = rt->retransmissions;
+	cmd.arg.rt.buffer_config = rt->buffer_config;
+	rds_charset_encode(cmd.arg.rt.msg, RDS_RT_MSG_LEN_MAX - 1,
+			(char *) rt->msg, strnlen((char *) rt->msg,
+						RDS_RT_MSG_LEN_MAX));
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_get_di - Get decoder info field
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ */
+int
+rds_get_di(struct rds_encoder *enc, uint8_t dsn, uint8_t psn)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_GET_DI, dsn, psn);
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_set_di - Set decoder info field
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @di: RDS_DI_* flags
+ */
+int
+rds_set_di(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t di)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_DI, dsn, psn);
+	cmd.arg.val = di;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_get_dynpty - Get dynamic PTY indicator
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ */
+int
+rds_get_dynpty(struct rds_encoder *enc, uint8_t dsn, uint8_t psn)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_GET_DYNPTY, dsn, psn);
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_set_dynpty - Set dynamic PTY indicator
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @dynpty: 1 -> Enabled, 0 -> Disabled
+ */
+int
+rds_set_dynpty(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t dynpty)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_DYNPTY, dsn, psn);
+	cmd.arg.val = dynpty;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_set_ta_tp - Get TA/TP status
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ */
+int
+rds_get_ta_tp(struct rds_encoder *enc, uint8_t dsn, uint8_t psn)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_GET_TA_TP, dsn, psn);
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_set_ta_tp - Set TA/TP status
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @ta_tp: RDS_TATP_* status flags
+ */
+int
+rds_set_ta_tp(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t ta_tp)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_TA_TP, dsn, psn);
+	cmd.arg.val = ta_tp;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_get_ms - Get M/S switch status
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ */
+int
+rds_get_ms(struct rds_encoder *enc, uint8_t dsn, uint8_t psn)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_GET_MS, dsn, psn);
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_set_ms - Set M/S switch status
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @ms: RDS_MS_* status flags
+ */
+int
+rds_set_ms(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t ms)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_MS, dsn, psn);
+	cmd.arg.val = ms;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_get_pty - Get Programme Type
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ */
+int
+rds_get_pty(struct rds_encoder *enc, uint8_t dsn, uint8_t psn)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_GET_PTY, dsn, psn);
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_set_pty - Set Programme Type
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @pty: The pty (0 - 19) to set
+ */
+int
+rds_set_pty(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t pty)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_PTY, dsn, psn);
+	cmd.arg.val = pty;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_get_ptyn - Get Programme Type Name
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @ptyn: pre-allocated PTY name string to fill
+ */
+int
+rds_get_ptyn(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, char* ptyn)
+{
+	struct rds_cmd cmd;
+	int ret = 0;
+
+	rds_cmd_init(&cmd, RDS_CMD_GET_PTYN, dsn, psn);
+
+	ret = rds_cmd_run(enc, &cmd);
+	if(ret >= 0)
+		memcpy(ptyn, cmd.arg.ptyn, RDS_PTYN_LEN);
+
+	return ret;
+}
+
+/**
+ * rds_set_ptyn - Set Programme Type Name
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @ptyn: PTY name string to set (UTF-8, see rds_charset.h)
+ */
+int
+rds_set_ptyn(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, char* ptyn)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_PTYN, dsn, psn);
+	rds_charset_encode((uint8_t *) cmd.arg.ptyn, RDS_PTYN_LEN,
+						ptyn, strlen(ptyn));
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_get_ct - Get transmission status of RTC
+ * @enc: pointer to &struct rds_encoder
+ */
+int
+rds_get_ct(struct rds_encoder *enc)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_GET_CT, 0, 0);
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_set_ct - Enable/disable transmission of RTC
+ * @enc: pointer to &struct rds_encoder
+ * @ct: 0 -> disable, 1 -> enable
+ */
+int
+rds_set_ct(struct rds_encoder *enc, uint8_t ct)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_CT, 0, 0);
+	cmd.arg.val = ct;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_get_rtc - Set Real Time Clock settings on the device
+ * @enc: pointer to &struct rds_encoder
+ * @rtc: the &struct rds_rtc to fill
+ */
+int
+rds_get_rtc(struct rds_encoder *enc, struct rds_rtc *rtc)
+{
+	struct rds_cmd cmd;
+	int ret = 0;
+
+	rds_cmd_init(&cmd, RDS_CMD_GET_RTC, 0, 0);
+
+	ret = rds_cmd_run(enc, &cmd);
+	if(ret >= 0)
+		*rtc = cmd.arg.rtc;
+
+	return ret;
+}
+
+/**
+ * rds_set_rtc - Set Real Time Clock settings on the device
+ * @enc: pointer to &struct rds_encoder
+ * @rtc: the &struct rds_rtc to send
+ */
+int
+rds_set_rtc(struct rds_encoder *enc, struct rds_rtc *rtc)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_RTC, 0, 0);
+	cmd.arg.rtc = *rtc;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_get_rds_on - Get the encoder's RDS output status
+ * @enc: pointer to &struct rds_encoder
+ */
+int
+rds_get_rds_on(struct rds_encoder *enc)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_GET_RDS_ON, 0, 0);
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_set_rds_on - Set encoder's RDS output status
+ * @enc: pointer to &struct rds_encoder
+ * @on: 1 -> Enable, 0 -> Disable
+ */
+int
+rds_set_rds_on(struct rds_encoder *enc, uint8_t on)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_RDS_ON, 0, 0);
+	cmd.arg.val = on;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_get_rtplus - Get RadioText and its RT+ tags
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @rtplus: the &struct rds_rtplus to fill
+ */
+int
+rds_get_rtplus(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+					struct rds_rtplus *rtplus)
+{
+	struct rds_cmd cmd;
+	int ret = 0;
+
+	rds_cmd_init(&cmd, RDS_CMD_GET_RTPLUS, dsn, psn);
+
+	ret = rds_cmd_run(enc, &cmd);
+	if(ret >= 0)
+		*rtplus = cmd.arg.rtplus;
+
+	return ret;
+}
+
+/**
+ * rds_set_rtplus - Set RadioText together with its RT+ tags
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @rtplus: the &struct rds_rtplus to send (G0 message, as filled
+ *	by rds_rtplus_build()), the item toggle bit used is returned
+ *	on it
+ *
+ * See rds_rtplus.h
+ */
+int
+rds_set_rtplus(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+					struct rds_rtplus *rtplus)
+{
+	struct rds_cmd cmd;
+	int ret = 0;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_RTPLUS, dsn, psn);
+	cmd.arg.rtplus = *rtplus;
+	cmd.arg.rtplus.rt.msg[RDS_RT_MSG_LEN_MAX - 1] = '\0';
+
+	ret = rds_cmd_run(enc, &cmd);
+	if(ret >= 0)
+		rtplus->toggle = cmd.arg.rtplus.toggle;
+
+	return ret;
+}
+
+/**
+ * rds_get_af - Get an Alternative Frequencies list
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @idx: the list (0 on method A)
+ * @list: the &struct rds_af_list to fill
+ *
+ * Returns: the AF method (RDS_AF_METHOD_*) or a negative error
+ * code, -ENOENT if there's no such list
+ */
+int
+rds_get_af(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t idx,
+					struct rds_af_list *list)
+{
+	struct rds_cmd cmd;
+	int ret = 0;
+
+	rds_cmd_init(&cmd, RDS_CMD_GET_AF, dsn, psn);
+	cmd.arg.af.idx = idx;
+
+	ret = rds_cmd_run(enc, &cmd);
+	if(ret >= 0)
+		*list = cmd.arg.af.list;
+
+	return ret;
+}
+
+/**
+ * rds_set_af - Set an Alternative Frequencies list
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @method: RDS_AF_METHOD_A or RDS_AF_METHOD_B, all lists of a
+ *	service use the same one (rds_clear_af() first to switch)
+ * @idx: the list, 0 on method A, 0 - RDS_AF_LISTS_MAX - 1 on B
+ * @list: the &struct rds_af_list to set
+ *
+ * Setting the same list again costs nothing, see rds_af.h
+ */
+int
+rds_set_af(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t method,
+				uint8_t idx, const struct rds_af_list *list)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_AF, dsn, psn);
+	cmd.arg.af.method = method;
+	cmd.arg.af.idx = idx;
+	cmd.arg.af.op = RDS_AF_OP_SET;
+	cmd.arg.af.list = *list;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_add_af - Add a frequency to an Alternative Frequencies list
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @idx: the list, it must exist on method B
+ * @khz: the frequency
+ * @regional: method B, it carries a regional variant
+ */
+int
+rds_add_af(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t idx,
+					uint32_t khz, uint8_t regional)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_AF, dsn, psn);
+	cmd.arg.af.idx = idx;
+	cmd.arg.af.op = RDS_AF_OP_ADD;
+	cmd.arg.af.list.num = 1;
+	cmd.arg.af.list.khz[0] = khz;
+	cmd.arg.af.list.regional = regional ? 1 : 0;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_del_af - Remove a frequency from an Alternative Frequencies list
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @idx: the list
+ * @khz: the frequency
+ */
+int
+rds_del_af(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t idx,
+					uint32_t khz)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_AF, dsn, psn);
+	cmd.arg.af.idx = idx;
+	cmd.arg.af.op = RDS_AF_OP_DEL;
+	cmd.arg.af.list.num = 1;
+	cmd.arg.af.list.khz[0] = khz;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_clear_af - Remove Alternative Frequencies lists
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @idx: the list, or RDS_AF_ALL
+ */
+int
+rds_clear_af(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t idx)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_AF, dsn, psn);
+	cmd.arg.af.idx = idx;
+	cmd.arg.af.op = RDS_AF_OP_CLEAR;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_get_eon - Get what we know about a service of another network
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: the service's Programme Service Number (1 - 255)
+ * @eon: the &struct rds_eon to fill
+ *
+ * Returns: the RDS_EON_* fields known or a negative error code,
+ * -ENOENT if there's no such service
+ */
+int
+rds_get_eon(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+					struct rds_eon *eon)
+{
+	struct rds_cmd cmd;
+	int ret = 0;
+
+	rds_cmd_init(&cmd, RDS_CMD_GET_EON, dsn, psn);
+
+	ret = rds_cmd_run(enc, &cmd);
+	if(ret >= 0)
+		*eon = cmd.arg.eon;
+
+	return ret;
+}
+
+/**
+ * rds_set_eon - Link / update a service of another network
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: the service's Programme Service Number (1 - 255)
+ * @eon: the &struct rds_eon, with the fields to set on eon->set
+ *
+ * Changes are held back until eon->push is set, rds_push_eon()
+ * is called or a TA/TP change comes, and then only what changed
+ * goes out (see rds_eon.h).
+ */
+int
+rds_set_eon(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+					const struct rds_eon *eon)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_EON, dsn, psn);
+	cmd.arg.eon = *eon;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_set_eon_ta_tp - Set TA/TP of a service of another network
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: the service's Programme Service Number (1 - 255)
+ * @ta_tp: RDS_TATP_* flags
+ *
+ * Goes out right away, together with anything else pending.
+ */
+int
+rds_set_eon_ta_tp(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+					uint8_t ta_tp)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_EON, dsn, psn);
+	cmd.arg.eon.set = RDS_EON_TA_TP;
+	cmd.arg.eon.ta_tp = ta_tp;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_del_eon - Unlink a service of another network
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: the service's Programme Service Number (1 - 255)
+ *
+ * Goes out right away, together with anything else pending.
+ */
+int
+rds_del_eon(struct rds_encoder *enc, uint8_t dsn, uint8_t psn)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_EON, dsn, psn);
+	cmd.arg.eon.set = RDS_EON_REMOVE;
+	cmd.arg.eon.push = 1;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_push_eon - Push pending changes of other networks' services
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ *
+ * Returns: the number of services pushed or a negative error code
+ */
+int
+rds_push_eon(struct rds_encoder *enc, uint8_t dsn)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_EON, dsn, 0);
+	cmd.arg.eon.push = 1;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_get_dsn - Get the active data set
+ * @enc: pointer to &struct rds_encoder
+ *
+ * Returns: the DSN or a negative error code, -ENODATA if we
+ * never selected one
+ */
+int
+rds_get_dsn(struct rds_encoder *enc)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_GET_DSN, 0, 0);
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_select_dsn - Switch to another data set
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: the data set, e.g. one loaded with rds_preload_profile()
+ *
+ * If its preload didn't finish yet, the rest of it goes out first.
+ */
+int
+rds_select_dsn(struct rds_encoder *enc, uint8_t dsn)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_DSN, 0, 0);
+	cmd.arg.val = dsn;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_set_psn_on - Enable / disable a service
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @on: 1 -> Enable, 0 -> Disable
+ */
+int
+rds_set_psn_on(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t on)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_PSN_ON, dsn, psn);
+	cmd.arg.val = on;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_get_addr - Get the address frames go to
+ * @enc: pointer to &struct rds_encoder
+ * @site_addr: filled with the site address (UECP)
+ * @enc_addr: filled with the encoder address
+ */
+int
+rds_get_addr(struct rds_encoder *enc, uint16_t *site_addr, uint16_t *enc_addr)
+{
+	struct rds_cmd cmd;
+	int ret = 0;
+
+	rds_cmd_init(&cmd, RDS_CMD_GET_ADDR, 0, 0);
+
+	ret = rds_cmd_run(enc, &cmd);
+	if(ret >= 0) {
+		*site_addr = cmd.arg.addr.site;
+		*enc_addr = cmd.arg.addr.enc;
+	}
+
+	return ret;
+}
+
+/**
+ * rds_set_addr - Send to another unit (or group of units) from now on
+ * @enc: pointer to &struct rds_encoder
+ * @site_addr: site address (UECP, 0 for all sites)
+ * @enc_addr: encoder address (0 for all encoders on UECP,
+ *	0xFFFF on Prais)
+ *
+ * Same as the addresses given to rds_init(). What we know about
+ * the main service (see rds_state.c) is for the old target, so
+ * it's forgotten.
+ */
+int
+rds_set_addr(struct rds_encoder *enc, uint16_t site_addr, uint16_t enc_addr)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_ADDR, 0, 0);
+	cmd.arg.addr.op = RDS_ADDR_OP_TARGET;
+	cmd.arg.addr.site = site_addr;
+	cmd.arg.addr.enc = enc_addr;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_unit_addr - Add / remove an address of the target unit(s)
+ * @enc: pointer to &struct rds_encoder
+ * @op: RDS_ADDR_OP_*
+ * @addr: the address
+ */
+static int
+rds_unit_addr(struct rds_encoder *enc, uint8_t op, uint16_t addr)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_ADDR, 0, 0);
+	cmd.arg.addr.op = op;
+	if(op == RDS_ADDR_OP_ADD_SITE || op == RDS_ADDR_OP_DEL_SITE)
+		cmd.arg.addr.site = addr;
+	else
+		cmd.arg.addr.enc = addr;
+
+	return rds_cmd_run(enc, &cmd);
+}
+
+/**
+ * rds_add_site_addr - Make the target unit(s) answer to a site address
+ * @enc: pointer to &struct rds_encoder
+ * @site_addr: the site address (1 - 1023)
+ *
+ * E.g. give all units of a region the same site address, then
+ * rds_set_addr(enc, site_addr, 0) reaches all of them with one frame.
+ */
+int
+rds_add_site_addr(struct rds_encoder *enc, uint16_t site_addr)
+{
+	return rds_unit_addr(enc, RDS_ADDR_OP_ADD_SITE, site_addr);
+}
+
+/**
+ * rds_del_site_addr - Remove a site address from the target unit(s)
+ * @enc: pointer to &struct rds_encoder
+ * @site_addr: the site address (1 - 1023)
+ */
+int
+rds_del_site_addr(struct rds_encoder *enc, uint16_t site_addr)
+{
+	return rds_unit_addr(enc, RDS_ADDR_OP_DEL_SITE, site_addr);
+}
+
+/**
+ * rds_add_enc_addr - Make the target unit(s) answer to an encoder address
+ * @enc: pointer to &struct rds_encoder
+ * @enc_addr: the encoder address (1 - 63)
+ */
+int
+rds_add_enc_addr(struct rds_encoder *enc, uint16_t enc_addr)
+{
+	return rds_unit_addr(enc, RDS_ADDR_OP_ADD_ENC, enc_addr);
+}
+
+/**
+ * rds_del_enc_addr - Remove an encoder address from the target unit(s)
+ * @enc: pointer to &struct rds_encoder
+ * @enc_addr: the encoder address (1 - 63)
+ */
+int
+rds_del_enc_addr(struct rds_encoder *enc, uint16_t enc_addr)
+{
+	return rds_unit_addr(enc, RDS_ADDR_OP_DEL_ENC, enc_addr);
+}
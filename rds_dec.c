@@ -0,0 +1,715 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_dec.c -	RDS bitstream decoder, to verify what goes on air
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <stdlib.h>	/* For malloc/free */
+#include <string.h>	/* For memset() / memcpy() */
+#include <pthread.h>	/* For pthread_once() */
+#include "rds.h"
+#include "rds_block.h"
+#include "rds_dec.h"
+
+#define RDS_BLOCK_MASK		((1 << RDS_BLOCK_BITS) - 1)
+#define RDS_CHECK_MASK		0x3FF
+
+/* Offset words, C' goes in the place of C */
+#define DEC_NUM_OFFSETS		5
+#define DEC_OFFSET_CP		3
+
+static const uint16_t dec_offsets[DEC_NUM_OFFSETS] = {
+	RDS_OFFSET_A, RDS_OFFSET_B, RDS_OFFSET_C, RDS_OFFSET_CP, RDS_OFFSET_D
+};
+
+static const uint8_t dec_offset_block[DEC_NUM_OFFSETS] = {
+	RDS_DEC_BLOCK_A, RDS_DEC_BLOCK_B, RDS_DEC_BLOCK_C,
+	RDS_DEC_BLOCK_C, RDS_DEC_BLOCK_D
+};
+
+/* Syndrome -> offset word index + 1, 0 for none */
+static uint8_t dec_syndrome_offset[RDS_CHECK_MASK + 1];
+
+/* Syndrome -> burst error pattern, 0 for none */
+static uint32_t dec_error_pattern[RDS_CHECK_MASK + 1];
+
+static pthread_once_t dec_tables_once = PTHREAD_ONCE_INIT;
+
+
+/********\
+* TABLES *
+\********/
+
+/**
+ * rds_dec_syndrome - Get the syndrome of a received block
+ * @block: the 26bit block
+ */
+static inline uint16_t
+rds_dec_syndrome(uint32_t block)
+{
+	return rds_block_check(block >> 10) ^ (block & RDS_CHECK_MASK);
+}
+
+/**
+ * rds_dec_tables_init - Build the syndrome / error pattern tables
+ *
+ * Error bursts are all patterns of 1 - 5 bits that start and end
+ * with an error, anywhere within the block (367 of them). The code
+ * is burst correcting up to 5 bits, so their syndromes are unique.
+ */
+static void
+rds_dec_tables_init(void)
+{
+	uint32_t pattern = 0;
+	uint32_t mid = 0;
+	int len = 0;
+	int pos = 0;
+	int i = 0;
+
+	for(i = 0; i < DEC_NUM_OFFSETS; i++)
+		dec_syndrome_offset[dec_offsets[i]] = i + 1;
+
+	for(len = 1; len <= 5; len++) {
+		/* Bits in between the first and last can be anything */
+		for(mid = 0; mid < (len > 2 ? 1U << (len - 2) : 1U); mid++) {
+			pattern = (len == 1) ? 1 :
+				(1U << (len - 1)) | (mid << 1) | 1;
+			for(pos = 0; pos + len <= RDS_BLOCK_BITS; pos++)
+				dec_error_pattern[rds_dec_syndrome(pattern << pos)] =
+								pattern << pos;
+		}
+	}
+}
+
+
+/******************\
+* GROUP PROCESSING *
+\******************/
+
+/**
+ * rds_dec_mjd_to_date - Convert a Modified Julian Day to a date
+ * @mjd: the MJD
+ * @rtc: the &struct rds_rtc to fill year / month / day
+ *
+ * See IEC 62106 Annex G
+ */
+static void
+rds_dec_mjd_to_date(uint32_t mjd, struct rds_rtc *rtc)
+{
+	int y = (int) ((mjd - 15078.2) / 365.25);
+	int m = (int) ((mjd - 14956.1 - (int) (y * 365.25)) / 30.6001);
+	int k = (m == 14 || m == 15) ? 1 : 0;
+
+	rtc->day = mjd - 14956 - (int) (y * 365.25) - (int) (m * 30.6001);
+	rtc->year = 1900 + y + k;
+	rtc->month = m - 1 - k * 12;
+}
+
+/**
+ * rds_dec_text_seg - Store a text segment
+ * @buf: the text buffer
+ * @segs: mask of segments received, updated
+ * @seg: segment number
+ * @data: the chars
+ * @len: number of chars per segment
+ */
+static void
+rds_dec_text_seg(uint8_t *buf, uint16_t *segs, uint8_t seg,
+				const uint16_t *data, int len)
+{
+	int i = 0;
+
+	for(i = 0; i < len; i++)
+		buf[seg * len + i] = (i & 1) ? data[i >> 1] & 0xFF :
+						data[i >> 1] >> 8;
+
+	*segs |= (1 << seg);
+}
+
+/**
+ * rds_dec_group_0 - Basic tuning and switching information
+ * @dec: the &struct rds_dec
+ * @info: the information words
+ * @ok: good blocks
+ */
+static void
+rds_dec_group_0(struct rds_dec *dec, const uint16_t *info, uint8_t ok)
+{
+	struct rds_state *st = &dec->state;
+	uint8_t seg = info[1] & 0x3;
+	uint16_t segs = dec->ps_segs;
+
+	/* TA and M/S only need block B */
+	if(info[1] & (1 << 4))
+		st->ta_tp |= RDS_TATP_TA_ON;
+	else
+		st->ta_tp &= ~RDS_TATP_TA_ON;
+	st->valid |= RDS_STATE_TA_TP;
+
+	st->ms = (info[1] & (1 << 3)) ? RDS_MS_MUSIC : RDS_MS_SPEECH;
+	st->valid |= RDS_STATE_MS;
+
+	/* DI goes one bit per segment, d3 first */
+	if(info[1] & (1 << 2))
+		dec->di |= (1 << (3 - seg));
+	else
+		dec->di &= ~(1 << (3 - seg));
+	dec->di_segs |= (1 << seg);
+	if(dec->di_segs == 0xF) {
+		st->di = dec->di & 0x7;
+		st->dynpty = (dec->di >> 3) & 0x1;
+		st->valid |= RDS_STATE_DI | RDS_STATE_DYNPTY;
+	}
+
+	if(!(ok & (1 << RDS_DEC_BLOCK_D)))
+		return;
+
+	rds_dec_text_seg((uint8_t *) dec->ps, &segs, seg, &info[3], 2);
+	dec->ps_segs = segs;
+	if(dec->ps_segs == 0xF) {
+		memcpy(st->ps, dec->ps, RDS_PS_LEN);
+		st->ps[RDS_PS_LEN] = '\0';
+		st->valid |= RDS_STATE_PS;
+	}
+}
+
+/**
+ * rds_dec_group_1a - Slow labeling codes, we only care for the ECC
+ * @dec: the &struct rds_dec
+ * @info: the information words
+ * @ok: good blocks
+ */
+static void
+rds_dec_group_1a(struct rds_dec *dec, const uint16_t *info, uint8_t ok)
+{
+	/* Variant 0 */
+	if(!(ok & (1 << RDS_DEC_BLOCK_C)) || (info[2] >> 12) & 0x7)
+		return;
+
+	dec->ecc = info[2] & 0xFF;
+	dec->state.pi.ccode = ((dec->pi_code >> 4) & 0x0F00) | dec->ecc;
+}
+
+/**
+ * rds_dec_group_2 - RadioText
+ * @dec: the &struct rds_dec
+ * @info: the information words
+ * @ok: good blocks
+ */
+static void
+rds_dec_group_2(struct rds_dec *dec, const uint16_t *info, uint8_t ok)
+{
+	struct rds_state *st = &dec->state;
+	uint8_t version_b = (info[1] >> 11) & 0x1;
+	uint8_t seg = info[1] & 0xF;
+	int8_t ab = (info[1] >> 4) & 0x1;
+	int chars = version_b ? 2 : 4;
+	int len = 0;
+	int i = 0;
+
+	if(version_b && !(ok & (1 << RDS_DEC_BLOCK_D)))
+		return;
+	if(!version_b && (ok & 0xC) != 0xC)
+		return;
+
+	/* New message */
+	if(ab != dec->rt_ab || dec->rt_method != (version_b ?
+				RDS_RT_METHOD_B : RDS_RT_METHOD_A)) {
+		memset(dec->rt_buf, 0, sizeof(dec->rt_buf));
+		dec->rt_segs = 0;
+		dec->rt_ab = ab;
+		dec->rt_method = version_b ? RDS_RT_METHOD_B : RDS_RT_METHOD_A;
+	}
+
+	rds_dec_text_seg(dec->rt_buf, &dec->rt_segs, seg,
+				version_b ? &info[3] : &info[2], chars);
+
+	/* Complete if we have all segments up to the end
+	 * marker, or all of them if there's no marker */
+	len = (version_b ? 32 : 64);
+	for(i = 0; i < len; i++) {
+		if(!(dec->rt_segs & (1 << (i / chars))))
+			return;
+		if(dec->rt_buf[i] == 0x0D)
+			break;
+	}
+	len = i;
+
+	memset(st->rt.msg, 0, sizeof(st->rt.msg));
+	memcpy(st->rt.msg, dec->rt_buf, len);
+	st->rt.ab_flag = dec->rt_method;
+	st->valid |= RDS_STATE_RT;
+}
+
+/**
+ * rds_dec_group_4a - Clock Time and date
+ * @dec: the &struct rds_dec
+ * @info: the information words
+ * @ok: good blocks
+ */
+static void
+rds_dec_group_4a(struct rds_dec *dec, const uint16_t *info, uint8_t ok)
+{
+	struct rds_rtc *rtc = &dec->rtc;
+	uint32_t mjd = 0;
+	uint8_t offset = 0;
+
+	if((ok & 0xC) != 0xC)
+		return;
+
+	mjd = ((info[1] & 0x3) << 15) | (info[2] >> 1);
+	rds_dec_mjd_to_date(mjd, rtc);
+	rtc->hours = ((info[2] & 0x1) << 4) | (info[3] >> 12);
+	rtc->minutes = (info[3] >> 6) & 0x3F;
+	rtc->seconds = 0;
+	rtc->centiseconds = 0;
+
+	/* In half hours, sign on bit 5 */
+	offset = info[3] & 0x1F;
+	rtc->offset = (info[3] & (1 << 5)) ? -(offset / 2) : offset / 2;
+
+	dec->has_rtc = 1;
+	dec->state.ct = 1;
+	dec->state.valid |= RDS_STATE_CT;
+}
+
+/**
+ * rds_dec_group_10a - Programme Type Name
+ * @dec: the &struct rds_dec
+ * @info: the information words
+ * @ok: good blocks
+ */
+static void
+rds_dec_group_10a(struct rds_dec *dec, const uint16_t *info, uint8_t ok)
+{
+	struct rds_state *st = &dec->state;
+	uint8_t seg = info[1] & 0x1;
+	int8_t ab = (info[1] >> 4) & 0x1;
+	uint16_t segs = 0;
+
+	if((ok & 0xC) != 0xC)
+		return;
+
+	if(ab != dec->ptyn_ab) {
+		dec->ptyn_segs = 0;
+		dec->ptyn_ab = ab;
+	}
+
+	segs = dec->ptyn_segs;
+	rds_dec_text_seg((uint8_t *) dec->ptyn, &segs, seg, &info[2], 4);
+	dec->ptyn_segs = segs;
+
+	if(dec->ptyn_segs == 0x3) {
+		memcpy(st->ptyn, dec->ptyn, RDS_PTYN_LEN);
+		st->ptyn[RDS_PTYN_LEN] = '\0';
+		st->valid |= RDS_STATE_PTYN;
+	}
+}
+
+/**
+ * rds_dec_group - Process a received group
+ * @dec: the &struct rds_dec
+ */
+static void
+rds_dec_group(struct rds_dec *dec)
+{
+	struct rds_state *st = &dec->state;
+	const uint16_t *info = dec->info;
+	uint8_t ok = dec->info_ok;
+	uint16_t pi_code = 0;
+	uint8_t code = 0;
+
+	/* Version B groups repeat PI on block C' */
+	if(ok & (1 << RDS_DEC_BLOCK_A))
+		pi_code = info[0];
+	else if((ok & 0x6) == 0x6 && (info[1] & (1 << 11)))
+		pi_code = info[2];
+
+	if(pi_code) {
+		dec->pi_code = pi_code;
+		st->pi.ccode = ((pi_code >> 4) & 0x0F00) | dec->ecc;
+		st->pi.coverage = (pi_code >> 8) & 0xF;
+		st->pi.prn = pi_code & 0xFF;
+		st->valid |= RDS_STATE_PI;
+	}
+
+	if(!(ok & (1 << RDS_DEC_BLOCK_B)))
+		return;
+
+	dec->stats.groups++;
+
+	/* Common to all groups */
+	st->pty = (info[1] >> 5) & 0x1F;
+	if(info[1] & (1 << 10))
+		st->ta_tp |= RDS_TATP_TP_ON;
+	else
+		st->ta_tp &= ~RDS_TATP_TP_ON;
+	st->valid |= RDS_STATE_PTY;
+
+	code = info[1] >> 11;
+	switch(code) {
+	case RDS_GROUP_CODE(0, 0):
+	case RDS_GROUP_CODE(0, 1):
+		rds_dec_group_0(dec, info, ok);
+		break;
+	case RDS_GROUP_1A:
+		rds_dec_group_1a(dec, info, ok);
+		break;
+	case RDS_GROUP_2A:
+	case RDS_GROUP_2B:
+		rds_dec_group_2(dec, info, ok);
+		break;
+	case RDS_GROUP_4A:
+		rds_dec_group_4a(dec, info, ok);
+		break;
+	case RDS_GROUP_10A:
+		rds_dec_group_10a(dec, info, ok);
+		break;
+	default:
+		break;
+	}
+
+	if(dec->group_cb)
+		dec->group_cb(dec, info, ok, dec->group_arg);
+}
+
+
+/************\
+* BLOCK SYNC *
+\************/
+
+/**
+ * rds_dec_sync_lost - Drop sync and start looking again
+ * @dec: the &struct rds_dec
+ */
+static void
+rds_dec_sync_lost(struct rds_dec *dec)
+{
+	dec->synced = 0;
+	dec->hit_pos = 0;
+	memset(dec->hits, 0, sizeof(dec->hits));
+	dec->stats.sync_losses++;
+	dec->state.rds_on = 0;
+}
+
+/**
+ * rds_dec_block - Process a block at a block boundary
+ * @dec: the &struct rds_dec
+ * @block: the 26bit block
+ */
+static void
+rds_dec_block(struct rds_dec *dec, uint32_t block)
+{
+	uint8_t blk = dec->next_block;
+	uint16_t syndrome = rds_dec_syndrome(block);
+	uint32_t pattern = 0;
+	uint8_t idx = 0;
+	uint8_t err = 0;
+	int i = 0;
+
+	dec->stats.blocks++;
+
+	idx = dec_syndrome_offset[syndrome];
+	if(idx && dec_offset_block[idx - 1] == blk) {
+		/* No errors */
+	} else {
+		/*
+		 * Try the offset words that may go here (C and
+		 * C' on the third block). For C / C' prefer the
+		 * one block B says, if we have it.
+		 */
+		pattern = 0;
+		for(i = 0; i < DEC_NUM_OFFSETS && !pattern; i++) {
+			if(dec_offset_block[i] != blk)
+				continue;
+			if(blk == RDS_DEC_BLOCK_C &&
+			(dec->info_ok & (1 << RDS_DEC_BLOCK_B)) &&
+			((dec->info[1] >> 11) & 0x1) != (i == DEC_OFFSET_CP))
+				continue;
+			pattern = dec_error_pattern[syndrome ^ dec_offsets[i]];
+		}
+
+		if(pattern) {
+			block ^= pattern;
+			dec->stats.corrected++;
+		} else {
+			dec->stats.errors++;
+			err = 1;
+		}
+	}
+
+	dec->err_window = (dec->err_window << 1) | err;
+	if(blk == RDS_DEC_BLOCK_A)
+		dec->info_ok = 0;
+
+	if(!err) {
+		dec->info[blk] = block >> 10;
+		dec->info_ok |= (1 << blk);
+	}
+
+	if(blk == RDS_DEC_BLOCK_D)
+		rds_dec_group(dec);
+
+	dec->next_block = (blk + 1) % RDS_GROUP_BLOCKS;
+
+	if(__builtin_popcountll(dec->err_window &
+		((1ULL << RDS_DEC_SYNC_WINDOW) - 1)) >= RDS_DEC_SYNC_LOSS_ERRS)
+		rds_dec_sync_lost(dec);
+}
+
+/**
+ * rds_dec_search - Look for block sync
+ * @dec: the &struct rds_dec
+ *
+ * Called for every bit while not in sync, with the last
+ * 26 bits on dec->reg.
+ */
+static void
+rds_dec_search(struct rds_dec *dec)
+{
+	uint8_t idx = dec_syndrome_offset[rds_dec_syndrome(dec->reg)];
+	uint64_t dist = 0;
+	uint8_t blk = 0;
+	int i = 0;
+
+	if(!idx || dec->bit_count < RDS_BLOCK_BITS)
+		return;
+
+	blk = dec_offset_block[idx - 1];
+
+	/* Does it fit with one we saw before ? */
+	for(i = 0; i < RDS_DEC_HIT_MAX; i++) {
+		if(!dec->hits[i].bit)
+			continue;
+		dist = dec->bit_count - dec->hits[i].bit;
+		if(dist % RDS_BLOCK_BITS ||
+		dist / RDS_BLOCK_BITS > RDS_DEC_SYNC_MAX_BLOCKS)
+			continue;
+		if((dec->hits[i].block + dist / RDS_BLOCK_BITS) %
+					RDS_GROUP_BLOCKS != blk)
+			continue;
+
+		/* Got it, this one goes in as the first block */
+		dec->synced = 1;
+		dec->state.rds_on = 1;
+		dec->err_window = 0;
+		dec->next_block = blk;
+		dec->info_ok = 0;
+		rds_dec_block(dec, dec->reg);
+		dec->bits_left = RDS_BLOCK_BITS;
+		return;
+	}
+
+	dec->hits[dec->hit_pos].bit = dec->bit_count;
+	dec->hits[dec->hit_pos].block = blk;
+	dec->hit_pos = (dec->hit_pos + 1) % RDS_DEC_HIT_MAX;
+}
+
+/**
+ * rds_dec_push_bit - Process one bit
+ * @dec: the &struct rds_dec
+ * @bit: the bit
+ */
+static inline void
+rds_dec_push_bit(struct rds_dec *dec, uint8_t bit)
+{
+	dec->reg = ((dec->reg << 1) | bit) & RDS_BLOCK_MASK;
+	dec->bit_count++;
+
+	if(!dec->synced) {
+		rds_dec_search(dec);
+		return;
+	}
+
+	if(--dec->bits_left == 0) {
+		rds_dec_block(dec, dec->reg);
+		dec->bits_left = RDS_BLOCK_BITS;
+	}
+}
+
+
+/************\
+* PUBLIC API *
+\************/
+
+/**
+ * rds_dec_push_bits - Feed the decoder with bits
+ * @dec: the &struct rds_dec
+ * @data: the bits, packed MSB first
+ * @num_bits: number of bits on @data
+ */
+int
+rds_dec_push_bits(struct rds_dec *dec, const uint8_t *data, int num_bits)
+{
+	int i = 0;
+
+	if(!dec || !data || num_bits < 0)
+		return -EINVAL;
+
+	for(i = 0; i < num_bits; i++)
+		rds_dec_push_bit(dec, (data[i >> 3] >> (7 - (i & 0x7))) & 0x1);
+
+	return 0;
+}
+
+/**
+ * rds_dec_push_blocks - Feed the decoder with 26bit blocks
+ * @dec: the &struct rds_dec
+ * @blocks: the blocks, as returned by rds_soft_get_groups()
+ * @num_blocks: number of blocks on @blocks
+ *
+ * Once in sync with the blocks (after the first couple), this
+ * skips the per-bit work and handles a block at a time.
+ */
+int
+rds_dec_push_blocks(struct rds_dec *dec, const uint32_t *blocks,
+						int num_blocks)
+{
+	int i = 0;
+	int j = 0;
+
+	if(!dec || !blocks || num_blocks < 0)
+		return -EINVAL;
+
+	for(i = 0; i < num_blocks; i++) {
+		if(dec->synced && dec->bits_left == RDS_BLOCK_BITS) {
+			dec->reg = blocks[i] & RDS_BLOCK_MASK;
+			dec->bit_count += RDS_BLOCK_BITS;
+			rds_dec_block(dec, dec->reg);
+			continue;
+		}
+
+		for(j = RDS_BLOCK_BITS - 1; j >= 0; j--)
+			rds_dec_push_bit(dec, (blocks[i] >> j) & 0x1);
+	}
+
+	return 0;
+}
+
+/**
+ * rds_dec_get_state - Get what we've received so far
+ * @dec: the &struct rds_dec
+ * @state: the &struct rds_state to fill, valid has the
+ *	RDS_STATE_* of the fields we've got in full and rds_on
+ *	is set while we are in sync
+ */
+int
+rds_dec_get_state(struct rds_dec *dec, struct rds_state *state)
+{
+	if(!dec || !state)
+		return -EINVAL;
+
+	*state = dec->state;
+	return 0;
+}
+
+/**
+ * rds_dec_get_rtc - Get the last Clock Time received
+ * @dec: the &struct rds_dec
+ * @rtc: the &struct rds_rtc to fill (UTC, offset in hours)
+ *
+ * Returns: 0 or -ENODATA if we didn't get a 4A group yet
+ */
+int
+rds_dec_get_rtc(struct rds_dec *dec, struct rds_rtc *rtc)
+{
+	if(!dec || !rtc)
+		return -EINVAL;
+
+	if(!dec->has_rtc)
+		return -ENODATA;
+
+	*rtc = dec->rtc;
+	return 0;
+}
+
+/**
+ * rds_dec_get_stats - Get block / group counters
+ * @dec: the &struct rds_dec
+ * @stats: the &struct rds_dec_stats to fill
+ */
+int
+rds_dec_get_stats(struct rds_dec *dec, struct rds_dec_stats *stats)
+{
+	if(!dec || !stats)
+		return -EINVAL;
+
+	*stats = dec->stats;
+	return 0;
+}
+
+/**
+ * rds_dec_reset - Forget everything and start looking for sync
+ * @dec: the &struct rds_dec
+ *
+ * The group callback is kept.
+ */
+void
+rds_dec_reset(struct rds_dec *dec)
+{
+	void (*group_cb)(struct rds_dec *dec, const uint16_t *info,
+						uint8_t ok, void *arg);
+	void *group_arg = NULL;
+
+	group_cb = dec->group_cb;
+	group_arg = dec->group_arg;
+
+	memset(dec, 0, sizeof(struct rds_dec));
+	dec->rt_ab = -1;
+	dec->ptyn_ab = -1;
+
+	dec->group_cb = group_cb;
+	dec->group_arg = group_arg;
+}
+
+/**
+ * rds_dec_create - Create a decoder
+ *
+ * Returns: a new &struct rds_dec or NULL on error (errno is set)
+ */
+struct rds_dec *
+rds_dec_create(void)
+{
+	struct rds_dec *dec = NULL;
+
+	pthread_once(&dec_tables_once, rds_dec_tables_init);
+
+	dec = malloc(sizeof(struct rds_dec));
+	if(!dec) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(dec, 0, sizeof(struct rds_dec));
+
+	rds_dec_reset(dec);
+
+	return dec;
+}
+
+/**
+ * rds_dec_destroy - Free a decoder
+ * @dec: the &struct rds_dec
+ */
+void
+rds_dec_destroy(struct rds_dec *dec)
+{
+	free(dec);
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_dec.h -	RDS bitstream decoder, to verify what goes on air
+ */
+
+#include "rds_block.h"	/* For RDS_GROUP_BLOCKS */
+
+/**
+ * DOC: Decoder
+ *
+ * The decoder takes the RDS data bitstream (after biphase and
+ * differential decoding, e.g. from a receiver's RDS output) or
+ * the blocks of a software encoder and rebuilds the parameters
+ * that are on air into a &struct rds_state, the same one
+ * we keep as the shadow state of an encoder, plus a &struct rds_rtc
+ * for CT. Comparing the two tells if an encoder transmits what we
+ * told it to.
+ *
+ * Block sync: the syndrome of a 26bit block is the remainder of its
+ * division by the generator polynomial, for a block with no errors
+ * that's its offset word. A 1024 entry table maps each syndrome to
+ * the offset word it is (if any), so looking for sync is a syndrome
+ * calculation (two table lookups) and a table lookup per bit. Once
+ * two blocks are found at a distance and order that makes sense we
+ * are in sync and only look at block boundaries from there on.
+ * We drop sync after RDS_DEC_SYNC_LOSS_ERRS uncorrectable blocks
+ * out of the last RDS_DEC_SYNC_WINDOW.
+ *
+ * Error correction: the code can correct any error burst of up to 5
+ * bits. The syndrome of a block with errors is its offset word xor
+ * the syndrome of the error pattern, so a second 1024 entry table
+ * maps the syndromes of all bursts of up to 5 bits to their error
+ * pattern and correction is a table lookup and an xor.
+ *
+ * Decoded groups are 0A/0B (PS, TA/TP, M/S, DI), 1A (ECC), 2A/2B
+ * (RT), 4A (CT) and 10A (PTYN). PTY and TP come from every group.
+ * A field is marked valid on &struct rds_state once it was received
+ * in full (e.g. all 4 PS segments).
+ */
+
+#define RDS_DEC_SYNC_WINDOW	50
+#define RDS_DEC_SYNC_LOSS_ERRS	20
+
+/* How far apart (in blocks) two blocks may be to get in sync */
+#define RDS_DEC_SYNC_MAX_BLOCKS	6
+
+/* Blocks of a group */
+#define RDS_DEC_BLOCK_A		0
+#define RDS_DEC_BLOCK_B		1
+#define RDS_DEC_BLOCK_C		2	/* C or C' */
+#define RDS_DEC_BLOCK_D		3
+
+#define RDS_DEC_HIT_MAX		8
+
+struct rds_dec_stats {
+	uint32_t blocks;		/* Blocks received while in sync */
+	uint32_t corrected;		/* Blocks with errors we corrected */
+	uint32_t errors;		/* Blocks we couldn't correct */
+	uint32_t groups;		/* Groups with a good block B */
+	uint32_t sync_losses;
+};
+
+struct rds_dec {
+	/* Block sync */
+	uint32_t reg;			/* Last 26 bits received */
+	uint64_t bit_count;
+	uint8_t synced;
+	uint8_t bits_left;		/* Until the next block boundary */
+	uint8_t next_block;		/* RDS_DEC_BLOCK_* expected next */
+	uint64_t err_window;		/* One bit per block, set on errors */
+
+	/* Candidate blocks while looking for sync */
+	struct {
+		uint64_t bit;
+		uint8_t block;
+	} hits[RDS_DEC_HIT_MAX];
+	uint8_t hit_pos;
+
+	/* Group being received */
+	uint16_t info[RDS_GROUP_BLOCKS];
+	uint8_t info_ok;		/* One bit per block */
+
+	/* Partially received fields */
+	uint16_t pi_code;
+	uint8_t ecc;
+	char ps[RDS_PS_LEN];
+	uint8_t ps_segs;
+	uint8_t di;
+	uint8_t di_segs;
+	uint8_t rt_buf[RDS_RT_MSG_LEN_MAX];
+	uint16_t rt_segs;
+	int8_t rt_ab;			/* -1 when we don't have one yet */
+	uint8_t rt_method;
+	char ptyn[RDS_PTYN_LEN];
+	uint8_t ptyn_segs;
+	int8_t ptyn_ab;
+
+	/* What we got so far */
+	struct rds_state state;
+	struct rds_rtc rtc;
+	uint8_t has_rtc;
+	struct rds_dec_stats stats;
+
+	/* Optional, called for every group with a good block B,
+	 * ok has a bit set for each block that's good */
+	void (*group_cb)(struct rds_dec *dec, const uint16_t *info,
+						uint8_t ok, void *arg);
+	void *group_arg;
+};
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+struct rds_dec *rds_dec_create(void);
+void rds_dec_destroy(struct rds_dec *dec);
+void rds_dec_reset(struct rds_dec *dec);
+int rds_dec_push_bits(struct rds_dec *dec, const uint8_t *data,
+						int num_bits);
+int rds_dec_push_blocks(struct rds_dec *dec, const uint32_t *blocks,
+						int num_blocks);
+int rds_dec_get_state(struct rds_dec *dec, struct rds_state *state);
+int rds_dec_get_rtc(struct rds_dec *dec, struct rds_rtc *rtc);
+int rds_dec_get_stats(struct rds_dec *dec, struct rds_dec_stats *stats);
@@ -0,0 +1,569 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_demod.c -	RDS demodulator, recovers the RDS bitstream
+ *			from FM composite (MPX) PCM samples
+ */
+
+#define _GNU_SOURCE	/* For M_PI */
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <stdlib.h>	/* For malloc/free */
+#include <string.h>	/* For memset() / memmove() */
+#include <unistd.h>	/* For read() */
+#include <math.h>	/* For sin() / cos() / sqrt() */
+#include "rds.h"
+#include "rds_block.h"
+#include "rds_dsp.h"
+#include "rds_dec.h"
+#include "rds_demod.h"
+
+
+/********\
+* TABLES *
+\********/
+
+/**
+ * rds_demod_init_lpf - Build the decimating low pass
+ * @demod: the &struct rds_demod
+ *
+ * Windowed sinc with a Blackman window, its transition band is
+ * ~5.5 * rate / taps wide so that sets the number of taps.
+ */
+static int
+rds_demod_init_lpf(struct rds_demod *demod)
+{
+	double fc = (double) RDS_DEMOD_LPF_CUTOFF / demod->rate;
+	double sum = 0;
+	double x = 0;
+	double w = 0;
+	int len = 0;
+	int i = 0;
+
+	len = (int) (5.5 * demod->rate / RDS_DEMOD_LPF_TRANS) | 1;
+
+	demod->lpf = malloc(sizeof(float) * len);
+	if(!demod->lpf)
+		return -ENOMEM;
+	demod->lpf_len = len;
+
+	for(i = 0; i < len; i++) {
+		x = i - (len - 1) / 2.0;
+		w = 0.42 - 0.5 * cos(2 * M_PI * i / (len - 1)) +
+			0.08 * cos(4 * M_PI * i / (len - 1));
+		demod->lpf[i] = (float) (w * ((x == 0) ? 2 * fc :
+					sin(2 * M_PI * fc * x) / (M_PI * x)));
+		sum += demod->lpf[i];
+	}
+
+	/* Unity gain at DC */
+	for(i = 0; i < len; i++)
+		demod->lpf[i] = (float) (demod->lpf[i] / sum);
+
+	return 0;
+}
+
+/**
+ * rds_demod_init_mf - Build the matched filter
+ * @demod: the &struct rds_demod
+ *
+ * The biphase symbol over two bit periods around its center,
+ * reversed in time (the oldest sample on the history gets the
+ * last tap), with unit energy.
+ */
+static int
+rds_demod_init_mf(struct rds_demod *demod)
+{
+	double energy = 0;
+	double x = 0;
+	int len = 0;
+	int i = 0;
+
+	len = (int) (2 * demod->sym_len) | 1;
+
+	demod->mf = malloc(sizeof(float) * len);
+	demod->mf_i = calloc(2 * len, sizeof(float));
+	demod->mf_q = calloc(2 * len, sizeof(float));
+	if(!demod->mf || !demod->mf_i || !demod->mf_q)
+		return -ENOMEM;
+	demod->mf_len = len;
+
+	for(i = 0; i < len; i++) {
+		x = -0.75 + (len - 1 - i) / demod->sym_len;
+		demod->mf[i] = (float) rds_dsp_biphase(x);
+		energy += demod->mf[i] * demod->mf[i];
+	}
+
+	for(i = 0; i < len; i++)
+		demod->mf[i] = (float) (demod->mf[i] / sqrt(energy));
+
+	return 0;
+}
+
+/**
+ * rds_demod_init_lo - Build the 57KHz mixer tables
+ * @demod: the &struct rds_demod
+ *
+ * Same trick as the modulator, a period (rate / gcd(rate, 57000)
+ * samples) plus RDS_DEMOD_CHUNK so that any chunk is contiguous.
+ */
+static void
+rds_demod_init_lo(struct rds_demod *demod)
+{
+	double phase = 0;
+	int i = 0;
+
+	for(i = 0; i < demod->period + RDS_DEMOD_CHUNK; i++) {
+		phase = 2.0 * M_PI * (double) RDS_DEMOD_CARRIER_HZ *
+			(double) (i % demod->period) / (double) demod->rate;
+		demod->lo_i[i] = (float) cos(phase);
+		demod->lo_q[i] = (float) -sin(phase);
+	}
+}
+
+
+/**************\
+* DEMODULATION *
+\**************/
+
+/**
+ * rds_demod_hist - Get a past sample of the timing history
+ * @demod: the &struct rds_demod
+ * @back: how many samples before the newest one (fractional)
+ */
+static inline float
+rds_demod_hist(struct rds_demod *demod, float back)
+{
+	uint32_t i = (uint32_t) back;
+	float frac = back - i;
+	float a = demod->hist[(demod->hist_pos - 1 - i) & (RDS_DEMOD_HIST - 1)];
+	float b = demod->hist[(demod->hist_pos - 2 - i) & (RDS_DEMOD_HIST - 1)];
+
+	return a + frac * (b - a);
+}
+
+/**
+ * rds_demod_bit - Pass a bit to the decoder
+ * @demod: the &struct rds_demod
+ * @bit: the bit
+ */
+static void
+rds_demod_bit(struct rds_demod *demod, uint8_t bit)
+{
+	uint8_t data = bit << 7;
+	uint32_t changed = 0;
+
+	rds_dec_push_bits(demod->dec, &data, 1);
+
+	changed = rds_state_diff(&demod->dec->state, &demod->on_air);
+	if(!changed)
+		return;
+
+	demod->on_air = demod->dec->state;
+	if(demod->event_cb)
+		demod->event_cb(demod, changed, demod->event_arg);
+}
+
+/**
+ * rds_demod_symbol - Carrier / timing recovery and decision
+ * @demod: the &struct rds_demod
+ * @zi: decimated sample, in phase
+ * @zq: decimated sample, quadrature
+ */
+static void
+rds_demod_symbol(struct rds_demod *demod, float zi, float zq)
+{
+	float mi = 0;
+	float mq = 0;
+	float c = 0;
+	float s = 0;
+	float r = 0;
+	float q = 0;
+	float err = 0;
+	float late = 0;
+	float on = 0;
+	float early = 0;
+	float mid = 0;
+	float back = 0;
+	float d = demod->sym_len / 8;
+	uint8_t sym = 0;
+
+	/* Matched filter */
+	demod->mf_i[demod->mf_pos] = zi;
+	demod->mf_i[demod->mf_pos + demod->mf_len] = zi;
+	demod->mf_q[demod->mf_pos] = zq;
+	demod->mf_q[demod->mf_pos + demod->mf_len] = zq;
+	if(++demod->mf_pos >= demod->mf_len)
+		demod->mf_pos = 0;
+
+	mi = rds_dsp_dot(demod->mf_i + demod->mf_pos, demod->mf, demod->mf_len);
+	mq = rds_dsp_dot(demod->mf_q + demod->mf_pos, demod->mf, demod->mf_len);
+
+	/* Costas loop */
+	c = cosf(demod->phase);
+	s = sinf(demod->phase);
+	r = mi * c + mq * s;
+	q = mq * c - mi * s;
+
+	demod->agc += RDS_DEMOD_AGC_RATE * (sqrtf(r * r + q * q) - demod->agc);
+
+	err = r * q / (demod->agc * demod->agc + 1e-20f);
+	if(err > 1.0f)
+		err = 1.0f;
+	else if(err < -1.0f)
+		err = -1.0f;
+
+	demod->freq += RDS_DEMOD_COSTAS_BETA * err;
+	demod->phase += demod->freq + RDS_DEMOD_COSTAS_ALPHA * err;
+	if(demod->phase > (float) M_PI)
+		demod->phase -= 2 * (float) M_PI;
+	else if(demod->phase < -(float) M_PI)
+		demod->phase += 2 * (float) M_PI;
+
+	/* Symbol timing */
+	demod->hist[demod->hist_pos & (RDS_DEMOD_HIST - 1)] = r;
+	demod->hist_pos++;
+
+	demod->strobe -= 1.0f;
+	if(demod->strobe > 0)
+		return;
+
+	/*
+	 * The strobe fell -strobe samples before the newest one,
+	 * the decision point is d before that and the early
+	 * point another d before. If the late point is stronger
+	 * than the early one we are early, move forward.
+	 */
+	back = -demod->strobe;
+	late = rds_demod_hist(demod, back);
+	on = rds_demod_hist(demod, back + d);
+	early = rds_demod_hist(demod, back + 2 * d);
+
+	err = (fabsf(late) - fabsf(early)) / (demod->agc + 1e-20f);
+	if(err > 1.0f)
+		err = 1.0f;
+	else if(err < -1.0f)
+		err = -1.0f;
+
+	demod->strobe += demod->sym_len * (1.0f + RDS_DEMOD_TIMING_GAIN * err);
+
+	/*
+	 * The matched filter's output of a biphase stream also peaks
+	 * half a symbol off, between two symbols of the same sign, so
+	 * the gate may settle there. On the right spot we get a peak
+	 * on every symbol, on the wrong one we get nothing between two
+	 * symbols of different sign. If the other spot looks stronger
+	 * on average, jump there.
+	 */
+	mid = rds_demod_hist(demod, back + d + demod->sym_len / 2);
+	demod->slip += RDS_DEMOD_SLIP_AVG * ((fabsf(mid) - fabsf(on)) /
+				(demod->agc + 1e-20f) - demod->slip);
+	if(demod->slip > RDS_DEMOD_SLIP_THRESH) {
+		demod->strobe -= demod->sym_len / 2;
+		demod->slip = 0;
+		return;
+	}
+
+	/* Differential decoding */
+	sym = (on > 0);
+	rds_demod_bit(demod, sym ^ demod->last_sym);
+	demod->last_sym = sym;
+}
+
+/**
+ * rds_demod_chunk - Process up to RDS_DEMOD_CHUNK input samples
+ * @demod: the &struct rds_demod
+ * @in: the (float) samples
+ * @len: number of samples
+ */
+static void
+rds_demod_chunk(struct rds_demod *demod, const float *in, int len)
+{
+	float zi = 0;
+	float zq = 0;
+
+	/* Mix down */
+	rds_dsp_mul(demod->bb_i + demod->bb_fill, in,
+			demod->lo_i + demod->lo_pos, len);
+	rds_dsp_mul(demod->bb_q + demod->bb_fill, in,
+			demod->lo_q + demod->lo_pos, len);
+	demod->bb_fill += len;
+	demod->lo_pos = (demod->lo_pos + len) % demod->period;
+
+	/* Low pass, only for the samples we keep */
+	while(demod->bb_next + demod->lpf_len <= demod->bb_fill) {
+		demod->pos = demod->bb_base + demod->bb_next + demod->lpf_len;
+
+		zi = rds_dsp_dot(demod->bb_i + demod->bb_next, demod->lpf,
+							demod->lpf_len);
+		zq = rds_dsp_dot(demod->bb_q + demod->bb_next, demod->lpf,
+							demod->lpf_len);
+		rds_demod_symbol(demod, zi, zq);
+
+		demod->bb_next += demod->decim;
+	}
+
+	/* Keep what the next window needs */
+	memmove(demod->bb_i, demod->bb_i + demod->bb_next,
+			sizeof(float) * (demod->bb_fill - demod->bb_next));
+	memmove(demod->bb_q, demod->bb_q + demod->bb_next,
+			sizeof(float) * (demod->bb_fill - demod->bb_next));
+	demod->bb_base += demod->bb_next;
+	demod->bb_fill -= demod->bb_next;
+	demod->bb_next = 0;
+
+	demod->pos = demod->bb_base + demod->bb_fill;
+}
+
+
+/************\
+* PUBLIC API *
+\************/
+
+/**
+ * rds_demod_run - Process samples from a caller's buffer
+ * @demod: the &struct rds_demod
+ * @buf: the MPX samples (float or int16_t, depending on the
+ *	format given on rds_demod_create())
+ * @num_samples: number of samples on @buf
+ *
+ * Returns: num_samples on success or a negative error code
+ */
+int
+rds_demod_run(struct rds_demod *demod, const void *buf, int num_samples)
+{
+	int done = 0;
+	int len = 0;
+
+	if(!demod || !buf || num_samples < 0)
+		return -EINVAL;
+
+	while(done < num_samples) {
+		len = num_samples - done;
+		if(len > RDS_DEMOD_CHUNK)
+			len = RDS_DEMOD_CHUNK;
+
+		if(demod->format == RDS_DEMOD_FMT_FLOAT) {
+			rds_demod_chunk(demod, (const float *) buf + done, len);
+		} else {
+			rds_dsp_from_s16(demod->in, (const int16_t *) buf + done,
+									len);
+			rds_demod_chunk(demod, demod->in, len);
+		}
+
+		done += len;
+	}
+
+	return num_samples;
+}
+
+/**
+ * rds_demod_read - Read samples from a file / pipe and process them
+ * @demod: the &struct rds_demod
+ * @fd: file descriptor to read from
+ *
+ * Does a single read() of up to RDS_DEMOD_CHUNK samples, call it
+ * in a loop (or when poll() says there's data on @fd). Partial
+ * samples are kept for the next call.
+ *
+ * Returns: number of samples processed, 0 on end of file, or a
+ * negative error code (e.g. -EAGAIN on a non-blocking @fd)
+ */
+int
+rds_demod_read(struct rds_demod *demod, int fd)
+{
+	int sample_len = 0;
+	int num_samples = 0;
+	ssize_t ret = 0;
+
+	if(!demod)
+		return -EINVAL;
+
+	sample_len = (demod->format == RDS_DEMOD_FMT_FLOAT) ?
+				sizeof(float) : sizeof(int16_t);
+
+	do {
+		ret = read(fd, demod->raw + demod->raw_len,
+			RDS_DEMOD_CHUNK * sample_len - demod->raw_len);
+	} while(ret < 0 && errno == EINTR);
+
+	if(ret < 0)
+		return -errno;
+	if(ret == 0)
+		return 0;
+
+	demod->raw_len += ret;
+	num_samples = demod->raw_len / sample_len;
+	if(!num_samples)
+		return -EAGAIN;
+
+	rds_demod_run(demod, demod->raw, num_samples);
+
+	demod->raw_len -= num_samples * sample_len;
+	memmove(demod->raw, demod->raw + num_samples * sample_len,
+						demod->raw_len);
+
+	return num_samples;
+}
+
+/**
+ * rds_demod_get_state - Get what's on air
+ * @demod: the &struct rds_demod
+ * @state: the &struct rds_state to fill (see rds_dec_get_state())
+ */
+int
+rds_demod_get_state(struct rds_demod *demod, struct rds_state *state)
+{
+	if(!demod)
+		return -EINVAL;
+
+	return rds_dec_get_state(demod->dec, state);
+}
+
+/**
+ * rds_demod_get_pos - Get how far into the input we are
+ * @demod: the &struct rds_demod
+ *
+ * From within the event callback, that's the input sample that
+ * completed the group that changed things (give or take the
+ * filters' delay, ~1ms), divide by the rate to get the time.
+ *
+ * Returns: number of input samples processed
+ */
+uint64_t
+rds_demod_get_pos(struct rds_demod *demod)
+{
+	return demod->pos;
+}
+
+
+/*************\
+* INIT / EXIT *
+\*************/
+
+/**
+ * rds_demod_destroy - Free a demodulator (and its decoder)
+ * @demod: the &struct rds_demod
+ */
+void
+rds_demod_destroy(struct rds_demod *demod)
+{
+	if(!demod)
+		return;
+
+	rds_dec_destroy(demod->dec);
+	free(demod->lo_i);
+	free(demod->lo_q);
+	free(demod->lpf);
+	free(demod->bb_i);
+	free(demod->bb_q);
+	free(demod->mf);
+	free(demod->mf_i);
+	free(demod->mf_q);
+	free(demod->in);
+	free(demod->raw);
+	free(demod);
+}
+
+/**
+ * rds_demod_create - Create a demodulator
+ * @rate: sample rate of the MPX input, RDS_DEMOD_RATE_MIN -
+ *	RDS_DEMOD_RATE_MAX, the 57KHz carrier's period must be within
+ *	RDS_DEMOD_PERIOD_MAX samples (multiples of 1KHz are fine)
+ * @format: RDS_DEMOD_FMT_FLOAT or RDS_DEMOD_FMT_S16
+ *
+ * Returns: a new &struct rds_demod or NULL on error (errno is set)
+ */
+struct rds_demod *
+rds_demod_create(uint32_t rate, uint8_t format)
+{
+	struct rds_demod *demod = NULL;
+	uint32_t period = 0;
+	uint32_t a = rate;
+	uint32_t b = RDS_DEMOD_CARRIER_HZ;
+	uint32_t t = 0;
+	int ret = 0;
+
+	if(rate < RDS_DEMOD_RATE_MIN || rate > RDS_DEMOD_RATE_MAX ||
+	format > RDS_DEMOD_FMT_S16) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* gcd */
+	while(b) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+	period = rate / a;
+	if(period > RDS_DEMOD_PERIOD_MAX) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	demod = malloc(sizeof(struct rds_demod));
+	if(!demod) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(demod, 0, sizeof(struct rds_demod));
+
+	demod->rate = rate;
+	demod->format = format;
+	demod->period = period;
+	demod->decim = (rate + RDS_DEMOD_IF_RATE / 2) / RDS_DEMOD_IF_RATE;
+	demod->if_rate = (float) rate / demod->decim;
+	demod->sym_len = demod->if_rate / RDS_DEMOD_BITRATE;
+	demod->strobe = demod->sym_len;
+
+	ret = rds_demod_init_lpf(demod);
+	if(ret < 0)
+		goto cleanup;
+
+	ret = rds_demod_init_mf(demod);
+	if(ret < 0)
+		goto cleanup;
+
+	ret = -ENOMEM;
+	demod->lo_i = malloc(sizeof(float) * (period + RDS_DEMOD_CHUNK));
+	demod->lo_q = malloc(sizeof(float) * (period + RDS_DEMOD_CHUNK));
+	demod->bb_i = malloc(sizeof(float) *
+				(demod->lpf_len + RDS_DEMOD_CHUNK));
+	demod->bb_q = malloc(sizeof(float) *
+				(demod->lpf_len + RDS_DEMOD_CHUNK));
+	demod->in = malloc(sizeof(float) * RDS_DEMOD_CHUNK);
+	demod->raw = malloc(sizeof(float) * RDS_DEMOD_CHUNK);
+	if(!demod->lo_i || !demod->lo_q || !demod->bb_i || !demod->bb_q ||
+	!demod->in || !demod->raw)
+		goto cleanup;
+
+	demod->dec = rds_dec_create();
+	if(!demod->dec)
+		goto cleanup;
+
+	rds_demod_init_lo(demod);
+
+	return demod;
+
+ cleanup:
+	rds_demod_destroy(demod);
+	errno = -ret;
+	return NULL;
+}
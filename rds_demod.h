@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_demod.h -	RDS demodulator, recovers the RDS bitstream
+ *			from FM composite (MPX) PCM samples
+ */
+
+/**
+ * DOC: Demodulator
+ *
+ * For off-air monitoring: feed it the MPX signal out of an FM
+ * receiver (float or signed 16bit mono PCM, from a buffer or a
+ * file / pipe) and it recovers the RDS bitstream and passes it to
+ * a &struct rds_dec, so we get what's on air as a &struct rds_state
+ * to compare with what we told the encoder (see rds_state_diff()).
+ *
+ * The chain is:
+ *
+ * 57KHz mixer: multiply with a 57KHz cos / -sin pair from a table
+ * (one period of the carrier), giving I/Q around 0Hz.
+ *
+ * Decimating low pass: a windowed sinc FIR, computed only for the
+ * samples we keep, that takes us down to ~19KHz (RDS is +-2.4KHz
+ * and the stereo subcarrier starts 4KHz away).
+ *
+ * Matched filter: correlate I/Q with the shaped biphase symbol
+ * (rds_dsp_biphase()), so the output peaks in the middle of
+ * each symbol with its sign.
+ *
+ * Carrier recovery: a Costas loop rotates I/Q so that all the
+ * energy ends up on I, it tracks the phase and the small frequency
+ * offset of the receiver's clock. It may lock 180 degrees off,
+ * that's fine since the data is differentialy encoded.
+ *
+ * Symbol timing: an early / late gate around each decision point
+ * that moves it towards the peak of the matched filter's output,
+ * plus a check that we are not half a symbol off.
+ *
+ * Decision and differential decoding: the sign of I on the decision
+ * point is the symbol, xor with the previous one gives the bit.
+ *
+ * The FIRs and the mixer run on the vector kernels of rds_dsp.c,
+ * everything after decimation is a few ops per sample at ~19KHz.
+ *
+ * rds_demod_get_pos() tells how far into the input we are, an
+ * event callback can be set to get notified when something changes
+ * on air, e.g. to measure the latency from an rds_set_* call to
+ * the new value reaching the receiver.
+ */
+
+#define RDS_DEMOD_FMT_FLOAT	0	/* 32bit float, native endian */
+#define RDS_DEMOD_FMT_S16	1	/* Signed 16bit, native endian */
+
+#define RDS_DEMOD_RATE_MIN	128000
+#define RDS_DEMOD_RATE_MAX	2000000
+
+#define RDS_DEMOD_CARRIER_HZ	57000
+#define RDS_DEMOD_BITRATE	1187.5
+
+/* Rate after decimation (roughly) */
+#define RDS_DEMOD_IF_RATE	19000
+
+/* Low pass, passes RDS (2.4KHz) and is down by 4KHz */
+#define RDS_DEMOD_LPF_CUTOFF	3000
+#define RDS_DEMOD_LPF_TRANS	2000
+
+/* Longest carrier period (in samples) we'll keep a table for */
+#define RDS_DEMOD_PERIOD_MAX	4096
+
+/* Input samples per run of the inner loops */
+#define RDS_DEMOD_CHUNK		2048
+
+/* Decimated samples we keep for timing recovery */
+#define RDS_DEMOD_HIST		64	/* Power of 2 */
+
+/* Loop gains */
+#define RDS_DEMOD_COSTAS_ALPHA	0.01f
+#define RDS_DEMOD_COSTAS_BETA	(RDS_DEMOD_COSTAS_ALPHA * \
+				RDS_DEMOD_COSTAS_ALPHA / 4)
+#define RDS_DEMOD_TIMING_GAIN	0.02f
+#define RDS_DEMOD_SLIP_AVG	0.02f
+#define RDS_DEMOD_SLIP_THRESH	0.1f
+#define RDS_DEMOD_AGC_RATE	0.002f
+
+struct rds_demod {
+	uint32_t rate;
+	uint8_t format;
+	int decim;
+	float if_rate;
+
+	/* 57KHz mixer, period + RDS_DEMOD_CHUNK long */
+	float *lo_i;
+	float *lo_q;
+	int period;
+	int lo_pos;
+
+	/* Decimating low pass */
+	float *lpf;
+	int lpf_len;
+	float *bb_i;			/* Mixer output, lpf_len + RDS_DEMOD_CHUNK */
+	float *bb_q;
+	int bb_fill;
+	int bb_next;			/* Where the next output's window starts */
+	uint64_t bb_base;		/* Input sample # of bb_*[0] */
+
+	/* Matched filter, on the decimated stream. The history is
+	 * written twice (at pos and pos + mf_len) so that the last
+	 * mf_len samples are always contiguous */
+	float *mf;
+	int mf_len;
+	float *mf_i;
+	float *mf_q;
+	int mf_pos;
+
+	/* Carrier recovery */
+	float phase;
+	float freq;
+	float agc;
+
+	/* Symbol timing */
+	float sym_len;			/* Decimated samples per symbol */
+	float strobe;			/* Samples until the next decision */
+	float hist[RDS_DEMOD_HIST];
+	uint32_t hist_pos;
+	float slip;			/* How much stronger it is half a
+					 * symbol off (average) */
+	uint8_t last_sym;
+
+	struct rds_dec *dec;		/* Use rds_dec_get_* on it for
+					 * the rest (RTC, stats) */
+	struct rds_state on_air;	/* Last state we reported */
+	uint64_t pos;			/* Input samples consumed */
+	float *in;			/* Scratch for s16 input */
+	uint8_t *raw;			/* Scratch for fd input */
+	int raw_len;
+
+	/* Optional, called when fields change on air (changed has
+	 * their RDS_STATE_* bits), from within rds_demod_run() */
+	void (*event_cb)(struct rds_demod *demod, uint32_t changed,
+								void *arg);
+	void *event_arg;
+};
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+struct rds_demod *rds_demod_create(uint32_t rate, uint8_t format);
+void rds_demod_destroy(struct rds_demod *demod);
+int rds_demod_run(struct rds_demod *demod, const void *buf, int num_samples);
+int rds_demod_read(struct rds_demod *demod, int fd);
+int rds_demod_get_state(struct rds_demod *demod, struct rds_state *state);
+uint64_t rds_demod_get_pos(struct rds_demod *demod);
@@ -0,0 +1,404 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_discover.c -	Finding the units on a port
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <string.h>	/* For memset() / memcpy() / strcmp() */
+#include <time.h>	/* For clock_gettime() */
+#include <pthread.h>	/* For pthread_create() / pthread_join() */
+#include "rds.h"
+#include "rds_thread.h"
+#include "rds_discover.h"
+
+
+/* A request in flight */
+struct rds_discover_probe {
+	uint16_t enc;
+	struct timespec sent;
+};
+
+/* One port of rds_discover_all() */
+struct rds_discover_job {
+	struct rds_encoder *enc;
+	struct rds_discover *d;
+};
+
+/* What rds_discover_move_fn() works on */
+struct rds_discover_move_req {
+	const char *serial;
+	uint16_t enc_addr;
+};
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+/**
+ * rds_discover_us - Get the time between two CLOCK_MONOTONIC stamps in us
+ * @from: the earlier one
+ * @to: the later one
+ */
+static uint32_t
+rds_discover_us(const struct timespec *from, const struct timespec *to)
+{
+	int64_t us = 0;
+
+	us = (int64_t) (to->tv_sec - from->tv_sec) * 1000000 +
+			(to->tv_nsec - from->tv_nsec) / 1000;
+
+	return us > 0 ? us : 0;
+}
+
+/**
+ * rds_discover_add - Record a unit we found
+ * @d: the &struct rds_discover
+ * @enc_addr: its address
+ * @serial: its serial number (NULL if we couldn't get it)
+ * @reply_us: how long it took to answer
+ * @ret: 0 or why we couldn't get its serial number
+ */
+static void
+rds_discover_add(struct rds_discover *d, uint16_t enc_addr,
+			const char *serial, uint32_t reply_us, int ret)
+{
+	struct rds_discover_unit *unit = NULL;
+
+	if(d->num_units >= d->max_units)
+		return;
+
+	unit = &d->units[d->num_units++];
+	memset(unit, 0, sizeof(struct rds_discover_unit));
+	unit->enc = enc_addr;
+	if(serial)
+		memcpy(unit->serial, serial, RDS_SERIAL_LEN + 1);
+	unit->reply_us = reply_us;
+	unit->ret = ret;
+}
+
+/**
+ * rds_discover_sweep - Ask each address of the range for its serial number
+ * @enc: pointer to &struct rds_encoder
+ * @d: the &struct rds_discover
+ *
+ * Requests from head to head + num - 1 (mod window) are in flight.
+ * Addresses up to solo_last are asked one at a time.
+ *
+ * Returns: how many units answered
+ */
+static int
+rds_discover_sweep(struct rds_encoder *enc, struct rds_discover *d)
+{
+	struct rds_discover_probe probes[RDS_DISCOVER_WINDOW_MAX];
+	struct rds_discover_probe *probe = NULL;
+	char serial[RDS_SERIAL_LEN + 1];
+	struct timespec now;
+	struct timespec last = { 0, 0 };
+	uint32_t slowest_us = 0;
+	uint32_t reply_us = 0;
+	uint32_t next = d->first;
+	uint32_t solo_last = 0;
+	uint16_t timeout = 0;
+	uint16_t addr = 0;
+	int window = 0;
+	int head = 0;
+	int num = 0;
+	int found = 0;
+	int ret = 0;
+	int i = 0;
+
+	window = d->window ? d->window : 1;
+	if(window > RDS_DISCOVER_WINDOW_MAX)
+		window = RDS_DISCOVER_WINDOW_MAX;
+
+	timeout = d->timeout_ms ? d->timeout_ms : RDS_DISCOVER_TIMEOUT_MS;
+
+	while(next <= d->last || num) {
+		/* Fill the window */
+		while(next <= d->last &&
+		num < (next <= solo_last ? 1 : window)) {
+			enc->addr = rds_addr_make(enc->type, 0, next);
+			ret = enc->serial_send(enc);
+			if(ret == -EOPNOTSUPP) {
+				next++;
+				continue;
+			}
+			if(ret < 0)
+				return ret;
+
+			probe = &probes[(head + num) % window];
+			probe->enc = next++;
+			clock_gettime(CLOCK_MONOTONIC, &probe->sent);
+			num++;
+		}
+
+		if(!num)
+			break;
+
+		enc->timeout_ms = timeout;
+		ret = enc->serial_recv(enc, &addr, serial);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		/* Silence, nobody else is there */
+		if(ret == -ENODATA || ret == -ETIME) {
+			num = 0;
+			continue;
+		}
+
+		/* Garbled, most likely more than one unit answered
+		 * on the same address. The input got flushed, so ask
+		 * the ones in flight again, one at a time, to find
+		 * which one it was */
+		if(ret == -EPROTO && num > 1) {
+			solo_last = probes[(head + num - 1) % window].enc;
+			next = probes[head].enc;
+			num = 0;
+			continue;
+		}
+
+		if(ret == -EPROTO) {
+			probe = &probes[head];
+			rds_discover_add(d, probe->enc, NULL,
+				rds_discover_us(&probe->sent, &now), -EPROTO);
+			found++;
+			num = 0;
+			continue;
+		}
+
+		if(ret < 0)
+			return ret;
+
+		for(i = 0; i < num; i++) {
+			probe = &probes[(head + i) % window];
+			if(addr == rds_addr_make(enc->type, 0, probe->enc))
+				break;
+		}
+
+		/* Not one of ours */
+		if(i == num)
+			continue;
+
+		/* Replies come in order, whoever was asked
+		 * before it and didn't reply is not there */
+		head = (head + i + 1) % window;
+		num -= i + 1;
+
+		/* It may have been waiting behind the previous one */
+		reply_us = rds_discover_us(&probe->sent, &now);
+		if(last.tv_sec && rds_discover_us(&last, &now) < reply_us)
+			reply_us = rds_discover_us(&last, &now);
+		last = now;
+
+		rds_discover_add(d, probe->enc, serial, reply_us, 0);
+		found++;
+
+		/* Tighten the timeout to what this line needs */
+		if(reply_us > slowest_us)
+			slowest_us = reply_us;
+		ret = slowest_us * RDS_DISCOVER_TIMEOUT_MARGIN / 1000 + 1;
+		if(ret < RDS_DISCOVER_TIMEOUT_MIN_MS)
+			ret = RDS_DISCOVER_TIMEOUT_MIN_MS;
+		if(ret < timeout)
+			timeout = ret;
+	}
+
+	d->final_timeout_ms = timeout;
+	return found;
+}
+
+/**
+ * rds_discover_fn - Do the sweep, with the encoder to ourselves
+ * @enc: pointer to &struct rds_encoder
+ * @arg: the &struct rds_discover
+ */
+static int
+rds_discover_fn(struct rds_encoder *enc, void *arg)
+{
+	struct rds_discover *d = arg;
+	uint16_t target = enc->addr;
+	int timeout_ms = enc->timeout_ms;
+	int ret = 0;
+
+	ret = rds_discover_sweep(enc, d);
+
+	enc->addr = target;
+	enc->timeout_ms = timeout_ms;
+	return ret;
+}
+
+/**
+ * rds_discover_move_fn - Move a unit and check it's there, with the
+ *			  encoder to ourselves
+ * @enc: pointer to &struct rds_encoder
+ * @arg: the &struct rds_discover_move_req
+ */
+static int
+rds_discover_move_fn(struct rds_encoder *enc, void *arg)
+{
+	struct rds_discover_move_req *req = arg;
+	char serial[RDS_SERIAL_LEN + 1];
+	uint16_t target = enc->addr;
+	uint16_t addr = 0;
+	int ret = 0;
+
+	enc->addr = rds_addr_make(enc->type, 0, req->enc_addr);
+
+	ret = enc->set_serial_addr(enc, req->serial, enc->addr);
+	if(ret < 0)
+		goto out;
+
+	ret = enc->serial_send(enc);
+	if(ret < 0)
+		goto out;
+
+	ret = enc->serial_recv(enc, &addr, serial);
+	if(ret < 0)
+		goto out;
+
+	if(addr != enc->addr || strcmp(serial, req->serial))
+		ret = -EIO;
+	else
+		ret = 0;
+
+ out:
+	enc->addr = target;
+	return ret;
+}
+
+/**
+ * rds_discover_thread_fn - Sweep one port of rds_discover_all()
+ * @arg: the &struct rds_discover_job
+ */
+static void *
+rds_discover_thread_fn(void *arg)
+{
+	struct rds_discover_job *job = arg;
+
+	job->d->ret = rds_discover(job->enc, job->d);
+	return NULL;
+}
+
+
+/**************\
+* ENTRY POINTS *
+\**************/
+
+/**
+ * rds_discover - Find the units on an encoder's port
+ * @enc: pointer to &struct rds_encoder
+ * @d: the &struct rds_discover, with units / num_units filled
+ *	on return
+ *
+ * The encoder's target address is left as is.
+ *
+ * Returns: how many units answered (only max_units of them are
+ * stored) or a negative error code
+ */
+int
+rds_discover(struct rds_encoder *enc, struct rds_discover *d)
+{
+	if(!d || d->first > d->last || (d->max_units && !d->units))
+		return -EINVAL;
+
+	if(!enc->serial_send || !enc->serial_recv)
+		return -EOPNOTSUPP;
+
+	d->num_units = 0;
+	d->final_timeout_ms = 0;
+
+	return rds_thread_run(enc, rds_discover_fn, d);
+}
+
+/**
+ * rds_discover_all - Find the units on several ports at once
+ * @encs: one encoder per port
+ * @ds: one &struct rds_discover per encoder, ret says how it went
+ * @num: how many (up to RDS_DISCOVER_PORTS_MAX)
+ *
+ * Returns: how many units answered on all ports, or a negative
+ * error code if we couldn't start the sweeps
+ */
+int
+rds_discover_all(struct rds_encoder **encs, struct rds_discover *ds,
+								int num)
+{
+	struct rds_discover_job jobs[RDS_DISCOVER_PORTS_MAX];
+	pthread_t tids[RDS_DISCOVER_PORTS_MAX];
+	int started = 0;
+	int found = 0;
+	int ret = 0;
+	int i = 0;
+
+	if(!encs || !ds || num <= 0 || num > RDS_DISCOVER_PORTS_MAX)
+		return -EINVAL;
+
+	for(i = 0; i < num; i++) {
+		jobs[i].enc = encs[i];
+		jobs[i].d = &ds[i];
+		ds[i].ret = -ECANCELED;
+	}
+
+	for(started = 0; started < num; started++) {
+		ret = pthread_create(&tids[started], NULL,
+				rds_discover_thread_fn, &jobs[started]);
+		if(ret != 0)
+			break;
+	}
+
+	for(i = 0; i < started; i++) {
+		pthread_join(tids[i], NULL);
+		if(ds[i].ret > 0)
+			found += ds[i].ret;
+	}
+
+	return (started < num) ? -ret : found;
+}
+
+/**
+ * rds_discover_move - Give a unit found by rds_discover() a new address
+ * @enc: pointer to &struct rds_encoder, on the unit's port
+ * @serial: the unit's serial number
+ * @enc_addr: its new address, as on rds_init()
+ *
+ * Works even if the unit shares its current address with another
+ * one. The encoder's target address is left as is.
+ *
+ * Returns: 0 if the unit answers on the new address, -EIO if
+ * someone else does, or a negative error code
+ */
+int
+rds_discover_move(struct rds_encoder *enc, const char *serial,
+							uint16_t enc_addr)
+{
+	struct rds_discover_move_req req;
+
+	if(!serial || !serial[0])
+		return -EINVAL;
+
+	if(!enc->set_serial_addr || !enc->serial_send || !enc->serial_recv)
+		return -EOPNOTSUPP;
+
+	req.serial = serial;
+	req.enc_addr = enc_addr;
+
+	return rds_thread_run(enc, rds_discover_move_fn, &req);
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_discover.h -	Finding the units on a port
+ */
+
+/**
+ * DOC: Discovery
+ *
+ * rds_discover() sweeps a range of addresses on a port, asking each
+ * one for its serial number, and returns the units that answered.
+ * Requests are pipelined like rds_fanout()'s reads: up to window
+ * of them go out before we wait for the first reply, and units
+ * reply in order, so a reply from a later address tells us that
+ * the ones asked before it are empty without waiting for them.
+ *
+ * Most addresses are empty, so what the sweep costs is mostly the
+ * time we wait on silence. We start with timeout_ms and, as units
+ * answer, tighten it to RDS_DISCOVER_TIMEOUT_MARGIN times the
+ * slowest reply we've seen (never below RDS_DISCOVER_TIMEOUT_MIN_MS),
+ * so on a healthy line an empty window costs a few ms on top of its
+ * wire time. If two units share an address their replies collide,
+ * the address is reported with -EPROTO so that one of them can be
+ * moved with rds_discover_move() (which finds the unit by serial
+ * number, not address).
+ *
+ * rds_discover_all() sweeps several ports at once, one thread each.
+ * Each sweep runs on its encoder's I/O thread (if any) with nobody
+ * else's commands in between. Only Prais supports discovery.
+ */
+
+#define RDS_DISCOVER_WINDOW_MAX		8
+#define RDS_DISCOVER_TIMEOUT_MS		100	/* Default timeout_ms */
+#define RDS_DISCOVER_TIMEOUT_MIN_MS	5
+#define RDS_DISCOVER_TIMEOUT_MARGIN	3
+#define RDS_DISCOVER_PORTS_MAX		16
+
+struct rds_discover_unit {
+	uint16_t enc;			/* Address, as on rds_init() */
+	char serial[RDS_SERIAL_LEN + 1];
+	uint32_t reply_us;		/* How long it took to answer */
+	int ret;			/* 0, or -EPROTO if replies collided
+					 * (more than one unit there) */
+};
+
+struct rds_discover {
+	uint16_t first;			/* Addresses to sweep, as on */
+	uint16_t last;			/* rds_init() */
+	uint8_t window;			/* Requests in flight, 0 -> one at a time */
+	uint16_t timeout_ms;		/* Initial one, 0 -> RDS_DISCOVER_TIMEOUT_MS */
+
+	struct rds_discover_unit *units;/* Filled with what we found */
+	uint16_t max_units;
+	uint16_t num_units;
+
+	uint16_t final_timeout_ms;	/* Where the adaptive timeout ended up */
+	int ret;			/* What rds_discover() returned, for
+					 * rds_discover_all() */
+};
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+int rds_discover(struct rds_encoder *enc, struct rds_discover *d);
+int rds_discover_all(struct rds_encoder **encs, struct rds_discover *ds,
+								int num);
+int rds_discover_move(struct rds_encoder *enc, const char *serial,
+							uint16_t enc_addr);
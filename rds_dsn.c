@@ -0,0 +1,396 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_dsn.c -	Data set preloading and switching
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <stdlib.h>	/* For malloc/free */
+#include <string.h>	/* For memset() / memcpy() */
+#include <pthread.h>	/* For pthread_mutex_* */
+#include "rds.h"
+#include "rds_thread.h"
+#include "rds_dsn.h"
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+/**
+ * rds_dsn_cache_get - Get an encoder's data sets, allocating them if needed
+ * @enc: pointer to &struct rds_encoder
+ *
+ * The I/O thread may look at enc->dsets at any time, so it's
+ * only set once, atomically.
+ *
+ * Returns: the &struct rds_dsn_cache or NULL and errno set
+ */
+static struct rds_dsn_cache *
+rds_dsn_cache_get(struct rds_encoder *enc)
+{
+	struct rds_dsn_cache *cache = NULL;
+	void *expected = NULL;
+
+	cache = __atomic_load_n(&enc->dsets, __ATOMIC_ACQUIRE);
+	if(cache)
+		return cache;
+
+	cache = malloc(sizeof(struct rds_dsn_cache));
+	if(!cache) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(cache, 0, sizeof(struct rds_dsn_cache));
+	pthread_mutex_init(&cache->lock, NULL);
+
+	/* Someone else got there first */
+	if(!__atomic_compare_exchange_n(&enc->dsets, &expected, cache, 0,
+					__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_destroy(&cache->lock);
+		free(cache);
+		return expected;
+	}
+
+	return cache;
+}
+
+/**
+ * rds_dsn_find - Find a preloaded data set (lock held)
+ * @cache: the &struct rds_dsn_cache
+ * @dsn: the data set
+ */
+static struct rds_dsn_set *
+rds_dsn_find(struct rds_dsn_cache *cache, uint8_t dsn)
+{
+	int i = 0;
+
+	for(i = 0; i < RDS_DSN_SETS_MAX; i++)
+		if(cache->sets[i].dsn == dsn)
+			return &cache->sets[i];
+
+	return NULL;
+}
+
+/**
+ * rds_dsn_field_cmd - Build the command that sets a profile field
+ * @profile: the &struct rds_profile
+ * @field: one RDS_PROFILE_* field
+ * @dsn: the data set to set it on
+ * @cmd: the &struct rds_cmd to fill
+ */
+static void
+rds_dsn_field_cmd(const struct rds_profile *profile, uint8_t field,
+				uint8_t dsn, struct rds_cmd *cmd)
+{
+	switch(field) {
+	case RDS_PROFILE_PI:
+		rds_cmd_init(cmd, RDS_CMD_SET_PI, dsn, 0);
+		cmd->arg.pi = profile->pi;
+		break;
+	case RDS_PROFILE_PS:
+		rds_cmd_init(cmd, RDS_CMD_SET_PS, dsn, 0);
+		memcpy(cmd->arg.ps, profile->ps, sizeof(cmd->arg.ps));
+		break;
+	case RDS_PROFILE_RT:
+		rds_cmd_init(cmd, RDS_CMD_SET_RT, dsn, 0);
+		cmd->arg.rt = profile->rt;
+		break;
+	case RDS_PROFILE_PTY:
+		rds_cmd_init(cmd, RDS_CMD_SET_PTY, dsn, 0);
+		cmd->arg.val = profile->pty;
+		break;
+	case RDS_PROFILE_TA_TP:
+		rds_cmd_init(cmd, RDS_CMD_SET_TA_TP, dsn, 0);
+		cmd->arg.val = profile->ta_tp;
+		break;
+	case RDS_PROFILE_MS:
+		rds_cmd_init(cmd, RDS_CMD_SET_MS, dsn, 0);
+		cmd->arg.val = profile->ms;
+		break;
+	case RDS_PROFILE_DI:
+		rds_cmd_init(cmd, RDS_CMD_SET_DI, dsn, 0);
+		cmd->arg.val = profile->di;
+		break;
+	case RDS_PROFILE_AF:
+		rds_cmd_init(cmd, RDS_CMD_SET_AF, dsn, 0);
+		cmd->arg.af.method = RDS_AF_METHOD_A;
+		cmd->arg.af.op = RDS_AF_OP_SET;
+		cmd->arg.af.list = profile->af;
+		break;
+	}
+}
+
+/**
+ * rds_dsn_select - Switch to another data set
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: the data set
+ *
+ * Runs on the I/O thread, if any.
+ */
+static int
+rds_dsn_select(struct rds_encoder *enc, uint8_t dsn)
+{
+	struct rds_dsn_cache *cache = NULL;
+	struct rds_dsn_set *set = NULL;
+	struct rds_profile profile;
+	struct rds_cmd cmd;
+	uint8_t field = 0;
+	int ret = 0;
+
+	if(dsn < RDS_DSN_MIN || dsn > RDS_DSN_MAX)
+		return -EINVAL;
+
+	if(!enc->set_dsn)
+		return -EOPNOTSUPP;
+
+	cache = rds_dsn_cache_get(enc);
+	if(!cache)
+		return -errno;
+
+	/* Finish its preload first */
+	while(rds_dsn_step(enc, dsn) > 0)
+		;
+
+	memset(&profile, 0, sizeof(struct rds_profile));
+
+	pthread_mutex_lock(&cache->lock);
+	set = rds_dsn_find(cache, dsn);
+	if(set) {
+		ret = set->error;
+		profile = set->profile;
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	/* Don't go on air half loaded */
+	if(ret < 0)
+		return ret;
+
+	ret = enc->set_dsn(enc, dsn);
+	if(ret < 0)
+		return ret;
+
+	cache->active = dsn;
+
+	/* The old data set's fields are gone, we
+	 * know what's on the new one if we loaded it */
+	enc->state.valid &= (RDS_STATE_CT | RDS_STATE_RDS_ON);
+	for(field = RDS_PROFILE_PI; field <= RDS_PROFILE_DI; field <<= 1) {
+		if(!(profile.set & field))
+			continue;
+		rds_dsn_field_cmd(&profile, field, 0, &cmd);
+		rds_state_update(&enc->state, &cmd);
+	}
+
+	return ret;
+}
+
+
+/**************\
+* ENTRY POINTS *
+\**************/
+
+/**
+ * rds_preload_profile - Load a station profile on a data set
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: the data set (1 - 253), normally not the active one
+ * @profile: the &struct rds_profile (copied)
+ *
+ * In threaded mode this only queues the profile, the I/O thread
+ * sends it when it has nothing else to do (see rds_dsn.h). A new
+ * profile for the same data set replaces what's still pending.
+ *
+ * Returns: 0 on success or a negative error code
+ */
+int
+rds_preload_profile(struct rds_encoder *enc, uint8_t dsn,
+				const struct rds_profile *profile)
+{
+	struct rds_dsn_cache *cache = NULL;
+	struct rds_dsn_set *set = NULL;
+	int ret = 0;
+
+	if(dsn < RDS_DSN_MIN || dsn > RDS_DSN_MAX || !profile->set)
+		return -EINVAL;
+
+	cache = rds_dsn_cache_get(enc);
+	if(!cache)
+		return -errno;
+
+	pthread_mutex_lock(&cache->lock);
+
+	set = rds_dsn_find(cache, dsn);
+	if(!set)
+		set = rds_dsn_find(cache, 0);
+	if(!set) {
+		pthread_mutex_unlock(&cache->lock);
+		return -ENOSPC;
+	}
+
+	set->dsn = dsn;
+	set->gen++;
+	set->pending = profile->set;
+	set->error = 0;
+	set->profile = *profile;
+
+	pthread_mutex_unlock(&cache->lock);
+
+	if(enc->io_thread || enc->bus) {
+		rds_thread_kick(enc);
+		return 0;
+	}
+
+	while(rds_dsn_step(enc, dsn) > 0)
+		;
+
+	pthread_mutex_lock(&cache->lock);
+	set = rds_dsn_find(cache, dsn);
+	ret = set ? set->error : 0;
+	pthread_mutex_unlock(&cache->lock);
+
+	return ret;
+}
+
+/**
+ * rds_preload_status - Check on a preloaded data set
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: the data set
+ *
+ * Returns: the RDS_PROFILE_* fields still pending (0 when it's
+ * loaded), the error that stopped it from loading, or -ENOENT
+ */
+int
+rds_preload_status(struct rds_encoder *enc, uint8_t dsn)
+{
+	struct rds_dsn_cache *cache = NULL;
+	struct rds_dsn_set *set = NULL;
+	int ret = -ENOENT;
+
+	cache = __atomic_load_n(&enc->dsets, __ATOMIC_ACQUIRE);
+	if(!cache || !dsn)
+		return -ENOENT;
+
+	pthread_mutex_lock(&cache->lock);
+	set = rds_dsn_find(cache, dsn);
+	if(set)
+		ret = set->error ? set->error : set->pending;
+	pthread_mutex_unlock(&cache->lock);
+
+	return ret;
+}
+
+/**
+ * rds_dsn_step - Send one pending field of a preloaded data set
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: only for this data set, 0 for any
+ *
+ * Called by the I/O thread when it's idle (or the caller, when
+ * not threaded). The lock is not held while the field goes out.
+ *
+ * Returns: 1 if it sent something, 0 if there was nothing to send
+ */
+int
+rds_dsn_step(struct rds_encoder *enc, uint8_t dsn)
+{
+	struct rds_dsn_cache *cache = NULL;
+	struct rds_dsn_set *set = NULL;
+	struct rds_cmd cmd;
+	uint32_t gen = 0;
+	uint8_t field = 0;
+	int ret = 0;
+	int i = 0;
+
+	cache = __atomic_load_n(&enc->dsets, __ATOMIC_ACQUIRE);
+	if(!cache)
+		return 0;
+
+	pthread_mutex_lock(&cache->lock);
+
+	for(i = 0; i < RDS_DSN_SETS_MAX; i++) {
+		set = &cache->sets[i];
+		if(set->dsn && set->pending && (!dsn || set->dsn == dsn))
+			break;
+	}
+
+	if(i == RDS_DSN_SETS_MAX) {
+		pthread_mutex_unlock(&cache->lock);
+		return 0;
+	}
+
+	field = set->pending & -set->pending;
+	rds_dsn_field_cmd(&set->profile, field, set->dsn, &cmd);
+	gen = set->gen;
+
+	pthread_mutex_unlock(&cache->lock);
+
+	ret = rds_cmd_exec(enc, &cmd);
+
+	pthread_mutex_lock(&cache->lock);
+
+	/* Unless it got replaced meanwhile */
+	if(set->gen == gen) {
+		set->pending &= ~field;
+		if(ret < 0 && !set->error)
+			set->error = ret;
+	}
+
+	pthread_mutex_unlock(&cache->lock);
+
+	return 1;
+}
+
+/**
+ * rds_dsn_exec - Run a data set command
+ * @enc: pointer to &struct rds_encoder
+ * @cmd: a RDS_CMD_GET_DSN / RDS_CMD_SET_DSN &struct rds_cmd
+ */
+int
+rds_dsn_exec(struct rds_encoder *enc, struct rds_cmd *cmd)
+{
+	struct rds_dsn_cache *cache = NULL;
+
+	if(cmd->op == RDS_CMD_SET_DSN)
+		return rds_dsn_select(enc, cmd->arg.val);
+
+	cache = __atomic_load_n(&enc->dsets, __ATOMIC_ACQUIRE);
+	if(!cache || !cache->active)
+		return -ENODATA;
+
+	return cache->active;
+}
+
+/**
+ * rds_dsn_free - Release an encoder's data sets
+ * @enc: pointer to &struct rds_encoder
+ *
+ * The I/O thread must be stopped.
+ */
+void
+rds_dsn_free(struct rds_encoder *enc)
+{
+	struct rds_dsn_cache *cache = enc->dsets;
+
+	if(!cache)
+		return;
+
+	pthread_mutex_destroy(&cache->lock);
+	free(cache);
+	enc->dsets = NULL;
+}
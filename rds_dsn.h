@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_dsn.h -	Data set preloading and switching
+ */
+
+/**
+ * DOC: Data sets
+ *
+ * UECP encoders hold several data sets (DSN 1 - 253), each with its
+ * own PS, RT, PTY, flags, AFs etc, and switch the one on air with a
+ * single UECP_MEC_DSN_SELECT message. So instead of a burst of sets
+ * when the station changes identity (e.g. live / overnight
+ * automation), the new identity is preloaded on an inactive data
+ * set with rds_preload_profile() and then rds_select_dsn() switches
+ * to it with one small frame.
+ *
+ * Preloading is background work: in threaded mode (see
+ * rds_thread.h) the I/O thread sends one field of a pending profile
+ * at a time, and only when nothing else waits on its ring, so normal
+ * commands are never delayed by more than a single preload message.
+ * Without an I/O thread rds_preload_profile() sends the profile
+ * before it returns. rds_select_dsn() sends whatever is still
+ * pending for that data set first, and refuses to switch to one
+ * that failed to load.
+ *
+ * On a switch, the shadow state (see rds_state.c) gets the values of
+ * the profile, the rest of the fields of the previous data set are
+ * marked unknown.
+ */
+
+/* Data sets an encoder may have (0 is the current one) */
+#define RDS_DSN_MIN		1
+#define RDS_DSN_MAX		253
+
+/* Data sets we preload */
+#define RDS_DSN_SETS_MAX	8
+
+struct rds_dsn_set {
+	uint8_t dsn;			/* 0 if unused */
+	uint32_t gen;			/* Bumped on each preload */
+	uint8_t pending;		/* RDS_PROFILE_* fields not sent yet */
+	int error;			/* First error while loading it */
+	struct rds_profile profile;
+};
+
+/* On enc->dsets */
+struct rds_dsn_cache {
+	pthread_mutex_t lock;		/* Preloaders vs the I/O thread */
+	uint8_t active;			/* Selected data set, 0 if unknown */
+	struct rds_dsn_set sets[RDS_DSN_SETS_MAX];
+};
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+/* Used internaly by rds_cmd_exec() / rds_exit() / the I/O thread */
+int rds_dsn_exec(struct rds_encoder *enc, struct rds_cmd *cmd);
+int rds_dsn_step(struct rds_encoder *enc, uint8_t dsn);
+void rds_dsn_free(struct rds_encoder *enc);
@@ -0,0 +1,458 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_dsp.c -	Vector kernels for the modulator / demodulator
+ *		(used internaly)
+ */
+
+#define _GNU_SOURCE	/* For M_PI */
+#include <stdint.h>	/* For sized integers */
+#include <math.h>	/* For cos() / fabs() */
+#include <pthread.h>	/* For pthread_once() */
+#include "rds_dsp.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RDS_DSP_AVX2
+#include <immintrin.h>	/* For AVX2 intrinsics */
+#elif defined(__ARM_NEON)
+#define RDS_DSP_NEON
+#include <arm_neon.h>	/* For NEON intrinsics */
+#endif
+
+struct rds_dsp_ops {
+	void (*axpy)(float *y, const float *x, float a, int len);
+	void (*mul)(float *out, const float *x, const float *y, int len);
+	void (*to_s16)(int16_t *out, const float *in, int len);
+	void (*from_s16)(float *out, const int16_t *in, int len);
+	float (*dot)(const float *x, const float *y, int len);
+};
+
+static struct rds_dsp_ops dsp_ops;
+static pthread_once_t dsp_ops_once = PTHREAD_ONCE_INIT;
+
+
+/********\
+* SCALAR *
+\********/
+
+static void
+dsp_axpy_scalar(float *y, const float *x, float a, int len)
+{
+	int i = 0;
+
+	for(i = 0; i < len; i++)
+		y[i] += a * x[i];
+}
+
+static void
+dsp_mul_scalar(float *out, const float *x, const float *y, int len)
+{
+	int i = 0;
+
+	for(i = 0; i < len; i++)
+		out[i] = x[i] * y[i];
+}
+
+static void
+dsp_to_s16_scalar(int16_t *out, const float *in, int len)
+{
+	float s = 0;
+	int i = 0;
+
+	for(i = 0; i < len; i++) {
+		s = in[i] * 32767.0f;
+		if(s > 32767.0f)
+			s = 32767.0f;
+		else if(s < -32768.0f)
+			s = -32768.0f;
+		/* Round to nearest */
+		out[i] = (int16_t) (s < 0 ? s - 0.5f : s + 0.5f);
+	}
+}
+
+static void
+dsp_from_s16_scalar(float *out, const int16_t *in, int len)
+{
+	int i = 0;
+
+	for(i = 0; i < len; i++)
+		out[i] = in[i] * (1.0f / 32768.0f);
+}
+
+static float
+dsp_dot_scalar(const float *x, const float *y, int len)
+{
+	float sum = 0;
+	int i = 0;
+
+	for(i = 0; i < len; i++)
+		sum += x[i] * y[i];
+
+	return sum;
+}
+
+
+/******\
+* AVX2 *
+\******/
+
+#ifdef RDS_DSP_AVX2
+
+__attribute__((target("avx2,fma"))) static void
+dsp_axpy_avx2(float *y, const float *x, float a, int len)
+{
+	__m256 va = _mm256_set1_ps(a);
+	int i = 0;
+
+	for(; i + 16 <= len; i += 16) {
+		__m256 y0 = _mm256_loadu_ps(y + i);
+		__m256 y1 = _mm256_loadu_ps(y + i + 8);
+		y0 = _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), y0);
+		y1 = _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i + 8), y1);
+		_mm256_storeu_ps(y + i, y0);
+		_mm256_storeu_ps(y + i + 8, y1);
+	}
+
+	for(; i + 8 <= len; i += 8)
+		_mm256_storeu_ps(y + i, _mm256_fmadd_ps(va,
+					_mm256_loadu_ps(x + i),
+					_mm256_loadu_ps(y + i)));
+
+	dsp_axpy_scalar(y + i, x + i, a, len - i);
+}
+
+__attribute__((target("avx2,fma"))) static void
+dsp_mul_avx2(float *out, const float *x, const float *y, int len)
+{
+	int i = 0;
+
+	for(; i + 8 <= len; i += 8)
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(x + i),
+						_mm256_loadu_ps(y + i)));
+
+	dsp_mul_scalar(out + i, x + i, y + i, len - i);
+}
+
+__attribute__((target("avx2,fma"))) static void
+dsp_to_s16_avx2(int16_t *out, const float *in, int len)
+{
+	__m256 scale = _mm256_set1_ps(32767.0f);
+	int i = 0;
+
+	/*
+	 * cvtps rounds to nearest (even) and packs saturates, out
+	 * of range values (|in| > 1) end up clipped like on the
+	 * scalar path
+	 */
+	for(; i + 16 <= len; i += 16) {
+		__m256i lo = _mm256_cvtps_epi32(_mm256_mul_ps(
+					_mm256_loadu_ps(in + i), scale));
+		__m256i hi = _mm256_cvtps_epi32(_mm256_mul_ps(
+					_mm256_loadu_ps(in + i + 8), scale));
+		/* packs works per 128bit lane, fix up the order */
+		__m256i packed = _mm256_permute4x64_epi64(
+					_mm256_packs_epi32(lo, hi), 0xD8);
+		_mm256_storeu_si256((__m256i *) (out + i), packed);
+	}
+
+	dsp_to_s16_scalar(out + i, in + i, len - i);
+}
+
+__attribute__((target("avx2,fma"))) static void
+dsp_from_s16_avx2(float *out, const int16_t *in, int len)
+{
+	__m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+	int i = 0;
+
+	for(; i + 8 <= len; i += 8) {
+		__m256i v = _mm256_cvtepi16_epi32(
+				_mm_loadu_si128((const __m128i *) (in + i)));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(
+					_mm256_cvtepi32_ps(v), scale));
+	}
+
+	dsp_from_s16_scalar(out + i, in + i, len - i);
+}
+
+__attribute__((target("avx2,fma"))) static float
+dsp_dot_avx2(const float *x, const float *y, int len)
+{
+	__m256 acc0 = _mm256_setzero_ps();
+	__m256 acc1 = _mm256_setzero_ps();
+	__m128 sum = _mm_setzero_ps();
+	int i = 0;
+
+	/* Two accumulators to hide the FMA latency */
+	for(; i + 16 <= len; i += 16) {
+		acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i),
+					_mm256_loadu_ps(y + i), acc0);
+		acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i + 8),
+					_mm256_loadu_ps(y + i + 8), acc1);
+	}
+
+	for(; i + 8 <= len; i += 8)
+		acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i),
+					_mm256_loadu_ps(y + i), acc0);
+
+	acc0 = _mm256_add_ps(acc0, acc1);
+	sum = _mm_add_ps(_mm256_castps256_ps128(acc0),
+			_mm256_extractf128_ps(acc0, 1));
+	sum = _mm_hadd_ps(sum, sum);
+	sum = _mm_hadd_ps(sum, sum);
+
+	return _mm_cvtss_f32(sum) + dsp_dot_scalar(x + i, y + i, len - i);
+}
+
+#endif
+
+
+/******\
+* NEON *
+\******/
+
+#ifdef RDS_DSP_NEON
+
+static void
+dsp_axpy_neon(float *y, const float *x, float a, int len)
+{
+	int i = 0;
+
+	for(; i + 8 <= len; i += 8) {
+		float32x4_t y0 = vld1q_f32(y + i);
+		float32x4_t y1 = vld1q_f32(y + i + 4);
+		y0 = vmlaq_n_f32(y0, vld1q_f32(x + i), a);
+		y1 = vmlaq_n_f32(y1, vld1q_f32(x + i + 4), a);
+		vst1q_f32(y + i, y0);
+		vst1q_f32(y + i + 4, y1);
+	}
+
+	dsp_axpy_scalar(y + i, x + i, a, len - i);
+}
+
+static void
+dsp_mul_neon(float *out, const float *x, const float *y, int len)
+{
+	int i = 0;
+
+	for(; i + 4 <= len; i += 4)
+		vst1q_f32(out + i, vmulq_f32(vld1q_f32(x + i),
+					vld1q_f32(y + i)));
+
+	dsp_mul_scalar(out + i, x + i, y + i, len - i);
+}
+
+static void
+dsp_to_s16_neon(int16_t *out, const float *in, int len)
+{
+	float32x4_t scale = vdupq_n_f32(32767.0f);
+	float32x4_t half = vdupq_n_f32(0.5f);
+	int i = 0;
+
+	for(; i + 8 <= len; i += 8) {
+		float32x4_t f0 = vmulq_f32(vld1q_f32(in + i), scale);
+		float32x4_t f1 = vmulq_f32(vld1q_f32(in + i + 4), scale);
+		/* vcvtq truncates, add +-0.5 to round to nearest */
+		f0 = vaddq_f32(f0, vbslq_f32(vcltq_f32(f0, vdupq_n_f32(0)),
+						vnegq_f32(half), half));
+		f1 = vaddq_f32(f1, vbslq_f32(vcltq_f32(f1, vdupq_n_f32(0)),
+						vnegq_f32(half), half));
+		/* Saturating narrow clips to the int16 range */
+		vst1q_s16(out + i, vcombine_s16(vqmovn_s32(vcvtq_s32_f32(f0)),
+						vqmovn_s32(vcvtq_s32_f32(f1))));
+	}
+
+	dsp_to_s16_scalar(out + i, in + i, len - i);
+}
+
+static void
+dsp_from_s16_neon(float *out, const int16_t *in, int len)
+{
+	int i = 0;
+
+	for(; i + 8 <= len; i += 8) {
+		int16x8_t v = vld1q_s16(in + i);
+		vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(
+				vmovl_s16(vget_low_s16(v))), 1.0f / 32768.0f));
+		vst1q_f32(out + i + 4, vmulq_n_f32(vcvtq_f32_s32(
+				vmovl_s16(vget_high_s16(v))), 1.0f / 32768.0f));
+	}
+
+	dsp_from_s16_scalar(out + i, in + i, len - i);
+}
+
+static float
+dsp_dot_neon(const float *x, const float *y, int len)
+{
+	float32x4_t acc0 = vdupq_n_f32(0);
+	float32x4_t acc1 = vdupq_n_f32(0);
+	float32x2_t sum;
+	int i = 0;
+
+	for(; i + 8 <= len; i += 8) {
+		acc0 = vmlaq_f32(acc0, vld1q_f32(x + i), vld1q_f32(y + i));
+		acc1 = vmlaq_f32(acc1, vld1q_f32(x + i + 4),
+						vld1q_f32(y + i + 4));
+	}
+
+	acc0 = vaddq_f32(acc0, acc1);
+	sum = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+	sum = vpadd_f32(sum, sum);
+
+	return vget_lane_f32(sum, 0) + dsp_dot_scalar(x + i, y + i, len - i);
+}
+
+#endif
+
+
+/*************\
+* DISPATCHING *
+\*************/
+
+static void
+dsp_ops_init(void)
+{
+	dsp_ops.axpy = dsp_axpy_scalar;
+	dsp_ops.mul = dsp_mul_scalar;
+	dsp_ops.to_s16 = dsp_to_s16_scalar;
+	dsp_ops.from_s16 = dsp_from_s16_scalar;
+	dsp_ops.dot = dsp_dot_scalar;
+
+#ifdef RDS_DSP_AVX2
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		dsp_ops.axpy = dsp_axpy_avx2;
+		dsp_ops.mul = dsp_mul_avx2;
+		dsp_ops.to_s16 = dsp_to_s16_avx2;
+		dsp_ops.from_s16 = dsp_from_s16_avx2;
+		dsp_ops.dot = dsp_dot_avx2;
+	}
+#elif defined(RDS_DSP_NEON)
+	dsp_ops.axpy = dsp_axpy_neon;
+	dsp_ops.mul = dsp_mul_neon;
+	dsp_ops.to_s16 = dsp_to_s16_neon;
+	dsp_ops.from_s16 = dsp_from_s16_neon;
+	dsp_ops.dot = dsp_dot_neon;
+#endif
+}
+
+/**
+ * rds_dsp_axpy - Scale and accumulate (y += a * x)
+ * @y: array to accumulate on
+ * @x: input array
+ * @a: scale factor
+ * @len: number of elements
+ */
+void
+rds_dsp_axpy(float *y, const float *x, float a, int len)
+{
+	pthread_once(&dsp_ops_once, dsp_ops_init);
+	dsp_ops.axpy(y, x, a, len);
+}
+
+/**
+ * rds_dsp_mul - Element-wise product (out = x * y)
+ * @out: output array (may be the same as @x or @y)
+ * @x: first input array
+ * @y: second input array
+ * @len: number of elements
+ */
+void
+rds_dsp_mul(float *out, const float *x, const float *y, int len)
+{
+	pthread_once(&dsp_ops_once, dsp_ops_init);
+	dsp_ops.mul(out, x, y, len);
+}
+
+/**
+ * rds_dsp_to_s16 - Convert float samples to signed 16bit PCM
+ * @out: output array
+ * @in: input array, full scale is +-1.0, anything outside gets clipped
+ * @len: number of elements
+ */
+void
+rds_dsp_to_s16(int16_t *out, const float *in, int len)
+{
+	pthread_once(&dsp_ops_once, dsp_ops_init);
+	dsp_ops.to_s16(out, in, len);
+}
+
+/**
+ * rds_dsp_from_s16 - Convert signed 16bit PCM to float samples
+ * @out: output array, full scale is +-1.0
+ * @in: input array
+ * @len: number of elements
+ */
+void
+rds_dsp_from_s16(float *out, const int16_t *in, int len)
+{
+	pthread_once(&dsp_ops_once, dsp_ops_init);
+	dsp_ops.from_s16(out, in, len);
+}
+
+/**
+ * rds_dsp_dot - Dot product, e.g. one output of an FIR filter
+ * @x: first input array
+ * @y: second input array
+ * @len: number of elements
+ */
+float
+rds_dsp_dot(const float *x, const float *y, int len)
+{
+	pthread_once(&dsp_ops_once, dsp_ops_init);
+	return dsp_ops.dot(x, y, len);
+}
+
+
+/********************\
+* RDS SYMBOL SHAPING *
+\********************/
+
+/**
+ * rds_dsp_shape - Impulse response of the data shaping filter
+ * @x: time in bit periods
+ *
+ * The filter of IEC 62106 is H(f) = cos(pi * f * td / 4) for
+ * f <= 2 / td and 0 above, its inverse Fourier transform is
+ * h(t) = cos(4 * pi * t / td) * (pi / 2) / (pi^2 / 16 - 4 * pi^2 * t^2)
+ * (in units of 1 / td). It's 0/0 at t = +-td/8, where the limit is 2.
+ */
+static double
+rds_dsp_shape(double x)
+{
+	double den = M_PI * M_PI * (1.0 / 16.0 - 4.0 * x * x);
+
+	if(fabs(den) < 1e-9)
+		return 2.0;
+
+	return cos(4.0 * M_PI * x) * (M_PI / 2.0) / den;
+}
+
+/**
+ * rds_dsp_biphase - Waveform of a shaped biphase symbol
+ * @x: time in bit periods, from the start of the symbol
+ *
+ * A biphase symbol is an impulse followed by an opposite one
+ * half a bit later, after the shaping filter that's
+ * h(t) - h(t - td/2), centered at td/4. Not normalized.
+ */
+double
+rds_dsp_biphase(double x)
+{
+	return rds_dsp_shape(x) - rds_dsp_shape(x - 0.5);
+}
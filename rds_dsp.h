@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_dsp.h -	Vector kernels for the modulator / demodulator
+ *		(used internaly)
+ */
+
+/**
+ * DOC: DSP kernels
+ *
+ * The inner loops of the modulator and the demodulator, on plain
+ * float arrays. Each one has a scalar version plus an AVX2 one on
+ * x86 (picked at runtime if the CPU has it) or a NEON one on ARM
+ * (picked at build time, NEON is always there on aarch64 and on
+ * armhf builds with -mfpu=neon).
+ *
+ * The shaped biphase symbol both of them need is also here.
+ *
+ * Arrays don't need to be aligned and lengths don't need to be a
+ * multiple of the vector width, the tail is done with scalar code.
+ */
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+void rds_dsp_axpy(float *y, const float *x, float a, int len);
+void rds_dsp_mul(float *out, const float *x, const float *y, int len);
+void rds_dsp_to_s16(int16_t *out, const float *in, int len);
+void rds_dsp_from_s16(float *out, const int16_t *in, int len);
+float rds_dsp_dot(const float *x, const float *y, int len);
+double rds_dsp_biphase(double x);
@@ -0,0 +1,400 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_eon.c -	Enhanced Other Networks services
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <stdlib.h>	/* For malloc/free */
+#include <string.h>	/* For memset() / memcmp() / strnlen() */
+#include "rds.h"
+#include "rds_charset.h"
+#include "rds_af.h"
+#include "rds_eon.h"
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+/**
+ * rds_eon_table_get - Get the EON table of a data set
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @create: allocate it if it's not there
+ *
+ * Returns: the &struct rds_eon_table or NULL and errno set
+ */
+static struct rds_eon_table *
+rds_eon_table_get(struct rds_encoder *enc, uint8_t dsn, uint8_t create)
+{
+	struct rds_eon_cache *cache = enc->eon;
+	struct rds_eon_table *table = NULL;
+	int free_slot = -1;
+	int i = 0;
+
+	if(!cache) {
+		if(!create) {
+			errno = ENOENT;
+			return NULL;
+		}
+
+		cache = malloc(sizeof(struct rds_eon_cache));
+		if(!cache) {
+			errno = ENOMEM;
+			return NULL;
+		}
+		memset(cache, 0, sizeof(struct rds_eon_cache));
+		enc->eon = cache;
+	}
+
+	for(i = 0; i < RDS_EON_TABLES_MAX; i++) {
+		table = cache->tables[i];
+		if(!table) {
+			if(free_slot < 0)
+				free_slot = i;
+			continue;
+		}
+		if(table->dsn == dsn)
+			return table;
+	}
+
+	if(!create) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	if(free_slot < 0) {
+		errno = ENOSPC;
+		return NULL;
+	}
+
+	table = malloc(sizeof(struct rds_eon_table));
+	if(!table) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(table, 0, sizeof(struct rds_eon_table));
+	table->dsn = dsn;
+	cache->tables[free_slot] = table;
+
+	return table;
+}
+
+/**
+ * rds_eon_encode_af - Encode the AFs of a linked service
+ * @list: the &struct rds_af_list
+ * @tuned: the code of our frequency they are mapped to (0 if none)
+ * @af: where to put the entries, RDS_EON_AF_MAX bytes
+ *
+ * Returns: the entries' length or -EINVAL
+ */
+static int
+rds_eon_encode_af(const struct rds_af_list *list, uint8_t *tuned,
+							uint8_t *af)
+{
+	uint8_t codes[RDS_AF_CODES_MAX];
+	uint8_t lfmf = 0;
+	int len = 0;
+	int ret = 0;
+	int i = 0;
+
+	*tuned = 0;
+
+	/* A method A list, without the count code / filler */
+	if(!list->tuned_khz) {
+		len = rds_af_encode(RDS_AF_METHOD_A, list, codes);
+		if(len < 0)
+			return len;
+		if(codes[len - 1] == RDS_AF_CODE_FILLER)
+			len--;
+		memcpy(af, codes + 1, len - 1);
+		return len - 1;
+	}
+
+	/* Mapped frequencies, FM only */
+	ret = rds_af_code(list->tuned_khz, &lfmf);
+	if(ret < 0 || lfmf || list->num > RDS_AF_LIST_MAX)
+		return -EINVAL;
+	*tuned = ret;
+
+	for(i = 0; i < list->num; i++) {
+		ret = rds_af_code(list->khz[i], &lfmf);
+		if(ret < 0 || lfmf)
+			return -EINVAL;
+		af[len++] = *tuned;
+		af[len++] = ret;
+	}
+
+	return len;
+}
+
+/**
+ * rds_eon_mark - Mark fields of a service as changed
+ * @table: the &struct rds_eon_table
+ * @svc: the &struct rds_eon_service
+ * @fields: RDS_EON_* / RDS_EON_DIRTY_* flags
+ */
+static void
+rds_eon_mark(struct rds_eon_table *table, struct rds_eon_service *svc,
+							uint8_t fields)
+{
+	uint64_t bit = 1ULL << (svc->psn % 64);
+
+	if(!fields)
+		return;
+
+	if(!(table->dirty[svc->psn / 64] & bit)) {
+		table->dirty[svc->psn / 64] |= bit;
+		table->num_dirty++;
+	}
+	svc->dirty |= fields;
+}
+
+/**
+ * rds_eon_push - Push all pending changes of a data set
+ * @enc: pointer to &struct rds_encoder
+ * @table: the &struct rds_eon_table
+ *
+ * Changed services go to the backend in PSN order, the ones it
+ * sent are marked clean.
+ *
+ * Returns: the number of services pushed or a negative error code
+ */
+static int
+rds_eon_push(struct rds_encoder *enc, struct rds_eon_table *table)
+{
+	struct rds_eon_service *svcs[RDS_EON_PSN_MAX];
+	struct rds_eon_service *svc = NULL;
+	uint64_t bits = 0;
+	int num = 0;
+	int ret = 0;
+	int i = 0;
+
+	if(!table->num_dirty)
+		return 0;
+
+	for(i = 0; i < 4; i++) {
+		bits = table->dirty[i];
+		while(bits) {
+			svcs[num++] = &table->services[i * 64 +
+						__builtin_ctzll(bits)];
+			bits &= bits - 1;
+		}
+	}
+
+	ret = enc->set_eon(enc, table->dsn, svcs, num);
+	if(ret < 0)
+		return ret;
+
+	for(i = 0; i < ret && i < num; i++) {
+		svc = svcs[i];
+		svc->dirty = 0;
+		table->dirty[svc->psn / 64] &= ~(1ULL << (svc->psn % 64));
+		table->num_dirty--;
+	}
+
+	return ret;
+}
+
+
+/**************\
+* ENTRY POINTS *
+\**************/
+
+/**
+ * rds_eon_exec - Run an EON command
+ * @enc: pointer to &struct rds_encoder
+ * @cmd: a RDS_CMD_GET_EON / RDS_CMD_SET_EON &struct rds_cmd
+ *
+ * Gets are served from the tables. Sets are checked as a whole
+ * before touching the table, so a bad field changes nothing.
+ */
+int
+rds_eon_exec(struct rds_encoder *enc, struct rds_cmd *cmd)
+{
+	struct rds_eon *eon = &cmd->arg.eon;
+	struct rds_eon_table *table = NULL;
+	struct rds_eon_service *svc = NULL;
+	uint8_t af[RDS_EON_AF_MAX];
+	uint8_t af_tuned = 0;
+	uint8_t changed = 0;
+	uint16_t pi = 0;
+	char ps[RDS_PS_LEN];
+	int len = 0;
+	int af_len = 0;
+
+	if(cmd->op == RDS_CMD_SET_EON && !enc->set_eon)
+		return -EOPNOTSUPP;
+
+	/* PSN 0 is the main service, only good for a push */
+	if(cmd->psn < RDS_EON_PSN_MIN &&
+	(cmd->op == RDS_CMD_GET_EON || eon->set))
+		return -EINVAL;
+
+	if((eon->set & ~(RDS_EON_ALL | RDS_EON_REMOVE)) ||
+	((eon->set & RDS_EON_REMOVE) && (eon->set & RDS_EON_ALL)))
+		return -EINVAL;
+
+	table = rds_eon_table_get(enc, cmd->dsn,
+			cmd->op == RDS_CMD_SET_EON && eon->set &&
+			!(eon->set & RDS_EON_REMOVE));
+	if(!table)
+		return (errno == ENOENT && cmd->op == RDS_CMD_SET_EON) ?
+								0 : -errno;
+	svc = &table->services[cmd->psn];
+
+	if(cmd->op == RDS_CMD_GET_EON) {
+		if(!svc->known)
+			return -ENOENT;
+		memset(eon, 0, sizeof(struct rds_eon));
+		eon->set = svc->known;
+		eon->pi = svc->pi_info;
+		memcpy(eon->ps, svc->ps, RDS_PS_LEN);
+		eon->pty = svc->pty;
+		eon->ta_tp = svc->ta_tp;
+		eon->af = svc->af_list;
+		return svc->known;
+	}
+
+	/* Push only */
+	if(!eon->set)
+		goto push;
+
+	/* Unlink, if it's linked */
+	if(eon->set & RDS_EON_REMOVE) {
+		if(!svc->known)
+			goto push;
+
+		/* The encoder never heard of it, just forget it */
+		if(svc->dirty & RDS_EON_DIRTY_ENABLE) {
+			table->dirty[svc->psn / 64] &= ~(1ULL << (svc->psn % 64));
+			table->num_dirty--;
+			memset(svc, 0, sizeof(struct rds_eon_service));
+			goto push;
+		}
+
+		memset(svc, 0, sizeof(struct rds_eon_service));
+		svc->psn = cmd->psn;
+		rds_eon_mark(table, svc, RDS_EON_REMOVE);
+		goto push;
+	}
+
+	/* Check everything first */
+	if(eon->set & RDS_EON_PI) {
+		pi = eon->pi.prn & 0xFF;
+		pi |= (eon->pi.coverage & 0xF) << 8;
+		pi |= (eon->pi.ccode & 0x0F00) << 4;
+	}
+
+	if(eon->set & RDS_EON_PS) {
+		/* Same conversion as the main service's PS, then pad */
+		len = rds_charset_encode((uint8_t *) ps, RDS_PS_LEN, eon->ps,
+					strnlen(eon->ps, sizeof(eon->ps)));
+		memset(ps + len, ' ', RDS_PS_LEN - len);
+	}
+
+	if((eon->set & RDS_EON_PTY) && eon->pty > 31)
+		return -EINVAL;
+
+	if((eon->set & RDS_EON_TA_TP) && eon->ta_tp > 0x3)
+		return -EINVAL;
+
+	if(eon->set & RDS_EON_AF) {
+		af_len = rds_eon_encode_af(&eon->af, &af_tuned, af);
+		if(af_len < 0)
+			return af_len;
+	}
+
+	/* Newly linked */
+	if(!svc->known) {
+		memset(svc, 0, sizeof(struct rds_eon_service));
+		svc->psn = cmd->psn;
+		changed |= RDS_EON_DIRTY_ENABLE;
+	}
+
+	/* And only mark what changed */
+	if((eon->set & RDS_EON_PI) &&
+	(!(svc->known & RDS_EON_PI) || svc->pi != pi)) {
+		svc->pi = pi;
+		svc->pi_info = eon->pi;
+		changed |= RDS_EON_PI;
+	}
+
+	if((eon->set & RDS_EON_PS) &&
+	(!(svc->known & RDS_EON_PS) || memcmp(svc->ps, ps, RDS_PS_LEN))) {
+		memcpy(svc->ps, ps, RDS_PS_LEN);
+		changed |= RDS_EON_PS;
+	}
+
+	if((eon->set & RDS_EON_PTY) &&
+	(!(svc->known & RDS_EON_PTY) || svc->pty != eon->pty)) {
+		svc->pty = eon->pty;
+		changed |= RDS_EON_PTY;
+	}
+
+	if((eon->set & RDS_EON_TA_TP) &&
+	(!(svc->known & RDS_EON_TA_TP) || svc->ta_tp != eon->ta_tp)) {
+		svc->ta_tp = eon->ta_tp;
+		changed |= RDS_EON_TA_TP;
+	}
+
+	if((eon->set & RDS_EON_AF) &&
+	(!(svc->known & RDS_EON_AF) || svc->af_tuned != af_tuned ||
+	svc->af_len != af_len || memcmp(svc->af, af, af_len))) {
+		svc->af_list = eon->af;
+		svc->af_tuned = af_tuned;
+		svc->af_len = af_len;
+		memcpy(svc->af, af, af_len);
+		changed |= RDS_EON_AF;
+	}
+
+	svc->known |= eon->set;
+	rds_eon_mark(table, svc, changed);
+
+	/* TA/TP changes can't wait */
+	if(changed & RDS_EON_TA_TP)
+		return rds_eon_push(enc, table);
+
+ push:
+	if(eon->push)
+		return rds_eon_push(enc, table);
+
+	return 0;
+}
+
+/**
+ * rds_eon_free - Release an encoder's EON tables
+ * @enc: pointer to &struct rds_encoder
+ */
+void
+rds_eon_free(struct rds_encoder *enc)
+{
+	struct rds_eon_cache *cache = enc->eon;
+	int i = 0;
+
+	if(!cache)
+		return;
+
+	for(i = 0; i < RDS_EON_TABLES_MAX; i++)
+		free(cache->tables[i]);
+	free(cache);
+	enc->eon = NULL;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_eon.h -	Enhanced Other Networks services
+ */
+
+/**
+ * DOC: Enhanced Other Networks
+ *
+ * With EON we tell receivers about the services of our sister
+ * stations (their PI, PS, PTY, TA/TP and frequencies), so that
+ * e.g. they can switch to a sister station's traffic announcement.
+ * On UECP each linked service gets its own PSN (1 - 255), and its
+ * data goes on the usual message elements with that PSN.
+ *
+ * The services of each data set live on a dense table indexed by
+ * PSN, on enc->eon. rds_set_eon() only updates
+ * the table and marks the fields that changed (setting a field to
+ * what it already is marks nothing), PSNs with changes are also
+ * marked on a bitmap. Changes go out when asked to (eon->push /
+ * rds_push_eon()), or right away when a TA/TP flag changes, since
+ * receivers need those within a group or two. Then all pending
+ * changes go to the backend at once, and only those: the UECP
+ * backend packs the changed fields of as many services as fit on
+ * each frame, and the rest of the table never hits the wire.
+ */
+
+/* PSNs of linked services (UECP's 1 - 255) */
+#define RDS_EON_PSN_MIN		1
+#define RDS_EON_PSN_MAX		255
+
+/* Data sets we keep EON tables for */
+#define RDS_EON_TABLES_MAX	4
+
+/* Internal dirty flags, next to the RDS_EON_* fields */
+#define RDS_EON_DIRTY_ENABLE	0x40	/* Newly linked service */
+
+/* AF entries (without count code / filler): a method A list, or
+ * (tuned, mapped) code pairs */
+#define RDS_EON_AF_MAX		(2 * RDS_AF_LIST_MAX)
+
+/* A linked service as passed to the backends */
+struct rds_eon_service {
+	uint8_t psn;
+	uint8_t known;			/* RDS_EON_* fields set */
+	uint8_t dirty;			/* RDS_EON_* fields / RDS_EON_DIRTY_*
+					 * flags not pushed yet, RDS_EON_REMOVE
+					 * if it got unlinked */
+	uint16_t pi;			/* As it goes on air */
+	struct rds_pi pi_info;		/* As set */
+	char ps[RDS_PS_LEN];
+	uint8_t pty;
+	uint8_t ta_tp;
+	struct rds_af_list af_list;	/* As set */
+	uint8_t af_tuned;		/* Code of our frequency the AFs are
+					 * mapped to, 0 for a method A list */
+	uint8_t af_len;
+	uint8_t af[RDS_EON_AF_MAX];
+};
+
+/* The services of a data set, indexed by PSN (0 is the
+ * main service, unused here) */
+struct rds_eon_table {
+	uint8_t dsn;
+	uint8_t num_dirty;
+	uint64_t dirty[4];		/* One bit per PSN */
+	struct rds_eon_service services[RDS_EON_PSN_MAX + 1];
+};
+
+/* On enc->eon */
+struct rds_eon_cache {
+	struct rds_eon_table *tables[RDS_EON_TABLES_MAX];
+};
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+/* Used internaly by rds_cmd_exec() / rds_exit() */
+int rds_eon_exec(struct rds_encoder *enc, struct rds_cmd *cmd);
+void rds_eon_free(struct rds_encoder *enc);
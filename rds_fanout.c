@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_fanout.c -	One change to a group of units, with optional
+ *			per-unit confirmation
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <string.h>	/* For memset() */
+#include <time.h>	/* For clock_gettime() / clock_nanosleep() */
+#include "rds.h"
+#include "rds_thread.h"
+#include "rds_fanout.h"
+
+
+/* What rds_fanout_fn() works on */
+struct rds_fanout_req {
+	struct rds_cmd *cmd;
+	struct rds_fanout *fo;
+};
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+/**
+ * rds_fanout_check - Check what a unit replied against the change
+ * @cmd: the set &struct rds_cmd that was sent
+ * @got: the get &struct rds_cmd we read back
+ * @ret: what the read returned
+ *
+ * Both go through a &struct rds_state, so they get compared the
+ * way rds_state_diff() compares them (e.g. PS padding doesn't
+ * matter).
+ */
+static int
+rds_fanout_check(const struct rds_cmd *cmd, struct rds_cmd *got, int ret)
+{
+	struct rds_state want;
+	struct rds_state have;
+
+	memset(&want, 0, sizeof(struct rds_state));
+	memset(&have, 0, sizeof(struct rds_state));
+
+	/* Flags / codes are returned, not filled in */
+	switch(cmd->op) {
+	case RDS_CMD_SET_DI:
+	case RDS_CMD_SET_DYNPTY:
+	case RDS_CMD_SET_TA_TP:
+	case RDS_CMD_SET_MS:
+	case RDS_CMD_SET_PTY:
+	case RDS_CMD_SET_CT:
+	case RDS_CMD_SET_RDS_ON:
+		got->arg.val = ret;
+		break;
+	default:
+		break;
+	}
+
+	got->op = cmd->op;
+	rds_state_update(&want, cmd);
+	rds_state_update(&have, got);
+
+	return rds_state_diff(&want, &have) ? -EIO : 0;
+}
+
+/**
+ * rds_fanout_pace - Wait for our turn to send the next read
+ * @next: when the next read may go out (CLOCK_MONOTONIC), updated
+ * @interval_ns: time between reads, 0 for no limit
+ */
+static void
+rds_fanout_pace(struct timespec *next, uint64_t interval_ns)
+{
+	struct timespec now;
+	uint64_t ns = 0;
+
+	if(!interval_ns)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if(now.tv_sec > next->tv_sec || (now.tv_sec == next->tv_sec &&
+	now.tv_nsec > next->tv_nsec))
+		*next = now;
+	else
+		while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+						next, NULL) == EINTR);
+
+	ns = next->tv_nsec + interval_ns;
+	next->tv_sec += ns / 1000000000;
+	next->tv_nsec = ns % 1000000000;
+}
+
+/**
+ * rds_fanout_verify - Read the changed field back from each unit
+ * @enc: pointer to &struct rds_encoder
+ * @cmd: the set &struct rds_cmd that was sent
+ * @fo: the &struct rds_fanout
+ *
+ * Units from first to next - 1 have a read in flight (ret is
+ * -EINPROGRESS until they reply).
+ *
+ * Returns: the number of units confirmed
+ */
+static int
+rds_fanout_verify(struct rds_encoder *enc, const struct rds_cmd *cmd,
+						struct rds_fanout *fo)
+{
+	struct rds_fanout_unit *unit = NULL;
+	struct rds_cmd get;
+	struct timespec next = { 0, 0 };
+	uint64_t interval_ns = 0;
+	uint16_t addr = 0;
+	int window = 0;
+	int first = 0;
+	int next_unit = 0;
+	int confirmed = 0;
+	int ret = 0;
+	int i = 0;
+
+	window = fo->window ? fo->window : 1;
+	if(window > RDS_FANOUT_WINDOW_MAX)
+		window = RDS_FANOUT_WINDOW_MAX;
+
+	if(fo->max_rate)
+		interval_ns = 1000000000ULL / fo->max_rate;
+
+	while(first < fo->num_units) {
+		/* Fill the window */
+		while(next_unit < fo->num_units &&
+		next_unit - first < window) {
+			unit = &fo->units[next_unit++];
+
+			rds_fanout_pace(&next, interval_ns);
+
+			rds_cmd_init(&get, cmd->op & ~1, cmd->dsn, cmd->psn);
+			enc->addr = rds_addr_make(enc->type, unit->site,
+								unit->enc);
+			ret = enc->read_send(enc, &get);
+			unit->ret = (ret < 0) ? ret : -EINPROGRESS;
+		}
+
+		/* Skip the ones we couldn't ask */
+		while(first < next_unit && fo->units[first].ret != -EINPROGRESS)
+			first++;
+		if(first == next_unit)
+			continue;
+
+		rds_cmd_init(&get, cmd->op & ~1, cmd->dsn, cmd->psn);
+		ret = enc->read_recv(enc, &addr, &get);
+
+		/* Nothing came, or it got garbled and the input was
+		 * flushed, either way the window is lost */
+		if(ret == -ENODATA || ret == -ETIME || ret == -EPROTO) {
+			for(i = first; i < next_unit; i++)
+				if(fo->units[i].ret == -EINPROGRESS)
+					fo->units[i].ret = (ret == -EPROTO) ?
+							-EPROTO : -ETIME;
+			first = next_unit;
+			continue;
+		}
+
+		for(i = first; i < next_unit; i++) {
+			unit = &fo->units[i];
+			if(unit->ret == -EINPROGRESS && addr ==
+			rds_addr_make(enc->type, unit->site, unit->enc))
+				break;
+		}
+
+		/* Not one of ours */
+		if(i == next_unit)
+			continue;
+
+		/* Replies come in order, whoever was asked
+		 * before it and didn't reply never will */
+		for(; first < i; first++)
+			if(fo->units[first].ret == -EINPROGRESS)
+				fo->units[first].ret = -ETIME;
+
+		unit->ret = (ret < 0) ? ret : rds_fanout_check(cmd, &get, ret);
+		if(!unit->ret)
+			confirmed++;
+	}
+
+	return confirmed;
+}
+
+/**
+ * rds_fanout_fn - Do the fan-out, with the encoder to ourselves
+ * @enc: pointer to &struct rds_encoder
+ * @arg: the &struct rds_fanout_req
+ */
+static int
+rds_fanout_fn(struct rds_encoder *enc, void *arg)
+{
+	struct rds_fanout_req *req = arg;
+	struct rds_fanout *fo = req->fo;
+	uint16_t target = enc->addr;
+	uint16_t group = 0;
+	int ret = 0;
+	int i = 0;
+
+	group = rds_addr_make(enc->type, fo->site, fo->enc);
+
+	/* If our target gets it too, record it */
+	enc->addr = group;
+	if(rds_addr_covers(enc->type, group, target))
+		ret = rds_cmd_exec(enc, req->cmd);
+	else
+		ret = rds_cmd_dispatch(enc, req->cmd);
+	if(ret < 0)
+		goto out;
+
+	if(!fo->num_units)
+		goto out;
+
+	if(!enc->read_send || !enc->read_recv ||
+	!(RDS_STATE_BIT(req->cmd->op) & RDS_STATE_ALL)) {
+		for(i = 0; i < fo->num_units; i++)
+			fo->units[i].ret = -EOPNOTSUPP;
+		ret = 0;
+		goto out;
+	}
+
+	ret = rds_fanout_verify(enc, req->cmd, fo);
+
+ out:
+	enc->addr = target;
+	return ret;
+}
+
+
+/**************\
+* ENTRY POINTS *
+\**************/
+
+/**
+ * rds_fanout - Send a change to a group of units at once
+ * @enc: pointer to &struct rds_encoder
+ * @cmd: the set &struct rds_cmd to send
+ * @fo: the &struct rds_fanout, with units' results filled
+ *	on return
+ *
+ * The change goes out as a single frame to fo->site / fo->enc,
+ * then (if fo->units is set) each unit is asked for the field
+ * and its ret says if it carries the change. Only fields of the
+ * main service that the backend can read back in one exchange
+ * can be confirmed (PI, PS, flags, PTY, RDS on / off on Prais),
+ * for the rest units get -EOPNOTSUPP.
+ *
+ * Returns: the number of units confirmed (0 if none were given)
+ * or a negative error code if the change couldn't be sent
+ */
+int
+rds_fanout(struct rds_encoder *enc, struct rds_cmd *cmd,
+					struct rds_fanout *fo)
+{
+	struct rds_fanout_req req;
+
+	if(!RDS_CMD_IS_SET(cmd->op) || (fo->num_units && !fo->units))
+		return -EINVAL;
+
+	if(enc->type != RDS_ENCODER_TYPE_PRAIS &&
+	enc->type != RDS_ENCODER_TYPE_UECP)
+		return -EOPNOTSUPP;
+
+	req.cmd = cmd;
+	req.fo = fo;
+
+	return rds_thread_run(enc, rds_fanout_fn, &req);
+}
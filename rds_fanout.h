@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_fanout.h -	One change to a group of units, with optional
+ *			per-unit confirmation
+ */
+
+/**
+ * DOC: Fan-out
+ *
+ * On a multi-drop line (e.g. RS-485) with many units, sending the
+ * same change to each one costs N frames of wire time. Instead
+ * rds_fanout() sends it once, to an address all of them answer to
+ * (broadcast, or on UECP a site address they were given with
+ * rds_add_site_addr()), so the update itself is one frame no matter
+ * how many units there are.
+ *
+ * Broadcast frames get no reply, so if the caller passes a list of
+ * units we then confirm each one by reading the field back. Reads
+ * are pipelined, up to window requests go out before we wait for
+ * the first reply, and rate-limited so that the verification pass
+ * doesn't hog the line. Replies are matched to units by the address
+ * they carry. Units reply in order, so a unit that a later one
+ * replied before is marked as missed without waiting for a timeout.
+ *
+ * The encoder's own target gets no special treatment, its shadow
+ * state is updated only if the group address reaches it. The whole
+ * thing runs on the encoder's I/O thread (if any) with nobody else's
+ * commands in between, so for its duration the line is ours. Not
+ * available through rdsd.
+ */
+
+#define RDS_FANOUT_WINDOW_MAX		8
+
+struct rds_fanout_unit {
+	uint16_t site;			/* UECP only */
+	uint16_t enc;
+	int ret;			/* 0 if confirmed, -EIO if it carries
+					 * something else, else why we couldn't
+					 * tell (e.g. -ETIME for no reply) */
+};
+
+struct rds_fanout {
+	uint16_t site;			/* Address the change goes to, as on */
+	uint16_t enc;			/* rds_init() (e.g. 0 / 0 on UECP and
+					 * 0xFFFF on Prais for broadcast) */
+	struct rds_fanout_unit *units;	/* Units to confirm (optional) */
+	uint16_t num_units;
+	uint8_t window;			/* Reads in flight, 0 -> one at a time */
+	uint16_t max_rate;		/* Reads per second, 0 -> no limit */
+};
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+int rds_fanout(struct rds_encoder *enc, struct rds_cmd *cmd,
+					struct rds_fanout *fo);
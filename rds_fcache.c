@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_fcache.c -	Cache of serialized frames (used internaly)
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <stdlib.h>	/* For malloc/free */
+#include <string.h>	/* For memset() */
+#include "rds.h"
+#include "rds_fcache.h"
+
+
+/**
+ * rds_fcache_key_init - Build a cache key for a command
+ * @key: the &struct rds_fcache_key to fill
+ * @enc: pointer to &struct rds_encoder
+ * @code: backend's command code (MEC, message type etc)
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @payload: the raw input of the command
+ * @len: payload's length
+ *
+ * Returns: 0 on success, -ENOSPC if the payload is too big
+ * to be cached (or caching is disabled)
+ */
+int
+rds_fcache_key_init(struct rds_fcache_key *key, struct rds_encoder *enc,
+			uint8_t code, uint8_t dsn, uint8_t psn,
+			const void *payload, int len)
+{
+	uint32_t hash = 2166136261U;	/* FNV-1a */
+	int i = 0;
+
+	key->len = 0;
+
+	if(!enc->fcache || len + 3 > RDS_FCACHE_KEY_MAX)
+		return -ENOSPC;
+
+	key->addr = enc->addr;
+	key->data[0] = code;
+	key->data[1] = dsn;
+	key->data[2] = psn;
+	memcpy(key->data + 3, payload, len);
+	key->len = len + 3;
+
+	for(i = 0; i < key->len; i++) {
+		hash ^= key->data[i];
+		hash *= 16777619U;
+	}
+	hash ^= key->addr;
+	hash *= 16777619U;
+
+	key->hash = hash;
+	return 0;
+}
+
+/**
+ * rds_fcache_lookup - Look for a cached frame
+ * @enc: pointer to &struct rds_encoder
+ * @key: the command's &struct rds_fcache_key
+ *
+ * Returns: the matching entry or NULL
+ */
+struct rds_fcache_entry *
+rds_fcache_lookup(struct rds_encoder *enc, const struct rds_fcache_key *key)
+{
+	struct rds_fcache *fc = enc->fcache;
+	struct rds_fcache_entry *entry = NULL;
+	int i = 0;
+
+	if(!fc || key->len == 0)
+		return NULL;
+
+	for(i = 0; i < fc->num_entries; i++) {
+		entry = &fc->entries[i];
+		if(entry->key.hash != key->hash || entry->len == 0 ||
+		entry->key.len != key->len || entry->key.addr != key->addr ||
+		memcmp(entry->key.data, key->data, key->len))
+			continue;
+
+		entry->stamp = ++fc->clock;
+		fc->hits++;
+		return entry;
+	}
+
+	fc->misses++;
+	return NULL;
+}
+
+/**
+ * rds_fcache_store - Add a serialized frame on the cache
+ * @enc: pointer to &struct rds_encoder
+ * @key: the command's &struct rds_fcache_key
+ * @frame: the frame, as it goes on the wire
+ * @len: frame's length
+ *
+ * Evicts the least recently used entry if needed.
+ */
+void
+rds_fcache_store(struct rds_encoder *enc, const struct rds_fcache_key *key,
+					const uint8_t *frame, int len)
+{
+	struct rds_fcache *fc = enc->fcache;
+	struct rds_fcache_entry *victim = NULL;
+	int i = 0;
+
+	if(!fc || key->len == 0 || len > RDS_FCACHE_FRAME_MAX)
+		return;
+
+	victim = &fc->entries[0];
+	for(i = 0; i < fc->num_entries; i++) {
+		/* Free slot */
+		if(fc->entries[i].len == 0) {
+			victim = &fc->entries[i];
+			break;
+		}
+
+		if(fc->entries[i].stamp < victim->stamp)
+			victim = &fc->entries[i];
+	}
+
+	victim->key = *key;
+	victim->stamp = ++fc->clock;
+	victim->len = len;
+	memcpy(victim->frame, frame, len);
+}
+
+/**
+ * rds_fcache_flush - Drop all cached frames
+ * @enc: pointer to &struct rds_encoder
+ */
+void
+rds_fcache_flush(struct rds_encoder *enc)
+{
+	struct rds_fcache *fc = enc->fcache;
+	int i = 0;
+
+	if(!fc)
+		return;
+
+	for(i = 0; i < fc->num_entries; i++)
+		fc->entries[i].len = 0;
+}
+
+/**
+ * rds_set_frame_cache - Enable / disable the frame cache of an encoder
+ * @enc: pointer to &struct rds_encoder
+ * @entries: number of frames to keep, 0 to disable
+ */
+int
+rds_set_frame_cache(struct rds_encoder *enc, uint8_t entries)
+{
+	struct rds_fcache *fc = NULL;
+
+	if(entries > RDS_FCACHE_ENTRIES_MAX)
+		return -EINVAL;
+
+	free(enc->fcache);
+	enc->fcache = NULL;
+
+	if(entries == 0)
+		return 0;
+
+	fc = malloc(sizeof(struct rds_fcache) +
+			entries * sizeof(struct rds_fcache_entry));
+	if(!fc)
+		return -ENOMEM;
+	memset(fc, 0, sizeof(struct rds_fcache) +
+			entries * sizeof(struct rds_fcache_entry));
+
+	fc->num_entries = entries;
+	enc->fcache = fc;
+
+	return 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_fcache.h -	Cache of serialized frames (used internaly)
+ */
+
+/**
+ * DOC: Frame cache
+ *
+ * PS rotations, station ID RadioTexts etc get sent again and again
+ * with the same content. When enabled (see rds_set_frame_cache())
+ * backends keep the fully serialized frame (stuffed / escaped, with
+ * CRC / checksum) of each command they send on a small per-encoder
+ * LRU, keyed by the command code, DSN, PSN, the raw input given by
+ * the caller and the target address. Sending the same thing again
+ * skips building the frame and just writes out the cached bytes.
+ */
+
+/* Big enough for a command code + DSN + PSN + a full RadioText
+ * with its RT+ tags */
+#define RDS_FCACHE_KEY_MAX	80
+
+/* Frames bigger than this don't get cached */
+#define RDS_FCACHE_FRAME_MAX	192
+
+#define RDS_FCACHE_ENTRIES_MAX	64
+
+struct rds_fcache_key {
+	uint32_t hash;
+	uint16_t addr;			/* Target address */
+	uint8_t len;
+	uint8_t data[RDS_FCACHE_KEY_MAX];
+};
+
+struct rds_fcache_entry {
+	struct rds_fcache_key key;
+	uint32_t stamp;			/* Last use, for LRU */
+	uint16_t len;
+	uint8_t frame[RDS_FCACHE_FRAME_MAX];
+};
+
+struct rds_fcache {
+	uint8_t num_entries;
+	uint32_t clock;
+	uint32_t hits;
+	uint32_t misses;
+	struct rds_fcache_entry entries[];
+};
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+int rds_fcache_key_init(struct rds_fcache_key *key, struct rds_encoder *enc,
+			uint8_t code, uint8_t dsn, uint8_t psn,
+			const void *payload, int len);
+struct rds_fcache_entry *rds_fcache_lookup(struct rds_encoder *enc,
+					const struct rds_fcache_key *key);
+void rds_fcache_store(struct rds_encoder *enc,
+			const struct rds_fcache_key *key,
+			const uint8_t *frame, int len);
+void rds_fcache_flush(struct rds_encoder *enc);
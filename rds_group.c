@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_group.c -	Encoder groups (simulcast)
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <stdlib.h>	/* For malloc/free */
+#include <string.h>	/* For memset() */
+#include <pthread.h>	/* For pthread_* */
+#include <time.h>	/* For nanosleep() */
+#include "rds.h"
+#include "rds_thread.h"
+#include "rds_group.h"
+
+
+/* State of a single rds_group_run() call */
+struct rds_group_run {
+	struct rds_group *grp;
+	struct rds_future futs[RDS_GROUP_MAX_MEMBERS];
+	int *results;
+	rds_group_cb cb;
+	void *cb_arg;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint8_t pending;
+};
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+/**
+ * rds_group_member_done - Completion callback for a member's command
+ * @enc: pointer to &struct rds_encoder (the member)
+ * @fut: the member's &struct rds_future
+ * @arg: pointer to &struct rds_group_run
+ */
+static void
+rds_group_member_done(struct rds_encoder *enc, struct rds_future *fut,
+								void *arg)
+{
+	struct rds_group_run *run = arg;
+	uint8_t idx = fut - run->futs;
+
+	if(run->results)
+		run->results[idx] = fut->ret;
+
+	if(run->cb)
+		run->cb(run->grp, idx, enc, fut->ret, run->cb_arg);
+
+	pthread_mutex_lock(&run->lock);
+	if(--run->pending == 0)
+		pthread_cond_signal(&run->cond);
+	pthread_mutex_unlock(&run->lock);
+}
+
+
+/**************\
+* ENTRY POINTS *
+\**************/
+
+/**
+ * rds_group_run - Run a command on all members of a group in parallel
+ * @grp: pointer to &struct rds_group
+ * @cmd: the &struct rds_cmd to run
+ * @results: optional array of RDS_GROUP_MAX_MEMBERS ints to fill
+ *	with each member's return value (in member order)
+ * @cb: optional per-member completion callback
+ * @arg: argument for @cb
+ *
+ * Returns when all members are done. Results of get commands
+ * are not returned (use rds_cmd_run() on a member for that).
+ *
+ * Returns: 0 if all members succeeded, else the number of
+ * members that failed
+ */
+int
+rds_group_run(struct rds_group *grp, const struct rds_cmd *cmd,
+				int *results, rds_group_cb cb, void *arg)
+{
+	struct timespec backoff = { 0, 1000000 };
+	struct rds_group_run *run = NULL;
+	uint8_t failed = 0;
+	uint8_t i = 0;
+	int ret = 0;
+
+	run = malloc(sizeof(struct rds_group_run));
+	if(!run)
+		return -ENOMEM;
+	memset(run, 0, sizeof(struct rds_group_run));
+
+	run->grp = grp;
+	run->results = results;
+	run->cb = cb;
+	run->cb_arg = arg;
+	pthread_mutex_init(&run->lock, NULL);
+	pthread_cond_init(&run->cond, NULL);
+	run->pending = grp->num_members;
+
+	/* Fire them all before waiting on any of them */
+	for(i = 0; i < grp->num_members; i++) {
+		rds_future_init(&run->futs[i], cmd);
+		run->futs[i].cb = rds_group_member_done;
+		run->futs[i].cb_arg = run;
+
+		while((ret = rds_submit(grp->members[i],
+					&run->futs[i])) == -EAGAIN)
+			nanosleep(&backoff, NULL);
+
+		if(ret < 0) {
+			run->futs[i].ret = ret;
+			rds_group_member_done(grp->members[i],
+						&run->futs[i], run);
+		}
+	}
+
+	pthread_mutex_lock(&run->lock);
+	while(run->pending > 0)
+		pthread_cond_wait(&run->cond, &run->lock);
+	pthread_mutex_unlock(&run->lock);
+
+	for(i = 0; i < grp->num_members; i++)
+		if(run->futs[i].ret < 0)
+			failed++;
+
+	pthread_cond_destroy(&run->cond);
+	pthread_mutex_destroy(&run->lock);
+	free(run);
+
+	return failed;
+}
+
+/**
+ * rds_group_add - Add an encoder to a group
+ * @grp: pointer to &struct rds_group
+ * @enc: pointer to &struct rds_encoder to add
+ */
+int
+rds_group_add(struct rds_group *grp, struct rds_encoder *enc)
+{
+	int ret = 0;
+
+	if(grp->num_members >= RDS_GROUP_MAX_MEMBERS)
+		return -ENOSPC;
+
+	if(!enc->io_thread) {
+		ret = rds_thread_start(enc, 0);
+		if(ret < 0)
+			return ret;
+		grp->started_thread[grp->num_members] = 1;
+	} else
+		grp->started_thread[grp->num_members] = 0;
+
+	grp->members[grp->num_members++] = enc;
+
+	return 0;
+}
+
+/**
+ * rds_group_remove - Remove an encoder from a group
+ * @grp: pointer to &struct rds_group
+ * @enc: pointer to &struct rds_encoder to remove
+ */
+int
+rds_group_remove(struct rds_group *grp, struct rds_encoder *enc)
+{
+	uint8_t i = 0;
+
+	for(i = 0; i < grp->num_members; i++)
+		if(grp->members[i] == enc)
+			break;
+
+	if(i == grp->num_members)
+		return -ENOENT;
+
+	if(grp->started_thread[i])
+		rds_thread_stop(enc);
+
+	for(; i + 1 < grp->num_members; i++) {
+		grp->members[i] = grp->members[i + 1];
+		grp->started_thread[i] = grp->started_thread[i + 1];
+	}
+	grp->num_members--;
+
+	return 0;
+}
+
+struct rds_group *
+rds_group_create(void)
+{
+	struct rds_group *grp = NULL;
+
+	grp = malloc(sizeof(struct rds_group));
+	if(!grp)
+		return NULL;
+	memset(grp, 0, sizeof(struct rds_group));
+
+	return grp;
+}
+
+void
+rds_group_destroy(struct rds_group *grp)
+{
+	while(grp->num_members > 0)
+		rds_group_remove(grp, grp->members[grp->num_members - 1]);
+
+	free(grp);
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_group.h -	Encoder groups (simulcast)
+ */
+
+/**
+ * DOC: Encoder groups
+ *
+ * A group bundles encoders that should carry the same data, e.g.
+ * one per transmitter, possibly of different types. A command sent
+ * to the group is queued on every member's I/O thread at once, so
+ * the transfers run in parallel and the total latency is that of
+ * the slowest member instead of the sum of all of them.
+ *
+ * Members that are not in threaded mode are switched to it when
+ * added, and switched back when removed / when the group is
+ * destroyed.
+ */
+
+#define RDS_GROUP_MAX_MEMBERS	16
+
+struct rds_group {
+	uint8_t num_members;
+	struct rds_encoder *members[RDS_GROUP_MAX_MEMBERS];
+	uint8_t started_thread[RDS_GROUP_MAX_MEMBERS];	/* We put it in
+							 * threaded mode */
+};
+
+/* Per-member completion callback, called from the member's I/O thread */
+typedef void (*rds_group_cb)(struct rds_group *grp, uint8_t idx,
+					struct rds_encoder *enc, int ret,
+					void *arg);
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+struct rds_group *rds_group_create(void);
+void rds_group_destroy(struct rds_group *grp);
+int rds_group_add(struct rds_group *grp, struct rds_encoder *enc);
+int rds_group_remove(struct rds_group *grp, struct rds_encoder *enc);
+int rds_group_run(struct rds_group *grp, const struct rds_cmd *cmd,
+				int *results, rds_group_cb cb, void *arg);
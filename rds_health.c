@@ -0,0 +1,488 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_health.c -	Background health monitor
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <stdlib.h>	/* For malloc/free */
+#include <string.h>	/* For memset() */
+#include <time.h>	/* For clock_gettime() */
+#include <pthread.h>	/* For pthread_* */
+#include "rds.h"
+#include "rds_thread.h"
+#include "rds_health.h"
+
+/* Fields we can read back with a single exchange, to find out
+ * what an encoder lost */
+static const uint8_t rds_health_readable[] = {
+	RDS_CMD_GET_PI,
+	RDS_CMD_GET_PS,
+	RDS_CMD_GET_DI,
+	RDS_CMD_GET_DYNPTY,
+	RDS_CMD_GET_TA_TP,
+	RDS_CMD_GET_MS,
+	RDS_CMD_GET_PTY,
+	RDS_CMD_GET_RDS_ON,
+};
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+/**
+ * rds_health_is_link_error - Check if an error means we lost the encoder
+ * @ret: a command's return value
+ */
+static int
+rds_health_is_link_error(int ret)
+{
+	switch(ret) {
+	case -ETIME:
+	case -ENODATA:
+	case -EPROTO:
+	case -EIO:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * rds_health_can_read - Check if the backend can read a field back
+ * @enc: pointer to &struct rds_encoder
+ * @op: one of rds_health_readable
+ */
+static int
+rds_health_can_read(struct rds_encoder *enc, uint8_t op)
+{
+	switch(op) {
+	case RDS_CMD_GET_PI:
+		return enc->get_pi != NULL;
+	case RDS_CMD_GET_PS:
+		return enc->get_ps != NULL;
+	case RDS_CMD_GET_DI:
+		return enc->get_di != NULL;
+	case RDS_CMD_GET_DYNPTY:
+		return enc->get_dynpty != NULL;
+	case RDS_CMD_GET_TA_TP:
+		return enc->get_ta_tp != NULL;
+	case RDS_CMD_GET_MS:
+		return enc->get_ms != NULL;
+	case RDS_CMD_GET_PTY:
+		return enc->get_pty != NULL;
+	case RDS_CMD_GET_RDS_ON:
+		return enc->get_rds_on != NULL;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * rds_health_now - Get CLOCK_MONOTONIC, optionally some ms later
+ * @ts: the &struct timespec to fill
+ * @after_ms: how far in the future
+ */
+static void
+rds_health_now(struct timespec *ts, uint32_t after_ms)
+{
+	uint64_t ns = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, ts);
+
+	ns = ts->tv_nsec + (uint64_t) after_ms * 1000000;
+	ts->tv_sec += ns / 1000000000;
+	ts->tv_nsec = ns % 1000000000;
+}
+
+/**
+ * rds_health_read - Read a field of the encoder's main service
+ * @enc: pointer to &struct rds_encoder
+ * @op: the RDS_CMD_GET_* to run
+ * @have: the &struct rds_state to record it on
+ *
+ * Goes straight to the backend, the shadow state is not touched.
+ */
+static int
+rds_health_read(struct rds_encoder *enc, uint8_t op, struct rds_state *have)
+{
+	struct rds_cmd cmd;
+	int ret = 0;
+
+	rds_cmd_init(&cmd, op, 0, 0);
+	ret = rds_cmd_dispatch(enc, &cmd);
+	if(ret < 0)
+		return ret;
+
+	/* Flags / codes are returned, not filled in */
+	switch(op) {
+	case RDS_CMD_GET_DI:
+	case RDS_CMD_GET_DYNPTY:
+	case RDS_CMD_GET_TA_TP:
+	case RDS_CMD_GET_MS:
+	case RDS_CMD_GET_PTY:
+	case RDS_CMD_GET_RDS_ON:
+		cmd.arg.val = ret;
+		break;
+	default:
+		break;
+	}
+
+	/* Record it as if we had set it */
+	cmd.op = op | 1;
+	rds_state_update(have, &cmd);
+
+	return 0;
+}
+
+/**
+ * rds_health_probe_fn - Check lock status and fingerprint, with the
+ *			 encoder to ourselves
+ * @enc: pointer to &struct rds_encoder
+ * @arg: the &struct rds_health, results go there
+ *
+ * Returns: how long we kept the link, in us
+ */
+static int
+rds_health_probe_fn(struct rds_encoder *enc, void *arg)
+{
+	struct rds_health *h = arg;
+	struct rds_state have;
+	struct timespec start;
+	struct timespec end;
+	uint32_t bit = RDS_STATE_BIT(h->fp_op);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	h->lock_ret = enc->get_lock ? enc->get_lock(enc) : -EOPNOTSUPP;
+	h->fp_ret = 0;
+	h->fp_mismatch = 0;
+
+	if(!rds_health_is_link_error(h->lock_ret)) {
+		memset(&have, 0, sizeof(struct rds_state));
+		h->fp_ret = rds_health_read(enc, h->fp_op, &have);
+
+		/* Only if we know what it should be */
+		if(h->fp_ret == 0 && (enc->state.valid & bit) &&
+		(rds_state_diff(&enc->state, &have) & bit))
+			h->fp_mismatch = 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return (end.tv_sec - start.tv_sec) * 1000000 +
+		(end.tv_nsec - start.tv_nsec) / 1000;
+}
+
+/**
+ * rds_health_resync_fn - Push what the encoder lost, with the encoder
+ *			  to ourselves
+ * @enc: pointer to &struct rds_encoder
+ * @arg: the &struct rds_health
+ *
+ * Fields that read back the same as on the shadow state are left
+ * alone, the rest (including the ones we can't read) are pushed.
+ */
+static int
+rds_health_resync_fn(struct rds_encoder *enc, void *arg)
+{
+	struct rds_health *h = arg;
+	struct rds_state have;
+	struct rds_state shadow;
+	uint32_t mask = 0;
+	int ret = 0;
+	uint32_t i = 0;
+
+	memset(&have, 0, sizeof(struct rds_state));
+
+	for(i = 0; i < sizeof(rds_health_readable); i++) {
+		ret = rds_health_read(enc, rds_health_readable[i], &have);
+		if(rds_health_is_link_error(ret))
+			return ret;
+	}
+
+	/* rds_state_apply() updates it as it goes */
+	shadow = enc->state;
+	mask = rds_state_diff(&shadow, &have) & shadow.valid;
+	h->last_resync_mask = mask;
+
+	return rds_state_apply(enc, &shadow, mask);
+}
+
+/**
+ * rds_health_event - Tell the caller
+ * @h: the &struct rds_health
+ * @event: RDS_HEALTH_EV_*
+ */
+static void
+rds_health_event(struct rds_health *h, uint8_t event)
+{
+	if(h->event_cb)
+		h->event_cb(h, event, h->event_arg);
+}
+
+/**
+ * rds_health_check - Probe the encoder and act on what we find
+ * @h: the &struct rds_health
+ */
+static void
+rds_health_check(struct rds_health *h)
+{
+	int ret = 0;
+
+	ret = rds_thread_run(h->enc, rds_health_probe_fn, h);
+	if(ret < 0)
+		return;
+
+	h->probes++;
+	h->probe_us += ret;
+
+	/* Keep probes at duty per mille of the link's time */
+	h->interval_ms = ret / h->duty;
+	if(h->interval_ms < RDS_HEALTH_INTERVAL_MIN_MS)
+		h->interval_ms = RDS_HEALTH_INTERVAL_MIN_MS;
+
+	if(rds_health_is_link_error(h->lock_ret) ||
+	rds_health_is_link_error(h->fp_ret)) {
+		if(h->up != 0) {
+			h->up = 0;
+			rds_health_event(h, RDS_HEALTH_EV_LINK_DOWN);
+		}
+		return;
+	}
+
+	if(h->up == 0)
+		rds_health_event(h, RDS_HEALTH_EV_LINK_UP);
+	h->up = 1;
+
+	if(h->lock_ret >= 0 && h->lock_ret != h->locked) {
+		if(!h->lock_ret)
+			rds_health_event(h, RDS_HEALTH_EV_UNLOCKED);
+		else if(h->locked == 0)
+			rds_health_event(h, RDS_HEALTH_EV_LOCKED);
+		h->locked = h->lock_ret;
+	}
+
+	if(!h->fp_mismatch)
+		return;
+
+	rds_health_event(h, RDS_HEALTH_EV_CONFIG_LOST);
+
+	ret = rds_thread_run(h->enc, rds_health_resync_fn, h);
+	h->resyncs++;
+
+	rds_health_event(h, (ret < 0) ? RDS_HEALTH_EV_RESYNC_FAILED :
+						RDS_HEALTH_EV_RESYNCED);
+}
+
+/**
+ * rds_health_thread_fn - Main loop of the monitor's thread
+ * @arg: the &struct rds_health
+ */
+static void *
+rds_health_thread_fn(void *arg)
+{
+	struct rds_health *h = arg;
+	struct timespec deadline;
+	uint32_t frames = 0;
+	uint8_t yielded = 0;
+	int ret = 0;
+
+	pthread_mutex_lock(&h->lock);
+	rds_health_now(&deadline, h->interval_ms);
+
+	while(!h->stop) {
+		ret = pthread_cond_timedwait(&h->cond, &h->lock, &deadline);
+		if(h->stop)
+			break;
+		if(ret != ETIMEDOUT)
+			continue;
+
+		/* Someone else is using the link, come back later */
+		frames = __atomic_load_n(&h->enc->tx_frames, __ATOMIC_RELAXED);
+		if(frames != h->seen_frames && yielded < RDS_HEALTH_YIELD_MAX) {
+			h->seen_frames = frames;
+			h->yields++;
+			yielded++;
+			rds_health_now(&deadline, RDS_HEALTH_YIELD_MS);
+			continue;
+		}
+		yielded = 0;
+
+		pthread_mutex_unlock(&h->lock);
+		rds_health_check(h);
+		pthread_mutex_lock(&h->lock);
+
+		/* Don't count our own frames as traffic */
+		h->seen_frames = __atomic_load_n(&h->enc->tx_frames,
+							__ATOMIC_RELAXED);
+		rds_health_now(&deadline, h->interval_ms);
+	}
+
+	pthread_mutex_unlock(&h->lock);
+
+	return NULL;
+}
+
+
+/**************\
+* ENTRY POINTS *
+\**************/
+
+/**
+ * rds_health_start - Start monitoring an encoder
+ * @enc: pointer to &struct rds_encoder
+ * @duty: link time probes may take, per mille (0 for
+ *	RDS_HEALTH_DUTY_DEFAULT, up to RDS_HEALTH_DUTY_MAX)
+ * @event_cb: called on RDS_HEALTH_EV_* (optional)
+ * @event_arg: passed to event_cb
+ *
+ * The backend must be able to read back the fingerprint, else
+ * there's nothing to check (e.g. UECP is one-way) and we fail
+ * with EOPNOTSUPP.
+ *
+ * Returns: a &struct rds_health or NULL and errno set
+ */
+struct rds_health *
+rds_health_start(struct rds_encoder *enc, uint8_t duty,
+	void (*event_cb)(struct rds_health *h, uint8_t event, void *arg),
+							void *event_arg)
+{
+	struct rds_health *h = NULL;
+	pthread_condattr_t attr;
+	int ret = 0;
+
+	if(!enc || duty > RDS_HEALTH_DUTY_MAX) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if(!rds_health_can_read(enc, RDS_CMD_GET_PI)) {
+		errno = EOPNOTSUPP;
+		return NULL;
+	}
+
+	h = malloc(sizeof(struct rds_health));
+	if(!h) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(h, 0, sizeof(struct rds_health));
+
+	h->enc = enc;
+	h->duty = duty ? duty : RDS_HEALTH_DUTY_DEFAULT;
+	h->fp_op = RDS_CMD_GET_PI;
+	h->up = -1;
+	h->locked = -1;
+	h->interval_ms = RDS_HEALTH_INTERVAL_MIN_MS;
+	h->event_cb = event_cb;
+	h->event_arg = event_arg;
+
+	pthread_mutex_init(&h->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&h->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	if(!enc->io_thread && !enc->bus) {
+		ret = rds_thread_start(enc, 0);
+		if(ret < 0) {
+			ret = -ret;
+			goto cleanup;
+		}
+		h->started_thread = 1;
+	}
+
+	h->seen_frames = __atomic_load_n(&enc->tx_frames, __ATOMIC_RELAXED);
+
+	ret = pthread_create(&h->tid, NULL, rds_health_thread_fn, h);
+	if(ret != 0)
+		goto cleanup;
+
+	return h;
+
+ cleanup:
+	if(h->started_thread)
+		rds_thread_stop(enc);
+	pthread_cond_destroy(&h->cond);
+	pthread_mutex_destroy(&h->lock);
+	free(h);
+	errno = ret;
+	return NULL;
+}
+
+/**
+ * rds_health_set_fingerprint - Choose the field that tells us the
+ *				encoder lost its settings
+ * @h: the &struct rds_health
+ * @op: RDS_CMD_GET_* of a field that's read in one exchange and
+ *	differs from the encoder's defaults (PI, PS, PTY, flags)
+ *
+ * Returns: -EOPNOTSUPP if the backend can't read that field back
+ */
+int
+rds_health_set_fingerprint(struct rds_health *h, uint8_t op)
+{
+	uint32_t i = 0;
+
+	for(i = 0; i < sizeof(rds_health_readable); i++)
+		if(rds_health_readable[i] == op)
+			break;
+
+	if(i == sizeof(rds_health_readable))
+		return -EINVAL;
+
+	if(!rds_health_can_read(h->enc, op))
+		return -EOPNOTSUPP;
+
+	pthread_mutex_lock(&h->lock);
+	h->fp_op = op;
+	pthread_mutex_unlock(&h->lock);
+
+	return 0;
+}
+
+/**
+ * rds_health_stop - Stop monitoring an encoder
+ * @h: the &struct rds_health
+ *
+ * Waits for a probe in progress.
+ */
+void
+rds_health_stop(struct rds_health *h)
+{
+	if(!h)
+		return;
+
+	pthread_mutex_lock(&h->lock);
+	h->stop = 1;
+	pthread_cond_signal(&h->cond);
+	pthread_mutex_unlock(&h->lock);
+
+	pthread_join(h->tid, NULL);
+
+	if(h->started_thread)
+		rds_thread_stop(h->enc);
+
+	pthread_cond_destroy(&h->cond);
+	pthread_mutex_destroy(&h->lock);
+	free(h);
+}
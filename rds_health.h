@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_health.h -	Background health monitor
+ */
+
+/**
+ * DOC: Health monitor
+ *
+ * An encoder can lose its pilot lock, or get power-cycled and come
+ * back with its factory settings, and nobody notices until a listener
+ * does. A health monitor watches one encoder from its own thread:
+ * every interval it checks the lock status (if the backend can tell)
+ * and reads back one cheap field, the fingerprint (PI by default),
+ * comparing it with the encoder's shadow state (see rds_state.c).
+ *
+ * If the fingerprint doesn't match, the encoder lost its settings.
+ * We read back every field we can, push only the ones that differ
+ * from the shadow state plus the ones we can't read (e.g. RT, AFs),
+ * and tell the caller through the event callback. An encoder that
+ * stops answering is reported down, and checked as soon as it comes
+ * back (that's usually a reboot).
+ *
+ * Probes must never get in the way. Each one costs a couple of
+ * frames, we time how long it keeps the link and space probes so
+ * that they take at most duty per mille of it (RDS_HEALTH_DUTY_MAX
+ * is 1%). If the encoder sent anything else since the last look we
+ * back off for RDS_HEALTH_YIELD_MS, up to RDS_HEALTH_YIELD_MAX times
+ * in a row, so a busy link gets probed less, not never.
+ *
+ * The encoder is put in threaded mode (if it isn't already) so that
+ * probes run on its I/O thread, between the caller's commands.
+ *
+ * Backends that can't read the fingerprint back (UECP is one-way)
+ * can't be monitored, rds_health_start() fails with EOPNOTSUPP.
+ */
+
+/* Events */
+#define RDS_HEALTH_EV_LINK_DOWN		0x01	/* Stopped answering */
+#define RDS_HEALTH_EV_LINK_UP		0x02	/* Answers again */
+#define RDS_HEALTH_EV_UNLOCKED		0x03	/* Lost lock */
+#define RDS_HEALTH_EV_LOCKED		0x04	/* Locked again */
+#define RDS_HEALTH_EV_CONFIG_LOST	0x05	/* Fingerprint doesn't match,
+						 * a resync follows */
+#define RDS_HEALTH_EV_RESYNCED		0x06
+#define RDS_HEALTH_EV_RESYNC_FAILED	0x07
+
+/* Link time spent on probes, per mille */
+#define RDS_HEALTH_DUTY_DEFAULT		5
+#define RDS_HEALTH_DUTY_MAX		10
+
+#define RDS_HEALTH_INTERVAL_MIN_MS	1000
+#define RDS_HEALTH_YIELD_MS		250
+#define RDS_HEALTH_YIELD_MAX		8
+
+struct rds_health {
+	struct rds_encoder *enc;
+	uint8_t started_thread;		/* We put it in threaded mode */
+	uint8_t duty;			/* Per mille */
+	uint8_t fp_op;			/* Fingerprint, an RDS_CMD_GET_* */
+
+	pthread_t tid;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint8_t stop;
+
+	int8_t up;			/* -1 until we know */
+	int8_t locked;			/* -1 until (or if we can't) tell */
+	uint32_t interval_ms;		/* Until the next probe */
+	uint32_t seen_frames;		/* enc->tx_frames on the last look */
+
+	/* Results of the last probe (see rds_health_probe_fn()) */
+	int lock_ret;
+	int fp_ret;
+	uint8_t fp_mismatch;
+
+	/* Stats */
+	uint32_t probes;
+	uint32_t yields;
+	uint32_t resyncs;
+	uint32_t last_resync_mask;	/* RDS_STATE_* fields we pushed */
+	uint64_t probe_us;		/* Link time spent on probes */
+
+	/* Optional, called from the monitor's thread */
+	void (*event_cb)(struct rds_health *h, uint8_t event, void *arg);
+	void *event_arg;
+};
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+struct rds_health *rds_health_start(struct rds_encoder *enc, uint8_t duty,
+	void (*event_cb)(struct rds_health *h, uint8_t event, void *arg),
+							void *event_arg);
+int rds_health_set_fingerprint(struct rds_health *h, uint8_t op);
+void rds_health_stop(struct rds_health *h);
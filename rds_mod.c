@@ -0,0 +1,463 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_mod.c -	RDS modulator, turns the groups of a software
+ *		encoder into 57KHz subcarrier PCM samples
+ */
+
+#define _GNU_SOURCE	/* For M_PI */
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <stdlib.h>	/* For malloc/free */
+#include <string.h>	/* For memset() / memmove() */
+#include <unistd.h>	/* For write() */
+#include <math.h>	/* For sin() / ceil() */
+#include "rds.h"
+#include "rds_block.h"
+#include "rds_dsp.h"
+#include "rds_mod.h"
+
+
+/********\
+* TABLES *
+\********/
+
+/**
+ * rds_mod_init_symbols - Build the symbol waveform tables
+ * @mod: the &struct rds_mod
+ *
+ * We keep RDS_MOD_SPAN bits around the center of each symbol
+ * (see rds_dsp_biphase()), the rest is way below the 16bit
+ * noise floor.
+ *
+ * Table p holds the waveform for a symbol starting p / RDS_MOD_PHASES
+ * samples after a sample, it's placed on the output with a constant
+ * delay (half the span) so that it never starts before its slot.
+ */
+static int
+rds_mod_init_symbols(struct rds_mod *mod)
+{
+	double spb = (double) mod->sym_step / RDS_MOD_BITRATE_NUM;
+	double pre = (RDS_MOD_SPAN / 2.0 - 0.25) * spb;
+	double peak = 0;
+	double sum = 0;
+	double x = 0;
+	float *sym = NULL;
+	int len = 0;
+	int p = 0;
+	int i = 0;
+	int k = 0;
+
+	len = (int) ceil(RDS_MOD_SPAN * spb) + 1;
+
+	mod->sym = malloc(sizeof(float) * RDS_MOD_PHASES * len);
+	if(!mod->sym)
+		return -ENOMEM;
+	mod->sym_len = len;
+
+	for(p = 0; p < RDS_MOD_PHASES; p++) {
+		sym = mod->sym + p * len;
+		for(i = 0; i < len; i++) {
+			x = (i - pre - (double) p / RDS_MOD_PHASES) / spb;
+			sym[i] = (float) rds_dsp_biphase(x);
+		}
+	}
+
+	/*
+	 * Normalize so that the subcarrier peaks at the configured
+	 * level. The worst case is when all symbols overlapping on
+	 * a sample add up with the same sign, so for each point of
+	 * a bit period sum up the magnitudes of its neighbours.
+	 */
+	sym = mod->sym;
+	for(i = 0; i < (int) spb; i++) {
+		sum = 0;
+		for(k = i; k < len; k += (int) spb)
+			sum += fabs(sym[k]);
+		if(sum > peak)
+			peak = sum;
+	}
+
+	for(i = 0; i < RDS_MOD_PHASES * len; i++)
+		mod->sym[i] = (float) (mod->sym[i] / peak);
+
+	return 0;
+}
+
+/**
+ * rds_mod_init_carrier - Build the carrier and pilot tables
+ * @mod: the &struct rds_mod
+ *
+ * Both are periodic on the pilot's period, in samples that's
+ * rate / gcd(rate, 19000), e.g. 12 samples at 228KHz or 192 at
+ * 192KHz. We store a period plus RDS_MOD_CHUNK samples so that
+ * a chunk starting anywhere within the period is contiguous.
+ * The levels are baked in.
+ */
+static void
+rds_mod_init_carrier(struct rds_mod *mod)
+{
+	double phase = 0;
+	int i = 0;
+
+	for(i = 0; i < mod->period + RDS_MOD_CHUNK; i++) {
+		phase = 2.0 * M_PI * (double) RDS_MOD_PILOT_HZ *
+			(double) (i % mod->period) / (double) mod->rate;
+		mod->pilot[i] = (float) (mod->pilot_level * sin(phase));
+		mod->carrier[i] = (float) (mod->level * sin(3.0 * phase));
+	}
+}
+
+
+/************\
+* BIT SOURCE *
+\************/
+
+/**
+ * rds_mod_next_symbol - Get the sign of the next symbol
+ * @mod: the &struct rds_mod
+ *
+ * Returns: +1 / -1, or 0 when RDS is off on the encoder
+ */
+static float
+rds_mod_next_symbol(struct rds_mod *mod)
+{
+	uint32_t block = 0;
+	int ret = 0;
+
+	if(mod->bit >= RDS_GROUP_BITS) {
+		ret = rds_soft_get_groups(mod->enc, mod->blocks, 1);
+		mod->silent = (ret <= 0);
+		mod->bit = 0;
+	}
+
+	/* Keep asking once per group time */
+	if(mod->silent) {
+		mod->bit++;
+		return 0;
+	}
+
+	block = mod->blocks[mod->bit / RDS_BLOCK_BITS];
+	mod->diff ^= (block >> (RDS_BLOCK_BITS - 1 -
+				(mod->bit % RDS_BLOCK_BITS))) & 0x1;
+	mod->bit++;
+
+	return mod->diff ? 1.0f : -1.0f;
+}
+
+
+/************\
+* MODULATION *
+\************/
+
+/**
+ * rds_mod_chunk - Generate up to RDS_MOD_CHUNK samples
+ * @mod: the &struct rds_mod
+ * @out: where to put the (float) samples
+ * @len: number of samples
+ */
+static void
+rds_mod_chunk(struct rds_mod *mod, float *out, int len)
+{
+	int64_t end = (int64_t) len * RDS_MOD_BITRATE_NUM;
+	int64_t frac = 0;
+	float sign = 0;
+	int n = 0;
+	int p = 0;
+
+	/* Add all symbols that start within this chunk */
+	while(mod->next_sym < end) {
+		n = (int) (mod->next_sym / RDS_MOD_BITRATE_NUM);
+		frac = mod->next_sym % RDS_MOD_BITRATE_NUM;
+		p = (int) ((frac * RDS_MOD_PHASES + RDS_MOD_BITRATE_NUM / 2) /
+							RDS_MOD_BITRATE_NUM);
+		if(p == RDS_MOD_PHASES) {
+			n++;
+			p = 0;
+		}
+
+		sign = rds_mod_next_symbol(mod);
+		if(sign != 0)
+			rds_dsp_axpy(mod->acc + n, mod->sym + p * mod->sym_len,
+							sign, mod->sym_len);
+
+		mod->next_sym += mod->sym_step;
+	}
+
+	/* Up-convert and mix in the pilot */
+	rds_dsp_mul(out, mod->acc, mod->carrier + mod->pos, len);
+	if(mod->pilot_level != 0)
+		rds_dsp_axpy(out, mod->pilot + mod->pos, 1.0f, len);
+
+	/* Move the tails of the symbols to the start */
+	memmove(mod->acc, mod->acc + len, sizeof(float) * (mod->sym_len + 1));
+	memset(mod->acc + mod->sym_len + 1, 0, sizeof(float) * len);
+
+	mod->next_sym -= end;
+	mod->pos = (mod->pos + len) % mod->period;
+}
+
+/**
+ * rds_mod_run - Generate samples on a caller's buffer
+ * @mod: the &struct rds_mod
+ * @buf: where to put the samples (float or int16_t, depending
+ *	on the format given on rds_mod_create())
+ * @num_samples: number of samples to generate
+ *
+ * Returns: num_samples on success or a negative error code
+ */
+int
+rds_mod_run(struct rds_mod *mod, void *buf, int num_samples)
+{
+	int done = 0;
+	int len = 0;
+
+	if(!mod || !buf || num_samples < 0)
+		return -EINVAL;
+
+	while(done < num_samples) {
+		len = num_samples - done;
+		if(len > RDS_MOD_CHUNK)
+			len = RDS_MOD_CHUNK;
+
+		if(mod->format == RDS_MOD_FMT_FLOAT) {
+			rds_mod_chunk(mod, (float *) buf + done, len);
+		} else {
+			rds_mod_chunk(mod, mod->out, len);
+			rds_dsp_to_s16((int16_t *) buf + done, mod->out, len);
+		}
+
+		done += len;
+	}
+
+	return num_samples;
+}
+
+/**
+ * rds_mod_write - Generate samples and write them to a file / pipe
+ * @mod: the &struct rds_mod
+ * @fd: file descriptor to write to (blocking)
+ * @num_samples: number of samples to generate
+ *
+ * Returns: num_samples on success or a negative error code
+ */
+int
+rds_mod_write(struct rds_mod *mod, int fd, int num_samples)
+{
+	const uint8_t *data = NULL;
+	size_t bytes = 0;
+	ssize_t ret = 0;
+	int done = 0;
+	int len = 0;
+
+	if(!mod || num_samples < 0)
+		return -EINVAL;
+
+	while(done < num_samples) {
+		len = num_samples - done;
+		if(len > RDS_MOD_CHUNK)
+			len = RDS_MOD_CHUNK;
+
+		rds_mod_chunk(mod, mod->out, len);
+		if(mod->format == RDS_MOD_FMT_FLOAT) {
+			data = (const uint8_t *) mod->out;
+			bytes = sizeof(float) * len;
+		} else {
+			rds_dsp_to_s16(mod->out_s16, mod->out, len);
+			data = (const uint8_t *) mod->out_s16;
+			bytes = sizeof(int16_t) * len;
+		}
+
+		while(bytes > 0) {
+			ret = write(fd, data, bytes);
+			if(ret < 0) {
+				if(errno == EINTR)
+					continue;
+				return -errno;
+			}
+			data += ret;
+			bytes -= ret;
+		}
+
+		done += len;
+	}
+
+	return num_samples;
+}
+
+
+/************\
+* CONFIG API *
+\************/
+
+/**
+ * rds_mod_set_levels - Set the output levels
+ * @mod: the &struct rds_mod
+ * @level: peak level of the RDS subcarrier (full scale is 1.0)
+ * @pilot_level: peak level of the 19KHz pilot, 0 to leave it out
+ *
+ * Both start at 1.0 / 0, i.e. the subcarrier alone at full scale
+ * for the caller to scale and mix. For a complete MPX where 100%
+ * is 75KHz deviation typical values are ~0.04 for RDS (3KHz) and
+ * 0.09 for the pilot (6.75KHz).
+ */
+int
+rds_mod_set_levels(struct rds_mod *mod, float level, float pilot_level)
+{
+	if(!mod || level < 0 || pilot_level < 0 || level + pilot_level > 1.0f)
+		return -EINVAL;
+
+	mod->level = level;
+	mod->pilot_level = pilot_level;
+	rds_mod_init_carrier(mod);
+
+	return 0;
+}
+
+/**
+ * rds_mod_set_pilot_pos - Align the carrier with an external pilot
+ * @mod: the &struct rds_mod
+ * @pos: where the next sample falls within the pilot's period, in
+ *	samples after a positive-going zero crossing
+ *
+ * When the pilot comes from a separate stereo encoder running off
+ * the same sample clock, this puts our carrier in phase with its
+ * third harmonic.
+ */
+int
+rds_mod_set_pilot_pos(struct rds_mod *mod, uint32_t pos)
+{
+	if(!mod)
+		return -EINVAL;
+
+	mod->pos = pos % mod->period;
+
+	return 0;
+}
+
+
+/*************\
+* INIT / EXIT *
+\*************/
+
+static uint32_t
+rds_mod_gcd(uint32_t a, uint32_t b)
+{
+	uint32_t t = 0;
+
+	while(b) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+/**
+ * rds_mod_destroy - Free a modulator
+ * @mod: the &struct rds_mod
+ *
+ * The encoder is left alone.
+ */
+void
+rds_mod_destroy(struct rds_mod *mod)
+{
+	if(!mod)
+		return;
+
+	free(mod->sym);
+	free(mod->carrier);
+	free(mod->pilot);
+	free(mod->acc);
+	free(mod->out);
+	free(mod->out_s16);
+	free(mod);
+}
+
+/**
+ * rds_mod_create - Create a modulator for a software encoder
+ * @enc: an initialized &struct rds_encoder of RDS_ENCODER_TYPE_SOFT
+ * @rate: sample rate, RDS_MOD_RATE_MIN - RDS_MOD_RATE_MAX, the pilot's
+ *	period must be within RDS_MOD_PERIOD_MAX samples (anything
+ *	that's a multiple of 1KHz is fine, e.g. 192000 or 228000)
+ * @format: RDS_MOD_FMT_FLOAT or RDS_MOD_FMT_S16
+ *
+ * Returns: a new &struct rds_mod or NULL on error (errno is set)
+ */
+struct rds_mod *
+rds_mod_create(struct rds_encoder *enc, uint32_t rate, uint8_t format)
+{
+	struct rds_mod *mod = NULL;
+	uint32_t period = 0;
+	int ret = 0;
+
+	if(!enc || enc->type != RDS_ENCODER_TYPE_SOFT ||
+	rate < RDS_MOD_RATE_MIN || rate > RDS_MOD_RATE_MAX ||
+	format > RDS_MOD_FMT_S16) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	period = rate / rds_mod_gcd(rate, RDS_MOD_PILOT_HZ);
+	if(period > RDS_MOD_PERIOD_MAX) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	mod = malloc(sizeof(struct rds_mod));
+	if(!mod) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(mod, 0, sizeof(struct rds_mod));
+
+	mod->enc = enc;
+	mod->rate = rate;
+	mod->format = format;
+	mod->level = 1.0f;
+	mod->pilot_level = 0;
+	mod->period = period;
+	mod->bit = RDS_GROUP_BITS;
+	mod->sym_step = (int64_t) rate * RDS_MOD_BITRATE_DEN;
+
+	ret = rds_mod_init_symbols(mod);
+	if(ret < 0)
+		goto cleanup;
+
+	mod->carrier = malloc(sizeof(float) * (period + RDS_MOD_CHUNK));
+	mod->pilot = malloc(sizeof(float) * (period + RDS_MOD_CHUNK));
+	mod->acc = calloc(RDS_MOD_CHUNK + mod->sym_len + 1, sizeof(float));
+	mod->out = malloc(sizeof(float) * RDS_MOD_CHUNK);
+	mod->out_s16 = malloc(sizeof(int16_t) * RDS_MOD_CHUNK);
+	if(!mod->carrier || !mod->pilot || !mod->acc || !mod->out ||
+	!mod->out_s16) {
+		ret = -ENOMEM;
+		goto cleanup;
+	}
+
+	rds_mod_init_carrier(mod);
+
+	return mod;
+
+ cleanup:
+	rds_mod_destroy(mod);
+	errno = -ret;
+	return NULL;
+}
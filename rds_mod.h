@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_mod.h -	RDS modulator, turns the groups of a software
+ *		encoder into 57KHz subcarrier PCM samples
+ */
+
+#include "rds_block.h"	/* For RDS_GROUP_BLOCKS */
+
+/**
+ * DOC: Modulator
+ *
+ * A modulator pulls groups from an RDS_ENCODER_TYPE_SOFT encoder and
+ * produces the RDS subcarrier as PCM samples (float or signed 16bit,
+ * mono) at the requested sample rate, ready to be mixed into the MPX
+ * signal or fed to an exciter's MPX / SCA input.
+ *
+ * The bitstream is differentialy encoded and each bit is sent as a
+ * biphase symbol, shaped as IEC 62106 describes (cos filter, 100%
+ * roll-off at 2400Hz). Instead of filtering we add up precomputed
+ * symbol waveforms: for each symbol we pick the table closest to its
+ * (fractional) start position out of RDS_MOD_PHASES ones, so any rate
+ * works, not just multiples of the bit rate, and add it to the output
+ * with its sign. The result is then multiplied by the 57KHz carrier,
+ * which we get from a table covering a whole period of the 19KHz pilot
+ * so the two are always phase locked (the carrier is the pilot's 3rd
+ * harmonic, in phase). The pilot itself can also be mixed in with
+ * rds_mod_set_levels(), to get a complete MPX signal for the stereo
+ * encoder to add its stuff.
+ *
+ * The table lookups and the additions / products are done with the
+ * vector kernels of rds_dsp.c, so it's a few float ops per output
+ * sample and a single core can feed lots of channels.
+ *
+ * A modulator is not thread safe, use one per output stream.
+ */
+
+#define RDS_MOD_FMT_FLOAT	0	/* 32bit float, native endian */
+#define RDS_MOD_FMT_S16		1	/* Signed 16bit, native endian */
+
+#define RDS_MOD_RATE_MIN	128000
+#define RDS_MOD_RATE_MAX	2000000
+
+/* 1187.5 bit/s, kept as a fraction so that we
+ * don't accumulate rounding errors */
+#define RDS_MOD_BITRATE_NUM	2375
+#define RDS_MOD_BITRATE_DEN	2
+
+#define RDS_MOD_PILOT_HZ	19000
+
+/* Symbol tables: one per 1/RDS_MOD_PHASES sample
+ * of start offset, each RDS_MOD_SPAN bits long */
+#define RDS_MOD_PHASES		32
+#define RDS_MOD_SPAN		4
+
+/* Samples per run of the inner loops */
+#define RDS_MOD_CHUNK		1024
+
+/* Longest pilot period (in samples) we'll keep a table for */
+#define RDS_MOD_PERIOD_MAX	4096
+
+struct rds_mod {
+	struct rds_encoder *enc;
+	uint32_t rate;
+	uint8_t format;
+	float level;			/* Subcarrier peak level */
+	float pilot_level;		/* Pilot level, 0 -> no pilot */
+
+	/* Bit source */
+	uint32_t blocks[RDS_GROUP_BLOCKS];
+	int bit;			/* Next bit on blocks[] */
+	uint8_t silent;			/* RDS was off when we got the group */
+	uint8_t diff;			/* Differential encoder state */
+
+	/* Symbol waveforms, RDS_MOD_PHASES x sym_len */
+	float *sym;
+	int sym_len;
+	int64_t next_sym;		/* Where the next symbol goes on acc[],
+					 * in 1/RDS_MOD_BITRATE_NUM samples */
+	int64_t sym_step;		/* Symbol length, same units */
+
+	/* Carrier / pilot, period + RDS_MOD_CHUNK samples
+	 * long so that any chunk is contiguous */
+	float *carrier;
+	float *pilot;
+	int period;
+	int pos;			/* Where we are within the period */
+
+	float *acc;			/* Baseband, RDS_MOD_CHUNK + sym_len + 1 */
+	float *out;			/* Scratch for s16 / fd output */
+	int16_t *out_s16;
+};
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+struct rds_mod *rds_mod_create(struct rds_encoder *enc, uint32_t rate,
+							uint8_t format);
+void rds_mod_destroy(struct rds_mod *mod);
+int rds_mod_set_levels(struct rds_mod *mod, float level, float pilot_level);
+int rds_mod_set_pilot_pos(struct rds_mod *mod, uint32_t pos);
+int rds_mod_run(struct rds_mod *mod, void *buf, int num_samples);
+int rds_mod_write(struct rds_mod *mod, int fd, int num_samples);
@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_pair.c -	Main / backup encoder redundancy
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <stdlib.h>	/* For malloc/free */
+#include <string.h>	/* For memset() */
+#include <pthread.h>	/* For pthread_* */
+#include <time.h>	/* For clock_gettime() */
+#include "rds.h"
+#include "rds_thread.h"
+#include "rds_pair.h"
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+static uint64_t
+rds_pair_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * rds_pair_is_link_error - Check if an error means the member is unreachable
+ * @ret: a command's return value
+ *
+ * Unsupported commands, invalid arguments etc don't say
+ * anything about the member's health.
+ */
+static int
+rds_pair_is_link_error(int ret)
+{
+	switch(ret) {
+	case -ETIME:
+	case -ENODATA:
+	case -EPROTO:
+	case -EIO:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static void
+rds_pair_mark(struct rds_pair *pair, uint8_t idx, uint8_t up)
+{
+	if(pair->down[idx] == !up)
+		return;
+
+	pair->down[idx] = !up;
+	if(!up)
+		pair->retry_at[idx] = rds_pair_now_ms() +
+					pair->retry_interval_ms;
+
+	if(pair->event_cb)
+		pair->event_cb(pair, idx, up, pair->event_arg);
+}
+
+/**
+ * rds_pair_try_resync - Try to bring back members that are down
+ * @pair: pointer to &struct rds_pair
+ *
+ * Pushing the full shadow state doubles as the probe, if the
+ * member is still dead the first field fails within one frame
+ * deadline and we try again on the next interval.
+ */
+static void
+rds_pair_try_resync(struct rds_pair *pair)
+{
+	uint64_t now = rds_pair_now_ms();
+	uint8_t i = 0;
+	int ret = 0;
+
+	for(i = 0; i < 2; i++) {
+		if(!pair->down[i] || now < pair->retry_at[i])
+			continue;
+
+		ret = rds_state_apply(pair->members[i], &pair->shadow,
+							RDS_STATE_ALL);
+		if(ret < 0)
+			pair->retry_at[i] = now + pair->retry_interval_ms;
+		else
+			rds_pair_mark(pair, i, 1);
+	}
+}
+
+/**
+ * rds_pair_write - Mirror a set command to all healthy members
+ * @pair: pointer to &struct rds_pair
+ * @cmd: the &struct rds_cmd to run
+ */
+static int
+rds_pair_write(struct rds_pair *pair, struct rds_cmd *cmd)
+{
+	struct timespec backoff = { 0, 1000000 };
+	struct rds_future futs[2];
+	uint8_t submitted[2] = { 0, 0 };
+	int ret[2] = { -ENODEV, -ENODEV };
+	uint8_t i = 0;
+
+	/* Fire both, then wait for both */
+	for(i = 0; i < 2; i++) {
+		if(pair->down[i])
+			continue;
+
+		rds_future_init(&futs[i], cmd);
+		while((ret[i] = rds_submit(pair->members[i],
+					&futs[i])) == -EAGAIN)
+			nanosleep(&backoff, NULL);
+		if(ret[i] == 0)
+			submitted[i] = 1;
+	}
+
+	for(i = 0; i < 2; i++) {
+		if(submitted[i])
+			ret[i] = rds_future_wait(&futs[i]);
+
+		if(rds_pair_is_link_error(ret[i]))
+			rds_pair_mark(pair, i, 0);
+	}
+
+	/* Done if anyone has it on air */
+	if(ret[RDS_PAIR_MAIN] >= 0 || ret[RDS_PAIR_BACKUP] >= 0) {
+		/* The shadow only tracks the main service */
+		if(cmd->dsn == 0 && cmd->psn == 0)
+			rds_state_update(&pair->shadow, cmd);
+		return (ret[RDS_PAIR_MAIN] >= 0) ? ret[RDS_PAIR_MAIN] :
+						ret[RDS_PAIR_BACKUP];
+	}
+
+	return (ret[RDS_PAIR_MAIN] != -ENODEV) ? ret[RDS_PAIR_MAIN] :
+						ret[RDS_PAIR_BACKUP];
+}
+
+/**
+ * rds_pair_read - Serve a get command from a healthy member
+ * @pair: pointer to &struct rds_pair
+ * @cmd: the &struct rds_cmd to run, results are stored back here
+ */
+static int
+rds_pair_read(struct rds_pair *pair, struct rds_cmd *cmd)
+{
+	struct rds_cmd tmp;
+	uint8_t i = 0;
+	int ret = -ENODEV;
+
+	for(i = 0; i < 2; i++) {
+		if(pair->down[i])
+			continue;
+
+		tmp = *cmd;
+		ret = rds_cmd_run(pair->members[i], &tmp);
+		if(ret >= 0) {
+			*cmd = tmp;
+			return ret;
+		}
+
+		if(rds_pair_is_link_error(ret))
+			rds_pair_mark(pair, i, 0);
+		else if(ret != -EOPNOTSUPP)
+			return ret;
+	}
+
+	/* Nobody could answer (e.g. a one-way UECP backup
+	 * while main is down), what we've set is our best bet */
+	if(cmd->dsn == 0 && cmd->psn == 0 &&
+	rds_state_get(&pair->shadow, cmd) != -ENODATA)
+		return rds_state_get(&pair->shadow, cmd);
+
+	return ret;
+}
+
+
+/**************\
+* ENTRY POINTS *
+\**************/
+
+/**
+ * rds_pair_run - Run a command on a redundant pair
+ * @pair: pointer to &struct rds_pair
+ * @cmd: the &struct rds_cmd to run, results are stored back here
+ *
+ * Sets are mirrored to both healthy members and succeed if at
+ * least one of them took it, gets are served by the main member
+ * if it's up, else by the backup.
+ */
+int
+rds_pair_run(struct rds_pair *pair, struct rds_cmd *cmd)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&pair->lock);
+
+	rds_pair_try_resync(pair);
+
+	if(RDS_CMD_IS_SET(cmd->op))
+		ret = rds_pair_write(pair, cmd);
+	else
+		ret = rds_pair_read(pair, cmd);
+
+	pthread_mutex_unlock(&pair->lock);
+
+	return ret;
+}
+
+/**
+ * rds_pair_is_up - Check if a member of the pair is healthy
+ * @pair: pointer to &struct rds_pair
+ * @idx: RDS_PAIR_MAIN or RDS_PAIR_BACKUP
+ */
+int
+rds_pair_is_up(struct rds_pair *pair, uint8_t idx)
+{
+	if(idx > RDS_PAIR_BACKUP)
+		return -EINVAL;
+
+	return !__atomic_load_n(&pair->down[idx], __ATOMIC_RELAXED);
+}
+
+/**
+ * rds_pair_create - Create a redundant pair
+ * @main_enc: pointer to the main &struct rds_encoder
+ * @backup_enc: pointer to the backup &struct rds_encoder
+ * @frame_timeout_ms: how long to wait for a member before
+ *	considering it dead, 0 for the default
+ */
+struct rds_pair *
+rds_pair_create(struct rds_encoder *main_enc, struct rds_encoder *backup_enc,
+						uint16_t frame_timeout_ms)
+{
+	struct rds_pair *pair = NULL;
+	uint8_t i = 0;
+
+	pair = malloc(sizeof(struct rds_pair));
+	if(!pair)
+		return NULL;
+	memset(pair, 0, sizeof(struct rds_pair));
+
+	if(frame_timeout_ms == 0)
+		frame_timeout_ms = RDS_PAIR_FRAME_TIMEOUT_MS_DEFAULT;
+
+	pair->members[RDS_PAIR_MAIN] = main_enc;
+	pair->members[RDS_PAIR_BACKUP] = backup_enc;
+	pair->retry_interval_ms = RDS_PAIR_RETRY_INTERVAL_MS_DEFAULT;
+	pthread_mutex_init(&pair->lock, NULL);
+
+	/* Restored by rds_pair_destroy() */
+	for(i = 0; i < 2; i++)
+		pair->saved_timeout_ms[i] = pair->members[i]->timeout_ms;
+
+	for(i = 0; i < 2; i++) {
+		rds_set_timeout(pair->members[i], frame_timeout_ms);
+
+		if(pair->members[i]->io_thread)
+			continue;
+
+		if(rds_thread_start(pair->members[i], 0) < 0) {
+			rds_pair_destroy(pair);
+			return NULL;
+		}
+		pair->started_thread[i] = 1;
+	}
+
+	return pair;
+}
+
+void
+rds_pair_destroy(struct rds_pair *pair)
+{
+	uint8_t i = 0;
+
+	for(i = 0; i < 2; i++) {
+		rds_set_timeout(pair->members[i], pair->saved_timeout_ms[i]);
+		if(pair->started_thread[i])
+			rds_thread_stop(pair->members[i]);
+	}
+
+	pthread_mutex_destroy(&pair->lock);
+	free(pair);
+}
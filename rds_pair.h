@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_pair.h -	Main / backup encoder redundancy
+ */
+
+/**
+ * DOC: Redundant pairs
+ *
+ * A pair mirrors every write to a main and a backup encoder (they
+ * may be of different types, e.g. Prais main, UECP backup) and serves
+ * reads from whichever is healthy, main first.
+ *
+ * Members are put in threaded mode so that mirrored writes run in
+ * parallel, and their I/O timeout is set to the pair's frame deadline,
+ * so a dead member fails its command within one frame time. A member
+ * that fails with a link error (timeout, garbled or missing reply) is
+ * marked down and skipped. Every retry interval we try to bring it back
+ * by pushing the pair's shadow state to it, if that goes through it's
+ * marked up again.
+ *
+ * UECP is one-way, a UECP member only fails when its own port does
+ * (the write times out or the port goes away), a unit that died at
+ * the far end of a working line goes unnoticed.
+ */
+
+#define RDS_PAIR_MAIN			0
+#define RDS_PAIR_BACKUP			1
+
+#define RDS_PAIR_FRAME_TIMEOUT_MS_DEFAULT	250
+#define RDS_PAIR_RETRY_INTERVAL_MS_DEFAULT	10000
+
+struct rds_pair {
+	struct rds_encoder *members[2];
+	uint8_t started_thread[2];	/* We put it in threaded mode */
+	uint16_t saved_timeout_ms[2];	/* Members' timeouts before we took over */
+	uint8_t down[2];
+	uint64_t retry_at[2];		/* When to try a resync (CLOCK_MONOTONIC ms) */
+	uint32_t retry_interval_ms;
+	struct rds_state shadow;	/* What the pair should be carrying */
+	pthread_mutex_t lock;
+
+	/* Optional, called when a member goes down (up = 0) or
+	 * comes back after a resync (up = 1) */
+	void (*event_cb)(struct rds_pair *pair, uint8_t idx, uint8_t up,
+								void *arg);
+	void *event_arg;
+};
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+struct rds_pair *rds_pair_create(struct rds_encoder *main_enc,
+				struct rds_encoder *backup_enc,
+				uint16_t frame_timeout_ms);
+void rds_pair_destroy(struct rds_pair *pair);
+int rds_pair_run(struct rds_pair *pair, struct rds_cmd *cmd);
+int rds_pair_is_up(struct rds_pair *pair, uint8_t idx);
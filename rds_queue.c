@@ -0,0 +1,358 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_queue.c -	Coalescing command queue, for event loops
+ *			that feed an encoder
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <stdlib.h>	/* For malloc/free */
+#include <string.h>	/* For memset() */
+#include <unistd.h>	/* For read() / write() / close() */
+#include <poll.h>	/* For poll() */
+#include <sys/eventfd.h>	/* For eventfd() */
+#include "rds.h"
+#include "rds_thread.h"
+#include "rds_queue.h"
+
+/* Ops that replace each other when coalescing */
+#define RDS_QUEUE_OP(_op) \
+	(((_op) == RDS_CMD_SET_RTPLUS) ? RDS_CMD_SET_RT : (_op))
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+/**
+ * rds_queue_cmd_done - Completion callback, called from the I/O thread
+ * @enc: pointer to &struct rds_encoder
+ * @fut: the queue's &struct rds_future
+ * @arg: pointer to &struct rds_queue
+ *
+ * Just wake up the event loop, it takes it from there.
+ */
+static void
+rds_queue_cmd_done(struct rds_encoder *enc, struct rds_future *fut,
+								void *arg)
+{
+	struct rds_queue *queue = arg;
+	uint64_t one = 1;
+	ssize_t ret = 0;
+
+	do {
+		ret = write(queue->event_fd, &one, sizeof(one));
+	} while(ret < 0 && errno == EINTR);
+}
+
+/**
+ * rds_queue_kick - Pass the next queued command to the encoder
+ * @queue: the &struct rds_queue
+ */
+static void
+rds_queue_kick(struct rds_queue *queue)
+{
+	struct rds_queue_entry *entry = NULL;
+	int ret = 0;
+
+	while(!queue->busy && queue->len) {
+		entry = &queue->entries[queue->head];
+
+		rds_future_init(&queue->fut, &entry->cmd);
+		queue->fut.cb = rds_queue_cmd_done;
+		queue->fut.cb_arg = queue;
+
+		/* Ring is full, someone else is also busy with this
+		 * encoder, try again on rds_queue_complete() */
+		ret = rds_submit(queue->enc, &queue->fut);
+		if(ret == -EAGAIN)
+			return;
+
+		queue->head = (queue->head + 1) % RDS_QUEUE_LEN;
+		queue->len--;
+
+		if(ret < 0) {
+			queue->stats.errors++;
+			if(queue->done_cb)
+				queue->done_cb(queue, &entry->cmd, ret,
+					entry->waiters, queue->done_arg);
+			continue;
+		}
+
+		queue->fut_waiters = entry->waiters;
+		queue->busy = 1;
+		queue->stats.commands++;
+	}
+}
+
+
+/**************\
+* ENTRY POINTS *
+\**************/
+
+/**
+ * rds_queue_find - Find a waiting command that a new one replaces
+ * @queue: the &struct rds_queue
+ * @cmd: the new &struct rds_cmd
+ *
+ * AF changes are incremental, so only a list set replaces
+ * another set of the same list, and only if no other AF change
+ * of that service waits after it. EON sets carry different
+ * fields each (and pushes), they never replace each other.
+ * Address and data set changes never replace each other either,
+ * and nothing replaces a command waiting before one (it may go to
+ * another unit / data set).
+ */
+static struct rds_queue_entry *
+rds_queue_find(struct rds_queue *queue, const struct rds_cmd *cmd)
+{
+	struct rds_queue_entry *entry = NULL;
+	struct rds_queue_entry *last = NULL;
+	int i = 0;
+
+	if(cmd->op == RDS_CMD_SET_EON || cmd->op == RDS_CMD_SET_ADDR ||
+	cmd->op == RDS_CMD_SET_DSN)
+		return NULL;
+
+	for(i = 0; i < queue->len; i++) {
+		entry = &queue->entries[(queue->head + i) % RDS_QUEUE_LEN];
+		if(entry->cmd.op == RDS_CMD_SET_ADDR ||
+		entry->cmd.op == RDS_CMD_SET_DSN) {
+			last = NULL;
+			continue;
+		}
+		if(RDS_QUEUE_OP(entry->cmd.op) != RDS_QUEUE_OP(cmd->op) ||
+		entry->cmd.dsn != cmd->dsn || entry->cmd.psn != cmd->psn)
+			continue;
+		last = entry;
+	}
+
+	if(!last || cmd->op != RDS_CMD_SET_AF)
+		return last;
+
+	if(last->cmd.arg.af.op == RDS_AF_OP_SET &&
+	cmd->arg.af.op == RDS_AF_OP_SET &&
+	last->cmd.arg.af.idx == cmd->arg.af.idx)
+		return last;
+
+	return NULL;
+}
+
+/**
+ * rds_queue_push - Queue a command for the encoder
+ * @queue: the &struct rds_queue
+ * @cmd: the &struct rds_cmd (copied)
+ * @waiters: who to report the result to (passed to done_cb)
+ *
+ * If a command with the same op and DSN / PSN still waits on the
+ * queue, it's replaced and the waiters are merged. RT and RT with
+ * RT+ tags count as the same op, both replace the text on air.
+ * AF changes coalesce as rds_queue_find() says.
+ *
+ * Returns: 0 on success or -ENOSPC if the queue is full
+ */
+int
+rds_queue_push(struct rds_queue *queue, const struct rds_cmd *cmd,
+							uint64_t waiters)
+{
+	struct rds_queue_entry *entry = NULL;
+
+	entry = rds_queue_find(queue, cmd);
+	if(entry) {
+		entry->cmd = *cmd;
+		entry->waiters |= waiters;
+		queue->stats.coalesced++;
+		return 0;
+	}
+
+	if(queue->len >= RDS_QUEUE_LEN)
+		return -ENOSPC;
+
+	entry = &queue->entries[(queue->head + queue->len) % RDS_QUEUE_LEN];
+	entry->cmd = *cmd;
+	entry->waiters = waiters;
+	queue->len++;
+
+	rds_queue_kick(queue);
+
+	return 0;
+}
+
+/**
+ * rds_queue_forget - Stop reporting to some waiters
+ * @queue: the &struct rds_queue
+ * @waiters: the waiters to remove (e.g. a client that went away)
+ *
+ * Their commands still run.
+ */
+void
+rds_queue_forget(struct rds_queue *queue, uint64_t waiters)
+{
+	int i = 0;
+
+	for(i = 0; i < queue->len; i++)
+		queue->entries[(queue->head + i) % RDS_QUEUE_LEN].waiters &=
+								~waiters;
+
+	queue->fut_waiters &= ~waiters;
+}
+
+/**
+ * rds_queue_get_fd - Get a file descriptor for the caller's event loop
+ * @queue: the &struct rds_queue
+ *
+ * It becomes readable when a command completes, call
+ * rds_queue_complete() then.
+ */
+int
+rds_queue_get_fd(struct rds_queue *queue)
+{
+	if(!queue)
+		return -EINVAL;
+
+	return queue->event_fd;
+}
+
+/**
+ * rds_queue_complete - Reap a completed command and pass the next one
+ * @queue: the &struct rds_queue
+ *
+ * Safe to call at any time, e.g. also periodically to retry
+ * a submission that found the I/O thread's ring full.
+ *
+ * Returns: 1 if a command completed, else 0
+ */
+int
+rds_queue_complete(struct rds_queue *queue)
+{
+	uint64_t count = 0;
+	int done = 0;
+
+	if(read(queue->event_fd, &count, sizeof(count)) > 0 && queue->busy) {
+		queue->busy = 0;
+		done = 1;
+
+		if(queue->fut.ret < 0)
+			queue->stats.errors++;
+
+		if(queue->done_cb)
+			queue->done_cb(queue, &queue->fut.cmd, queue->fut.ret,
+					queue->fut_waiters, queue->done_arg);
+	}
+
+	rds_queue_kick(queue);
+
+	return done;
+}
+
+/**
+ * rds_queue_get_stats - Get the queue's counters
+ * @queue: the &struct rds_queue
+ * @stats: the &struct rds_queue_stats to fill
+ */
+int
+rds_queue_get_stats(struct rds_queue *queue, struct rds_queue_stats *stats)
+{
+	if(!queue || !stats)
+		return -EINVAL;
+
+	*stats = queue->stats;
+	return 0;
+}
+
+/**
+ * rds_queue_create - Create a coalescing queue for an encoder
+ * @enc: the &struct rds_encoder, put in threaded mode if it
+ *	isn't already (and switched back on destroy)
+ *
+ * Returns: a &struct rds_queue or NULL and errno set
+ */
+struct rds_queue *
+rds_queue_create(struct rds_encoder *enc)
+{
+	struct rds_queue *queue = NULL;
+	int ret = 0;
+
+	if(!enc) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	queue = malloc(sizeof(struct rds_queue));
+	if(!queue) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(queue, 0, sizeof(struct rds_queue));
+	queue->enc = enc;
+
+	queue->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(queue->event_fd < 0) {
+		ret = errno;
+		free(queue);
+		errno = ret;
+		return NULL;
+	}
+
+	if(!enc->io_thread) {
+		ret = rds_thread_start(enc, 0);
+		if(ret < 0) {
+			close(queue->event_fd);
+			free(queue);
+			errno = -ret;
+			return NULL;
+		}
+		queue->started_thread = 1;
+	}
+
+	return queue;
+}
+
+/**
+ * rds_queue_destroy - Free a queue
+ * @queue: the &struct rds_queue
+ *
+ * Waits for the command the encoder runs (if any), the ones
+ * still queued are dropped and done_cb is not called.
+ */
+void
+rds_queue_destroy(struct rds_queue *queue)
+{
+	struct pollfd pfd;
+	uint64_t count = 0;
+
+	if(!queue)
+		return;
+
+	pfd.fd = queue->event_fd;
+	pfd.events = POLLIN;
+	while(queue->busy) {
+		if(read(queue->event_fd, &count, sizeof(count)) > 0)
+			queue->busy = 0;
+		else
+			poll(&pfd, 1, -1);
+	}
+
+	if(queue->started_thread)
+		rds_thread_stop(queue->enc);
+
+	close(queue->event_fd);
+	free(queue);
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_queue.h -	Coalescing command queue, for event loops
+ *			that feed an encoder
+ */
+
+/**
+ * DOC: Coalescing queue
+ *
+ * Servers that take commands from the network (see uecp_srv.h and
+ * rdsd.c) can't wait on the serial link from their event loop. They
+ * push commands on a &struct rds_queue instead, that passes them to
+ * the encoder's I/O thread one at a time and signals completions
+ * through an eventfd (rds_queue_get_fd()), to be reaped with
+ * rds_queue_complete() from the event loop.
+ *
+ * While a command is in flight the rest wait on the queue, and a
+ * newer command with the same op / DSN / PSN replaces the one that
+ * waits, so when commands come in faster than the encoder can take
+ * them only the latest value of each field gets out. Each command
+ * carries a bitmask of waiters (e.g. clients of a server, up to 64)
+ * that gets merged when commands are coalesced, so everyone who
+ * asked for something gets the result of the command that
+ * replaced theirs.
+ */
+
+#define RDS_QUEUE_LEN	64
+
+struct rds_queue_entry {
+	struct rds_cmd cmd;
+	uint64_t waiters;
+};
+
+struct rds_queue_stats {
+	uint32_t commands;		/* Commands passed to the encoder */
+	uint32_t coalesced;		/* Commands replaced by newer ones */
+	uint32_t errors;		/* Commands the encoder failed */
+};
+
+struct rds_queue {
+	struct rds_encoder *enc;
+	uint8_t started_thread;		/* We put it in threaded mode */
+	int event_fd;			/* Signaled on command completion */
+
+	struct rds_queue_entry entries[RDS_QUEUE_LEN];
+	uint8_t head;
+	uint8_t len;
+
+	/* The command the encoder runs */
+	struct rds_future fut;
+	uint64_t fut_waiters;
+	uint8_t busy;
+
+	struct rds_queue_stats stats;
+
+	/* Called from rds_queue_complete() for each completed command,
+	 * results of get commands are on cmd */
+	void (*done_cb)(struct rds_queue *queue, const struct rds_cmd *cmd,
+					int ret, uint64_t waiters, void *arg);
+	void *done_arg;
+};
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+struct rds_queue *rds_queue_create(struct rds_encoder *enc);
+void rds_queue_destroy(struct rds_queue *queue);
+int rds_queue_push(struct rds_queue *queue, const struct rds_cmd *cmd,
+							uint64_t waiters);
+void rds_queue_forget(struct rds_queue *queue, uint64_t waiters);
+int rds_queue_get_fd(struct rds_queue *queue);
+int rds_queue_complete(struct rds_queue *queue);
+int rds_queue_get_stats(struct rds_queue *queue,
+				struct rds_queue_stats *stats);
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_rtplus.c -	RadioText Plus (RT+) tagging
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <string.h>	/* For memset() / memcmp() / strlen() */
+#include "rds.h"
+#include "rds_block.h"
+#include "rds_charset.h"
+#include "rds_rtplus.h"
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+/**
+ * rds_rtplus_text_len - Max RT length for an RT config
+ * @rt: the &struct rds_rt
+ *
+ * 2B groups only carry 32 chars.
+ */
+static int
+rds_rtplus_text_len(const struct rds_rt *rt)
+{
+	return (rt->ab_flag & RDS_RT_METHOD_B) ? 32 : RDS_RT_MSG_LEN_MAX - 1;
+}
+
+/**
+ * rds_rtplus_check - Check that the tags fit their text
+ * @rtplus: the &struct rds_rtplus
+ *
+ * Returns: 0 or -EINVAL
+ */
+int
+rds_rtplus_check(const struct rds_rtplus *rtplus)
+{
+	const struct rds_rtplus_tag *tag = NULL;
+	int len = strnlen((const char *) rtplus->rt.msg,
+				rds_rtplus_text_len(&rtplus->rt));
+	int i = 0;
+
+	for(i = 0; i < RDS_RTPLUS_TAGS_MAX; i++) {
+		tag = &rtplus->tags[i];
+		if(!tag->len)
+			continue;
+		if(tag->type > RDS_RTPLUS_TYPE_MAX ||
+		tag->start + tag->len > len)
+			return -EINVAL;
+	}
+
+	if(rtplus->tags[0].len > RDS_RTPLUS_TAG1_LEN_MAX ||
+	rtplus->tags[1].len > RDS_RTPLUS_TAG2_LEN_MAX)
+		return -EINVAL;
+
+	return 0;
+}
+
+/**
+ * rds_rtplus_same_item - Check if two RT+ messages tag the same item
+ * @a: pointer to &struct rds_rtplus
+ * @b: pointer to &struct rds_rtplus
+ *
+ * Same item means same tagged text with the same content types,
+ * the untagged parts of the RT may differ.
+ */
+int
+rds_rtplus_same_item(const struct rds_rtplus *a, const struct rds_rtplus *b)
+{
+	const struct rds_rtplus_tag *ta = NULL;
+	const struct rds_rtplus_tag *tb = NULL;
+	int i = 0;
+
+	for(i = 0; i < RDS_RTPLUS_TAGS_MAX; i++) {
+		ta = &a->tags[i];
+		tb = &b->tags[i];
+		if(ta->len != tb->len || (ta->len && ta->type != tb->type))
+			return 0;
+		if(memcmp(a->rt.msg + ta->start, b->rt.msg + tb->start, ta->len))
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * rds_rtplus_encode - Fill an 11A group
+ * @rtplus: the &struct rds_rtplus
+ * @info: the information words to fill, only the 5 low bits of
+ *	block B and blocks C / D are touched
+ *
+ * Lengths go on air as length markers, the number of chars
+ * after the first one.
+ */
+void
+rds_rtplus_encode(const struct rds_rtplus *rtplus, uint16_t *info)
+{
+	const struct rds_rtplus_tag *t1 = &rtplus->tags[0];
+	const struct rds_rtplus_tag *t2 = &rtplus->tags[1];
+	uint8_t len1 = t1->len ? t1->len - 1 : 0;
+	uint8_t len2 = t2->len ? t2->len - 1 : 0;
+
+	info[1] = (info[1] & ~0x1F) |
+		((rtplus->toggle & 0x1) << 4) |
+		((rtplus->running & 0x1) << 3) |
+		((t1->type >> 3) & 0x7);
+	info[2] = ((t1->type & 0x7) << 13) |
+		((t1->start & 0x3F) << 7) |
+		((len1 & 0x3F) << 1) |
+		((t2->type >> 5) & 0x1);
+	info[3] = ((t2->type & 0x1F) << 11) |
+		((t2->start & 0x3F) << 5) |
+		(len2 & 0x1F);
+}
+
+
+/**************\
+* ENTRY POINTS *
+\**************/
+
+/**
+ * rds_rtplus_build - Lay out an RT message and its RT+ tags
+ * @rtplus: the &struct rds_rtplus to fill, set rt.ab_flag /
+ *	retransmissions / buffer_config before calling this
+ * @fields: the parts of the message, in order
+ * @num_fields: number of @fields
+ *
+ * Fields are converted to G0 and appended to the message, the ones
+ * with a content type get a tag covering them (at most two). Text
+ * that doesn't fit is cut, along with its tag. The longer tag goes
+ * first since the second one can't cover more than 32 chars.
+ *
+ * Returns: the message length or -EINVAL if more than two fields
+ * are tagged
+ */
+int
+rds_rtplus_build(struct rds_rtplus *rtplus,
+		const struct rds_rtplus_field *fields, int num_fields)
+{
+	struct rds_rtplus_tag tmp;
+	struct rds_rtplus_tag *tag = NULL;
+	uint8_t buf[RDS_RT_MSG_LEN_MAX + 1];
+	int max = rds_rtplus_text_len(&rtplus->rt);
+	int cut = 0;
+	int num_tags = 0;
+	int tagged = 0;
+	int len = 0;
+	int ret = 0;
+	int i = 0;
+
+	memset(rtplus->rt.msg, 0, RDS_RT_MSG_LEN_MAX);
+	memset(rtplus->tags, 0, sizeof(rtplus->tags));
+	rtplus->running = 0;
+
+	for(i = 0; i < num_fields; i++) {
+		if(!fields[i].text)
+			continue;
+
+		/* One more byte than what's left, to tell if it got cut */
+		ret = rds_charset_encode(buf, max - len + 1,
+					fields[i].text, strlen(fields[i].text));
+		cut = (ret > max - len);
+		if(cut)
+			ret = max - len;
+		memcpy(rtplus->rt.msg + len, buf, ret);
+
+		if(fields[i].type != RDS_RTPLUS_NONE && ret > 0) {
+			if(tagged == RDS_RTPLUS_TAGS_MAX ||
+			fields[i].type > RDS_RTPLUS_TYPE_MAX)
+				return -EINVAL;
+			tagged++;
+		}
+
+		/* A partial title / artist is worse than none */
+		if(fields[i].type != RDS_RTPLUS_NONE && ret > 0 && !cut) {
+			tag = &rtplus->tags[num_tags++];
+			tag->type = fields[i].type;
+			tag->start = len;
+			tag->len = ret;
+		}
+
+		len += ret;
+	}
+
+	if(rtplus->tags[1].len > rtplus->tags[0].len) {
+		tmp = rtplus->tags[0];
+		rtplus->tags[0] = rtplus->tags[1];
+		rtplus->tags[1] = tmp;
+	}
+
+	rtplus->running = num_tags ? 1 : 0;
+
+	return len;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_rtplus.h -	RadioText Plus (RT+) tagging
+ */
+
+/**
+ * DOC: RadioText Plus
+ *
+ * RT+ is an ODA (AID 0x4BD7) that marks parts of the RadioText,
+ * e.g. artist and title, so that receivers can show / store them.
+ * It's announced on 3A groups and sent on 11A groups, each one
+ * carrying up to two tags (content type, start, length) plus the
+ * item running / item toggle bits. The tags point into the RT as
+ * it is on air, so they are only valid together with that exact
+ * text, a receiver that gets tags for the new text while it still
+ * shows the old one (or the other way around) shows garbage.
+ *
+ * So RT and its tags travel together, as a single command
+ * (RDS_CMD_SET_RTPLUS, see rds_set_rtplus()):
+ *
+ * rds_rtplus_build() takes the metadata as a list of fields (e.g.
+ * artist, " - ", title), converts them to G0 and lays out the RT
+ * message and the tag offsets in one pass, so offsets are always in
+ * chars on air.
+ *
+ * The UECP backend sends the RT message and the RT+ ODA messages
+ * back to back in a single frame. The software encoder switches RT
+ * and tags under its lock and holds back 11A groups until the new
+ * text went out once.
+ *
+ * A plain rds_set_rt() afterwards clears the tags (running bit off)
+ * along with the text they pointed into. The item toggle bit flips
+ * when the tagged text changes (a new item), backends keep track of
+ * it and return it on &struct rds_rtplus.
+ */
+
+#define RDS_RTPLUS_AID		0x4BD7
+#define RDS_RTPLUS_GROUP	RDS_GROUP_CODE(11, 0)
+
+/* 3A message bits: no template, CB = 0, SCB = 0 */
+#define RDS_RTPLUS_ODA_MSG	0x0000
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+void rds_rtplus_encode(const struct rds_rtplus *rtplus, uint16_t *info);
+int rds_rtplus_check(const struct rds_rtplus *rtplus);
+int rds_rtplus_same_item(const struct rds_rtplus *a, const struct rds_rtplus *b);
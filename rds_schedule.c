@@ -0,0 +1,578 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_schedule.c -	Commands scheduled for a wall-clock time
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <stdlib.h>	/* For malloc/realloc/free */
+#include <string.h>	/* For memset() */
+#include <time.h>	/* For clock_gettime() / clock_nanosleep() */
+#include <pthread.h>	/* For pthread_* */
+#include "rds.h"
+#include "rds_thread.h"
+#include "rds_schedule.h"
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+/**
+ * rds_schedule_ns - Read a clock in ns
+ * @clk: CLOCK_REALTIME or CLOCK_MONOTONIC
+ */
+static uint64_t
+rds_schedule_ns(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * rds_schedule_wait - Wait on the scheduler's condition (lock held)
+ * @s: the &struct rds_schedule
+ * @ns: for how long at most
+ */
+static void
+rds_schedule_wait(struct rds_schedule *s, uint64_t ns)
+{
+	struct timespec deadline;
+
+	ns += rds_schedule_ns(CLOCK_MONOTONIC);
+	deadline.tv_sec = ns / 1000000000;
+	deadline.tv_nsec = ns % 1000000000;
+
+	if(!s->stop)
+		pthread_cond_timedwait(&s->cond, &s->lock, &deadline);
+}
+
+
+/******\
+* HEAP *
+\******/
+
+/**
+ * rds_schedule_before - Check if an item goes before another
+ * @a: the first &struct rds_schedule_item
+ * @b: the second one
+ */
+static inline int
+rds_schedule_before(const struct rds_schedule_item *a,
+			const struct rds_schedule_item *b)
+{
+	if(a->at_ns != b->at_ns)
+		return a->at_ns < b->at_ns;
+
+	return a->seq < b->seq;
+}
+
+/**
+ * rds_schedule_sift_up - Move an item up the heap to its place
+ * @s: the &struct rds_schedule
+ * @i: its index
+ */
+static void
+rds_schedule_sift_up(struct rds_schedule *s, uint32_t i)
+{
+	struct rds_schedule_item *item = s->heap[i];
+	uint32_t parent = 0;
+
+	while(i > 0) {
+		parent = (i - 1) / 2;
+		if(!rds_schedule_before(item, s->heap[parent]))
+			break;
+		s->heap[i] = s->heap[parent];
+		i = parent;
+	}
+
+	s->heap[i] = item;
+}
+
+/**
+ * rds_schedule_sift_down - Move an item down the heap to its place
+ * @s: the &struct rds_schedule
+ * @i: its index
+ */
+static void
+rds_schedule_sift_down(struct rds_schedule *s, uint32_t i)
+{
+	struct rds_schedule_item *item = s->heap[i];
+	uint32_t child = 0;
+
+	while((child = 2 * i + 1) < s->heap_len) {
+		if(child + 1 < s->heap_len &&
+		rds_schedule_before(s->heap[child + 1], s->heap[child]))
+			child++;
+		if(!rds_schedule_before(s->heap[child], item))
+			break;
+		s->heap[i] = s->heap[child];
+		i = child;
+	}
+
+	s->heap[i] = item;
+}
+
+/**
+ * rds_schedule_push - Add an item on the heap (lock held)
+ * @s: the &struct rds_schedule
+ * @item: the &struct rds_schedule_item
+ */
+static int
+rds_schedule_push(struct rds_schedule *s, struct rds_schedule_item *item)
+{
+	struct rds_schedule_item **heap = NULL;
+	uint32_t size = 0;
+
+	if(s->heap_len == s->heap_size) {
+		if(s->heap_size >= RDS_SCHEDULE_PENDING_MAX)
+			return -ENOSPC;
+
+		size = s->heap_size ? s->heap_size * 2 :
+				RDS_SCHEDULE_HEAP_LEN_INIT;
+		heap = realloc(s->heap, size * sizeof(*heap));
+		if(!heap)
+			return -ENOMEM;
+
+		s->heap = heap;
+		s->heap_size = size;
+	}
+
+	s->heap[s->heap_len] = item;
+	rds_schedule_sift_up(s, s->heap_len++);
+
+	return 0;
+}
+
+/**
+ * rds_schedule_remove - Take an item off the heap (lock held)
+ * @s: the &struct rds_schedule
+ * @i: its index, 0 for the earliest one
+ */
+static struct rds_schedule_item *
+rds_schedule_remove(struct rds_schedule *s, uint32_t i)
+{
+	struct rds_schedule_item *item = s->heap[i];
+
+	s->heap_len--;
+	if(i == s->heap_len)
+		return item;
+
+	/* Put the last one in its place, it may need to go either way */
+	s->heap[i] = s->heap[s->heap_len];
+	rds_schedule_sift_up(s, i);
+	rds_schedule_sift_down(s, i);
+
+	return item;
+}
+
+
+/***********\
+* EXECUTION *
+\***********/
+
+/**
+ * rds_schedule_inflight_del - Take an item off the in-flight list (lock held)
+ * @s: the &struct rds_schedule
+ * @item: the &struct rds_schedule_item
+ */
+static void
+rds_schedule_inflight_del(struct rds_schedule *s,
+			struct rds_schedule_item *item)
+{
+	struct rds_schedule_item **p = &s->inflight;
+
+	while(*p && *p != item)
+		p = &(*p)->next;
+
+	if(*p)
+		*p = item->next;
+}
+
+/**
+ * rds_schedule_exec_fn - Run a scheduled command (on the I/O thread)
+ * @enc: pointer to &struct rds_encoder
+ * @arg: the &struct rds_schedule_item
+ *
+ * Holds its first frame so that its last byte goes out at the item's
+ * time, minus the link latency we measured so far, then updates the
+ * model with how late it actually went out.
+ */
+static int
+rds_schedule_exec_fn(struct rds_encoder *enc, void *arg)
+{
+	struct rds_schedule_item *item = arg;
+	struct rds_schedule *s = item->s;
+	struct rds_future *fut = item->fut;
+	struct timespec ts;
+	uint64_t send_at_ns = 0;
+	int32_t late_us = 0;
+	int ret = 0;
+
+	pthread_mutex_lock(&s->lock);
+	rds_schedule_inflight_del(s, item);
+	pthread_mutex_unlock(&s->lock);
+
+	send_at_ns = item->at_ns - (uint64_t) s->latency_us * 1000;
+	free(item);
+
+	/* No port to hold the frame on, wait here */
+	if(enc->type == RDS_ENCODER_TYPE_SOFT) {
+		ts.tv_sec = send_at_ns / 1000000000;
+		ts.tv_nsec = send_at_ns % 1000000000;
+		while(clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts,
+							NULL) == EINTR);
+		s->run++;
+		return rds_cmd_exec(enc, &fut->cmd);
+	}
+
+	/* Left alone by rds_send_buf() unless the frame got held */
+	enc->send_late_us = INT32_MIN;
+	enc->send_at_ns = send_at_ns;
+
+	ret = rds_cmd_exec(enc, &fut->cmd);
+
+	/* In case it failed before sending anything */
+	enc->send_at_ns = 0;
+
+	s->run++;
+	late_us = enc->send_late_us;
+	if(late_us == INT32_MIN) {
+		if(ret >= 0)
+			s->late++;
+		return ret;
+	}
+
+	/* Only this thread touches the model */
+	late_us = s->latency_us + late_us / RDS_SCHEDULE_LATENCY_GAIN;
+	if(late_us < 0)
+		late_us = 0;
+	else if(late_us > RDS_SCHEDULE_LATENCY_MAX_US)
+		late_us = RDS_SCHEDULE_LATENCY_MAX_US;
+	s->latency_us = late_us;
+
+	return ret;
+}
+
+/**
+ * rds_schedule_thread_fn - Main loop of the scheduler's thread
+ * @arg: the &struct rds_schedule
+ */
+static void *
+rds_schedule_thread_fn(void *arg)
+{
+	struct rds_schedule *s = arg;
+	struct rds_schedule_item *item = NULL;
+	struct rds_future *fut = NULL;
+	uint64_t lead_ns = RDS_SCHEDULE_LEAD_MS * 1000000ULL;
+	uint64_t now = 0;
+	int ret = 0;
+
+	pthread_mutex_lock(&s->lock);
+
+	while(!s->stop) {
+		if(!s->heap_len) {
+			pthread_cond_wait(&s->cond, &s->lock);
+			continue;
+		}
+
+		now = rds_schedule_ns(CLOCK_REALTIME);
+		if(now + lead_ns < s->heap[0]->at_ns) {
+			now = s->heap[0]->at_ns - lead_ns - now;
+			rds_schedule_wait(s, now < RDS_SCHEDULE_CHECK_MS *
+					1000000ULL ? now :
+					RDS_SCHEDULE_CHECK_MS * 1000000ULL);
+			continue;
+		}
+
+		item = rds_schedule_remove(s, 0);
+		item->next = s->inflight;
+		s->inflight = item;
+
+		fut = item->fut;
+		fut->fn = rds_schedule_exec_fn;
+		fut->fn_arg = item;
+
+		/* Don't hold the lock while it runs, it needs it */
+		pthread_mutex_unlock(&s->lock);
+		ret = rds_submit(s->enc, fut);
+		pthread_mutex_lock(&s->lock);
+
+		if(ret == 0)
+			continue;
+
+		rds_schedule_inflight_del(s, item);
+		fut->fn = NULL;
+		fut->fn_arg = NULL;
+
+		/* Queue is full, try again in a while (unless it's
+		 * too late already) */
+		if(ret == -EAGAIN &&
+		rds_schedule_ns(CLOCK_REALTIME) < item->at_ns &&
+		rds_schedule_push(s, item) == 0) {
+			rds_schedule_wait(s, RDS_SCHEDULE_RETRY_MS * 1000000ULL);
+			continue;
+		}
+
+		pthread_mutex_unlock(&s->lock);
+		free(item);
+		rds_future_complete(s->enc, fut, ret);
+		pthread_mutex_lock(&s->lock);
+	}
+
+	pthread_mutex_unlock(&s->lock);
+
+	return NULL;
+}
+
+/**
+ * rds_schedule_barrier_fn - Nothing, see rds_schedule_free()
+ * @enc: pointer to &struct rds_encoder
+ * @arg: unused
+ */
+static int
+rds_schedule_barrier_fn(struct rds_encoder *enc, void *arg)
+{
+	return 0;
+}
+
+/**
+ * rds_schedule_get - Get an encoder's scheduler, creating it if needed
+ * @enc: pointer to &struct rds_encoder
+ *
+ * Returns: the &struct rds_schedule or NULL and errno set
+ */
+static struct rds_schedule *
+rds_schedule_get(struct rds_encoder *enc)
+{
+	struct rds_schedule *s = NULL;
+	pthread_condattr_t attr;
+	void *expected = NULL;
+	int ret = 0;
+
+	s = __atomic_load_n(&enc->sched, __ATOMIC_ACQUIRE);
+	if(s)
+		return s;
+
+	if(!enc->io_thread && !enc->bus) {
+		ret = rds_thread_start(enc, 0);
+		if(ret < 0 && ret != -EALREADY) {
+			errno = -ret;
+			return NULL;
+		}
+	}
+
+	s = malloc(sizeof(struct rds_schedule));
+	if(!s) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(s, 0, sizeof(struct rds_schedule));
+	s->enc = enc;
+
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&s->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	ret = pthread_create(&s->tid, NULL, rds_schedule_thread_fn, s);
+	if(ret != 0) {
+		pthread_cond_destroy(&s->cond);
+		pthread_mutex_destroy(&s->lock);
+		free(s);
+		errno = ret;
+		return NULL;
+	}
+
+	/* Someone else got there first */
+	if(!__atomic_compare_exchange_n(&enc->sched, &expected, s, 0,
+					__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&s->lock);
+		s->stop = 1;
+		pthread_cond_signal(&s->cond);
+		pthread_mutex_unlock(&s->lock);
+		pthread_join(s->tid, NULL);
+		pthread_cond_destroy(&s->cond);
+		pthread_mutex_destroy(&s->lock);
+		free(s);
+		return expected;
+	}
+
+	return s;
+}
+
+
+/**************\
+* ENTRY POINTS *
+\**************/
+
+/**
+ * rds_schedule - Run a set command at a given time
+ * @enc: pointer to &struct rds_encoder
+ * @fut: a &struct rds_future with the command (see rds_future_init()),
+ *	it must stay around until it completes
+ * @at_ns: when it should take effect (CLOCK_REALTIME, in ns), its
+ *	last byte goes out then
+ *
+ * If the time has passed already it runs right away. Wait for it
+ * with rds_future_wait(), or set a callback on it.
+ *
+ * Returns: 0 on success or a negative error code (-EINVAL if it's
+ * not a set command, -ENOSPC if there are too many pending already)
+ */
+int
+rds_schedule(struct rds_encoder *enc, struct rds_future *fut, uint64_t at_ns)
+{
+	struct rds_schedule *s = NULL;
+	struct rds_schedule_item *item = NULL;
+	int ret = 0;
+
+	if(!enc || !fut || !at_ns || !RDS_CMD_IS_SET(fut->cmd.op))
+		return -EINVAL;
+
+	s = rds_schedule_get(enc);
+	if(!s)
+		return -errno;
+
+	item = malloc(sizeof(struct rds_schedule_item));
+	if(!item)
+		return -ENOMEM;
+	memset(item, 0, sizeof(struct rds_schedule_item));
+	item->s = s;
+	item->fut = fut;
+	item->at_ns = at_ns;
+
+	fut->done = 0;
+	fut->fn = NULL;
+	fut->fn_arg = NULL;
+
+	pthread_mutex_lock(&s->lock);
+
+	item->seq = s->next_seq++;
+	ret = rds_schedule_push(s, item);
+
+	/* It's the new earliest one, the thread may need to wake up sooner */
+	if(ret == 0 && s->heap[0] == item)
+		pthread_cond_signal(&s->cond);
+
+	pthread_mutex_unlock(&s->lock);
+
+	if(ret < 0)
+		free(item);
+
+	return ret;
+}
+
+/**
+ * rds_unschedule - Cancel a scheduled command
+ * @enc: pointer to &struct rds_encoder
+ * @fut: the &struct rds_future given to rds_schedule()
+ *
+ * The future completes with -ECANCELED. This looks it up among the
+ * pending ones, so it's O(n).
+ *
+ * Returns: 0 on success, -EBUSY if it's been handed to the encoder
+ * already, -ENOENT if it's not scheduled (or done)
+ */
+int
+rds_unschedule(struct rds_encoder *enc, struct rds_future *fut)
+{
+	struct rds_schedule *s = NULL;
+	struct rds_schedule_item *item = NULL;
+	uint32_t i = 0;
+
+	s = __atomic_load_n(&enc->sched, __ATOMIC_ACQUIRE);
+	if(!s || !fut)
+		return -ENOENT;
+
+	pthread_mutex_lock(&s->lock);
+
+	for(i = 0; i < s->heap_len; i++)
+		if(s->heap[i]->fut == fut)
+			break;
+
+	if(i == s->heap_len) {
+		for(item = s->inflight; item; item = item->next)
+			if(item->fut == fut)
+				break;
+		pthread_mutex_unlock(&s->lock);
+		return item ? -EBUSY : -ENOENT;
+	}
+
+	item = rds_schedule_remove(s, i);
+	s->cancelled++;
+
+	pthread_mutex_unlock(&s->lock);
+
+	free(item);
+	rds_future_complete(enc, fut, -ECANCELED);
+
+	return 0;
+}
+
+/**
+ * rds_schedule_free - Stop the scheduler and release it
+ * @enc: pointer to &struct rds_encoder
+ *
+ * Called from rds_exit() while the I/O thread is still there, the
+ * ones still pending complete with -ESHUTDOWN, the ones handed to
+ * the encoder already get to run.
+ */
+void
+rds_schedule_free(struct rds_encoder *enc)
+{
+	struct rds_schedule *s = enc->sched;
+	struct rds_schedule_item *item = NULL;
+
+	if(!s)
+		return;
+
+	pthread_mutex_lock(&s->lock);
+	s->stop = 1;
+	pthread_cond_signal(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+
+	pthread_join(s->tid, NULL);
+
+	while(s->heap_len) {
+		item = rds_schedule_remove(s, s->heap_len - 1);
+		rds_future_complete(enc, item->fut, -ESHUTDOWN);
+		free(item);
+	}
+
+	/* The queue is FIFO, once this runs the in-flight ones did too */
+	rds_thread_run(enc, rds_schedule_barrier_fn, NULL);
+
+	/* Dropped by the I/O thread (it got stopped) */
+	while(s->inflight) {
+		item = s->inflight;
+		s->inflight = item->next;
+		free(item);
+	}
+
+	enc->sched = NULL;
+	pthread_cond_destroy(&s->cond);
+	pthread_mutex_destroy(&s->lock);
+	free(s->heap);
+	free(s);
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_schedule.h -	Commands scheduled for a wall-clock time
+ */
+
+/**
+ * DOC: Scheduled commands
+ *
+ * RT / PS / TA changes often need to line up with something on air
+ * (a jingle, the news at the top of the hour), but a set command
+ * takes an unpredictable time to reach the encoder. Instead of
+ * calling rds_set_*() at the right time, fill a &struct rds_future
+ * with the set command and pass it to rds_schedule() along with the
+ * time it should take effect (CLOCK_REALTIME, i.e. UTC, in ns). It
+ * completes like a submitted one (see rds_thread.h), with -ECANCELED
+ * if it was rds_unschedule()d or -ESHUTDOWN if the encoder went away
+ * first.
+ *
+ * Pending commands are kept on a binary min-heap ordered by time (and
+ * order of scheduling for the same time), so adding one and taking
+ * the next one is O(log n) and thousands of them cost nothing while
+ * they wait. A scheduler thread per encoder (created on the first
+ * rds_schedule()) sleeps until RDS_SCHEDULE_LEAD_MS before the
+ * earliest one and hands it to the I/O thread (the encoder is put in
+ * threaded mode if it isn't already).
+ *
+ * There the frame gets serialized as usual and then held (see
+ * rds_send_buf()) so that, after its wire time, its last byte goes
+ * out at the requested time minus the link's latency. The latency
+ * is learned: every held frame reports how late its last byte left
+ * the port (tcdrain() returned), e.g. because of a USB serial
+ * adapter's buffering, and that gets averaged into the next holds.
+ * Commands that take more than one frame (e.g. an RT mode change
+ * plus the RT on Prais) hold their first one. Commands that reach
+ * the I/O thread after their time (it was busy) go out right away
+ * and are counted as late.
+ */
+
+/* The command goes to the I/O thread this long before its time, it
+ * must cover the worst case wait there plus the frame's wire time.
+ * The I/O thread does nothing else while it holds the frame */
+#define RDS_SCHEDULE_LEAD_MS		250
+
+/* How often the scheduler thread wakes up anyway, in case the
+ * system clock got stepped */
+#define RDS_SCHEDULE_CHECK_MS		1000
+
+/* How long to wait before handing a command again when the
+ * I/O thread's queue is full */
+#define RDS_SCHEDULE_RETRY_MS		10
+
+#define RDS_SCHEDULE_PENDING_MAX	65536
+#define RDS_SCHEDULE_HEAP_LEN_INIT	64
+
+/* Link latency model: each measurement moves it by 1 /
+ * RDS_SCHEDULE_LATENCY_GAIN of the error, within limits */
+#define RDS_SCHEDULE_LATENCY_GAIN	4
+#define RDS_SCHEDULE_LATENCY_MAX_US	50000
+
+struct rds_schedule_item {
+	struct rds_schedule *s;
+	struct rds_future *fut;
+	uint64_t at_ns;			/* CLOCK_REALTIME */
+	uint64_t seq;			/* Order of scheduling */
+	struct rds_schedule_item *next;	/* On the in-flight list */
+};
+
+/* Per encoder state, on enc->sched */
+struct rds_schedule {
+	struct rds_encoder *enc;
+
+	pthread_t tid;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint8_t stop;
+
+	/* Pending ones, heap[0] is the earliest */
+	struct rds_schedule_item **heap;
+	uint32_t heap_len;
+	uint32_t heap_size;
+	uint64_t next_seq;
+
+	/* Handed to the I/O thread, not run yet */
+	struct rds_schedule_item *inflight;
+
+	int32_t latency_us;		/* Link latency model */
+
+	/* Stats */
+	uint32_t run;
+	uint32_t late;			/* Reached the encoder after their time */
+	uint32_t cancelled;
+};
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+int rds_schedule(struct rds_encoder *enc, struct rds_future *fut,
+							uint64_t at_ns);
+int rds_unschedule(struct rds_encoder *enc, struct rds_future *fut);
+
+/* Used internaly by rds_exit() */
+void rds_schedule_free(struct rds_encoder *enc);
@@ -0,0 +1,367 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_shm.c -	Encoder state published on shared memory
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <stdlib.h>	/* For malloc/free */
+#include <string.h>	/* For memset() / memcpy() */
+#include <unistd.h>	/* For close() / ftruncate() */
+#include <fcntl.h>	/* For open() */
+#include <time.h>	/* For clock_gettime() */
+#include <sched.h>	/* For sched_yield() */
+#include <sys/mman.h>	/* For mmap() */
+#include <sys/stat.h>	/* For fstat() */
+#include "rds.h"
+#include "rds_shm.h"
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+/**
+ * rds_shm_map - Map a file and check its header
+ * @fd: the file
+ * @writable: map it read / write
+ */
+static struct rds_shm *
+rds_shm_map(int fd, uint8_t writable)
+{
+	struct rds_shm *shm = NULL;
+	struct stat st;
+	void *addr = NULL;
+	int ret = 0;
+
+	if(fstat(fd, &st) < 0)
+		return NULL;
+
+	if(st.st_size < (off_t) sizeof(struct rds_shm_hdr)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	addr = mmap(NULL, st.st_size, writable ? PROT_READ | PROT_WRITE :
+					PROT_READ, MAP_SHARED, fd, 0);
+	if(addr == MAP_FAILED)
+		return NULL;
+
+	shm = malloc(sizeof(struct rds_shm));
+	if(!shm) {
+		ret = ENOMEM;
+		goto cleanup;
+	}
+
+	shm->hdr = addr;
+	shm->len = st.st_size;
+	shm->writable = writable;
+
+	/* A new file gets its header from rds_shm_create() */
+	if(writable)
+		return shm;
+
+	if(shm->hdr->magic != RDS_SHM_MAGIC ||
+	shm->hdr->version != RDS_SHM_VERSION ||
+	shm->hdr->slot_size != sizeof(struct rds_shm_slot) ||
+	shm->len < sizeof(struct rds_shm_hdr) +
+		shm->hdr->num_slots * sizeof(struct rds_shm_slot)) {
+		ret = EPROTO;
+		goto cleanup;
+	}
+
+	return shm;
+
+ cleanup:
+	free(shm);
+	munmap(addr, st.st_size);
+	errno = ret;
+	return NULL;
+}
+
+/**
+ * rds_shm_now_ms - Get CLOCK_REALTIME in ms (served by the vDSO)
+ */
+static uint64_t
+rds_shm_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/********\
+* WRITER *
+\********/
+
+/**
+ * rds_shm_publish - Copy an encoder's shadow state to its slot
+ * @enc: pointer to &struct rds_encoder
+ *
+ * There's one writer per slot (whoever owns the encoder), so
+ * we only need to keep readers from seeing half an update.
+ */
+void
+rds_shm_publish(struct rds_encoder *enc)
+{
+	struct rds_shm_slot *slot = enc->shm;
+	uint32_t seq = 0;
+
+	if(!slot)
+		return;
+
+	seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	slot->state = enc->state;
+	slot->updated_ms = rds_shm_now_ms();
+
+	__atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * rds_shm_attach - Publish an encoder's state on a free slot
+ * @shm: a &struct rds_shm from rds_shm_create()
+ * @enc: pointer to &struct rds_encoder
+ * @name: a name for readers to find it with rds_shm_find()
+ *
+ * Returns: the slot's index or a negative error code
+ */
+int
+rds_shm_attach(struct rds_shm *shm, struct rds_encoder *enc,
+						const char *name)
+{
+	struct rds_shm_slot *slot = NULL;
+	int i = 0;
+
+	if(!shm || !enc || !name || !shm->writable || enc->shm)
+		return -EINVAL;
+
+	for(i = 0; i < shm->hdr->num_slots; i++)
+		if(!shm->hdr->slots[i].in_use)
+			break;
+
+	if(i == shm->hdr->num_slots)
+		return -ENOSPC;
+
+	slot = &shm->hdr->slots[i];
+	strncpy(slot->name, name, RDS_SHM_NAME_LEN - 1);
+	slot->name[RDS_SHM_NAME_LEN - 1] = '\0';
+	__atomic_store_n(&slot->in_use, 1, __ATOMIC_RELEASE);
+
+	enc->shm = slot;
+	rds_shm_publish(enc);
+
+	return i;
+}
+
+/**
+ * rds_shm_detach - Stop publishing an encoder's state
+ * @enc: pointer to &struct rds_encoder
+ *
+ * The slot is freed, readers of it get -ENOENT from then on.
+ */
+void
+rds_shm_detach(struct rds_encoder *enc)
+{
+	struct rds_shm_slot *slot = enc->shm;
+
+	if(!slot)
+		return;
+
+	__atomic_store_n(&slot->in_use, 0, __ATOMIC_RELEASE);
+	enc->shm = NULL;
+}
+
+/**
+ * rds_shm_create - Create the shared memory file
+ * @path: where to create it, e.g. under /dev/shm (replaced if
+ *	it exists)
+ * @num_slots: how many encoders it can hold
+ *
+ * Returns: a &struct rds_shm or NULL and errno set
+ */
+struct rds_shm *
+rds_shm_create(const char *path, uint16_t num_slots)
+{
+	struct rds_shm *shm = NULL;
+	size_t len = 0;
+	int fd = 0;
+	int ret = 0;
+
+	if(!path || !num_slots || num_slots > RDS_SHM_SLOTS_MAX) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	len = sizeof(struct rds_shm_hdr) +
+		num_slots * sizeof(struct rds_shm_slot);
+
+	/* Readers that still map the old one keep it */
+	unlink(path);
+	fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if(fd < 0)
+		return NULL;
+
+	if(ftruncate(fd, len) < 0) {
+		ret = errno;
+		close(fd);
+		errno = ret;
+		return NULL;
+	}
+
+	shm = rds_shm_map(fd, 1);
+	ret = errno;
+	close(fd);
+	if(!shm) {
+		errno = ret;
+		return NULL;
+	}
+
+	/* The file is all zeroes, fill the header last */
+	shm->hdr->num_slots = num_slots;
+	shm->hdr->slot_size = sizeof(struct rds_shm_slot);
+	shm->hdr->version = RDS_SHM_VERSION;
+	__atomic_store_n(&shm->hdr->magic, RDS_SHM_MAGIC, __ATOMIC_RELEASE);
+
+	return shm;
+}
+
+
+/*********\
+* READERS *
+\*********/
+
+/**
+ * rds_shm_open - Map a shared memory file for reading
+ * @path: the file, as given to rds_shm_create()
+ *
+ * Returns: a &struct rds_shm or NULL and errno set (EPROTO if
+ * the file is not something we understand)
+ */
+struct rds_shm *
+rds_shm_open(const char *path)
+{
+	struct rds_shm *shm = NULL;
+	int fd = 0;
+	int ret = 0;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+		return NULL;
+
+	shm = rds_shm_map(fd, 0);
+	ret = errno;
+	close(fd);
+	errno = ret;
+
+	return shm;
+}
+
+/**
+ * rds_shm_find - Find an encoder's slot by name
+ * @shm: the &struct rds_shm
+ * @name: the name given to rds_shm_attach()
+ *
+ * Returns: the slot's index or -ENOENT
+ */
+int
+rds_shm_find(struct rds_shm *shm, const char *name)
+{
+	struct rds_shm_slot *slot = NULL;
+	int i = 0;
+
+	for(i = 0; i < shm->hdr->num_slots; i++) {
+		slot = &shm->hdr->slots[i];
+		if(__atomic_load_n(&slot->in_use, __ATOMIC_ACQUIRE) &&
+		!strncmp(slot->name, name, RDS_SHM_NAME_LEN))
+			return i;
+	}
+
+	return -ENOENT;
+}
+
+/**
+ * rds_shm_read - Get a consistent snapshot of an encoder's state
+ * @shm: the &struct rds_shm
+ * @slot: the slot's index
+ * @state: the &struct rds_state to fill
+ * @updated_ms: when it last changed, CLOCK_REALTIME in ms (optional)
+ *
+ * Returns: 0 on success, -ENOENT if nobody publishes on that slot,
+ * -EAGAIN if we kept hitting updates (the writer died mid-update)
+ */
+int
+rds_shm_read(struct rds_shm *shm, int slot, struct rds_state *state,
+						uint64_t *updated_ms)
+{
+	struct rds_shm_slot *s = NULL;
+	uint32_t seq = 0;
+	uint64_t stamp = 0;
+	int i = 0;
+
+	if(slot < 0 || slot >= shm->hdr->num_slots)
+		return -EINVAL;
+	s = &shm->hdr->slots[slot];
+
+	for(i = 1; i <= RDS_SHM_READ_RETRIES; i++) {
+		if(!__atomic_load_n(&s->in_use, __ATOMIC_ACQUIRE))
+			return -ENOENT;
+
+		if(!(i % RDS_SHM_READ_SPINS))
+			sched_yield();
+
+		seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+		if(seq & 1)
+			continue;
+
+		memcpy(state, &s->state, sizeof(struct rds_state));
+		stamp = s->updated_ms;
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&s->seq, __ATOMIC_RELAXED) != seq)
+			continue;
+
+		if(updated_ms)
+			*updated_ms = stamp;
+		return 0;
+	}
+
+	return -EAGAIN;
+}
+
+/**
+ * rds_shm_close - Unmap a shared memory file
+ * @shm: the &struct rds_shm
+ *
+ * On the writer's side, detach all encoders first.
+ */
+void
+rds_shm_close(struct rds_shm *shm)
+{
+	if(!shm)
+		return;
+
+	munmap(shm->hdr, shm->len);
+	free(shm);
+}
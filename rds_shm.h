@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_shm.h -	Encoder state published on shared memory
+ */
+
+/**
+ * DOC: Shared memory state
+ *
+ * Dashboards and monitors poll the current PS / RT / flags all the
+ * time, going to the encoder for each poll costs a serial round trip
+ * and competes with real updates. Instead the owner of the encoders
+ * creates a memory-mapped file with rds_shm_create() and attaches
+ * its encoders to it with rds_shm_attach(), from then on every
+ * change to an encoder's shadow state (see rds_state.c) is copied
+ * to its slot there.
+ *
+ * Readers map the file with rds_shm_open() and take snapshots with
+ * rds_shm_read(), with no locks and (unless they keep hitting
+ * updates) no syscalls. Each slot is a seqlock: the writer makes
+ * the sequence number odd, updates the slot and makes it even
+ * again, readers copy the slot and retry if the sequence number was
+ * odd or changed meanwhile. The writer never
+ * waits for readers, readers only retry if they hit an update.
+ *
+ * The layout is the one below on the host's byte order, with
+ * RDS_SHM_MAGIC / RDS_SHM_VERSION on the header so that readers
+ * built against a different &struct rds_state refuse to use it.
+ */
+
+#define RDS_SHM_MAGIC		0x52445353	/* "RDSS" */
+#define RDS_SHM_VERSION		2
+
+#define RDS_SHM_NAME_LEN	32
+#define RDS_SHM_SLOTS_MAX	64
+
+/* Readers yield the CPU every RDS_SHM_READ_SPINS retries (the
+ * writer may have been preempted in the middle of an update) and
+ * give up after RDS_SHM_READ_RETRIES (it must have died there) */
+#define RDS_SHM_READ_SPINS	1000
+#define RDS_SHM_READ_RETRIES	1000000
+
+struct rds_shm_slot {
+	uint32_t seq;			/* Odd while being written */
+	uint8_t in_use;
+	char name[RDS_SHM_NAME_LEN];	/* e.g. the port */
+	uint64_t updated_ms;		/* CLOCK_REALTIME of the last change */
+	struct rds_state state;
+} __attribute__((aligned(64)));		/* Own cache line(s) */
+
+struct rds_shm_hdr {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t num_slots;
+	uint32_t slot_size;		/* sizeof(struct rds_shm_slot) */
+	struct rds_shm_slot slots[];
+};
+
+struct rds_shm {
+	struct rds_shm_hdr *hdr;
+	size_t len;
+	uint8_t writable;
+};
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+/* Writer (owner of the encoders) */
+struct rds_shm *rds_shm_create(const char *path, uint16_t num_slots);
+int rds_shm_attach(struct rds_shm *shm, struct rds_encoder *enc,
+						const char *name);
+void rds_shm_detach(struct rds_encoder *enc);
+
+/* Used internaly by rds_cmd_exec() */
+void rds_shm_publish(struct rds_encoder *enc);
+
+/* Readers */
+struct rds_shm *rds_shm_open(const char *path);
+int rds_shm_find(struct rds_shm *shm, const char *name);
+int rds_shm_read(struct rds_shm *shm, int slot, struct rds_state *state,
+							uint64_t *updated_ms);
+
+void rds_shm_close(struct rds_shm *shm);
@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_state.c -	Shadow state handling
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <string.h>	/* For memset() */
+#include "rds.h"
+
+
+/* The order we push fields when re-applying a state: get the
+ * output up first, then identification, then the rest */
+static const uint8_t rds_state_apply_order[] = {
+	RDS_CMD_SET_RDS_ON,
+	RDS_CMD_SET_PI,
+	RDS_CMD_SET_PTY,
+	RDS_CMD_SET_PS,
+	RDS_CMD_SET_TA_TP,
+	RDS_CMD_SET_DI,
+	RDS_CMD_SET_DYNPTY,
+	RDS_CMD_SET_MS,
+	RDS_CMD_SET_PTYN,
+	RDS_CMD_SET_CT,
+	RDS_CMD_SET_RT,
+	RDS_CMD_SET_RTPLUS,
+};
+
+
+/**
+ * rds_state_update - Record a set command on a shadow state
+ * @state: pointer to &struct rds_state
+ * @cmd: the (successful) &struct rds_cmd
+ */
+void
+rds_state_update(struct rds_state *state, const struct rds_cmd *cmd)
+{
+	switch(cmd->op) {
+	case RDS_CMD_SET_PI:
+		state->pi = cmd->arg.pi;
+		break;
+	case RDS_CMD_SET_PS:
+		memcpy(state->ps, cmd->arg.ps, sizeof(state->ps));
+		break;
+	case RDS_CMD_SET_RT:
+		state->rt = cmd->arg.rt;
+		/* The tags went away with their text */
+		state->valid &= ~RDS_STATE_RTPLUS;
+		break;
+	case RDS_CMD_SET_RTPLUS:
+		state->rt = cmd->arg.rtplus.rt;
+		state->rtplus_running = cmd->arg.rtplus.running;
+		state->rtplus_toggle = cmd->arg.rtplus.toggle;
+		memcpy(state->rtplus_tags, cmd->arg.rtplus.tags,
+					sizeof(state->rtplus_tags));
+		state->valid |= RDS_STATE_RT;
+		break;
+	case RDS_CMD_SET_DI:
+		state->di = cmd->arg.val;
+		break;
+	case RDS_CMD_SET_DYNPTY:
+		state->dynpty = cmd->arg.val;
+		break;
+	case RDS_CMD_SET_TA_TP:
+		state->ta_tp = cmd->arg.val;
+		break;
+	case RDS_CMD_SET_MS:
+		state->ms = cmd->arg.val;
+		break;
+	case RDS_CMD_SET_PTY:
+		state->pty = cmd->arg.val;
+		break;
+	case RDS_CMD_SET_PTYN:
+		memcpy(state->ptyn, cmd->arg.ptyn, sizeof(state->ptyn));
+		break;
+	case RDS_CMD_SET_CT:
+		state->ct = cmd->arg.val;
+		break;
+	case RDS_CMD_SET_RDS_ON:
+		state->rds_on = cmd->arg.val;
+		break;
+	case RDS_CMD_SET_ADDR:
+		/* What we know is about the old target */
+		if(cmd->arg.addr.op == RDS_ADDR_OP_TARGET)
+			state->valid = 0;
+		return;
+	case RDS_CMD_SET_DSN:
+		/* The old data set's fields are gone */
+		state->valid &= (RDS_STATE_CT | RDS_STATE_RDS_ON);
+		return;
+	default:
+		/* RTC is a moving target, not state */
+		return;
+	}
+
+	state->valid |= RDS_STATE_BIT(cmd->op);
+}
+
+/**
+ * rds_state_get_rtplus - Get RT and its tags from a shadow state
+ * @state: pointer to &struct rds_state
+ * @rtplus: the &struct rds_rtplus to fill
+ */
+static void
+rds_state_get_rtplus(const struct rds_state *state, struct rds_rtplus *rtplus)
+{
+	rtplus->rt = state->rt;
+	rtplus->running = state->rtplus_running;
+	rtplus->toggle = state->rtplus_toggle;
+	memcpy(rtplus->tags, state->rtplus_tags, sizeof(rtplus->tags));
+}
+
+/**
+ * rds_state_get - Answer a get command from a shadow state
+ * @state: pointer to &struct rds_state
+ * @cmd: the &struct rds_cmd, results are stored here
+ *
+ * Returns: what the matching rds_get_* call would return, or
+ * -ENODATA if the field was never set
+ */
+int
+rds_state_get(const struct rds_state *state, struct rds_cmd *cmd)
+{
+	if(RDS_CMD_IS_SET(cmd->op) || !(state->valid & RDS_STATE_BIT(cmd->op)))
+		return -ENODATA;
+
+	switch(cmd->op) {
+	case RDS_CMD_GET_PI:
+		cmd->arg.pi = state->pi;
+		return 0;
+	case RDS_CMD_GET_PS:
+		memcpy(cmd->arg.ps, state->ps, sizeof(state->ps));
+		return strnlen(state->ps, RDS_PS_LEN);
+	case RDS_CMD_GET_RT:
+		cmd->arg.rt = state->rt;
+		return 0;
+	case RDS_CMD_GET_DI:
+		return state->di;
+	case RDS_CMD_GET_DYNPTY:
+		return state->dynpty;
+	case RDS_CMD_GET_TA_TP:
+		return state->ta_tp;
+	case RDS_CMD_GET_MS:
+		return state->ms;
+	case RDS_CMD_GET_PTY:
+		return state->pty;
+	case RDS_CMD_GET_PTYN:
+		memcpy(cmd->arg.ptyn, state->ptyn, sizeof(state->ptyn));
+		return strnlen(state->ptyn, RDS_PTYN_LEN);
+	case RDS_CMD_GET_CT:
+		return state->ct;
+	case RDS_CMD_GET_RDS_ON:
+		return state->rds_on;
+	case RDS_CMD_GET_RTPLUS:
+		rds_state_get_rtplus(state, &cmd->arg.rtplus);
+		return 0;
+	default:
+		return -ENODATA;
+	}
+}
+
+/**
+ * rds_state_text_eq - Compare two text fields
+ * @a: first text
+ * @b: second text
+ * @len: max length
+ *
+ * Text on air is padded with spaces, so a NULL and
+ * anything after it counts as spaces.
+ */
+static int
+rds_state_text_eq(const char *a, const char *b, int len)
+{
+	uint8_t ca = 0;
+	uint8_t cb = 0;
+	int end_a = 0;
+	int end_b = 0;
+	int i = 0;
+
+	for(i = 0; i < len; i++) {
+		if(!a[i])
+			end_a = 1;
+		if(!b[i])
+			end_b = 1;
+		ca = end_a ? ' ' : a[i];
+		cb = end_b ? ' ' : b[i];
+		if(ca != cb)
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * rds_state_diff - Find the fields where two states differ
+ * @a: pointer to &struct rds_state
+ * @b: pointer to &struct rds_state
+ *
+ * A field that is valid on one state but not on the other
+ * counts as different. For RT only the text is compared,
+ * the rest is buffer / transmission config.
+ *
+ * Returns: RDS_STATE_* mask of the fields that differ
+ */
+uint32_t
+rds_state_diff(const struct rds_state *a, const struct rds_state *b)
+{
+	uint32_t both = a->valid & b->valid;
+	uint32_t diff = a->valid ^ b->valid;
+
+	if((both & RDS_STATE_PI) && memcmp(&a->pi, &b->pi, sizeof(a->pi)))
+		diff |= RDS_STATE_PI;
+	if((both & RDS_STATE_PS) &&
+	!rds_state_text_eq(a->ps, b->ps, RDS_PS_LEN))
+		diff |= RDS_STATE_PS;
+	if((both & RDS_STATE_RT) && !rds_state_text_eq((const char *) a->rt.msg,
+				(const char *) b->rt.msg, RDS_RT_MSG_LEN_MAX - 1))
+		diff |= RDS_STATE_RT;
+	if((both & RDS_STATE_DI) && a->di != b->di)
+		diff |= RDS_STATE_DI;
+	if((both & RDS_STATE_DYNPTY) && a->dynpty != b->dynpty)
+		diff |= RDS_STATE_DYNPTY;
+	if((both & RDS_STATE_TA_TP) && a->ta_tp != b->ta_tp)
+		diff |= RDS_STATE_TA_TP;
+	if((both & RDS_STATE_MS) && a->ms != b->ms)
+		diff |= RDS_STATE_MS;
+	if((both & RDS_STATE_PTY) && a->pty != b->pty)
+		diff |= RDS_STATE_PTY;
+	if((both & RDS_STATE_PTYN) &&
+	!rds_state_text_eq(a->ptyn, b->ptyn, RDS_PTYN_LEN))
+		diff |= RDS_STATE_PTYN;
+	if((both & RDS_STATE_CT) && a->ct != b->ct)
+		diff |= RDS_STATE_CT;
+	if((both & RDS_STATE_RDS_ON) && a->rds_on != b->rds_on)
+		diff |= RDS_STATE_RDS_ON;
+	if((both & RDS_STATE_RTPLUS) && (a->rtplus_running !=
+	b->rtplus_running || memcmp(a->rtplus_tags, b->rtplus_tags,
+						sizeof(a->rtplus_tags))))
+		diff |= RDS_STATE_RTPLUS;
+
+	return diff;
+}
+
+/**
+ * rds_state_apply - Push a shadow state to an encoder's main service
+ * @enc: pointer to &struct rds_encoder
+ * @state: pointer to &struct rds_state to push
+ * @mask: RDS_STATE_* fields to push (only valid ones are sent)
+ *
+ * Fields the encoder doesn't support are skipped, any other
+ * error aborts, so that a dead encoder costs us a single timeout.
+ * RT with RT+ tags goes out as a single RDS_CMD_SET_RTPLUS, so
+ * that the tags are never pushed without their text.
+ */
+int
+rds_state_apply(struct rds_encoder *enc, const struct rds_state *state,
+							uint32_t mask)
+{
+	struct rds_cmd cmd;
+	uint8_t op = 0;
+	uint32_t i = 0;
+	int ret = 0;
+
+	mask &= state->valid;
+	if((mask & RDS_STATE_RT) && (state->valid & RDS_STATE_RTPLUS))
+		mask |= RDS_STATE_RTPLUS;
+	if(mask & RDS_STATE_RTPLUS)
+		mask &= ~RDS_STATE_RT;
+
+	for(i = 0; i < sizeof(rds_state_apply_order); i++) {
+		op = rds_state_apply_order[i];
+		if(!(mask & RDS_STATE_BIT(op)))
+			continue;
+
+		rds_cmd_init(&cmd, op, 0, 0);
+
+		switch(op) {
+		case RDS_CMD_SET_PI:
+			cmd.arg.pi = state->pi;
+			break;
+		case RDS_CMD_SET_PS:
+			memcpy(cmd.arg.ps, state->ps, sizeof(state->ps));
+			break;
+		case RDS_CMD_SET_RT:
+			cmd.arg.rt = state->rt;
+			break;
+		case RDS_CMD_SET_RTPLUS:
+			rds_state_get_rtplus(state, &cmd.arg.rtplus);
+			break;
+		case RDS_CMD_SET_PTYN:
+			memcpy(cmd.arg.ptyn, state->ptyn, sizeof(state->ptyn));
+			break;
+		case RDS_CMD_SET_DI:
+			cmd.arg.val = state->di;
+			break;
+		case RDS_CMD_SET_DYNPTY:
+			cmd.arg.val = state->dynpty;
+			break;
+		case RDS_CMD_SET_TA_TP:
+			cmd.arg.val = state->ta_tp;
+			break;
+		case RDS_CMD_SET_MS:
+			cmd.arg.val = state->ms;
+			break;
+		case RDS_CMD_SET_PTY:
+			cmd.arg.val = state->pty;
+			break;
+		case RDS_CMD_SET_CT:
+			cmd.arg.val = state->ct;
+			break;
+		case RDS_CMD_SET_RDS_ON:
+			cmd.arg.val = state->rds_on;
+			break;
+		}
+
+		ret = rds_cmd_run(enc, &cmd);
+		if(ret < 0 && ret != -EOPNOTSUPP)
+			return ret;
+	}
+
+	return 0;
+}
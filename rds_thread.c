@@ -0,0 +1,502 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_thread.c -	Threaded mode, one I/O thread per encoder
+ */
+
+#include <stdint.h>		/* For sized integers */
+#include <errno.h>		/* For error numbers */
+#include <stdlib.h>		/* For malloc/free */
+#include <string.h>		/* For memset() */
+#include <limits.h>		/* For INT_MAX */
+#include <pthread.h>		/* For pthread_* */
+#include <time.h>		/* For nanosleep() */
+#include <unistd.h>		/* For syscall() */
+#include <sys/syscall.h>	/* For SYS_futex */
+#include <linux/futex.h>	/* For FUTEX_* */
+#include "rds.h"
+#include "rds_thread.h"
+#include "rds_dsn.h"
+#include "rds_bus.h"
+
+
+/* A slot on the submission ring, seq tells producers and
+ * the consumer who owns it (see rds_ring_push/pop) */
+struct rds_ring_slot {
+	uint32_t seq;
+	struct rds_future *fut;
+};
+
+struct rds_io_thread {
+	struct rds_encoder *enc;
+	pthread_t tid;
+	uint32_t mask;			/* Ring size - 1 */
+	struct rds_ring_slot *slots;
+
+	/* Keep producer and consumer indices on
+	 * different cache lines */
+	uint32_t head __attribute__((aligned(64)));	/* Next slot to fill */
+	uint32_t tail __attribute__((aligned(64)));	/* Next slot to drain */
+
+	uint32_t idle;			/* Consumer is about to sleep */
+	uint32_t wake;			/* Futex the consumer sleeps on */
+	uint32_t stop;			/* Asked to exit */
+};
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+static void
+rds_futex_wait(uint32_t *addr, uint32_t val)
+{
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void
+rds_futex_wake(uint32_t *addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/**
+ * rds_ring_push - Add a future on the submission ring (multiple producers)
+ * @t: pointer to &struct rds_io_thread
+ * @fut: the &struct rds_future to add
+ *
+ * A slot is free for position pos when its seq equals pos, and
+ * holds a future for the consumer when its seq equals pos + 1.
+ * Producers claim positions by CASing head, so nobody waits
+ * on a lock held by someone else.
+ */
+static int
+rds_ring_push(struct rds_io_thread *t, struct rds_future *fut)
+{
+	struct rds_ring_slot *slot = NULL;
+	uint32_t pos = 0;
+	uint32_t seq = 0;
+	int32_t diff = 0;
+
+	pos = __atomic_load_n(&t->head, __ATOMIC_RELAXED);
+	for(;;) {
+		slot = &t->slots[pos & t->mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (int32_t) (seq - pos);
+
+		if(diff == 0) {
+			if(__atomic_compare_exchange_n(&t->head, &pos, pos + 1,
+				1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if(diff < 0)
+			return -EAGAIN;	/* Full */
+		else
+			pos = __atomic_load_n(&t->head, __ATOMIC_RELAXED);
+	}
+
+	slot->fut = fut;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/**
+ * rds_ring_pop - Grab the next future from the submission ring (single consumer)
+ * @t: pointer to &struct rds_io_thread
+ */
+static struct rds_future *
+rds_ring_pop(struct rds_io_thread *t)
+{
+	struct rds_ring_slot *slot = &t->slots[t->tail & t->mask];
+	struct rds_future *fut = NULL;
+	uint32_t seq = 0;
+
+	seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+	if((int32_t) (seq - (t->tail + 1)) < 0)
+		return NULL;	/* Empty */
+
+	fut = slot->fut;
+
+	/* Hand the slot back to producers, one lap ahead */
+	__atomic_store_n(&slot->seq, t->tail + t->mask + 1, __ATOMIC_RELEASE);
+	t->tail++;
+
+	return fut;
+}
+
+/**
+ * rds_future_complete - Mark a future as done and notify whoever waits on it
+ * @enc: pointer to &struct rds_encoder
+ * @fut: the &struct rds_future
+ * @ret: command's return value
+ */
+void
+rds_future_complete(struct rds_encoder *enc, struct rds_future *fut, int ret)
+{
+	fut->ret = ret;
+
+	/* The callback owns the future, don't touch it afterwards */
+	if(fut->cb) {
+		fut->cb(enc, fut, fut->cb_arg);
+		return;
+	}
+
+	__atomic_store_n(&fut->done, 1, __ATOMIC_RELEASE);
+	rds_futex_wake(&fut->done);
+}
+
+/**
+ * rds_future_exec - Run a future's work on the I/O thread
+ * @enc: pointer to &struct rds_encoder
+ * @fut: the &struct rds_future
+ */
+static int
+rds_future_exec(struct rds_encoder *enc, struct rds_future *fut)
+{
+	if(fut->fn)
+		return fut->fn(enc, fut->fn_arg);
+
+	return rds_cmd_exec(enc, &fut->cmd);
+}
+
+/**
+ * rds_io_thread_fn - Main loop of the I/O thread
+ * @arg: pointer to &struct rds_io_thread
+ */
+static void *
+rds_io_thread_fn(void *arg)
+{
+	struct rds_io_thread *t = arg;
+	struct rds_future *fut = NULL;
+	uint32_t wake = 0;
+
+	for(;;) {
+		fut = rds_ring_pop(t);
+		if(fut) {
+			rds_future_complete(t->enc, fut,
+					rds_future_exec(t->enc, fut));
+			continue;
+		}
+
+		if(__atomic_load_n(&t->stop, __ATOMIC_ACQUIRE))
+			break;
+
+		/* Nothing else to do, background work
+		 * (preloading data sets, see rds_dsn.h) */
+		if(rds_dsn_step(t->enc, 0) > 0)
+			continue;
+
+		/* Ring is empty, tell producers we are going
+		 * to sleep and check again before we do so, in
+		 * case someone pushed in the meantime */
+		wake = __atomic_load_n(&t->wake, __ATOMIC_ACQUIRE);
+		__atomic_store_n(&t->idle, 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+		fut = rds_ring_pop(t);
+		if(!fut && !__atomic_load_n(&t->stop, __ATOMIC_ACQUIRE))
+			rds_futex_wait(&t->wake, wake);
+
+		__atomic_store_n(&t->idle, 0, __ATOMIC_RELAXED);
+
+		if(fut)
+			rds_future_complete(t->enc, fut,
+					rds_future_exec(t->enc, fut));
+	}
+
+	return NULL;
+}
+
+static void
+rds_io_thread_kick(struct rds_io_thread *t)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&t->idle, __ATOMIC_RELAXED)) {
+		__atomic_add_fetch(&t->wake, 1, __ATOMIC_RELEASE);
+		rds_futex_wake(&t->wake);
+	}
+}
+
+
+/*****************\
+* FUTURE HANDLING *
+\*****************/
+
+/**
+ * rds_future_init - Prepare a future for submission
+ * @fut: the &struct rds_future to initialize
+ * @cmd: the &struct rds_cmd to run (copied)
+ */
+void
+rds_future_init(struct rds_future *fut, const struct rds_cmd *cmd)
+{
+	memset(fut, 0, sizeof(struct rds_future));
+	fut->cmd = *cmd;
+}
+
+/**
+ * rds_submit - Queue a command on the encoder's I/O thread
+ * @enc: pointer to &struct rds_encoder
+ * @fut: an initialized &struct rds_future, must stay around
+ *	until it completes
+ *
+ * Returns: 0 on success, -EAGAIN if the ring is full, -ESHUTDOWN
+ * if the encoder is not in threaded mode (or is stopping)
+ */
+int
+rds_submit(struct rds_encoder *enc, struct rds_future *fut)
+{
+	struct rds_io_thread *t = enc->io_thread;
+	int ret = 0;
+
+	/* Shares a port, the bus' thread owns it */
+	if(enc->bus)
+		return rds_bus_submit(enc, fut);
+
+	if(!t || __atomic_load_n(&t->stop, __ATOMIC_ACQUIRE))
+		return -ESHUTDOWN;
+
+	fut->done = 0;
+
+	ret = rds_ring_push(t, fut);
+	if(ret < 0)
+		return ret;
+
+	rds_io_thread_kick(t);
+	return 0;
+}
+
+/**
+ * rds_future_done - Check if a submitted command has completed
+ * @fut: the &struct rds_future
+ */
+int
+rds_future_done(struct rds_future *fut)
+{
+	return __atomic_load_n(&fut->done, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * rds_future_wait - Wait for a submitted command to complete
+ * @fut: the &struct rds_future
+ *
+ * Returns: the command's return value
+ */
+int
+rds_future_wait(struct rds_future *fut)
+{
+	while(!__atomic_load_n(&fut->done, __ATOMIC_ACQUIRE))
+		rds_futex_wait(&fut->done, 0);
+
+	return fut->ret;
+}
+
+/**
+ * rds_thread_call - Run a command on the I/O thread and wait for it
+ * @enc: pointer to &struct rds_encoder
+ * @cmd: the &struct rds_cmd to run, results are stored back here
+ *
+ * If the ring is full we back off for about a byte time at 9600
+ * baud and retry, the I/O thread is draining it anyway.
+ */
+int
+rds_thread_call(struct rds_encoder *enc, struct rds_cmd *cmd)
+{
+	struct timespec backoff = { 0, 1000000 };
+	struct rds_future fut;
+	int ret = 0;
+
+	rds_future_init(&fut, cmd);
+
+	while((ret = rds_submit(enc, &fut)) == -EAGAIN)
+		nanosleep(&backoff, NULL);
+	if(ret < 0)
+		return ret;
+
+	ret = rds_future_wait(&fut);
+	*cmd = fut.cmd;
+
+	return ret;
+}
+
+/**
+ * rds_thread_run - Run a function on the I/O thread and wait for it
+ * @enc: pointer to &struct rds_encoder
+ * @fn: the function, gets the encoder to itself while it runs
+ * @arg: passed to @fn
+ *
+ * For work that needs several exchanges with the encoder in a
+ * row, with nobody else's commands in between. If we are not
+ * in threaded mode (or are the I/O thread) @fn is called here.
+ *
+ * Returns: what @fn returned
+ */
+int
+rds_thread_run(struct rds_encoder *enc,
+		int (*fn)(struct rds_encoder *enc, void *arg), void *arg)
+{
+	struct timespec backoff = { 0, 1000000 };
+	struct rds_future fut;
+	int ret = 0;
+
+	if((!enc->io_thread && !enc->bus) || rds_thread_is_self(enc))
+		return fn(enc, arg);
+
+	memset(&fut, 0, sizeof(struct rds_future));
+	fut.fn = fn;
+	fut.fn_arg = arg;
+
+	while((ret = rds_submit(enc, &fut)) == -EAGAIN)
+		nanosleep(&backoff, NULL);
+	if(ret < 0)
+		return ret;
+
+	return rds_future_wait(&fut);
+}
+
+
+/*************\
+* INIT / EXIT *
+\*************/
+
+/**
+ * rds_thread_start - Switch an encoder to threaded mode
+ * @enc: pointer to &struct rds_encoder
+ * @queue_len: submission ring size (power of 2), 0 for the default
+ */
+int
+rds_thread_start(struct rds_encoder *enc, uint32_t queue_len)
+{
+	struct rds_io_thread *t = NULL;
+	uint32_t i = 0;
+	int ret = 0;
+
+	if(enc->io_thread)
+		return -EALREADY;
+
+	/* The bus' thread already does this job */
+	if(enc->bus)
+		return 0;
+
+	if(queue_len == 0)
+		queue_len = RDS_THREAD_QUEUE_LEN_DEFAULT;
+
+	if(queue_len & (queue_len - 1))
+		return -EINVAL;
+
+	t = malloc(sizeof(struct rds_io_thread));
+	if(!t)
+		return -ENOMEM;
+	memset(t, 0, sizeof(struct rds_io_thread));
+
+	t->slots = malloc(queue_len * sizeof(struct rds_ring_slot));
+	if(!t->slots) {
+		free(t);
+		return -ENOMEM;
+	}
+
+	for(i = 0; i < queue_len; i++) {
+		t->slots[i].seq = i;
+		t->slots[i].fut = NULL;
+	}
+
+	t->enc = enc;
+	t->mask = queue_len - 1;
+	enc->io_thread = t;
+
+	ret = pthread_create(&t->tid, NULL, rds_io_thread_fn, t);
+	if(ret != 0) {
+		enc->io_thread = NULL;
+		free(t->slots);
+		free(t);
+		return -ret;
+	}
+
+	return 0;
+}
+
+/**
+ * rds_thread_stop - Leave threaded mode
+ * @enc: pointer to &struct rds_encoder
+ *
+ * Commands already queued are run before the thread exits. Make
+ * sure nobody is still submitting when calling this.
+ */
+int
+rds_thread_stop(struct rds_encoder *enc)
+{
+	struct rds_io_thread *t = enc->io_thread;
+	struct rds_future *fut = NULL;
+
+	if(!t)
+		return 0;
+
+	if(rds_thread_is_self(enc))
+		return -EDEADLK;
+
+	__atomic_store_n(&t->stop, 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&t->wake, 1, __ATOMIC_RELEASE);
+	rds_futex_wake(&t->wake);
+
+	pthread_join(t->tid, NULL);
+
+	/* Anything that raced with stop */
+	while((fut = rds_ring_pop(t)) != NULL)
+		rds_future_complete(enc, fut, -ESHUTDOWN);
+
+	enc->io_thread = NULL;
+	free(t->slots);
+	free(t);
+
+	return 0;
+}
+
+/**
+ * rds_thread_kick - Wake up the I/O thread if it sleeps
+ * @enc: pointer to &struct rds_encoder
+ *
+ * For when there's new background work for it.
+ */
+void
+rds_thread_kick(struct rds_encoder *enc)
+{
+	struct rds_io_thread *t = enc->io_thread;
+
+	if(enc->bus)
+		rds_bus_kick(enc);
+	else if(t) {
+		__atomic_add_fetch(&t->wake, 1, __ATOMIC_RELEASE);
+		rds_futex_wake(&t->wake);
+	}
+}
+
+/**
+ * rds_thread_is_self - Check if we are running on the encoder's I/O thread
+ * @enc: pointer to &struct rds_encoder
+ */
+int
+rds_thread_is_self(struct rds_encoder *enc)
+{
+	struct rds_io_thread *t = enc->io_thread;
+
+	if(enc->bus)
+		return rds_bus_is_self(enc);
+
+	return t && pthread_equal(pthread_self(), t->tid);
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_thread.h -	Threaded mode, one I/O thread per encoder
+ */
+
+/**
+ * DOC: Threaded mode
+ *
+ * A &struct rds_encoder is not safe to share between threads, the
+ * backends keep per-link state (sequence numbers, receive buffer etc)
+ * on it. In threaded mode a dedicated I/O thread owns the encoder and
+ * everyone else submits commands to it through a bounded lock-free
+ * multi-producer / single-consumer ring, so producers never block on
+ * each other's transfers.
+ *
+ * Once rds_thread_start() is called, the normal rds_get_* / rds_set_*
+ * calls are routed through the I/O thread transparently (the caller
+ * waits for its own command only). For asynchronous operation, fill
+ * a &struct rds_future and pass it to rds_submit(), then either
+ * rds_future_wait() on it or set a callback to be notified from the
+ * I/O thread.
+ */
+
+/* A queued command */
+struct rds_future {
+	struct rds_cmd cmd;		/* The command, results of get
+					 * commands are also returned here */
+	int ret;			/* Command's return value */
+	uint32_t done;			/* Set when the command completes */
+
+	/* Optional completion callback, called from the I/O thread.
+	 * When set, the future belongs to the callback after submission,
+	 * don't wait on it (it's free to release it) */
+	void (*cb)(struct rds_encoder *enc, struct rds_future *fut,
+							void *arg);
+	void *cb_arg;
+
+	/* Used internaly (see rds_thread_run()), when set it's
+	 * run instead of cmd */
+	int (*fn)(struct rds_encoder *enc, void *arg);
+	void *fn_arg;
+};
+
+/* Default submission ring size (must be a power of 2) */
+#define RDS_THREAD_QUEUE_LEN_DEFAULT	64
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+int rds_thread_start(struct rds_encoder *enc, uint32_t queue_len);
+int rds_thread_stop(struct rds_encoder *enc);
+int rds_thread_is_self(struct rds_encoder *enc);
+
+void rds_future_init(struct rds_future *fut, const struct rds_cmd *cmd);
+int rds_submit(struct rds_encoder *enc, struct rds_future *fut);
+int rds_future_done(struct rds_future *fut);
+int rds_future_wait(struct rds_future *fut);
+
+/* Used internaly by rds_cmd_run() / rds_dsn.c / rds_fanout.c / rds_bus.c */
+int rds_thread_call(struct rds_encoder *enc, struct rds_cmd *cmd);
+void rds_future_complete(struct rds_encoder *enc, struct rds_future *fut,
+								int ret);
+int rds_thread_run(struct rds_encoder *enc,
+		int (*fn)(struct rds_encoder *enc, void *arg), void *arg);
+void rds_thread_kick(struct rds_encoder *enc);
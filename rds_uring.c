@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_uring.c -	io_uring based transport (used internaly)
+ *
+ * On the poll() path every transfer costs a poll() plus a read() or
+ * write() (plus a tcdrain() on output). Here each transfer is submitted
+ * as a read/write linked to a timeout, so a whole frame (or a whole
+ * chunk of a reply) costs a single io_uring_enter(), output is drained
+ * the same way so frames are timed alike on both paths. We talk to the
+ * kernel directly instead of pulling in liburing, the subset we need
+ * is tiny.
+ *
+ * If io_uring is missing (old kernel, seccomp etc) attaching fails
+ * with -EOPNOTSUPP and the encoder stays on the poll() path. If the
+ * kernel has io_uring but not the ops we need, the first transfer
+ * returns -EINVAL and rds.c falls back to poll() for good.
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <stdlib.h>	/* For malloc/free */
+#include <string.h>	/* For memset() */
+#include "rds.h"
+#include "rds_uring.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define RDS_HAVE_IO_URING
+#endif
+#endif
+
+#ifdef RDS_HAVE_IO_URING
+
+#include <fcntl.h>		/* For fcntl() */
+#include <unistd.h>		/* For syscall(), close() */
+#include <sys/mman.h>		/* For mmap() */
+#include <sys/syscall.h>	/* For __NR_io_uring_* */
+#include <linux/io_uring.h>
+
+/* We only ever have an op and its linked timeout in flight */
+#define RDS_URING_ENTRIES	4
+
+/* user_data tags */
+#define RDS_URING_TAG_OP	1
+#define RDS_URING_TAG_TIMEOUT	2
+
+struct rds_uring {
+	int ring_fd;
+	int fd_flags;			/* Original flags of the serial fd */
+
+	void *sq_ring;
+	size_t sq_ring_sz;
+	void *cq_ring;
+	size_t cq_ring_sz;
+	struct io_uring_sqe *sqes;
+	size_t sqes_sz;
+
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+};
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+static void
+rds_uring_free(struct rds_uring *u)
+{
+	if(u->sqes && u->sqes != MAP_FAILED)
+		munmap(u->sqes, u->sqes_sz);
+	if(u->cq_ring && u->cq_ring != MAP_FAILED && u->cq_ring != u->sq_ring)
+		munmap(u->cq_ring, u->cq_ring_sz);
+	if(u->sq_ring && u->sq_ring != MAP_FAILED)
+		munmap(u->sq_ring, u->sq_ring_sz);
+	if(u->ring_fd >= 0)
+		close(u->ring_fd);
+	free(u);
+}
+
+/**
+ * rds_uring_xfer - Do a single read/write with a timeout through io_uring
+ * @u: pointer to &struct rds_uring
+ * @opcode: IORING_OP_READ or IORING_OP_WRITE
+ * @fd: the file descriptor to operate on
+ * @buf: the buffer to read to / write from
+ * @len: the buffer's length
+ * @timeout_ms: timeout in msecs
+ *
+ * Returns: number of bytes transfered or -errno, -ETIME on timeout
+ */
+static int
+rds_uring_xfer(struct rds_uring *u, uint8_t opcode, int fd, void *buf,
+						int len, int timeout_ms)
+{
+	struct __kernel_timespec ts;
+	struct io_uring_sqe *sqe = NULL;
+	struct io_uring_cqe *cqe = NULL;
+	unsigned tail = 0;
+	unsigned head = 0;
+	unsigned idx = 0;
+	int pending = 2;
+	int res = -ETIME;
+	int ret = 0;
+
+	ts.tv_sec = timeout_ms / 1000;
+	ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+
+	/* We are the only producer, no need for an acquire here */
+	tail = *u->sq_tail;
+
+	/* The read/write, linked to ... */
+	idx = tail & *u->sq_mask;
+	sqe = &u->sqes[idx];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = opcode;
+	sqe->flags = IOSQE_IO_LINK;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t) (uintptr_t) buf;
+	sqe->len = len;
+	sqe->off = (uint64_t) -1;	/* Current position, it's a tty anyway */
+	sqe->user_data = RDS_URING_TAG_OP;
+	u->sq_array[idx] = idx;
+	tail++;
+
+	/* ... a timeout that cancels it */
+	idx = tail & *u->sq_mask;
+	sqe = &u->sqes[idx];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = IORING_OP_LINK_TIMEOUT;
+	sqe->fd = -1;
+	sqe->addr = (uint64_t) (uintptr_t) &ts;
+	sqe->len = 1;
+	sqe->user_data = RDS_URING_TAG_TIMEOUT;
+	u->sq_array[idx] = idx;
+	tail++;
+
+	__atomic_store_n(u->sq_tail, tail, __ATOMIC_RELEASE);
+
+	/* Submit both and wait for both to complete, one syscall */
+	do {
+		ret = syscall(__NR_io_uring_enter, u->ring_fd, 2, 2,
+					IORING_ENTER_GETEVENTS, NULL, 0);
+	} while(ret < 0 && errno == EINTR);
+	if(ret < 0)
+		return -errno;
+
+	while(pending > 0) {
+		head = *u->cq_head;
+		if(head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+			ret = syscall(__NR_io_uring_enter, u->ring_fd, 0,
+					pending, IORING_ENTER_GETEVENTS, NULL, 0);
+			if(ret < 0 && errno != EINTR)
+				return -errno;
+			continue;
+		}
+
+		cqe = &u->cqes[head & *u->cq_mask];
+		if(cqe->user_data == RDS_URING_TAG_OP)
+			res = cqe->res;
+		__atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+		pending--;
+	}
+
+	/* Canceled by the linked timeout */
+	if(res == -ECANCELED || res == -EINTR)
+		return -ETIME;
+
+	return res;
+}
+
+
+/**************\
+* ENTRY POINTS *
+\**************/
+
+/**
+ * rds_uring_attach - Set up an io_uring instance for an encoder
+ * @enc: pointer to &struct rds_encoder
+ */
+int
+rds_uring_attach(struct rds_encoder *enc)
+{
+	struct io_uring_params p;
+	struct rds_uring *u = NULL;
+	int flags = 0;
+
+	u = malloc(sizeof(struct rds_uring));
+	if(!u)
+		return -ENOMEM;
+	memset(u, 0, sizeof(struct rds_uring));
+	memset(&p, 0, sizeof(struct io_uring_params));
+
+	u->ring_fd = syscall(__NR_io_uring_setup, RDS_URING_ENTRIES, &p);
+	if(u->ring_fd < 0) {
+		free(u);
+		return -EOPNOTSUPP;
+	}
+
+	u->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	u->cq_ring_sz = p.cq_off.cqes +
+			p.cq_entries * sizeof(struct io_uring_cqe);
+
+	/* On recent kernels both rings live on the same mapping */
+	if(p.features & IORING_FEAT_SINGLE_MMAP) {
+		if(u->cq_ring_sz > u->sq_ring_sz)
+			u->sq_ring_sz = u->cq_ring_sz;
+		u->cq_ring_sz = u->sq_ring_sz;
+	}
+
+	u->sq_ring = mmap(NULL, u->sq_ring_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, u->ring_fd,
+			IORING_OFF_SQ_RING);
+	if(u->sq_ring == MAP_FAILED)
+		goto fail;
+
+	if(p.features & IORING_FEAT_SINGLE_MMAP)
+		u->cq_ring = u->sq_ring;
+	else {
+		u->cq_ring = mmap(NULL, u->cq_ring_sz, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, u->ring_fd,
+				IORING_OFF_CQ_RING);
+		if(u->cq_ring == MAP_FAILED)
+			goto fail;
+	}
+
+	u->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->sqes_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, u->ring_fd,
+			IORING_OFF_SQES);
+	if(u->sqes == MAP_FAILED)
+		goto fail;
+
+	u->sq_tail = (unsigned *) ((char *) u->sq_ring + p.sq_off.tail);
+	u->sq_mask = (unsigned *) ((char *) u->sq_ring + p.sq_off.ring_mask);
+	u->sq_array = (unsigned *) ((char *) u->sq_ring + p.sq_off.array);
+	u->cq_head = (unsigned *) ((char *) u->cq_ring + p.cq_off.head);
+	u->cq_tail = (unsigned *) ((char *) u->cq_ring + p.cq_off.tail);
+	u->cq_mask = (unsigned *) ((char *) u->cq_ring + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *) ((char *) u->cq_ring +
+							p.cq_off.cqes);
+
+	/* The port is opened with O_NDELAY for the poll() path,
+	 * io_uring honors that and would complete reads with
+	 * -EAGAIN instead of waiting, so switch to blocking I/O
+	 * and let the linked timeouts handle the rest */
+	flags = fcntl(enc->serial_fd, F_GETFL);
+	if(flags < 0)
+		goto fail;
+	u->fd_flags = flags;
+	fcntl(enc->serial_fd, F_SETFL, flags & ~O_NONBLOCK);
+
+	enc->uring = u;
+	return 0;
+
+fail:
+	rds_uring_free(u);
+	return -EOPNOTSUPP;
+}
+
+/**
+ * rds_uring_detach - Tear down the io_uring instance of an encoder
+ * @enc: pointer to &struct rds_encoder
+ */
+void
+rds_uring_detach(struct rds_encoder *enc)
+{
+	struct rds_uring *u = enc->uring;
+
+	if(!u)
+		return;
+
+	fcntl(enc->serial_fd, F_SETFL, u->fd_flags);
+	rds_uring_free(u);
+	enc->uring = NULL;
+}
+
+/**
+ * rds_uring_read - Read up to len bytes from an encoder through io_uring
+ * @enc: pointer to &struct rds_encoder
+ * @buf: buffer to fill
+ * @len: the buffer's length
+ * @timeout_ms: timeout in msecs
+ */
+int
+rds_uring_read(struct rds_encoder *enc, uint8_t *buf, int len, int timeout_ms)
+{
+	return rds_uring_xfer(enc->uring, IORING_OP_READ, enc->serial_fd,
+						buf, len, timeout_ms);
+}
+
+/**
+ * rds_uring_write - Write a full buffer to an encoder through io_uring
+ * @enc: pointer to &struct rds_encoder
+ * @buf: the buffer to send
+ * @len: the buffer's length
+ * @timeout_ms: timeout in msecs (per write)
+ */
+int
+rds_uring_write(struct rds_encoder *enc, const uint8_t *buf, int len,
+							int timeout_ms)
+{
+	int sent = 0;
+	int ret = 0;
+
+	while(sent < len) {
+		ret = rds_uring_xfer(enc->uring, IORING_OP_WRITE,
+				enc->serial_fd, (void *) (buf + sent),
+				len - sent, timeout_ms);
+		if(ret < 0)
+			return ret;
+		/* Nothing went out (e.g. hung up tty), don't spin */
+		if(ret == 0)
+			return -EIO;
+		sent += ret;
+	}
+
+	return sent;
+}
+
+#else /* !RDS_HAVE_IO_URING */
+
+int
+rds_uring_attach(struct rds_encoder *enc)
+{
+	return -EOPNOTSUPP;
+}
+
+void
+rds_uring_detach(struct rds_encoder *enc)
+{
+}
+
+int
+rds_uring_read(struct rds_encoder *enc, uint8_t *buf, int len, int timeout_ms)
+{
+	return -EOPNOTSUPP;
+}
+
+int
+rds_uring_write(struct rds_encoder *enc, const uint8_t *buf, int len,
+							int timeout_ms)
+{
+	return -EOPNOTSUPP;
+}
+
+#endif
@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rds_uring.h -	io_uring based transport (used internaly)
+ */
+
+/************\
+* PROTOTYPES *
+\************/
+
+int rds_uring_attach(struct rds_encoder *enc);
+void rds_uring_detach(struct rds_encoder *enc);
+int rds_uring_read(struct rds_encoder *enc, uint8_t *buf, int len,
+							int timeout_ms);
+int rds_uring_write(struct rds_encoder *enc, const uint8_t *buf, int len,
+							int timeout_ms);
@@ -0,0 +1,608 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rdsd.c -	Daemon that owns the encoders and multiplexes
+ *		local clients onto them (see rdsd.h)
+ *
+ * Usage: rdsd [-s socket] [-m shm_file] type:port[:site_addr:enc_addr] ...
+ * with type one of prais, uecp or soft (for soft, port is
+ * just a name for clients to find it). With -m the state of all
+ * encoders is also published on shm_file (see rds_shm.h), under
+ * their port.
+ */
+
+#define _GNU_SOURCE	/* For accept4() */
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <stdlib.h>	/* For malloc/free / strtoul() */
+#include <string.h>	/* For memset() / strcmp() */
+#include <stdio.h>	/* For fprintf() */
+#include <unistd.h>	/* For close() / unlink() / getopt() */
+#include <signal.h>	/* For sigaction() */
+#include <sys/socket.h>	/* For socket() / bind() / listen() */
+#include <sys/un.h>	/* For struct sockaddr_un */
+#include <sys/epoll.h>	/* For epoll_*() */
+#include "rds.h"
+#include "rds_thread.h"
+#include "rds_queue.h"
+#include "rds_shm.h"
+#include "rdsd.h"
+
+/* What an epoll event is about, on the upper bits of data.u32,
+ * the lower ones hold the client / encoder index */
+#define RDSD_EV_CLIENT		0x00000
+#define RDSD_EV_LISTEN		0x10000
+#define RDSD_EV_QUEUE		0x20000
+#define RDSD_EV_TYPE_MASK	0xF0000
+#define RDSD_EV_IDX_MASK	0x0FFFF
+
+#define RDSD_EVENTS_MAX		32
+#define RDSD_LISTEN_BACKLOG	16
+
+struct rdsd_encoder {
+	char port[RDSD_PORT_LEN];
+	struct rds_encoder *enc;
+	struct rds_queue *queue;
+	struct rds_state state;		/* What we know is on the encoder */
+};
+
+struct rdsd_client {
+	int fd;
+	int enc;			/* Index on encoders, -1 until
+					 * RDSD_REQ_OPEN */
+};
+
+struct rdsd {
+	int epoll_fd;
+	int listen_fd;
+	const char *path;
+	struct rds_shm *shm;		/* NULL if not publishing */
+	struct rdsd_encoder encoders[RDSD_ENCODERS_MAX];
+	uint8_t num_encoders;
+	struct rdsd_client clients[RDSD_CLIENTS_MAX];
+};
+
+static volatile sig_atomic_t rdsd_stop = 0;
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+static void
+rdsd_sig_handler(int sig)
+{
+	rdsd_stop = 1;
+}
+
+/**
+ * rdsd_reply - Send a reply to a client
+ * @rd: the &struct rdsd
+ * @idx: the client's index
+ * @ret: the result
+ * @cmd: the command, with results of gets (NULL -> none)
+ *
+ * Clients wait for their reply so there's always room for it,
+ * if there isn't the client is broken and gets nothing.
+ */
+static void
+rdsd_reply(struct rdsd *rd, int idx, int ret, const struct rds_cmd *cmd)
+{
+	struct rdsd_rep rep;
+
+	memset(&rep, 0, sizeof(struct rdsd_rep));
+	rep.ret = ret;
+	if(cmd)
+		rep.cmd = *cmd;
+
+	send(rd->clients[idx].fd, &rep, sizeof(struct rdsd_rep),
+					MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+/**
+ * rdsd_learn - Record what we learned about the encoder from a command
+ * @renc: the &struct rdsd_encoder
+ * @cmd: the command that succeeded
+ * @ret: what it returned
+ *
+ * Sets go on the state as is, gets too since they tell us what's
+ * on the encoder (for the simple fields the value is on ret).
+ */
+static void
+rdsd_learn(struct rdsd_encoder *renc, const struct rds_cmd *cmd, int ret)
+{
+	struct rds_cmd set = *cmd;
+
+	if(ret < 0 || cmd->dsn != 0 || cmd->psn != 0)
+		return;
+
+	if(!RDS_CMD_IS_SET(cmd->op)) {
+		set.op |= 1;
+		switch(cmd->op) {
+		case RDS_CMD_GET_DI:
+		case RDS_CMD_GET_DYNPTY:
+		case RDS_CMD_GET_TA_TP:
+		case RDS_CMD_GET_MS:
+		case RDS_CMD_GET_PTY:
+		case RDS_CMD_GET_CT:
+		case RDS_CMD_GET_RDS_ON:
+			set.arg.val = ret;
+			break;
+		default:
+			break;
+		}
+	}
+
+	rds_state_update(&renc->state, &set);
+}
+
+/**
+ * rdsd_cmd_done - Completion callback of an encoder's queue
+ * @queue: the &struct rds_queue
+ * @cmd: the command, with results of gets
+ * @ret: its return value
+ * @waiters: clients that wait for it, one bit each
+ * @arg: pointer to &struct rdsd
+ */
+static void
+rdsd_cmd_done(struct rds_queue *queue, const struct rds_cmd *cmd, int ret,
+						uint64_t waiters, void *arg)
+{
+	struct rdsd *rd = arg;
+	int i = 0;
+
+	for(i = 0; i < rd->num_encoders; i++)
+		if(rd->encoders[i].queue == queue)
+			rdsd_learn(&rd->encoders[i], cmd, ret);
+
+	for(i = 0; i < RDSD_CLIENTS_MAX; i++)
+		if(waiters & (1ULL << i))
+			rdsd_reply(rd, i, ret, cmd);
+}
+
+
+/*****************\
+* CLIENT HANDLING *
+\*****************/
+
+/**
+ * rdsd_drop_client - Close a client's connection
+ * @rd: the &struct rdsd
+ * @idx: the client's index
+ */
+static void
+rdsd_drop_client(struct rdsd *rd, int idx)
+{
+	struct rdsd_client *cl = &rd->clients[idx];
+
+	/* Its commands still run, nobody gets their results */
+	if(cl->enc >= 0)
+		rds_queue_forget(rd->encoders[cl->enc].queue, 1ULL << idx);
+
+	epoll_ctl(rd->epoll_fd, EPOLL_CTL_DEL, cl->fd, NULL);
+	close(cl->fd);
+	cl->fd = -1;
+	cl->enc = -1;
+}
+
+/**
+ * rdsd_accept - Accept pending connections
+ * @rd: the &struct rdsd
+ */
+static void
+rdsd_accept(struct rdsd *rd)
+{
+	struct epoll_event ev;
+	int fd = 0;
+	int i = 0;
+
+	for(;;) {
+		fd = accept4(rd->listen_fd, NULL, NULL,
+				SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if(fd < 0)
+			return;
+
+		for(i = 0; i < RDSD_CLIENTS_MAX; i++)
+			if(rd->clients[i].fd < 0)
+				break;
+
+		if(i == RDSD_CLIENTS_MAX) {
+			close(fd);
+			continue;
+		}
+
+		memset(&ev, 0, sizeof(struct epoll_event));
+		ev.events = EPOLLIN;
+		ev.data.u32 = RDSD_EV_CLIENT | i;
+		if(epoll_ctl(rd->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			close(fd);
+			continue;
+		}
+
+		rd->clients[i].fd = fd;
+		rd->clients[i].enc = -1;
+	}
+}
+
+/**
+ * rdsd_handle_req - Handle a request from a client
+ * @rd: the &struct rdsd
+ * @idx: the client's index
+ * @req: the &struct rdsd_req
+ */
+static void
+rdsd_handle_req(struct rdsd *rd, int idx, struct rdsd_req *req)
+{
+	struct rdsd_client *cl = &rd->clients[idx];
+	struct rdsd_encoder *renc = NULL;
+	int ret = 0;
+	int i = 0;
+
+	if(req->type == RDSD_REQ_OPEN) {
+		req->port[RDSD_PORT_LEN - 1] = '\0';
+		for(i = 0; i < rd->num_encoders; i++)
+			if(!strcmp(rd->encoders[i].port, req->port))
+				break;
+
+		if(i == rd->num_encoders) {
+			rdsd_reply(rd, idx, -ENODEV, NULL);
+			return;
+		}
+
+		if(cl->enc >= 0)
+			rds_queue_forget(rd->encoders[cl->enc].queue,
+							1ULL << idx);
+		cl->enc = i;
+		rdsd_reply(rd, idx, 0, NULL);
+		return;
+	}
+
+	if(req->type != RDSD_REQ_CMD || req->cmd.op > RDS_CMD_MAX) {
+		rdsd_reply(rd, idx, -EINVAL, NULL);
+		return;
+	}
+
+	if(cl->enc < 0) {
+		rdsd_reply(rd, idx, -ENOTCONN, NULL);
+		return;
+	}
+	renc = &rd->encoders[cl->enc];
+
+	/* Reads of the main service from what we know,
+	 * if we know it */
+	if(!RDS_CMD_IS_SET(req->cmd.op) && req->cmd.dsn == 0 &&
+	req->cmd.psn == 0) {
+		ret = rds_state_get(&renc->state, &req->cmd);
+		if(ret != -ENODATA) {
+			rdsd_reply(rd, idx, ret, &req->cmd);
+			return;
+		}
+	}
+
+	ret = rds_queue_push(renc->queue, &req->cmd, 1ULL << idx);
+	if(ret < 0)
+		rdsd_reply(rd, idx, -EBUSY, NULL);
+}
+
+/**
+ * rdsd_client_event - Handle an epoll event on a client
+ * @rd: the &struct rdsd
+ * @idx: the client's index
+ */
+static void
+rdsd_client_event(struct rdsd *rd, int idx)
+{
+	struct rdsd_req req;
+	ssize_t ret = 0;
+
+	for(;;) {
+		ret = recv(rd->clients[idx].fd, &req, sizeof(req), 0);
+		if(ret < 0 && errno == EINTR)
+			continue;
+		if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return;
+		if(ret <= 0)
+			break;
+
+		if(ret != sizeof(req)) {
+			rdsd_reply(rd, idx, -EINVAL, NULL);
+			continue;
+		}
+
+		rdsd_handle_req(rd, idx, &req);
+	}
+
+	rdsd_drop_client(rd, idx);
+}
+
+
+/*******\
+* SETUP *
+\*******/
+
+/**
+ * rdsd_add_encoder - Open an encoder from its command line spec
+ * @rd: the &struct rdsd
+ * @spec: type:port[:site_addr:enc_addr]
+ */
+static int
+rdsd_add_encoder(struct rdsd *rd, char *spec)
+{
+	struct rdsd_encoder *renc = NULL;
+	struct epoll_event ev;
+	char *type = NULL;
+	char *port = NULL;
+	char *site = NULL;
+	char *addr = NULL;
+	uint8_t enc_type = 0;
+
+	if(rd->num_encoders >= RDSD_ENCODERS_MAX)
+		return -ENOSPC;
+	renc = &rd->encoders[rd->num_encoders];
+
+	type = strtok(spec, ":");
+	port = strtok(NULL, ":");
+	site = strtok(NULL, ":");
+	addr = strtok(NULL, ":");
+	if(!type || !port || strlen(port) >= RDSD_PORT_LEN)
+		return -EINVAL;
+
+	if(!strcmp(type, "prais"))
+		enc_type = RDS_ENCODER_TYPE_PRAIS;
+	else if(!strcmp(type, "uecp"))
+		enc_type = RDS_ENCODER_TYPE_UECP;
+	else if(!strcmp(type, "soft"))
+		enc_type = RDS_ENCODER_TYPE_SOFT;
+	else
+		return -EINVAL;
+
+	renc->enc = rds_init(enc_type, site ? strtoul(site, NULL, 0) : 0,
+				addr ? strtoul(addr, NULL, 0) : 0,
+				(const unsigned char *) port);
+	if(!renc->enc)
+		return -ENODEV;
+
+	/* Before the I/O thread gets it */
+	if(rd->shm)
+		rds_shm_attach(rd->shm, renc->enc, port);
+
+	renc->queue = rds_queue_create(renc->enc);
+	if(!renc->queue) {
+		rds_exit(renc->enc);
+		return -errno;
+	}
+	renc->queue->done_cb = rdsd_cmd_done;
+	renc->queue->done_arg = rd;
+
+	memset(&ev, 0, sizeof(struct epoll_event));
+	ev.events = EPOLLIN;
+	ev.data.u32 = RDSD_EV_QUEUE | rd->num_encoders;
+	if(epoll_ctl(rd->epoll_fd, EPOLL_CTL_ADD,
+			rds_queue_get_fd(renc->queue), &ev) < 0) {
+		rds_queue_destroy(renc->queue);
+		rds_exit(renc->enc);
+		return -errno;
+	}
+
+	strcpy(renc->port, port);
+	rd->num_encoders++;
+
+	return 0;
+}
+
+/**
+ * rdsd_listen - Start accepting clients
+ * @rd: the &struct rdsd
+ */
+static int
+rdsd_listen(struct rdsd *rd)
+{
+	struct sockaddr_un sun;
+	struct epoll_event ev;
+
+	if(strlen(rd->path) >= sizeof(sun.sun_path))
+		return -ENAMETOOLONG;
+
+	memset(&sun, 0, sizeof(struct sockaddr_un));
+	sun.sun_family = AF_UNIX;
+	strcpy(sun.sun_path, rd->path);
+
+	rd->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK |
+							SOCK_CLOEXEC, 0);
+	if(rd->listen_fd < 0)
+		return -errno;
+
+	unlink(rd->path);
+	if(bind(rd->listen_fd, (struct sockaddr *) &sun,
+				sizeof(struct sockaddr_un)) < 0)
+		return -errno;
+
+	if(listen(rd->listen_fd, RDSD_LISTEN_BACKLOG) < 0)
+		return -errno;
+
+	memset(&ev, 0, sizeof(struct epoll_event));
+	ev.events = EPOLLIN;
+	ev.data.u32 = RDSD_EV_LISTEN;
+	if(epoll_ctl(rd->epoll_fd, EPOLL_CTL_ADD, rd->listen_fd, &ev) < 0)
+		return -errno;
+
+	return 0;
+}
+
+/**
+ * rdsd_run - The event loop
+ * @rd: the &struct rdsd
+ *
+ * Runs until we get SIGINT / SIGTERM
+ */
+static void
+rdsd_run(struct rdsd *rd)
+{
+	struct epoll_event events[RDSD_EVENTS_MAX];
+	struct rds_queue *queue = NULL;
+	uint32_t idx = 0;
+	int timeout_ms = 0;
+	int num_events = 0;
+	int i = 0;
+
+	while(!rdsd_stop) {
+		/* Retry submissions that found the ring full */
+		timeout_ms = -1;
+		for(i = 0; i < rd->num_encoders; i++) {
+			queue = rd->encoders[i].queue;
+			if(queue->len && !queue->busy)
+				timeout_ms = 1;
+		}
+
+		num_events = epoll_wait(rd->epoll_fd, events, RDSD_EVENTS_MAX,
+								timeout_ms);
+		if(num_events < 0 && errno != EINTR)
+			break;
+
+		for(i = 0; i < num_events; i++) {
+			idx = events[i].data.u32 & RDSD_EV_IDX_MASK;
+
+			switch(events[i].data.u32 & RDSD_EV_TYPE_MASK) {
+			case RDSD_EV_LISTEN:
+				rdsd_accept(rd);
+				break;
+			case RDSD_EV_QUEUE:
+				rds_queue_complete(rd->encoders[idx].queue);
+				break;
+			default:
+				if(rd->clients[idx].fd >= 0)
+					rdsd_client_event(rd, idx);
+				break;
+			}
+		}
+
+		if(timeout_ms == 1)
+			for(i = 0; i < rd->num_encoders; i++)
+				rds_queue_complete(rd->encoders[i].queue);
+	}
+}
+
+static void
+rdsd_usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-s socket] [-m shm_file] "
+			"type:port[:site_addr:enc_addr] ...\n"
+			"\ttype: prais, uecp or soft\n"
+			"\tsocket: defaults to %s\n"
+			"\tshm_file: publish the encoders' state there\n",
+			name, RDSD_SOCKET_PATH);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct rdsd *rd = NULL;
+	const char *shm_path = NULL;
+	struct sigaction sa;
+	int ret = 0;
+	int opt = 0;
+	int i = 0;
+
+	rd = malloc(sizeof(struct rdsd));
+	if(!rd)
+		return 1;
+	memset(rd, 0, sizeof(struct rdsd));
+	rd->path = RDSD_SOCKET_PATH;
+	rd->listen_fd = -1;
+	for(i = 0; i < RDSD_CLIENTS_MAX; i++) {
+		rd->clients[i].fd = -1;
+		rd->clients[i].enc = -1;
+	}
+
+	while((opt = getopt(argc, argv, "s:m:h")) != -1) {
+		switch(opt) {
+		case 's':
+			rd->path = optarg;
+			break;
+		case 'm':
+			shm_path = optarg;
+			break;
+		default:
+			rdsd_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(optind >= argc) {
+		rdsd_usage(argv[0]);
+		return 1;
+	}
+
+	rd->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if(rd->epoll_fd < 0) {
+		perror("epoll_create1");
+		return 1;
+	}
+
+	if(shm_path) {
+		rd->shm = rds_shm_create(shm_path, RDSD_ENCODERS_MAX);
+		if(!rd->shm) {
+			perror(shm_path);
+			return 1;
+		}
+	}
+
+	for(i = optind; i < argc; i++) {
+		ret = rdsd_add_encoder(rd, argv[i]);
+		if(ret < 0) {
+			fprintf(stderr, "%s: %s\n", argv[i], strerror(-ret));
+			goto cleanup;
+		}
+	}
+
+	ret = rdsd_listen(rd);
+	if(ret < 0) {
+		fprintf(stderr, "%s: %s\n", rd->path, strerror(-ret));
+		goto cleanup;
+	}
+
+	memset(&sa, 0, sizeof(struct sigaction));
+	sa.sa_handler = rdsd_sig_handler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	rdsd_run(rd);
+
+ cleanup:
+	for(i = 0; i < RDSD_CLIENTS_MAX; i++)
+		if(rd->clients[i].fd >= 0)
+			rdsd_drop_client(rd, i);
+
+	if(rd->listen_fd >= 0) {
+		close(rd->listen_fd);
+		unlink(rd->path);
+	}
+
+	for(i = 0; i < rd->num_encoders; i++) {
+		rds_queue_destroy(rd->encoders[i].queue);
+		rds_exit(rd->encoders[i].enc);
+	}
+
+	rds_shm_close(rd->shm);
+	close(rd->epoll_fd);
+	free(rd);
+
+	return ret < 0 ? 1 : 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * rdsd.h -	Protocol between rdsd and its clients (see rds_client.c)
+ */
+
+/**
+ * DOC: rdsd
+ *
+ * Only one process can own a serial port, rdsd is that process. It
+ * opens the encoders given on its command line and accepts clients
+ * on a Unix socket, so that e.g. automation, the traffic system and
+ * the studio UI can all control the same encoder.
+ *
+ * Clients link with rds_client.c instead of rds.c and the backends,
+ * it provides rds_init() / rds_exit() / rds_cmd_run() that talk to
+ * rdsd, and rds_cmd.c provides the same rds_get_* / rds_set_* calls
+ * on top of them, so moving an application to rdsd is a relink.
+ * On rds_init() the port selects which of rdsd's encoders the
+ * connection controls, type and addresses are ignored (rdsd knows
+ * them).
+ *
+ * The socket is SOCK_SEQPACKET so each request / reply is a single
+ * message, with the layout below (same host, so native layout).
+ * A client sends one request and waits for its reply.
+ *
+ * On rdsd's side each encoder has a &struct rds_queue, so commands
+ * of all clients get merged / coalesced there and the event loop
+ * never waits on a serial link. Reads of the main service are
+ * answered from rdsd's own copy of the encoder's state, without
+ * touching the link, reads of anything else (or of fields we don't
+ * know yet) go to the encoder.
+ */
+
+#define RDSD_SOCKET_PATH	"/run/rdsd.sock"
+#define RDSD_SOCKET_ENV		"RDSD_SOCKET"	/* Overrides the path */
+
+#define RDSD_PORT_LEN		64
+
+/* One bit each on &struct rds_queue waiters */
+#define RDSD_CLIENTS_MAX	64
+#define RDSD_ENCODERS_MAX	16
+
+/* Request types */
+#define RDSD_REQ_OPEN		0x01	/* Bind the connection to the
+					 * encoder on port */
+#define RDSD_REQ_CMD		0x02	/* Run cmd */
+
+struct rdsd_req {
+	uint8_t type;			/* RDSD_REQ_* */
+	char port[RDSD_PORT_LEN];	/* RDSD_REQ_OPEN */
+	struct rds_cmd cmd;		/* RDSD_REQ_CMD */
+};
+
+struct rdsd_rep {
+	int32_t ret;			/* What rds_cmd_run() returned */
+	struct rds_cmd cmd;		/* Results of get commands */
+};
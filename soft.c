@@ -0,0 +1,1160 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * soft.c -	Software RDS encoder, generates the RDS groups
+ *		itself instead of talking to a device
+ */
+
+#define _GNU_SOURCE	/* For timegm() */
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <stdlib.h>	/* For malloc/free */
+#include <string.h>	/* For memset() */
+#include <time.h>	/* For clock_gettime() / timegm() */
+#include <pthread.h>	/* For pthread_mutex_* */
+#include "rds.h"
+#include "rds_block.h"
+#include "rds_af.h"
+#include "soft.h"
+#include "rds_rtplus.h"
+
+
+/******************\
+* GROUP GENERATION *
+\******************/
+
+/**
+ * soft_now_ns - Get the system (UTC) time in ns
+ */
+static int64_t
+soft_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * soft_block_b - Build the common part of block B
+ * @soft: the &struct soft_encoder
+ * @code: group type code (RDS_GROUP_*)
+ */
+static inline uint16_t
+soft_block_b(struct soft_encoder *soft, uint8_t code)
+{
+	return (code << 11) |
+		((soft->ta_tp & RDS_TATP_TP_ON) ? (1 << 10) : 0) |
+		((soft->pty & 0x1F) << 5);
+}
+
+/**
+ * soft_af_next - Get the next two AF codes for block C of 0A
+ * @soft: the &struct soft_encoder
+ *
+ * Lists go out whole, one after the other.
+ */
+static uint16_t
+soft_af_next(struct soft_encoder *soft)
+{
+	const uint8_t *codes = NULL;
+	int i = 0;
+
+	if(!soft->af_used)
+		return (RDS_AF_CODE_NONE << 8) | RDS_AF_CODE_FILLER;
+
+	/* Done with this one (or it went away), next list */
+	if(!(soft->af_used & (1 << soft->af_list)) ||
+	soft->af_pos >= soft->af_len[soft->af_list]) {
+		for(i = 1; i <= RDS_AF_LISTS_MAX; i++)
+			if(soft->af_used & (1 << ((soft->af_list + i) %
+							RDS_AF_LISTS_MAX)))
+				break;
+		soft->af_list = (soft->af_list + i) % RDS_AF_LISTS_MAX;
+		soft->af_pos = 0;
+	}
+
+	codes = &soft->af[soft->af_list][soft->af_pos];
+	soft->af_pos += 2;
+
+	return (codes[0] << 8) | codes[1];
+}
+
+/**
+ * soft_build_0a - Basic tuning and switching information
+ * @soft: the &struct soft_encoder
+ * @info: the information words to fill
+ */
+static void
+soft_build_0a(struct soft_encoder *soft, uint16_t *info)
+{
+	uint8_t seg = soft->ps_seg;
+	uint8_t di = 0;
+
+	/* DI bits go out one per segment, d3 first */
+	di = (soft->di & 0x7) | (soft->dynpty ? 0x8 : 0);
+
+	info[1] = soft_block_b(soft, RDS_GROUP_0A) |
+		((soft->ta_tp & RDS_TATP_TA_ON) ? (1 << 4) : 0) |
+		((soft->ms != RDS_MS_SPEECH) ? (1 << 3) : 0) |
+		(((di >> (3 - seg)) & 0x1) << 2) | seg;
+	info[2] = soft_af_next(soft);
+	info[3] = ((uint8_t) soft->ps[2 * seg] << 8) |
+		(uint8_t) soft->ps[2 * seg + 1];
+
+	soft->ps_seg = (seg + 1) & 0x3;
+}
+
+/**
+ * soft_build_1a - Programme Item Number and slow labeling codes
+ * @soft: the &struct soft_encoder
+ * @info: the information words to fill
+ *
+ * We only use it for the ECC (variant 0), no paging and no PIN.
+ */
+static void
+soft_build_1a(struct soft_encoder *soft, uint16_t *info)
+{
+	info[1] = soft_block_b(soft, RDS_GROUP_1A);
+	info[2] = soft->pi.ccode & 0xFF;
+	info[3] = 0;
+}
+
+/**
+ * soft_build_2 - RadioText
+ * @soft: the &struct soft_encoder
+ * @info: the information words to fill
+ */
+static void
+soft_build_2(struct soft_encoder *soft, uint16_t *info)
+{
+	const uint8_t *msg = soft->rt_air;
+	uint8_t seg = soft->rt_seg;
+	int chars = 0;
+
+	if(soft->rt.ab_flag & RDS_RT_METHOD_B) {
+		chars = 2;
+		info[1] = soft_block_b(soft, RDS_GROUP_2B);
+		info[2] = soft->pi_code;
+		info[3] = (msg[2 * seg] << 8) | msg[2 * seg + 1];
+	} else {
+		chars = 4;
+		info[1] = soft_block_b(soft, RDS_GROUP_2A);
+		info[2] = (msg[4 * seg] << 8) | msg[4 * seg + 1];
+		info[3] = (msg[4 * seg + 2] << 8) | msg[4 * seg + 3];
+	}
+	info[1] |= (soft->rt_ab << 4) | seg;
+
+	seg++;
+	if(seg * chars >= soft->rt_len) {
+		seg = 0;
+		/* One more full transmission */
+		if(soft->rt_boost)
+			soft->rt_boost--;
+		/* Receivers have the text, its tags can follow */
+		soft->rtplus_hold = 0;
+	}
+	soft->rt_seg = seg;
+}
+
+/**
+ * soft_mjd - Get the Modified Julian Day of a date
+ * @tm: the date (UTC)
+ *
+ * See IEC 62106 Annex G
+ */
+static uint32_t
+soft_mjd(const struct tm *tm)
+{
+	int y = tm->tm_year;		/* Since 1900 */
+	int m = tm->tm_mon + 1;
+	int l = (m == 1 || m == 2) ? 1 : 0;
+
+	return 14956 + tm->tm_mday + (int)((y - l) * 365.25) +
+				(int)((m + 1 + l * 12) * 30.6001);
+}
+
+/**
+ * soft_build_4a - Clock Time and date
+ * @soft: the &struct soft_encoder
+ * @info: the information words to fill
+ * @now_ns: the time to send (UTC, on the RTC)
+ */
+static void
+soft_build_4a(struct soft_encoder *soft, uint16_t *info, int64_t now_ns)
+{
+	time_t secs = now_ns / 1000000000LL;
+	struct tm tm;
+	uint32_t mjd = 0;
+	uint8_t offset = 0;
+
+	gmtime_r(&secs, &tm);
+	mjd = soft_mjd(&tm);
+
+	/* Local time offset in half hours, sign on bit 5 */
+	offset = (soft->rtc_offset < 0) ? (1 << 5) : 0;
+	offset |= (abs(soft->rtc_offset) * 2) & 0x1F;
+
+	info[1] = soft_block_b(soft, RDS_GROUP_4A) | ((mjd >> 15) & 0x3);
+	info[2] = ((mjd & 0x7FFF) << 1) | ((tm.tm_hour >> 4) & 0x1);
+	info[3] = ((tm.tm_hour & 0xF) << 12) | (tm.tm_min << 6) | offset;
+}
+
+/**
+ * soft_build_10a - Programme Type Name
+ * @soft: the &struct soft_encoder
+ * @info: the information words to fill
+ */
+static void
+soft_build_10a(struct soft_encoder *soft, uint16_t *info)
+{
+	const uint8_t *ptyn = (const uint8_t *) soft->ptyn;
+	uint8_t seg = soft->ptyn_seg;
+
+	info[1] = soft_block_b(soft, RDS_GROUP_10A) |
+					(soft->ptyn_ab << 4) | seg;
+	info[2] = (ptyn[4 * seg] << 8) | ptyn[4 * seg + 1];
+	info[3] = (ptyn[4 * seg + 2] << 8) | ptyn[4 * seg + 3];
+
+	soft->ptyn_seg = seg ^ 0x1;
+}
+
+/**
+ * soft_build_3a - Open Data Application announcement
+ * @soft: the &struct soft_encoder
+ * @info: the information words to fill
+ *
+ * ODAs take turns.
+ *
+ * Returns: 0 or -ENODATA if there are no ODAs
+ */
+static int
+soft_build_3a(struct soft_encoder *soft, uint16_t *info)
+{
+	struct rds_soft_oda *oda = NULL;
+	int i = 0;
+
+	if(!soft->oda_used)
+		return -ENODATA;
+
+	for(i = 0; i < SOFT_ODA_MAX; i++) {
+		oda = &soft->oda[soft->oda_ann];
+		if(soft->oda_used & (1 << soft->oda_ann))
+			break;
+		soft->oda_ann = (soft->oda_ann + 1) % SOFT_ODA_MAX;
+	}
+	soft->oda_ann = (soft->oda_ann + 1) % SOFT_ODA_MAX;
+
+	info[1] = soft_block_b(soft, RDS_GROUP_3A) | (oda->code & 0x1F);
+	info[2] = oda->msg;
+	info[3] = oda->aid;
+
+	return 0;
+}
+
+/**
+ * soft_build_oda - Open Data Application data group
+ * @enc: pointer to &struct rds_encoder
+ * @idx: index on soft->oda
+ * @info: the information words to fill
+ *
+ * Returns: 0 or -ENODATA if the ODA had nothing to send
+ */
+static int
+soft_build_oda(struct rds_encoder *enc, int idx, uint16_t *info)
+{
+	struct soft_encoder *soft = enc->priv;
+	struct rds_soft_oda *oda = &soft->oda[idx];
+
+	info[1] = soft_block_b(soft, oda->code);
+	info[2] = 0;
+	info[3] = 0;
+
+	if(oda->fill(enc, info, oda->arg) < 0)
+		return -ENODATA;
+
+	/* Don't let it mess with the common bits */
+	info[1] = soft_block_b(soft, oda->code) | (info[1] & 0x1F);
+
+	/* Version B groups repeat PI on block C */
+	if(RDS_GROUP_IS_B(oda->code))
+		info[2] = soft->pi_code;
+
+	return 0;
+}
+
+/**
+ * soft_build_group - Build the next group to transmit
+ * @enc: pointer to &struct rds_encoder
+ * @info: the information words to fill
+ */
+static void
+soft_build_group(struct rds_encoder *enc, uint16_t *info)
+{
+	struct soft_encoder *soft = enc->priv;
+	uint8_t slot = 0;
+
+	info[0] = soft->pi_code;
+
+	slot = soft_sched_next(soft);
+	switch(slot) {
+	case SOFT_SLOT_0A:
+		break;
+	case SOFT_SLOT_1A:
+		if(soft->pi.ccode & 0xFF) {
+			soft_build_1a(soft, info);
+			return;
+		}
+		break;
+	case SOFT_SLOT_2A:
+		if(soft->rt_len) {
+			soft_build_2(soft, info);
+			return;
+		}
+		break;
+	case SOFT_SLOT_3A:
+		if(soft_build_3a(soft, info) == 0)
+			return;
+		break;
+	case SOFT_SLOT_4A:
+		soft_build_4a(soft, info, soft->stream_ns);
+		return;
+	case SOFT_SLOT_10A:
+		if(soft->has_ptyn) {
+			soft_build_10a(soft, info);
+			return;
+		}
+		break;
+	default:
+		if(soft_build_oda(enc, slot - SOFT_SLOT_ODA, info) == 0)
+			return;
+		break;
+	}
+
+	/* Nothing to send on this slot */
+	soft_build_0a(soft, info);
+}
+
+/**
+ * rds_soft_get_groups - Get the next groups to transmit
+ * @enc: pointer to &struct rds_encoder (RDS_ENCODER_TYPE_SOFT)
+ * @blocks: buffer for num_groups * RDS_GROUP_BLOCKS blocks
+ * @num_groups: number of groups to generate
+ *
+ * Returns: number of groups generated (0 when RDS output
+ * is disabled), or a negative error code
+ */
+int
+rds_soft_get_groups(struct rds_encoder *enc, uint32_t *blocks,
+						int num_groups)
+{
+	struct soft_encoder *soft = enc->priv;
+	uint16_t info[RDS_GROUP_BLOCKS];
+	int64_t now_ns = 0;
+	int i = 0;
+
+	if(enc->type != RDS_ENCODER_TYPE_SOFT || !soft)
+		return -EINVAL;
+
+	pthread_mutex_lock(&soft->lock);
+
+	if(!soft->rds_on) {
+		pthread_mutex_unlock(&soft->lock);
+		return 0;
+	}
+
+	/* Catch up with the wall clock if we fell behind */
+	now_ns = soft_now_ns() + soft->rtc_delta_ns;
+	if(now_ns - soft->stream_ns > SOFT_RESYNC_NS) {
+		soft->stream_ns = now_ns;
+		soft_sched_ct_reset(soft);
+	}
+
+	for(i = 0; i < num_groups; i++) {
+		soft_build_group(enc, info);
+		rds_block_encode_group(info, blocks + i * RDS_GROUP_BLOCKS);
+		soft->stream_ns += SOFT_GROUP_NS;
+	}
+
+	pthread_mutex_unlock(&soft->lock);
+
+	return num_groups;
+}
+
+
+/**********************\
+* PARAMETER MANAGEMENT *
+\**********************/
+
+/**
+ * soft_get_pi - Get Programme Identifier of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ * @pi: pointer to &struct rds_pi to fill
+ */
+static int
+soft_get_pi(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+						struct rds_pi *pi)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	pthread_mutex_lock(&soft->lock);
+	*pi = soft->pi;
+	pthread_mutex_unlock(&soft->lock);
+
+	return 0;
+}
+
+/**
+ * soft_set_pi - Set Programme Identifier of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ * @pi: pointer to &struct rds_pi containing the infos
+ */
+static int
+soft_set_pi(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+						struct rds_pi *pi)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	pthread_mutex_lock(&soft->lock);
+	soft->pi = *pi;
+	soft->pi_code = (pi->prn & 0xFF) | ((pi->coverage & 0xF) << 8) |
+					((pi->ccode & 0x0F00) << 4);
+	pthread_mutex_unlock(&soft->lock);
+
+	return 0;
+}
+
+/**
+ * soft_get_ps - Get Programme Service name of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ * @ps: pre-allocated 8 char array to fill
+ */
+static int
+soft_get_ps(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, char* ps)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	pthread_mutex_lock(&soft->lock);
+	memcpy(ps, soft->ps, RDS_PS_LEN);
+	pthread_mutex_unlock(&soft->lock);
+
+	return RDS_PS_LEN;
+}
+
+/**
+ * soft_set_ps - Set Programme Service name of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ * @ps: PS name to set (G0), padded with spaces
+ */
+static int
+soft_set_ps(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, char* ps)
+{
+	struct soft_encoder *soft = enc->priv;
+	int i = 0;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	pthread_mutex_lock(&soft->lock);
+	for(i = 0; i < RDS_PS_LEN && ps[i] != '\0'; i++)
+		soft->ps[i] = ps[i];
+	for(; i < RDS_PS_LEN; i++)
+		soft->ps[i] = ' ';
+	pthread_mutex_unlock(&soft->lock);
+
+	return 0;
+}
+
+/**
+ * soft_get_rt - Get RadioText of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ * @rt: the &struct rds_rt to fill
+ */
+static int
+soft_get_rt(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+						struct rds_rt *rt)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	pthread_mutex_lock(&soft->lock);
+	*rt = soft->rt;
+	pthread_mutex_unlock(&soft->lock);
+
+	return 0;
+}
+
+/**
+ * soft_rt_update - Switch to a new RadioText
+ * @soft: the &struct soft_encoder (locked)
+ * @rt: the &struct rds_rt to set (G0 text)
+ *
+ * Returns: 1 if the text on air changed, else 0
+ */
+static int
+soft_rt_update(struct soft_encoder *soft, const struct rds_rt *rt)
+{
+	uint8_t air[RDS_RT_MSG_LEN_MAX];
+	int max = (rt->ab_flag & RDS_RT_METHOD_B) ?
+			SOFT_RT_B_LEN_MAX : RDS_RT_MSG_LEN_MAX - 1;
+	int len = strnlen((const char *) rt->msg, max);
+	int changed = 0;
+
+	memset(air, ' ', RDS_RT_MSG_LEN_MAX);
+	memcpy(air, rt->msg, len);
+	if(len > 0 && len < max)
+		air[len++] = SOFT_RT_END;
+
+	/* Receivers clear their RT buffer when the flag toggles,
+	 * also give the new text more air time for a while */
+	if(len != soft->rt_len || memcmp(air, soft->rt_air, len)) {
+		soft->rt_ab ^= 1;
+		soft->rt_boost = len ? SOFT_RT_BOOST_CYCLES : 0;
+		changed = 1;
+	}
+
+	soft->rt = *rt;
+	memcpy(soft->rt_air, air, RDS_RT_MSG_LEN_MAX);
+	soft->rt_len = len;
+	soft->rt_seg = 0;
+
+	return changed;
+}
+
+/**
+ * soft_set_rt - Set RadioText of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ * @rt: the &struct rds_rt to set (G0 text)
+ *
+ * An empty message stops RT transmission. Messages shorter than
+ * the maximum get an end marker and are padded with spaces up to
+ * the segment boundary. Retransmissions and buffer config don't
+ * apply here, we send the current message until it changes.
+ * RT+ tags of the previous text (if any) are dropped with it.
+ */
+static int
+soft_set_rt(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+						struct rds_rt *rt)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	pthread_mutex_lock(&soft->lock);
+
+	soft_rt_update(soft, rt);
+
+	/* Item stopped, no tags */
+	soft->rtplus.running = 0;
+	memset(soft->rtplus.tags, 0, sizeof(soft->rtplus.tags));
+
+	pthread_mutex_unlock(&soft->lock);
+
+	return 0;
+}
+
+/**
+ * soft_rtplus_fill - Fill an RT+ 11A group
+ * @enc: pointer to &struct rds_encoder
+ * @info: the information words to fill
+ * @arg: unused
+ *
+ * Called with the encoder locked. Nothing goes out until the
+ * text the tags point into went out once.
+ */
+static int
+soft_rtplus_fill(struct rds_encoder *enc, uint16_t *info, void *arg)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	if(soft->rtplus_hold || !soft->rt_len)
+		return -ENODATA;
+
+	rds_rtplus_encode(&soft->rtplus, info);
+
+	return 0;
+}
+
+/**
+ * soft_get_rtplus - Get RadioText and RT+ tags of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ * @rtplus: the &struct rds_rtplus to fill
+ */
+static int
+soft_get_rtplus(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+						struct rds_rtplus *rtplus)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	pthread_mutex_lock(&soft->lock);
+	*rtplus = soft->rtplus;
+	rtplus->rt = soft->rt;
+	pthread_mutex_unlock(&soft->lock);
+
+	return 0;
+}
+
+/**
+ * soft_set_rtplus - Set RadioText and its RT+ tags on a software encoder
+ * @enc: pointer to &struct rds_encoder
+ * @rtplus: the &struct rds_rtplus to set (G0 text), the item
+ *	toggle bit is returned here
+ *
+ * Text and tags change together, under the lock, and the RT+ ODA
+ * gets registered on first use. If the text changed, 11A groups are
+ * held back until it went out once, so that receivers never get
+ * tags for a text they don't have yet.
+ */
+static int
+soft_set_rtplus(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+						struct rds_rtplus *rtplus)
+{
+	struct soft_encoder *soft = enc->priv;
+	struct rds_soft_oda oda;
+	int ret = 0;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	pthread_mutex_lock(&soft->lock);
+
+	if(soft->rtplus_oda < 0) {
+		memset(&oda, 0, sizeof(struct rds_soft_oda));
+		oda.aid = RDS_RTPLUS_AID;
+		oda.code = RDS_RTPLUS_GROUP;
+		oda.msg = RDS_RTPLUS_ODA_MSG;
+		oda.weight = SOFT_WEIGHT_RTPLUS;
+		oda.fill = &soft_rtplus_fill;
+
+		ret = soft_sched_add_oda(soft, &oda);
+		if(ret < 0) {
+			pthread_mutex_unlock(&soft->lock);
+			return ret;
+		}
+		soft->rtplus_oda = ret;
+	}
+
+	/* New item */
+	if(!rds_rtplus_same_item(rtplus, &soft->rtplus))
+		soft->rtplus.toggle ^= 1;
+	rtplus->toggle = soft->rtplus.toggle;
+
+	if(soft_rt_update(soft, &rtplus->rt))
+		soft->rtplus_hold = 1;
+
+	soft->rtplus = *rtplus;
+
+	pthread_mutex_unlock(&soft->lock);
+
+	return 0;
+}
+
+/**
+ * soft_set_af - Set Alternative Frequencies on a software encoder
+ * @enc: pointer to &struct rds_encoder
+ * @af: the change, with the new list already encoded
+ *
+ * We just keep the encoded list, a list that's on air finishes
+ * its round with the new codes.
+ */
+static int
+soft_set_af(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+				const struct rds_af_wire *af)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	pthread_mutex_lock(&soft->lock);
+
+	if(af->op == RDS_AF_OP_CLEAR) {
+		if(af->idx == RDS_AF_ALL)
+			soft->af_used = 0;
+		else
+			soft->af_used &= ~(1 << af->idx);
+	} else {
+		memcpy(soft->af[af->idx], af->codes, af->len);
+		soft->af_len[af->idx] = af->len;
+		soft->af_used |= (1 << af->idx);
+	}
+
+	pthread_mutex_unlock(&soft->lock);
+
+	return 0;
+}
+
+/**
+ * soft_get_di - Get decoder info field of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ */
+static int
+soft_get_di(struct rds_encoder *enc, uint8_t dsn, uint8_t psn)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	return soft->di;
+}
+
+/**
+ * soft_set_di - Set decoder info field of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ * @di: RDS_DI_* flags
+ */
+static int
+soft_set_di(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t di)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	soft->di = di & (RDS_DI_STEREO | RDS_DI_ARTIFICIAL_HEAD |
+						RDS_DI_COMPRESSED);
+	return 0;
+}
+
+/**
+ * soft_get_dynpty - Get dynamic PTY flag of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ */
+static int
+soft_get_dynpty(struct rds_encoder *enc, uint8_t dsn, uint8_t psn)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	return soft->dynpty;
+}
+
+/**
+ * soft_set_dynpty - Set dynamic PTY flag of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ * @dynpty: 1 -> Dynamic PTY, 0 -> Static PTY
+ */
+static int
+soft_set_dynpty(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+							uint8_t dynpty)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	soft->dynpty = dynpty ? 1 : 0;
+	return 0;
+}
+
+/**
+ * soft_get_ta_tp - Get TA/TP flags of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ */
+static int
+soft_get_ta_tp(struct rds_encoder *enc, uint8_t dsn, uint8_t psn)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	return soft->ta_tp;
+}
+
+/**
+ * soft_set_ta_tp - Set TA/TP flags of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ * @ta_tp: RDS_TATP_* flags
+ */
+static int
+soft_set_ta_tp(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+							uint8_t ta_tp)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	soft->ta_tp = ta_tp & (RDS_TATP_TA_ON | RDS_TATP_TP_ON);
+	return 0;
+}
+
+/**
+ * soft_get_ms - Get Music/Speech switch of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ */
+static int
+soft_get_ms(struct rds_encoder *enc, uint8_t dsn, uint8_t psn)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	return soft->ms;
+}
+
+/**
+ * soft_set_ms - Set Music/Speech switch of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ * @ms: RDS_MS_MUSIC or RDS_MS_SPEECH
+ */
+static int
+soft_set_ms(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t ms)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	if(ms != RDS_MS_MUSIC && ms != RDS_MS_SPEECH)
+		return -EINVAL;
+
+	soft->ms = ms;
+	return 0;
+}
+
+/**
+ * soft_get_pty - Get Programme Type of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ */
+static int
+soft_get_pty(struct rds_encoder *enc, uint8_t dsn, uint8_t psn)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	return soft->pty;
+}
+
+/**
+ * soft_set_pty - Set Programme Type of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ * @pty: The pty (0 - 31) to set
+ */
+static int
+soft_set_pty(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t pty)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	if(pty > 31)
+		return -EINVAL;
+
+	soft->pty = pty;
+	return 0;
+}
+
+/**
+ * soft_get_ptyn - Get Programme Type Name of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ * @ptyn: pre-allocated 8 char array to fill
+ */
+static int
+soft_get_ptyn(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+							char* ptyn)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	if(!soft->has_ptyn)
+		return 0;
+
+	pthread_mutex_lock(&soft->lock);
+	memcpy(ptyn, soft->ptyn, RDS_PTYN_LEN);
+	pthread_mutex_unlock(&soft->lock);
+
+	return RDS_PTYN_LEN;
+}
+
+/**
+ * soft_set_ptyn - Set Programme Type Name of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ * @ptyn: PTY name to set (G0), empty to stop sending 10A
+ */
+static int
+soft_set_ptyn(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+							char* ptyn)
+{
+	struct soft_encoder *soft = enc->priv;
+	char new[RDS_PTYN_LEN];
+	int i = 0;
+
+	/* Only the main service is supported */
+	if(dsn != 0 || psn != 0)
+		return -EOPNOTSUPP;
+
+	for(i = 0; i < RDS_PTYN_LEN && ptyn[i] != '\0'; i++)
+		new[i] = ptyn[i];
+	soft->has_ptyn = (i > 0);
+	for(; i < RDS_PTYN_LEN; i++)
+		new[i] = ' ';
+
+	pthread_mutex_lock(&soft->lock);
+	if(memcmp(new, soft->ptyn, RDS_PTYN_LEN))
+		soft->ptyn_ab ^= 1;
+	memcpy(soft->ptyn, new, RDS_PTYN_LEN);
+	soft->ptyn_seg = 0;
+	pthread_mutex_unlock(&soft->lock);
+
+	return 0;
+}
+
+/**
+ * soft_get_ct - Get transmission status of CT on a software encoder
+ * @enc: pointer to &struct rds_encoder
+ */
+static int
+soft_get_ct(struct rds_encoder *enc)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	return soft->ct;
+}
+
+/**
+ * soft_set_ct - Enable / disable CT (4A groups) on a software encoder
+ * @enc: pointer to &struct rds_encoder
+ * @ct: 1 -> Enable, 0 -> Disable
+ */
+static int
+soft_set_ct(struct rds_encoder *enc, uint8_t ct)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	soft->ct = ct ? 1 : 0;
+
+	return 0;
+}
+
+/**
+ * soft_get_rtc - Get the clock of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ * @rtc: the &struct rds_rtc to fill (UTC)
+ */
+static int
+soft_get_rtc(struct rds_encoder *enc, struct rds_rtc *rtc)
+{
+	struct soft_encoder *soft = enc->priv;
+	int64_t now_ns = soft_now_ns() + soft->rtc_delta_ns;
+	time_t secs = now_ns / 1000000000LL;
+	struct tm tm;
+
+	gmtime_r(&secs, &tm);
+
+	rtc->year = tm.tm_year + 1900;
+	rtc->month = tm.tm_mon + 1;
+	rtc->day = tm.tm_mday;
+	rtc->hours = tm.tm_hour;
+	rtc->minutes = tm.tm_min;
+	rtc->seconds = tm.tm_sec;
+	rtc->centiseconds = (now_ns % 1000000000LL) / 10000000LL;
+	rtc->offset = soft->rtc_offset;
+
+	return 0;
+}
+
+/**
+ * soft_set_rtc - Set the clock of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ * @rtc: the &struct rds_rtc to set (UTC, offset in hours)
+ *
+ * By default we follow the system clock, this sets an offset
+ * from it.
+ */
+static int
+soft_set_rtc(struct rds_encoder *enc, struct rds_rtc *rtc)
+{
+	struct soft_encoder *soft = enc->priv;
+	struct tm tm;
+	int64_t rtc_ns = 0;
+	int64_t delta_ns = 0;
+
+	if(rtc->month < 1 || rtc->month > 12 || rtc->day < 1 ||
+	rtc->day > 31 || rtc->hours > 23 || rtc->minutes > 59 ||
+	rtc->seconds > 59 || rtc->centiseconds > 99 ||
+	rtc->offset > 14 || rtc->offset < -12)
+		return -EINVAL;
+
+	memset(&tm, 0, sizeof(struct tm));
+	tm.tm_year = rtc->year - 1900;
+	tm.tm_mon = rtc->month - 1;
+	tm.tm_mday = rtc->day;
+	tm.tm_hour = rtc->hours;
+	tm.tm_min = rtc->minutes;
+	tm.tm_sec = rtc->seconds;
+
+	rtc_ns = (int64_t) timegm(&tm) * 1000000000LL +
+			rtc->centiseconds * 10000000LL;
+	delta_ns = rtc_ns - soft_now_ns();
+
+	pthread_mutex_lock(&soft->lock);
+	soft->stream_ns += delta_ns - soft->rtc_delta_ns;
+	soft->rtc_delta_ns = delta_ns;
+	soft->rtc_offset = rtc->offset;
+	soft_sched_ct_reset(soft);
+	pthread_mutex_unlock(&soft->lock);
+
+	return 0;
+}
+
+/**
+ * soft_get_rds_on - Get the RDS output status of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ */
+static int
+soft_get_rds_on(struct rds_encoder *enc)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	return soft->rds_on;
+}
+
+/**
+ * soft_set_rds_on - Set the RDS output status of a software encoder
+ * @enc: pointer to &struct rds_encoder
+ * @on: 1 -> Enable, 0 -> Disable
+ */
+static int
+soft_set_rds_on(struct rds_encoder *enc, uint8_t on)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	soft->rds_on = on ? 1 : 0;
+	return 0;
+}
+
+
+/**************\
+* ENTRY POINTS *
+\**************/
+
+/**
+ * soft_exit - Release a software encoder's state
+ * @enc: pointer to &struct rds_encoder
+ */
+static void
+soft_exit(struct rds_encoder *enc)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	if(!soft)
+		return;
+
+	pthread_mutex_destroy(&soft->lock);
+	free(soft);
+	enc->priv = NULL;
+}
+
+int
+soft_init(struct rds_encoder *enc)
+{
+	struct soft_encoder *soft = NULL;
+
+	soft = malloc(sizeof(struct soft_encoder));
+	if(!soft)
+		return -ENOMEM;
+	memset(soft, 0, sizeof(struct soft_encoder));
+
+	pthread_mutex_init(&soft->lock, NULL);
+	memset(soft->ps, ' ', RDS_PS_LEN);
+	memset(soft->ptyn, ' ', RDS_PTYN_LEN);
+	soft->ms = RDS_MS_DEFAULT;
+	soft->rds_on = 1;
+	soft->rtplus_oda = -1;
+	soft->stream_ns = soft_now_ns();
+	soft_sched_init(soft);
+
+	enc->priv = soft;
+	enc->exit = &soft_exit;
+
+	enc->get_pi = &soft_get_pi;
+	enc->set_pi = &soft_set_pi;
+	enc->get_ps = &soft_get_ps;
+	enc->set_ps = &soft_set_ps;
+	enc->get_di = &soft_get_di;
+	enc->set_di = &soft_set_di;
+	enc->get_dynpty = &soft_get_dynpty;
+	enc->set_dynpty = &soft_set_dynpty;
+	enc->get_rt = &soft_get_rt;
+	enc->set_rt = &soft_set_rt;
+	enc->get_ta_tp = &soft_get_ta_tp;
+	enc->set_ta_tp = &soft_set_ta_tp;
+	enc->get_ms = &soft_get_ms;
+	enc->set_ms = &soft_set_ms;
+	enc->get_pty = &soft_get_pty;
+	enc->set_pty = &soft_set_pty;
+	enc->get_ptyn = &soft_get_ptyn;
+	enc->set_ptyn = &soft_set_ptyn;
+	enc->get_ct = &soft_get_ct;
+	enc->set_ct = &soft_set_ct;
+	enc->get_rtc = &soft_get_rtc;
+	enc->set_rtc = &soft_set_rtc;
+	enc->get_rds_on = &soft_get_rds_on;
+	enc->set_rds_on = &soft_set_rds_on;
+	enc->get_rtplus = &soft_get_rtplus;
+	enc->set_rtplus = &soft_set_rtplus;
+	enc->set_af = &soft_set_af;
+	return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * soft.h -	Software RDS encoder, generates the RDS groups
+ *		itself instead of talking to a device
+ */
+
+/**
+ * DOC: Software encoder
+ *
+ * An encoder of type RDS_ENCODER_TYPE_SOFT has no port, the usual
+ * rds_set_* calls update its parameters and rds_soft_get_groups()
+ * returns the RDS groups to transmit, as 26bit blocks ready to go
+ * on the bitstream (see rds_block.h). Groups generated are:
+ *
+ * 0A: PS, TA/TP, PTY, M/S, DI and AF lists (method A or B, one
+ *     list after the other, two codes per group)
+ * 1A: Extended Country Code (from &struct rds_pi ccode)
+ * 2A/2B: RadioText, 2B when using RDS_RT_METHOD_B (32 chars max)
+ * 4A: Clock Time, once per minute when CT is enabled
+ * 10A: PTY Name
+ * 3A/11A: RadioText Plus, once rds_set_rtplus() is used
+ *
+ * Only the main service is supported (dsn 0, psn 0). The text A/B
+ * flags of RT and PTYN toggle on their own when the text changes.
+ *
+ * Each group covers 104 bits, at 1187.5 bit/s that's ~87.6ms of
+ * air time. We keep track of the stream time so that when groups
+ * are generated faster than real time (e.g. offline) CT and the
+ * rest still follow the stream and not the wall clock.
+ */
+
+/* Air time of one group in ns (104 bits at 1187.5 bit/s) */
+#define SOFT_GROUP_NS		87578947LL
+
+/* If the stream falls behind the wall clock by more than
+ * this (e.g. nobody pulled groups for a while), resync */
+#define SOFT_RESYNC_NS		1000000000LL
+
+/* RT end of message marker */
+#define SOFT_RT_END		0x0D
+
+/* Max RT length on 2B groups */
+#define SOFT_RT_B_LEN_MAX	32
+
+
+/**
+ * DOC: Group scheduler
+ *
+ * Each kind of group we send gets a slot with a weight, the share
+ * of air time it gets (see rds_soft_set_weight()). Instead of
+ * picking the next group by looking at all of them every time, we
+ * lay out a "wheel" with the slots interleaved as evenly as their
+ * weights allow (smooth weighted round robin) when the weights
+ * change, and then just walk it, so picking a group is O(1).
+ * When a slot comes up and has nothing to send, 0A goes instead.
+ *
+ * On top of that:
+ *
+ * 4A is deadline driven and doesn't go on the wheel, it preempts
+ * whatever is next so that its start falls within half a group
+ * (~44ms) from the minute boundary, as the standard requires.
+ *
+ * After the RT changes we switch to a second wheel where RT has
+ * SOFT_RT_BOOST times its weight and the slow stuff (1A, 3A, 10A)
+ * is left out, until the new text went out SOFT_RT_BOOST_CYCLES
+ * times, so that receivers pick it up quickly.
+ *
+ * ODAs get a slot each for their data groups plus a shared 3A
+ * slot for their announcements, taking turns.
+ */
+#define SOFT_SLOT_0A		0
+#define SOFT_SLOT_1A		1
+#define SOFT_SLOT_2A		2	/* 2A or 2B */
+#define SOFT_SLOT_3A		3
+#define SOFT_SLOT_4A		4	/* Not on the wheel */
+#define SOFT_SLOT_10A		5
+#define SOFT_SLOT_ODA		6	/* First ODA slot */
+#define SOFT_ODA_MAX		4
+#define SOFT_NUM_SLOTS		(SOFT_SLOT_ODA + SOFT_ODA_MAX)
+
+#define SOFT_WEIGHT_MAX		16
+#define SOFT_WHEEL_MAX		(SOFT_NUM_SLOTS * SOFT_WEIGHT_MAX)
+
+#define SOFT_RT_BOOST		2
+#define SOFT_RT_BOOST_CYCLES	2
+
+/* Default weights, ~4.5 0A/s, ~3.4 2A/s and ~1.1/s for the rest */
+#define SOFT_WEIGHT_0A_DEFAULT	4
+#define SOFT_WEIGHT_2A_DEFAULT	3
+#define SOFT_WEIGHT_1A_DEFAULT	1
+#define SOFT_WEIGHT_3A_DEFAULT	1
+#define SOFT_WEIGHT_10A_DEFAULT	1
+
+struct soft_wheel {
+	uint8_t len;
+	uint8_t pos;
+	uint8_t slots[SOFT_WHEEL_MAX];
+};
+
+/* Software encoder state, lives on enc->priv */
+struct soft_encoder {
+	pthread_mutex_t lock;		/* Setters vs group generation */
+
+	/* Parameters */
+	struct rds_pi pi;
+	uint16_t pi_code;
+	char ps[RDS_PS_LEN];
+	struct rds_rt rt;		/* As set */
+	uint8_t rt_air[RDS_RT_MSG_LEN_MAX];	/* As it goes on air, with the
+						 * end marker and padding */
+	uint8_t rt_len;			/* Chars on air, including SOFT_RT_END */
+	uint8_t rt_ab;			/* Text A/B flag */
+	char ptyn[RDS_PTYN_LEN];
+	uint8_t ptyn_ab;		/* PTYN A/B flag */
+	uint8_t has_ptyn;
+	uint8_t di;
+	uint8_t dynpty;
+	uint8_t ta_tp;
+	uint8_t ms;
+	uint8_t pty;
+	uint8_t ct;
+	uint8_t rds_on;
+	int8_t rtc_offset;		/* Local time offset in hours */
+	int64_t rtc_delta_ns;		/* RTC - system clock */
+
+	/* Transmission state */
+	int64_t stream_ns;		/* Stream time of the next group (RTC) */
+	uint8_t ps_seg;
+	uint8_t rt_seg;
+	uint8_t ptyn_seg;
+
+	/* Scheduler (see soft_sched.c) */
+	uint8_t weights[SOFT_NUM_SLOTS];
+	struct soft_wheel wheel;
+	struct soft_wheel boost_wheel;
+	uint8_t rt_boost;		/* RT cycles left to boost for */
+	int64_t next_ct_ns;		/* Next minute boundary */
+
+	/* Open Data Applications */
+	struct rds_soft_oda oda[SOFT_ODA_MAX];
+	uint8_t oda_used;		/* One bit per oda[] entry */
+	uint8_t oda_ann;		/* Next ODA to announce */
+
+	/* RadioText Plus (see rds_rtplus.h) */
+	struct rds_rtplus rtplus;	/* Tags of rt_air */
+	int8_t rtplus_oda;		/* Its oda[] entry, -1 if not used yet */
+	uint8_t rtplus_hold;		/* Text didn't go out yet, hold the tags */
+
+	/* Alternative Frequencies, encoded (see rds_af.h) */
+	uint8_t af[RDS_AF_LISTS_MAX][RDS_AF_CODES_MAX];
+	uint8_t af_len[RDS_AF_LISTS_MAX];
+	uint16_t af_used;		/* One bit per af[] list */
+	uint8_t af_list;		/* List on air */
+	uint8_t af_pos;			/* Next code of it */
+};
+
+/* Air time share of RT+ 11A groups */
+#define SOFT_WEIGHT_RTPLUS	1
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+int soft_init(struct rds_encoder *enc);
+
+/* Scheduler */
+void soft_sched_init(struct soft_encoder *soft);
+void soft_sched_rebuild(struct soft_encoder *soft);
+uint8_t soft_sched_next(struct soft_encoder *soft);
+void soft_sched_ct_reset(struct soft_encoder *soft);
+int soft_sched_add_oda(struct soft_encoder *soft,
+				const struct rds_soft_oda *oda);
@@ -0,0 +1,325 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * soft_sched.c -	Group scheduler of the software encoder
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <string.h>	/* For memset() */
+#include <pthread.h>	/* For pthread_mutex_* */
+#include "rds.h"
+#include "rds_block.h"
+#include "rds_af.h"
+#include "soft.h"
+
+#define SOFT_MINUTE_NS		(60 * 1000000000LL)
+
+
+/**
+ * soft_wheel_build - Lay out a wheel from a set of weights
+ * @wheel: the &struct soft_wheel to fill
+ * @weights: one weight per slot
+ *
+ * Smooth weighted round robin: on every position each slot
+ * earns its weight, the richest one gets the position and
+ * pays the total. This spreads each slot's appearances as
+ * evenly as possible over the wheel.
+ */
+static void
+soft_wheel_build(struct soft_wheel *wheel, const uint8_t *weights)
+{
+	int credit[SOFT_NUM_SLOTS];
+	int total = 0;
+	int best = 0;
+	int pos = 0;
+	int i = 0;
+
+	memset(credit, 0, sizeof(credit));
+
+	for(i = 0; i < SOFT_NUM_SLOTS; i++)
+		total += weights[i];
+
+	for(pos = 0; pos < total; pos++) {
+		best = -1;
+		for(i = 0; i < SOFT_NUM_SLOTS; i++) {
+			if(!weights[i])
+				continue;
+			credit[i] += weights[i];
+			if(best < 0 || credit[i] > credit[best])
+				best = i;
+		}
+		credit[best] -= total;
+		wheel->slots[pos] = best;
+	}
+
+	/* Nothing at all, just send 0As */
+	if(total == 0) {
+		wheel->slots[0] = SOFT_SLOT_0A;
+		total = 1;
+	}
+
+	wheel->len = total;
+	wheel->pos = 0;
+}
+
+/**
+ * soft_sched_rebuild - Rebuild the wheels after a weight change
+ * @soft: the &struct soft_encoder
+ */
+void
+soft_sched_rebuild(struct soft_encoder *soft)
+{
+	uint8_t boost[SOFT_NUM_SLOTS];
+	int i = 0;
+
+	/* Unused ODA slots get no air time */
+	for(i = 0; i < SOFT_ODA_MAX; i++)
+		soft->weights[SOFT_SLOT_ODA + i] = (soft->oda_used & (1 << i)) ?
+						soft->oda[i].weight : 0;
+
+	soft->weights[SOFT_SLOT_4A] = 0;
+	soft_wheel_build(&soft->wheel, soft->weights);
+
+	memcpy(boost, soft->weights, sizeof(boost));
+	boost[SOFT_SLOT_2A] *= SOFT_RT_BOOST;
+	boost[SOFT_SLOT_1A] = 0;
+	boost[SOFT_SLOT_3A] = 0;
+	boost[SOFT_SLOT_10A] = 0;
+	soft_wheel_build(&soft->boost_wheel, boost);
+}
+
+/**
+ * soft_sched_ct_reset - Re-arm the CT deadline
+ * @soft: the &struct soft_encoder
+ *
+ * Called when the stream time jumps (RTC set, resync) or
+ * CT gets enabled, points next_ct_ns to the first minute
+ * boundary we can still hit.
+ */
+void
+soft_sched_ct_reset(struct soft_encoder *soft)
+{
+	int64_t t = soft->stream_ns - SOFT_GROUP_NS / 2;
+
+	soft->next_ct_ns = (t / SOFT_MINUTE_NS + 1) * SOFT_MINUTE_NS;
+}
+
+/**
+ * soft_sched_next - Pick the slot of the next group
+ * @soft: the &struct soft_encoder
+ *
+ * Returns: a SOFT_SLOT_* value
+ */
+uint8_t
+soft_sched_next(struct soft_encoder *soft)
+{
+	struct soft_wheel *wheel = NULL;
+	uint8_t slot = 0;
+
+	/*
+	 * A group starting at stream_ns is the one closest to the
+	 * minute boundary if the boundary falls before its middle,
+	 * (the next one would start more than half a group late)
+	 */
+	if(soft->stream_ns + SOFT_GROUP_NS / 2 >= soft->next_ct_ns) {
+		/* Way late (stream jumped), don't send a stale one */
+		if(soft->stream_ns - soft->next_ct_ns > SOFT_GROUP_NS / 2) {
+			soft_sched_ct_reset(soft);
+		} else {
+			soft->next_ct_ns += SOFT_MINUTE_NS;
+			if(soft->ct)
+				return SOFT_SLOT_4A;
+		}
+	}
+
+	wheel = soft->rt_boost ? &soft->boost_wheel : &soft->wheel;
+
+	slot = wheel->slots[wheel->pos];
+	if(++wheel->pos >= wheel->len)
+		wheel->pos = 0;
+
+	return slot;
+}
+
+/**
+ * soft_sched_init - Initialize the scheduler with the default weights
+ * @soft: the &struct soft_encoder
+ */
+void
+soft_sched_init(struct soft_encoder *soft)
+{
+	memset(soft->weights, 0, sizeof(soft->weights));
+	soft->weights[SOFT_SLOT_0A] = SOFT_WEIGHT_0A_DEFAULT;
+	soft->weights[SOFT_SLOT_1A] = SOFT_WEIGHT_1A_DEFAULT;
+	soft->weights[SOFT_SLOT_2A] = SOFT_WEIGHT_2A_DEFAULT;
+	soft->weights[SOFT_SLOT_3A] = SOFT_WEIGHT_3A_DEFAULT;
+	soft->weights[SOFT_SLOT_10A] = SOFT_WEIGHT_10A_DEFAULT;
+
+	soft_sched_rebuild(soft);
+	soft_sched_ct_reset(soft);
+}
+
+/**
+ * soft_sched_add_oda - Put an ODA on the wheel
+ * @soft: the &struct soft_encoder (locked)
+ * @oda: the &struct rds_soft_oda to register (copied)
+ *
+ * Also used for the ODAs we run ourselves (RT+, see soft.c).
+ *
+ * Returns: the ODA's id on success or a negative error code
+ */
+int
+soft_sched_add_oda(struct soft_encoder *soft, const struct rds_soft_oda *oda)
+{
+	int i = 0;
+
+	if(!oda->fill || oda->weight > SOFT_WEIGHT_MAX || (oda->code >> 1) > 15)
+		return -EINVAL;
+
+	/* Group types we send ourselves (3A is the announcement) */
+	switch(oda->code >> 1) {
+	case 0:
+	case 1:
+	case 2:
+	case 3:
+	case 4:
+	case 10:
+		return -EINVAL;
+	default:
+		break;
+	}
+
+	for(i = 0; i < SOFT_ODA_MAX; i++)
+		if(!(soft->oda_used & (1 << i)))
+			break;
+
+	if(i == SOFT_ODA_MAX)
+		return -ENOSPC;
+
+	soft->oda[i] = *oda;
+	soft->oda_used |= (1 << i);
+	soft_sched_rebuild(soft);
+
+	return i;
+}
+
+
+/************\
+* CONFIG API *
+\************/
+
+/**
+ * rds_soft_set_weight - Set the air time share of a group type
+ * @enc: pointer to &struct rds_encoder (RDS_ENCODER_TYPE_SOFT)
+ * @code: RDS_GROUP_0A, 1A, 2A (also for 2B), 3A (ODA announcements)
+ *	or 10A
+ * @weight: relative share (0 - SOFT_WEIGHT_MAX), 0 to not send it
+ *	(for 0A that only means it's sent when nothing else is)
+ *
+ * 4A doesn't have a weight, it's sent on every minute change when
+ * CT is enabled. ODA data groups get their weight on rds_soft_add_oda().
+ */
+int
+rds_soft_set_weight(struct rds_encoder *enc, uint8_t code, uint8_t weight)
+{
+	struct soft_encoder *soft = enc->priv;
+	uint8_t slot = 0;
+
+	if(enc->type != RDS_ENCODER_TYPE_SOFT || !soft)
+		return -EINVAL;
+
+	if(weight > SOFT_WEIGHT_MAX)
+		return -EINVAL;
+
+	switch(code) {
+	case RDS_GROUP_0A:
+		slot = SOFT_SLOT_0A;
+		break;
+	case RDS_GROUP_1A:
+		slot = SOFT_SLOT_1A;
+		break;
+	case RDS_GROUP_2A:
+	case RDS_GROUP_2B:
+		slot = SOFT_SLOT_2A;
+		break;
+	case RDS_GROUP_3A:
+		slot = SOFT_SLOT_3A;
+		break;
+	case RDS_GROUP_10A:
+		slot = SOFT_SLOT_10A;
+		break;
+	default:
+		return -EOPNOTSUPP;
+	}
+
+	pthread_mutex_lock(&soft->lock);
+	soft->weights[slot] = weight;
+	soft_sched_rebuild(soft);
+	pthread_mutex_unlock(&soft->lock);
+
+	return 0;
+}
+
+/**
+ * rds_soft_add_oda - Register an Open Data Application
+ * @enc: pointer to &struct rds_encoder (RDS_ENCODER_TYPE_SOFT)
+ * @oda: the &struct rds_soft_oda to register (copied)
+ *
+ * Returns: the ODA's id on success or a negative error code
+ */
+int
+rds_soft_add_oda(struct rds_encoder *enc, const struct rds_soft_oda *oda)
+{
+	struct soft_encoder *soft = enc->priv;
+	int ret = 0;
+
+	if(enc->type != RDS_ENCODER_TYPE_SOFT || !soft)
+		return -EINVAL;
+
+	pthread_mutex_lock(&soft->lock);
+	ret = soft_sched_add_oda(soft, oda);
+	pthread_mutex_unlock(&soft->lock);
+
+	return ret;
+}
+
+/**
+ * rds_soft_remove_oda - Unregister an Open Data Application
+ * @enc: pointer to &struct rds_encoder (RDS_ENCODER_TYPE_SOFT)
+ * @id: what rds_soft_add_oda() returned
+ */
+int
+rds_soft_remove_oda(struct rds_encoder *enc, int id)
+{
+	struct soft_encoder *soft = enc->priv;
+
+	if(enc->type != RDS_ENCODER_TYPE_SOFT || !soft)
+		return -EINVAL;
+
+	if(id < 0 || id >= SOFT_ODA_MAX)
+		return -EINVAL;
+
+	pthread_mutex_lock(&soft->lock);
+	soft->oda_used &= ~(1 << id);
+	soft_sched_rebuild(soft);
+	pthread_mutex_unlock(&soft->lock);
+
+	return 0;
+}
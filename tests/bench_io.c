@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * bench_io.c -	Cost per command of the poll() and io_uring transports
+ *
+ * Runs the same set commands against a UECP encoder simulated on a
+ * pty pair, once per transport, and prints the calling thread's CPU
+ * time and context switches per command. For the syscalls per
+ * command, run it under strace -f -c.
+ */
+
+#define _GNU_SOURCE	/* For RUSAGE_THREAD */
+#include <stdint.h>	/* For sized integers */
+#include <stdio.h>	/* For printf() */
+#include <stdlib.h>	/* For atoi() */
+#include <unistd.h>	/* For read() */
+#include <pty.h>	/* For openpty() */
+#include <termios.h>	/* For cfmakeraw() */
+#include <pthread.h>	/* For pthread_create() */
+#include <sys/resource.h>	/* For getrusage() */
+#include <time.h>	/* For clock_gettime() */
+#include "rds.h"
+
+#define BENCH_CMDS_DEFAULT	2000
+
+struct bench_result {
+	double wall_us;
+	double cpu_us;
+	double csw;
+};
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+/**
+ * bench_sink_fn - Drain the pty's master side, so writes never block
+ * @arg: the master's fd
+ */
+static void *
+bench_sink_fn(void *arg)
+{
+	int fd = *(int *) arg;
+	uint8_t buf[4096];
+
+	while(read(fd, buf, sizeof(buf)) > 0);
+
+	return NULL;
+}
+
+static double
+bench_tv_us(const struct timeval *tv)
+{
+	return tv->tv_sec * 1e6 + tv->tv_usec;
+}
+
+/**
+ * bench_run - Run the commands on one transport
+ * @port: the pty's slave side
+ * @uring: use io_uring
+ * @cmds: how many commands
+ * @res: the &struct bench_result to fill (per command)
+ */
+static int
+bench_run(const char *port, uint8_t uring, int cmds,
+			struct bench_result *res)
+{
+	struct rds_encoder *enc = NULL;
+	struct rusage ru0, ru1;
+	struct timespec t0, t1;
+	char ps[RDS_PS_LEN + 1];
+	int ret = 0;
+	int i = 0;
+
+	enc = rds_init(RDS_ENCODER_TYPE_UECP, 0, 1,
+				(const unsigned char *) port);
+	if(!enc)
+		return -1;
+
+	if(uring && rds_set_io_uring(enc, 1) < 0) {
+		rds_exit(enc);
+		return -1;
+	}
+
+	getrusage(RUSAGE_THREAD, &ru0);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	/* Different text each time, so that nothing gets skipped */
+	for(i = 0; i < cmds && ret >= 0; i++) {
+		snprintf(ps, sizeof(ps), "PS%06d", i % 1000000);
+		ret = rds_set_ps(enc, 0, 0, ps);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	getrusage(RUSAGE_THREAD, &ru1);
+
+	rds_exit(enc);
+	if(ret < 0)
+		return ret;
+
+	res->wall_us = ((t1.tv_sec - t0.tv_sec) * 1e6 +
+			(t1.tv_nsec - t0.tv_nsec) / 1e3) / cmds;
+	res->cpu_us = (bench_tv_us(&ru1.ru_utime) - bench_tv_us(&ru0.ru_utime) +
+			bench_tv_us(&ru1.ru_stime) - bench_tv_us(&ru0.ru_stime)) /
+			cmds;
+	res->csw = (double) (ru1.ru_nvcsw - ru0.ru_nvcsw +
+			ru1.ru_nivcsw - ru0.ru_nivcsw) / cmds;
+
+	return 0;
+}
+
+
+/*************\
+* ENTRY POINT *
+\*************/
+
+int
+main(int argc, char *argv[])
+{
+	struct bench_result res;
+	struct termios tio;
+	pthread_t sink;
+	char port[64];
+	int master = 0;
+	int slave = 0;
+	int cmds = BENCH_CMDS_DEFAULT;
+	int i = 0;
+
+	if(argc > 1)
+		cmds = atoi(argv[1]);
+	if(cmds <= 0)
+		cmds = BENCH_CMDS_DEFAULT;
+
+	if(openpty(&master, &slave, port, NULL, NULL) < 0) {
+		perror("openpty");
+		return 1;
+	}
+	cfmakeraw(&tio);
+	tcsetattr(slave, TCSANOW, &tio);
+	pthread_create(&sink, NULL, bench_sink_fn, &master);
+
+	printf("%d UECP set PS commands per transport\n", cmds);
+	printf("%-10s %12s %12s %12s\n", "transport", "wall us/cmd",
+					"cpu us/cmd", "csw/cmd");
+
+	for(i = 0; i < 2; i++) {
+		if(bench_run(port, i, cmds, &res) < 0) {
+			printf("%-10s %12s\n", i ? "io_uring" : "poll",
+							"unavailable");
+			continue;
+		}
+		printf("%-10s %12.1f %12.1f %12.2f\n", i ? "io_uring" : "poll",
+				res.wall_us, res.cpu_us, res.csw);
+	}
+
+	return 0;
+}
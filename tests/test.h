@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * test.h -	Helpers shared by the tests, each test is its own program
+ */
+
+#include <stdio.h>	/* For fprintf() */
+
+static int test_failures;
+
+/* Report a failed check and go on with the rest */
+#define TEST_CHECK(_cond) do {						\
+	if(!(_cond)) {							\
+		fprintf(stderr, "%s:%d: check failed: %s\n",		\
+					__FILE__, __LINE__, #_cond);	\
+		test_failures++;					\
+	}								\
+} while(0)
+
+/* Return value of main() */
+#define TEST_RESULT()	(test_failures ? 1 : 0)
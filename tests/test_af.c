@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * test_af.c -	AF code / list encoding (methods A and B)
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <string.h>	/* For memset() / memcmp() */
+#include "rds.h"
+#include "rds_af.h"
+#include "test.h"
+
+
+/*******\
+* TESTS *
+\*******/
+
+static void
+test_codes(void)
+{
+	uint8_t lfmf = 0;
+
+	/* FM, 100KHz steps from 87.6MHz */
+	TEST_CHECK(rds_af_code(87600, &lfmf) == 1 && !lfmf);
+	TEST_CHECK(rds_af_code(89000, &lfmf) == 15 && !lfmf);
+	TEST_CHECK(rds_af_code(107900, &lfmf) == 204 && !lfmf);
+	TEST_CHECK(rds_af_code(95050, &lfmf) == -EINVAL);
+
+	/* LF / MF, 9KHz steps */
+	TEST_CHECK(rds_af_code(153, &lfmf) == 1 && lfmf);
+	TEST_CHECK(rds_af_code(279, &lfmf) == 15 && lfmf);
+	TEST_CHECK(rds_af_code(531, &lfmf) == 16 && lfmf);
+	TEST_CHECK(rds_af_code(1008, &lfmf) == 69 && lfmf);
+	TEST_CHECK(rds_af_code(1602, &lfmf) == 135 && lfmf);
+	TEST_CHECK(rds_af_code(1000, &lfmf) == -EINVAL);
+
+	TEST_CHECK(rds_af_code(87500, &lfmf) == -EINVAL);
+	TEST_CHECK(rds_af_code(108000, &lfmf) == -EINVAL);
+}
+
+static void
+test_method_a(void)
+{
+	struct rds_af_list list;
+	uint8_t codes[RDS_AF_CODES_MAX];
+	/* Count, FM, FM, LF/MF + MF, filler */
+	const uint8_t expected[] = { RDS_AF_CODE_COUNT + 3, 15, 137,
+				RDS_AF_CODE_LFMF, 69, RDS_AF_CODE_FILLER };
+
+	memset(&list, 0, sizeof(struct rds_af_list));
+	list.num = 3;
+	list.khz[0] = 89000;
+	list.khz[1] = 101200;
+	list.khz[2] = 1008;
+
+	TEST_CHECK(rds_af_encode(RDS_AF_METHOD_A, &list, codes) ==
+							sizeof(expected));
+	TEST_CHECK(!memcmp(codes, expected, sizeof(expected)));
+
+	/* Even length, no filler */
+	list.num = 1;
+	TEST_CHECK(rds_af_encode(RDS_AF_METHOD_A, &list, codes) == 2);
+	TEST_CHECK(codes[0] == RDS_AF_CODE_COUNT + 1 && codes[1] == 15);
+
+	/* No duplicates */
+	list.num = 2;
+	list.khz[1] = 89000;
+	TEST_CHECK(rds_af_encode(RDS_AF_METHOD_A, &list, codes) == -EINVAL);
+}
+
+static void
+test_method_b(void)
+{
+	struct rds_af_list list;
+	uint8_t codes[RDS_AF_CODES_MAX];
+	/* Count (tuned + 2 per pair), tuned, then pairs: ascending
+	 * for the same programme, descending for a regional one */
+	const uint8_t expected[] = { RDS_AF_CODE_COUNT + 5, 15,
+					15, 137,
+					15, 5 };
+
+	memset(&list, 0, sizeof(struct rds_af_list));
+	list.tuned_khz = 89000;
+	list.num = 2;
+	list.khz[0] = 101200;
+	list.khz[1] = 88000;
+	list.regional = 1 << 1;
+
+	TEST_CHECK(rds_af_encode(RDS_AF_METHOD_B, &list, codes) ==
+							sizeof(expected));
+	TEST_CHECK(!memcmp(codes, expected, sizeof(expected)));
+
+	/* Regional with a higher AF goes descending too */
+	list.regional = 1 << 0;
+	TEST_CHECK(rds_af_encode(RDS_AF_METHOD_B, &list, codes) ==
+							sizeof(expected));
+	TEST_CHECK(codes[2] == 137 && codes[3] == 15);
+	TEST_CHECK(codes[4] == 5 && codes[5] == 15);
+
+	/* No LF / MF on method B */
+	list.khz[1] = 1008;
+	TEST_CHECK(rds_af_encode(RDS_AF_METHOD_B, &list, codes) == -EINVAL);
+
+	list.khz[1] = 88000;
+	list.tuned_khz = 1008;
+	TEST_CHECK(rds_af_encode(RDS_AF_METHOD_B, &list, codes) == -EINVAL);
+
+	list.tuned_khz = 89000;
+	list.num = RDS_AF_METHOD_B_LIST_MAX + 1;
+	TEST_CHECK(rds_af_encode(RDS_AF_METHOD_B, &list, codes) == -EINVAL);
+}
+
+
+/*************\
+* ENTRY POINT *
+\*************/
+
+int
+main(void)
+{
+	test_codes();
+	test_method_a();
+	test_method_b();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * test_queue.c -	Coalescing rules of &struct rds_queue
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <string.h>	/* For memset() / memcmp() / strncpy() */
+#include <poll.h>	/* For poll() */
+#include "rds.h"
+#include "rds_thread.h"
+#include "rds_queue.h"
+#include "test.h"
+
+#define TEST_DONE_MAX	16
+
+/* What came out of the queue, in order */
+struct test_done {
+	struct rds_cmd cmd;
+	uint64_t waiters;
+};
+
+static struct test_done done[TEST_DONE_MAX];
+static int num_done;
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+static void
+test_done_cb(struct rds_queue *queue, const struct rds_cmd *cmd, int ret,
+					uint64_t waiters, void *arg)
+{
+	if(num_done == TEST_DONE_MAX)
+		return;
+
+	done[num_done].cmd = *cmd;
+	done[num_done].waiters = waiters;
+	num_done++;
+}
+
+static int
+test_push_ps(struct rds_queue *queue, uint8_t psn, const char *ps,
+							int waiter)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_PS, 0, psn);
+	strncpy(cmd.arg.ps, ps, RDS_PS_LEN);
+
+	return rds_queue_push(queue, &cmd, 1ULL << waiter);
+}
+
+static int
+test_push_af(struct rds_queue *queue, uint8_t op, uint32_t khz, int waiter)
+{
+	struct rds_cmd cmd;
+
+	rds_cmd_init(&cmd, RDS_CMD_SET_AF, 0, 0);
+	cmd.arg.af.method = RDS_AF_METHOD_A;
+	cmd.arg.af.op = op;
+	cmd.arg.af.list.num = 1;
+	cmd.arg.af.list.khz[0] = khz;
+
+	return rds_queue_push(queue, &cmd, 1ULL << waiter);
+}
+
+/**
+ * test_drain - Run the event loop until the queue is empty
+ * @queue: the &struct rds_queue
+ */
+static void
+test_drain(struct rds_queue *queue)
+{
+	struct pollfd pfd;
+
+	memset(&pfd, 0, sizeof(struct pollfd));
+	pfd.fd = rds_queue_get_fd(queue);
+	pfd.events = POLLIN;
+
+	while(queue->busy || queue->len) {
+		if(poll(&pfd, 1, 1000) <= 0)
+			break;
+		rds_queue_complete(queue);
+	}
+}
+
+static void
+test_check_ps(int i, const char *ps, uint64_t waiters)
+{
+	TEST_CHECK(i < num_done);
+	if(i >= num_done)
+		return;
+
+	TEST_CHECK(done[i].cmd.op == RDS_CMD_SET_PS);
+	TEST_CHECK(!memcmp(done[i].cmd.arg.ps, ps, strlen(ps)));
+	TEST_CHECK(done[i].waiters == waiters);
+}
+
+
+/*************\
+* ENTRY POINT *
+\*************/
+
+int
+main(void)
+{
+	struct rds_encoder *enc = NULL;
+	struct rds_queue *queue = NULL;
+	struct rds_queue_stats stats;
+	struct rds_cmd cmd;
+
+	enc = rds_init(RDS_ENCODER_TYPE_SOFT, 0, 0, NULL);
+	TEST_CHECK(enc != NULL);
+	if(!enc)
+		return TEST_RESULT();
+
+	queue = rds_queue_create(enc);
+	TEST_CHECK(queue != NULL);
+	if(!queue) {
+		rds_exit(enc);
+		return TEST_RESULT();
+	}
+	queue->done_cb = test_done_cb;
+
+	/* Goes to the encoder, the rest wait until we complete it */
+	TEST_CHECK(test_push_ps(queue, 0, "FIRST", 0) == 0);
+	TEST_CHECK(queue->busy && queue->len == 0);
+
+	/* The second one gets replaced by the third */
+	TEST_CHECK(test_push_ps(queue, 0, "SECOND", 1) == 0);
+	TEST_CHECK(test_push_ps(queue, 0, "THIRD", 2) == 0);
+	TEST_CHECK(queue->len == 1);
+
+	/* Another service is another field */
+	TEST_CHECK(test_push_ps(queue, 1, "OTHER", 3) == 0);
+	TEST_CHECK(queue->len == 2);
+
+	/* Nothing gets merged across a data set switch */
+	rds_cmd_init(&cmd, RDS_CMD_SET_DSN, 0, 0);
+	cmd.arg.val = 1;
+	TEST_CHECK(rds_queue_push(queue, &cmd, 1ULL << 4) == 0);
+	TEST_CHECK(test_push_ps(queue, 0, "AFTER", 5) == 0);
+	TEST_CHECK(queue->len == 4);
+
+	/* ...but after it, it's business as usual */
+	TEST_CHECK(test_push_ps(queue, 0, "LATEST", 6) == 0);
+	TEST_CHECK(queue->len == 4);
+
+	/* An AF list set doesn't replace one with an add after it */
+	TEST_CHECK(test_push_af(queue, RDS_AF_OP_SET, 89000, 7) == 0);
+	TEST_CHECK(test_push_af(queue, RDS_AF_OP_ADD, 95000, 8) == 0);
+	TEST_CHECK(test_push_af(queue, RDS_AF_OP_SET, 101200, 9) == 0);
+	TEST_CHECK(queue->len == 7);
+
+	TEST_CHECK(rds_queue_get_stats(queue, &stats) == 0);
+	TEST_CHECK(stats.coalesced == 2);
+
+	test_drain(queue);
+	TEST_CHECK(num_done == 8);
+
+	test_check_ps(0, "FIRST", 1ULL << 0);
+	test_check_ps(1, "THIRD", (1ULL << 1) | (1ULL << 2));
+	test_check_ps(2, "OTHER", 1ULL << 3);
+	TEST_CHECK(num_done > 3 && done[3].cmd.op == RDS_CMD_SET_DSN);
+	test_check_ps(4, "LATEST", (1ULL << 5) | (1ULL << 6));
+	TEST_CHECK(num_done > 7 && done[7].cmd.arg.af.op == RDS_AF_OP_SET &&
+					done[7].cmd.arg.af.list.khz[0] == 101200);
+
+	rds_queue_destroy(queue);
+	rds_exit(enc);
+
+	return TEST_RESULT();
+}
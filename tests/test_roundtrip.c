@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * test_roundtrip.c -	Software encoder -> (modulator -> demodulator) ->
+ *			decoder, the decoder must get back what we set
+ */
+
+#include <stdint.h>	/* For sized integers */
+#include <stdlib.h>	/* For malloc/free */
+#include <string.h>	/* For memset() / memcmp() / strlen() */
+#include <math.h>	/* For sin() */
+#include "rds.h"
+#include "rds_block.h"
+#include "rds_dec.h"
+#include "rds_mod.h"
+#include "rds_demod.h"
+#include "test.h"
+
+#define TEST_PS		"UOC RADI"
+#define TEST_RT		"Hello from the round trip test"
+#define TEST_PTYN	"STUDENTS"
+#define TEST_PI_CCODE	0x01E1
+#define TEST_PTY	10
+
+/* Enough for RT and CT to go out a few times */
+#define TEST_GROUPS	1200
+#define TEST_MOD_RATE	228000
+#define TEST_MOD_SECS	12
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+/**
+ * test_encoder - Create a software encoder with the test's parameters
+ */
+static struct rds_encoder *
+test_encoder(void)
+{
+	struct rds_encoder *enc = NULL;
+	struct rds_pi pi = { TEST_PI_CCODE, 0x2, 0x34 };
+	struct rds_rt rt;
+	struct rds_rtc rtc = { 2026, 10, 18, 20, 15, 0, 0, 4 };
+
+	enc = rds_init(RDS_ENCODER_TYPE_SOFT, 0, 0, NULL);
+	if(!enc)
+		return NULL;
+
+	memset(&rt, 0, sizeof(struct rds_rt));
+	strcpy((char *) rt.msg, TEST_RT);
+
+	TEST_CHECK(rds_set_pi(enc, 0, 0, &pi) == 0);
+	TEST_CHECK(rds_set_ps(enc, 0, 0, TEST_PS) == 0);
+	TEST_CHECK(rds_set_rt(enc, 0, 0, &rt) == 0);
+	TEST_CHECK(rds_set_pty(enc, 0, 0, TEST_PTY) == 0);
+	TEST_CHECK(rds_set_ptyn(enc, 0, 0, TEST_PTYN) == 0);
+	TEST_CHECK(rds_set_ta_tp(enc, 0, 0, RDS_TATP_TP_ON) == 0);
+	TEST_CHECK(rds_set_rtc(enc, &rtc) == 0);
+	TEST_CHECK(rds_set_ct(enc, 1) == 0);
+	TEST_CHECK(rds_set_rds_on(enc, 1) == 0);
+
+	return enc;
+}
+
+/**
+ * test_check_state - Compare what the decoder got with what we set
+ * @state: the decoded &struct rds_state
+ */
+static void
+test_check_state(const struct rds_state *state)
+{
+	TEST_CHECK(state->valid & RDS_STATE_PI);
+	TEST_CHECK(state->pi.ccode == TEST_PI_CCODE);
+	TEST_CHECK(state->pi.prn == 0x34);
+
+	TEST_CHECK(state->valid & RDS_STATE_PS);
+	TEST_CHECK(!memcmp(state->ps, TEST_PS, RDS_PS_LEN));
+
+	TEST_CHECK(state->valid & RDS_STATE_RT);
+	TEST_CHECK(!memcmp(state->rt.msg, TEST_RT, strlen(TEST_RT)));
+
+	TEST_CHECK(state->valid & RDS_STATE_PTY);
+	TEST_CHECK(state->pty == TEST_PTY);
+
+	TEST_CHECK(state->valid & RDS_STATE_PTYN);
+	TEST_CHECK(!memcmp(state->ptyn, TEST_PTYN, RDS_PTYN_LEN));
+
+	TEST_CHECK(state->valid & RDS_STATE_TA_TP);
+	TEST_CHECK(state->ta_tp & RDS_TATP_TP_ON);
+}
+
+
+/*******\
+* TESTS *
+\*******/
+
+/**
+ * test_blocks - Encoder blocks straight to the decoder, with burst
+ *		errors on some of them that it must correct
+ */
+static void
+test_blocks(void)
+{
+	struct rds_encoder *enc = NULL;
+	struct rds_dec *dec = NULL;
+	struct rds_dec_stats stats;
+	struct rds_state state;
+	struct rds_rtc rtc;
+	uint32_t *blocks = NULL;
+	int num_blocks = TEST_GROUPS * RDS_GROUP_BLOCKS;
+	int i = 0;
+
+	enc = test_encoder();
+	dec = rds_dec_create();
+	blocks = malloc(num_blocks * sizeof(uint32_t));
+	TEST_CHECK(enc && dec && blocks);
+	if(!enc || !dec || !blocks)
+		goto out;
+
+	TEST_CHECK(rds_soft_get_groups(enc, blocks, TEST_GROUPS) ==
+							TEST_GROUPS);
+
+	/* A burst of up to 5 bits every 11 blocks, at a different
+	 * place each time */
+	for(i = 0; i < num_blocks; i += 11)
+		blocks[i] ^= (0x11 | (i % 16)) << (i % 21);
+
+	TEST_CHECK(rds_dec_push_blocks(dec, blocks, num_blocks) >= 0);
+
+	memset(&state, 0, sizeof(struct rds_state));
+	TEST_CHECK(rds_dec_get_state(dec, &state) == 0);
+	test_check_state(&state);
+
+	TEST_CHECK(rds_dec_get_rtc(dec, &rtc) == 0);
+	TEST_CHECK(rtc.year == 2026 && rtc.month == 10 && rtc.day == 18);
+	TEST_CHECK(rtc.hours == 20);
+
+	TEST_CHECK(rds_dec_get_stats(dec, &stats) == 0);
+	TEST_CHECK(stats.corrected > 0);
+	TEST_CHECK(stats.errors == 0);
+	TEST_CHECK(stats.sync_losses == 0);
+
+ out:
+	free(blocks);
+	if(dec)
+		rds_dec_destroy(dec);
+	if(enc)
+		rds_exit(enc);
+}
+
+/**
+ * test_modem - Through the modulator and the demodulator, mixed with
+ *		some audio and noise as it would be on the MPX signal
+ */
+static void
+test_modem(void)
+{
+	struct rds_encoder *enc = NULL;
+	struct rds_mod *mod = NULL;
+	struct rds_demod *demod = NULL;
+	struct rds_state state;
+	float *buf = NULL;
+	int num_samples = TEST_MOD_RATE * TEST_MOD_SECS;
+	uint32_t seed = 1;
+	int i = 0;
+
+	enc = test_encoder();
+	if(enc)
+		mod = rds_mod_create(enc, TEST_MOD_RATE, RDS_MOD_FMT_FLOAT);
+	demod = rds_demod_create(TEST_MOD_RATE, RDS_DEMOD_FMT_FLOAT);
+	buf = malloc(num_samples * sizeof(float));
+	TEST_CHECK(enc && mod && demod && buf);
+	if(!enc || !mod || !demod || !buf)
+		goto out;
+
+	TEST_CHECK(rds_mod_set_levels(mod, 0.05, 0.09) == 0);
+	TEST_CHECK(rds_mod_run(mod, buf, num_samples) == num_samples);
+
+	/* A 1KHz tone on the mono part and some white noise */
+	for(i = 0; i < num_samples; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] += 0.4 * sin(2 * M_PI * 1000 * i / TEST_MOD_RATE) +
+				0.02 * ((int32_t) seed / 2147483648.0);
+	}
+
+	TEST_CHECK(rds_demod_run(demod, buf, num_samples) >= 0);
+
+	memset(&state, 0, sizeof(struct rds_state));
+	TEST_CHECK(rds_demod_get_state(demod, &state) == 0);
+	test_check_state(&state);
+
+ out:
+	free(buf);
+	if(demod)
+		rds_demod_destroy(demod);
+	if(mod)
+		rds_mod_destroy(mod);
+	if(enc)
+		rds_exit(enc);
+}
+
+
+/*************\
+* ENTRY POINT *
+\*************/
+
+int
+main(void)
+{
+	test_blocks();
+	test_modem();
+
+	return TEST_RESULT();
+}
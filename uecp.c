@@ -35,6 +35,12 @@
 #include <arpa/inet.h> 	/* For ntohs */
 #include "rds.h"
 #include "uecp.h"
+#include "rds_fcache.h"
+#include "rds_charset.h"
+#include "rds_block.h"
+#include "rds_rtplus.h"
+#include "rds_af.h"
+#include "rds_eon.h"
 
 
 /******************\
@@ -46,8 +52,8 @@
  * @data: the buffer containing the data frame
  * @len: the buffer's length
  */
-static uint16_t
-uecp_crc16_ccitt(unsigned char* data, uint8_t len)
+uint16_t
+uecp_crc16_ccitt(const unsigned char* data, int len)
 {
 	int i = 0;
 	uint16_t crc = 0xFFFF;
@@ -69,7 +75,7 @@ uecp_crc16_ccitt(unsigned char* data, uint8_t len)
  * 			to a specific Data Set / Programme number
  * @mec: The Message Element Code to check
  */
-static int
+int
 uecp_is_global_mec(uint8_t mec)
 {
 	switch(mec) {
@@ -80,6 +86,8 @@ uecp_is_global_mec(uint8_t mec)
 	case UECP_MEC_SET_SITE_ADDR:
 	case UECP_MEC_SET_ENC_ADDR:
 	case UECP_MEC_SET_COMM_MODE:
+	case UECP_MEC_ODA_CONF:
+	case UECP_MEC_ODA_FREE:
 		return 1;
 	default:
 		return 0;
@@ -124,8 +132,10 @@ uecp_data_frame_to_buf(struct uecp_data_frame *data,
 		msg_fields = 1; /* mec only */
 
 	/* Should we add mel_len ? */
-	if(msg->mel_len != UECP_MSG_MEL_NA)
+	if(msg->mel_len != UECP_MSG_MEL_NA) {
 		buf[len++] = msg->mel_len;
+		msg_fields++;
+	}
 
 	/* Add message data */
 	for(i = 0; i < data->msg_len - msg_fields; i++)
@@ -144,19 +154,60 @@ finalize:
 	return len;
 }
 
+/**
+ * uecp_stuff - Byte-stuff a serialized data frame and add start / stop
+ * @buf: the data frame, as written by uecp_data_frame_to_buf()
+ * @len: its length
+ * @out: buffer to fill, at least 2 * @len + 2 bytes long
+ *
+ * Returns: the length of @out
+ */
+int
+uecp_stuff(const unsigned char *buf, int len, uint8_t *out)
+{
+	int out_len = 0;
+	int i = 0;
+
+	out[out_len++] = UECP_DF_START_BYTE;
+
+	/* Perform byte-stuffing on output */
+	for(i = 0; i < len && i < UECP_DF_MAX_LEN; i++) {
+
+		if(buf[i] == 0xFD) {
+			out[out_len++] = 0xFD;
+			out[out_len++] = 0x00;
+		} else if(buf[i] == 0xFE) {
+			out[out_len++] = 0xFD;
+			out[out_len++] = 0x01;
+		} else if(buf[i] == 0xFF) {
+			out[out_len++] = 0xFD;
+			out[out_len++] = 0x02;
+		} else
+			out[out_len++] = buf[i];
+	}
+
+	out[out_len++] = UECP_DF_STOP_BYTE;
+
+	return out_len;
+}
+
 /**
  * uecp_send_frame_to_enc - Send a UECP data frame to encoder
  * @enc: pointer to &struct rds_encoder
  * @data_frame: pointer to the &struct uecp_data_frame to send
+ * @key: the command's &struct rds_fcache_key, to cache the
+ *	serialized frame (NULL -> don't cache)
  */
 static int
 uecp_send_frame_to_enc(struct rds_encoder *enc,
-			struct uecp_data_frame *data_frame)
+			struct uecp_data_frame *data_frame,
+			const struct rds_fcache_key *key)
 {
 	int ret = 0;
-	int i = 0;
-	int fd = 0;
+	int len = 0;
 	unsigned char buf[UECP_DF_MAX_LEN];
+	/* Worst case every byte gets stuffed */
+	uint8_t out[2 * UECP_DF_MAX_LEN];
 
 	data_frame->addr = enc->addr;
 	data_frame->seq = 0;
@@ -166,27 +217,74 @@ uecp_send_frame_to_enc(struct rds_encoder *enc,
 		return ret;
 
 
-	rds_send_byte(enc, UECP_DF_START_BYTE);
+	len = uecp_stuff(buf, ret, out);
 
-	/* Perform byte-stuffing on output */
-	for(i = 0; i < ret && i < UECP_DF_MAX_LEN; i++) {
+	if(key)
+		rds_fcache_store(enc, key, out, len);
 
-		if(buf[i] == 0xFD) {
-			rds_send_byte(enc, 0xFD);
-			rds_send_byte(enc, 0x00);
-		} else if(buf[i] == 0xFE) {
-			rds_send_byte(enc, 0xFD);
-			rds_send_byte(enc, 0x01);
-		} else if(buf[i] == 0xFF) {
-			rds_send_byte(enc, 0xFD);
-			rds_send_byte(enc, 0x02);
-		} else
-			rds_send_byte(enc, buf[i]);
-	}
+	/* Send the whole frame at once */
+	return rds_send_buf(enc, out, len);
+}
+
+/**
+ * uecp_send_msgs_to_enc - Send a UECP data frame with several messages
+ * @enc: pointer to &struct rds_encoder
+ * @msgs: the serialized messages, back to back
+ * @len: their total length (up to UECP_MSG_LEN_MAX)
+ * @key: the command's &struct rds_fcache_key, to cache the
+ *	serialized frame (NULL -> don't cache)
+ *
+ * The encoder gets them all at once, so they take effect together.
+ */
+static int
+uecp_send_msgs_to_enc(struct rds_encoder *enc, const uint8_t *msgs, int len,
+					const struct rds_fcache_key *key)
+{
+	unsigned char buf[UECP_DF_MAX_LEN];
+	uint8_t out[2 * UECP_DF_MAX_LEN];
+	uint16_t crc = 0;
+	int buf_len = 0;
+	int out_len = 0;
+
+	if(len > UECP_MSG_LEN_MAX)
+		return -EMSGSIZE;
+
+	buf[buf_len++] = (enc->addr & 0xFF00) >> 8;
+	buf[buf_len++] = (enc->addr & 0xFF);
+	buf[buf_len++] = UECP_DF_SEQ_DISABLED;
+	buf[buf_len++] = len;
+	memcpy(buf + buf_len, msgs, len);
+	buf_len += len;
+
+	crc = uecp_crc16_ccitt(buf, buf_len);
+	buf[buf_len++] = (crc & 0xFF00) >> 8;
+	buf[buf_len++] = (crc & 0xFF);
+
+	out_len = uecp_stuff(buf, buf_len, out);
+
+	if(key)
+		rds_fcache_store(enc, key, out, out_len);
+
+	return rds_send_buf(enc, out, out_len);
+}
+
+/**
+ * uecp_send_cached - Send the cached frame of a command, if we have it
+ * @enc: pointer to &struct rds_encoder
+ * @key: the command's &struct rds_fcache_key
+ *
+ * Returns: -ENOENT on a cache miss, else what rds_send_buf() returns
+ */
+static int
+uecp_send_cached(struct rds_encoder *enc, const struct rds_fcache_key *key)
+{
+	struct rds_fcache_entry *entry = NULL;
 
-	rds_send_byte(enc, UECP_DF_STOP_BYTE);
+	entry = rds_fcache_lookup(enc, key);
+	if(!entry)
+		return -ENOENT;
 
-	return ret;
+	return rds_send_buf(enc, entry->frame, entry->len);
 }
 
 
@@ -231,14 +329,23 @@ uecp_set_pi(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, struct rds_pi *pi
 {
 	struct uecp_data_frame data_frame;
 	struct uecp_message *msg = &data_frame.msg;
+	struct rds_fcache_key key;
+	int ret = 0;
 	uint16_t pi_val = 0;
 
-	memset(&data_frame, 0, sizeof(struct uecp_data_frame));
-
 	pi_val |= pi->prn & 0xFF;
 	pi_val |= (pi->coverage & 0xF) << 8;
 	pi_val |= (pi->ccode & 0x0F00) << 4;
 
+	/* Same thing sent before ? */
+	rds_fcache_key_init(&key, enc, UECP_MEC_PI, dsn, psn,
+						&pi_val, sizeof(pi_val));
+	ret = uecp_send_cached(enc, &key);
+	if(ret != -ENOENT)
+		return ret < 0 ? ret : 0;
+
+	memset(&data_frame, 0, sizeof(struct uecp_data_frame));
+
 	msg->mec = UECP_MEC_PI;
 	msg->dsn = dsn;
 	msg->psn = psn;
@@ -249,9 +356,9 @@ uecp_set_pi(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, struct rds_pi *pi
 	/* Don't include mel_len */
 	data_frame.msg_len = 3 + 2;
 
-	uecp_send_frame_to_enc(enc, &data_frame);
+	ret = uecp_send_frame_to_enc(enc, &data_frame, &key);
 
-	return 0;
+	return ret < 0 ? ret : 0;
 }
 
 
@@ -267,8 +374,17 @@ uecp_set_ps(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, char* ps)
 {
 	struct uecp_data_frame data_frame;
 	struct uecp_message *msg = &data_frame.msg;
+	struct rds_fcache_key key;
+	int ret = 0;
 	int i = 0;
 
+	/* Same thing sent before ? */
+	rds_fcache_key_init(&key, enc, UECP_MEC_PS, dsn, psn,
+						ps, strnlen(ps, RDS_PS_LEN));
+	ret = uecp_send_cached(enc, &key);
+	if(ret != -ENOENT)
+		return ret < 0 ? ret : 0;
+
 	memset(&data_frame, 0, sizeof(struct uecp_data_frame));
 
 	msg->mec = UECP_MEC_PS;
@@ -282,8 +398,8 @@ uecp_set_ps(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, char* ps)
 		if(ps[i] == '\0')
 			break;
 
-		/* Non-ASCII character */
-		else if (ps[i] < 0x20 || ps[i] > 0x7E)
+		/* Control code */
+		else if (!RDS_G0_PRINTABLE(ps[i]))
 			msg->mel_data[i] = ' ';
 		else
 			msg->mel_data[i] = ps[i];
@@ -299,25 +415,386 @@ uecp_set_ps(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, char* ps)
 	/* Don't include mel_len */
 	data_frame.msg_len = 3 + 8;
 
-	uecp_send_frame_to_enc(enc, &data_frame);
+	ret = uecp_send_frame_to_enc(enc, &data_frame, &key);
 
-	return 0;
+	return ret < 0 ? ret : 0;
 }
 
 
+/**
+ * uecp_put_rt - Write out the data of an RT message element
+ * @out: buffer to fill, RDS_RT_MSG_LEN_MAX bytes long
+ * @rt: the &struct rds_rt to send
+ *
+ * Returns: the number of bytes written (the MEL)
+ */
+static int
+uecp_put_rt(uint8_t *out, const struct rds_rt *rt)
+{
+	int i = 0;
+
+	out[0] = (rt->ab_flag & RDS_RT_METHOD_B) ? 1 : 0;
+	out[0] |= (rt->retransmissions & 0xF) << 1;
+	out[0] |= (rt->buffer_config & 0x3) << 5;
+
+	/* The RT message can be empty, in this case
+	 * mel_len will be 1 and bufer_config should be
+	 * RDS_RT_BUFF_CONFIG_FLUSH */
+	for(i = 0; i < RDS_RT_MSG_LEN_MAX - 1; i++) {
+		/* Reached NULL */
+		if(rt->msg[i] == '\0')
+			break;
+
+		/* Control code */
+		else if (!RDS_G0_PRINTABLE(rt->msg[i]))
+			out[1 + i] = ' ';
+		else
+			out[1 + i] = rt->msg[i];
+	}
+
+	return 1 + i;
+}
+
+/**
+ * uecp_rt_key - Fill the frame cache key data of an RT message
+ * @key: buffer to fill, 1 + RDS_RT_MSG_LEN_MAX bytes long
+ * @rt: the &struct rds_rt
+ *
+ * Returns: the key's length
+ */
+static int
+uecp_rt_key(uint8_t *key, const struct rds_rt *rt)
+{
+	int rt_len = strnlen((char *) rt->msg, RDS_RT_MSG_LEN_MAX - 1);
+
+	key[0] = rt->ab_flag | (rt->retransmissions << 2) |
+					(rt->buffer_config << 6);
+	memcpy(key + 1, rt->msg, rt_len);
+
+	return rt_len + 1;
+}
+
+/**
+ * uecp_set_rtplus - Set RadioText and its RT+ tags through UECP
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @rtplus: the &struct rds_rtplus to send, the item toggle
+ *	bit is returned here
+ *
+ * The RT message, the RT+ ODA configuration and the 11A group
+ * go on the same frame, so the encoder switches text and tags
+ * together. We only know the previous tags of the main service
+ * (from the shadow state), for the rest the caller's item toggle
+ * bit goes out as is.
+ */
+static int
+uecp_set_rtplus(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+						struct rds_rtplus *rtplus)
+{
+	struct rds_fcache_key key;
+	struct rds_rtplus prev;
+	uint8_t key_data[1 + RDS_RT_MSG_LEN_MAX + 2 + sizeof(rtplus->tags)];
+	uint8_t msgs[UECP_MSG_LEN_MAX];
+	uint16_t info[RDS_GROUP_BLOCKS];
+	int key_len = 0;
+	int len = 0;
+	int ret = 0;
+
+	/* New item ? */
+	if(dsn == 0 && psn == 0 && (enc->state.valid & RDS_STATE_RTPLUS)) {
+		prev.rt = enc->state.rt;
+		memcpy(prev.tags, enc->state.rtplus_tags, sizeof(prev.tags));
+		rtplus->toggle = enc->state.rtplus_toggle;
+		if(!rds_rtplus_same_item(rtplus, &prev))
+			rtplus->toggle ^= 1;
+	}
+
+	/* Same thing sent before ? */
+	key_len = uecp_rt_key(key_data, &rtplus->rt);
+	key_data[key_len++] = rtplus->running;
+	key_data[key_len++] = rtplus->toggle;
+	memcpy(key_data + key_len, rtplus->tags, sizeof(rtplus->tags));
+	key_len += sizeof(rtplus->tags);
+	rds_fcache_key_init(&key, enc, UECP_MEC_ODA_FREE, dsn, psn,
+						key_data, key_len);
+	ret = uecp_send_cached(enc, &key);
+	if(ret != -ENOENT)
+		return (ret < 0) ? ret : 0;
+
+	/* RadioText */
+	msgs[len++] = UECP_MEC_RT;
+	msgs[len++] = dsn;
+	msgs[len++] = psn;
+	ret = uecp_put_rt(msgs + len + 1, &rtplus->rt);
+	msgs[len++] = ret;
+	len += ret;
+
+	/* RT+ ODA configuration, so that the encoder announces
+	 * it on 3A even if it lost its config meanwhile */
+	msgs[len++] = UECP_MEC_ODA_CONF;
+	msgs[len++] = (RDS_RTPLUS_AID & 0xFF00) >> 8;
+	msgs[len++] = RDS_RTPLUS_AID & 0xFF;
+	msgs[len++] = RDS_RTPLUS_GROUP;
+	msgs[len++] = (RDS_RTPLUS_ODA_MSG & 0xFF00) >> 8;
+	msgs[len++] = RDS_RTPLUS_ODA_MSG & 0xFF;
+
+	/* The 11A group with the tags */
+	memset(info, 0, sizeof(info));
+	rds_rtplus_encode(rtplus, info);
+	msgs[len++] = UECP_MEC_ODA_FREE;
+	msgs[len++] = RDS_RTPLUS_GROUP;
+	msgs[len++] = UECP_ODA_FREE_CYCLIC;
+	msgs[len++] = info[1] & 0x1F;
+	msgs[len++] = (info[2] & 0xFF00) >> 8;
+	msgs[len++] = info[2] & 0xFF;
+	msgs[len++] = (info[3] & 0xFF00) >> 8;
+	msgs[len++] = info[3] & 0xFF;
+
+	ret = uecp_send_msgs_to_enc(enc, msgs, len, &key);
+
+	return (ret < 0) ? ret : 0;
+}
+
+/**
+ * uecp_set_af - Update an Alternative Frequencies list through UECP
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Programme Service Number
+ * @af: the change (see rds_af.h)
+ *
+ * Adding / removing a frequency only sends that entry, setting
+ * a list replaces it in one message (and goes through the frame
+ * cache, so setting it back costs no serialization).
+ */
+static int
+uecp_set_af(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+				const struct rds_af_wire *af)
+{
+	struct rds_fcache_key key;
+	struct rds_fcache_key *keyp = NULL;
+	uint8_t msgs[4 + 3 + RDS_AF_CODES_MAX];
+	uint8_t key_data[2 + RDS_AF_CODES_MAX];
+	const uint8_t *entries = NULL;
+	uint16_t loc = UECP_AF_LOC_METHOD_A;
+	int num = 0;
+	int len = 0;
+	int ret = 0;
+
+	if(af->method == RDS_AF_METHOD_B)
+		loc = (af->op == RDS_AF_OP_CLEAR && af->idx == RDS_AF_ALL) ?
+						UECP_AF_LOC_ALL : af->tuned;
+
+	switch(af->op) {
+	case RDS_AF_OP_ADD:
+	case RDS_AF_OP_DEL:
+		entries = af->delta;
+		num = af->delta_len;
+		break;
+	case RDS_AF_OP_SET:
+		/* Skip the count code (and the tuned frequency
+		 * on method B), and the filler */
+		entries = af->codes + (af->method == RDS_AF_METHOD_B ? 2 : 1);
+		num = af->len - (entries - af->codes);
+		if(num && entries[num - 1] == RDS_AF_CODE_FILLER)
+			num--;
+
+		/* Same thing sent before ? */
+		key_data[0] = (loc & 0xFF00) >> 8;
+		key_data[1] = loc & 0xFF;
+		memcpy(key_data + 2, af->codes, af->len);
+		rds_fcache_key_init(&key, enc, UECP_MEC_AF, dsn, psn,
+						key_data, 2 + af->len);
+		ret = uecp_send_cached(enc, &key);
+		if(ret != -ENOENT)
+			return (ret < 0) ? ret : 0;
+		keyp = &key;
+		break;
+	case RDS_AF_OP_CLEAR:
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	msgs[len++] = UECP_MEC_AF;
+	msgs[len++] = dsn;
+	msgs[len++] = psn;
+	msgs[len++] = 3 + num;
+	if(af->op == RDS_AF_OP_ADD)
+		msgs[len++] = UECP_AF_CONF_ADD;
+	else if(af->op == RDS_AF_OP_DEL)
+		msgs[len++] = UECP_AF_CONF_DEL;
+	else
+		msgs[len++] = UECP_AF_CONF_REPLACE;
+	msgs[len++] = (loc & 0xFF00) >> 8;
+	msgs[len++] = loc & 0xFF;
+	if(num)
+		memcpy(msgs + len, entries, num);
+	len += num;
+
+	ret = uecp_send_msgs_to_enc(enc, msgs, len, keyp);
+
+	return (ret < 0) ? ret : 0;
+}
+
+/**
+ * uecp_put_eon - Write out the changed fields of a linked service
+ * @out: buffer to fill, UECP_MSG_LEN_MAX bytes long
+ * @dsn: Data Segment Number
+ * @svc: the &struct rds_eon_service
+ *
+ * A newly linked service gets enabled after its data, so that it
+ * never goes on air half set.
+ *
+ * Returns: the number of bytes written
+ */
+static int
+uecp_put_eon(uint8_t *out, uint8_t dsn, const struct rds_eon_service *svc)
+{
+	int len = 0;
+
+	if(svc->dirty & RDS_EON_REMOVE) {
+		out[len++] = UECP_MEC_PSN_ENABLE;
+		out[len++] = dsn;
+		out[len++] = svc->psn;
+		out[len++] = UECP_PSN_DISABLE;
+		return len;
+	}
+
+	if(svc->dirty & RDS_EON_PI) {
+		out[len++] = UECP_MEC_PI;
+		out[len++] = dsn;
+		out[len++] = svc->psn;
+		out[len++] = (svc->pi & 0xFF00) >> 8;
+		out[len++] = svc->pi & 0xFF;
+	}
+
+	if(svc->dirty & RDS_EON_PS) {
+		out[len++] = UECP_MEC_PS;
+		out[len++] = dsn;
+		out[len++] = svc->psn;
+		memcpy(out + len, svc->ps, RDS_PS_LEN);
+		len += RDS_PS_LEN;
+	}
+
+	if(svc->dirty & RDS_EON_PTY) {
+		out[len++] = UECP_MEC_PTY;
+		out[len++] = dsn;
+		out[len++] = svc->psn;
+		out[len++] = svc->pty & 0x1F;
+	}
+
+	if(svc->dirty & RDS_EON_TA_TP) {
+		out[len++] = UECP_MEC_TA_TP;
+		out[len++] = dsn;
+		out[len++] = svc->psn;
+		/* Note: UECP_TATP_* flags match RDS_TATP_* flags */
+		out[len++] = svc->ta_tp & 0x3;
+	}
+
+	if(svc->dirty & RDS_EON_AF) {
+		out[len++] = UECP_MEC_AF;
+		out[len++] = dsn;
+		out[len++] = svc->psn;
+		out[len++] = 3 + svc->af_len;
+		out[len++] = UECP_AF_CONF_REPLACE;
+		out[len++] = 0;
+		out[len++] = svc->af_tuned;
+		memcpy(out + len, svc->af, svc->af_len);
+		len += svc->af_len;
+	}
+
+	if(svc->dirty & RDS_EON_DIRTY_ENABLE) {
+		out[len++] = UECP_MEC_PSN_ENABLE;
+		out[len++] = dsn;
+		out[len++] = svc->psn;
+		out[len++] = UECP_PSN_ENABLE;
+	}
+
+	return len;
+}
+
+/**
+ * uecp_set_eon - Push changes of other networks' services through UECP
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @svcs: the changed services (see rds_eon.h)
+ * @num: how many
+ *
+ * Changes of as many services as fit go on each frame, each
+ * service's changes on the same frame.
+ *
+ * Returns: the number of services sent or a negative error code
+ */
+static int
+uecp_set_eon(struct rds_encoder *enc, uint8_t dsn,
+		struct rds_eon_service *const *svcs, int num)
+{
+	uint8_t msgs[UECP_MSG_LEN_MAX];
+	uint8_t svc_msgs[UECP_MSG_LEN_MAX];
+	int svc_len = 0;
+	int sent = 0;
+	int len = 0;
+	int ret = 0;
+	int i = 0;
+
+	for(i = 0; i < num; i++) {
+		svc_len = uecp_put_eon(svc_msgs, dsn, svcs[i]);
+
+		/* Frame is full, send it */
+		if(len + svc_len > UECP_MSG_LEN_MAX) {
+			ret = uecp_send_msgs_to_enc(enc, msgs, len, NULL);
+			if(ret < 0)
+				return sent ? sent : ret;
+			sent = i;
+			len = 0;
+		}
+
+		memcpy(msgs + len, svc_msgs, svc_len);
+		len += svc_len;
+	}
+
+	if(len) {
+		ret = uecp_send_msgs_to_enc(enc, msgs, len, NULL);
+		if(ret < 0)
+			return sent ? sent : ret;
+	}
+
+	return num;
+}
+
 /**
  * uecp_set_rt - Set RadioText message through UECP
  * @enc: pointer to &struct rds_encoder
  * @dsn: Data Segment Number
  * @psn: Programme Service Number
  * @rt: the &struct rds_rt to send
+ *
+ * If the main service's text had RT+ tags, they are cleared
+ * on the same frame (see uecp_set_rtplus()).
  */
 static int
 uecp_set_rt(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, struct rds_rt *rt)
 {
 	struct uecp_data_frame data_frame;
 	struct uecp_message *msg = &data_frame.msg;
-	int i = 0;
+	struct rds_fcache_key key;
+	int ret = 0;
+	struct rds_rtplus rtplus;
+	uint8_t rt_key[1 + RDS_RT_MSG_LEN_MAX];
+
+	if(dsn == 0 && psn == 0 && (enc->state.valid & RDS_STATE_RTPLUS)) {
+		memset(&rtplus, 0, sizeof(struct rds_rtplus));
+		rtplus.rt = *rt;
+		return uecp_set_rtplus(enc, dsn, psn, &rtplus);
+	}
+
+	/* Same thing sent before ? */
+	rds_fcache_key_init(&key, enc, UECP_MEC_RT, dsn, psn,
+				rt_key, uecp_rt_key(rt_key, rt));
+	ret = uecp_send_cached(enc, &key);
+	if(ret != -ENOENT)
+		return ret < 0 ? ret : 0;
 
 	memset(&data_frame, 0, sizeof(struct uecp_data_frame));
 
@@ -326,32 +803,13 @@ uecp_set_rt(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, struct rds_rt *rt
 	msg->psn = psn;
 
 	/* RadioText can be 64bytes long */
-	msg->mel_data[0] |= (rt->ab_flag & RDS_RT_METHOD_B) ? 1 : 0;
-	msg->mel_data[0] |= (rt->retransmissions & 0xF) << 1;
-	msg->mel_data[0] |= (rt->buffer_config & 0x3) << 5;
+	msg->mel_len = uecp_put_rt(msg->mel_data, rt);
 
-	/* The RT message can be empty, in this case
-	 * mel_len will be 1 and bufer_config should be
-	 * RDS_RT_BUFF_CONFIG_FLUSH */
-	for(i = 1; i < 65; i++) {
-		/* Reached NULL */
-		if(rt->msg[i] == '\0')
-			break;
+	data_frame.msg_len = 4 + msg->mel_len;
 
-		/* Non-ASCII character */
-		else if (rt->msg[i] < 0x20 || rt->msg[i] > 0x7E)
-			msg->mel_data[i] = ' ';
-		else
-			msg->mel_data[i] = rt->msg[i];
-	}
-
-	msg->mel_len = i;
+	ret = uecp_send_frame_to_enc(enc, &data_frame, &key);
 
-	data_frame.msg_len = 4 + i;
-
-	uecp_send_frame_to_enc(enc, &data_frame);
-
-	return 0;
+	return ret < 0 ? ret : 0;
 }
 
 
@@ -367,6 +825,8 @@ uecp_set_di(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t di)
 {
 	struct uecp_data_frame data_frame;
 	struct uecp_message *msg = &data_frame.msg;
+	struct rds_fcache_key key;
+	int ret = 0;
 	uint8_t di_dynpty = 0;
 
 	memset(&data_frame, 0, sizeof(struct uecp_data_frame));
@@ -384,12 +844,19 @@ uecp_set_di(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t di)
 	msg->mel_data[0] = (di_dynpty & UECP_DI_DYNPTY_DYNAMIC_PTY) |
 					(di & UECP_DI_DYNPTY_DI_MASK);
 
+	/* Same thing sent before ? */
+	rds_fcache_key_init(&key, enc, UECP_MEC_DI_PTYI, dsn, psn,
+						msg->mel_data, 1);
+	ret = uecp_send_cached(enc, &key);
+	if(ret != -ENOENT)
+		return ret < 0 ? ret : 0;
+
 	/* Don't include mel_len */
 	data_frame.msg_len = 3 + 1;
 
-	uecp_send_frame_to_enc(enc, &data_frame);
+	ret = uecp_send_frame_to_enc(enc, &data_frame, &key);
 
-	return 0;
+	return ret < 0 ? ret : 0;
 }
 
 
@@ -405,6 +872,8 @@ uecp_set_dynpty(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t dynpt
 {
 	struct uecp_data_frame data_frame;
 	struct uecp_message *msg = &data_frame.msg;
+	struct rds_fcache_key key;
+	int ret = 0;
 	uint8_t di_dynpty = 0;
 
 	memset(&data_frame, 0, sizeof(struct uecp_data_frame));
@@ -420,12 +889,19 @@ uecp_set_dynpty(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t dynpt
 	msg->mel_data[0] = (di_dynpty & UECP_DI_DYNPTY_DI_MASK) |
 				((dynpty != 0) ? UECP_DI_DYNPTY_DYNAMIC_PTY : 0);
 
+	/* Same thing sent before ? */
+	rds_fcache_key_init(&key, enc, UECP_MEC_DI_PTYI, dsn, psn,
+						msg->mel_data, 1);
+	ret = uecp_send_cached(enc, &key);
+	if(ret != -ENOENT)
+		return ret < 0 ? ret : 0;
+
 	/* Don't include mel_len */
 	data_frame.msg_len = 3 + 1;
 
-	uecp_send_frame_to_enc(enc, &data_frame);
+	ret = uecp_send_frame_to_enc(enc, &data_frame, &key);
 
-	return 0;
+	return ret < 0 ? ret : 0;
 }
 
 
@@ -441,6 +917,15 @@ uecp_set_ta_tp(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t ta_tp)
 {
 	struct uecp_data_frame data_frame;
 	struct uecp_message *msg = &data_frame.msg;
+	struct rds_fcache_key key;
+	int ret = 0;
+
+	/* Same thing sent before ? */
+	rds_fcache_key_init(&key, enc, UECP_MEC_TA_TP, dsn, psn,
+						&ta_tp, 1);
+	ret = uecp_send_cached(enc, &key);
+	if(ret != -ENOENT)
+		return ret < 0 ? ret : 0;
 
 	memset(&data_frame, 0, sizeof(struct uecp_data_frame));
 
@@ -454,9 +939,9 @@ uecp_set_ta_tp(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t ta_tp)
 	/* Don't include mel_len */
 	data_frame.msg_len = 3 + 1;
 
-	uecp_send_frame_to_enc(enc, &data_frame);
+	ret = uecp_send_frame_to_enc(enc, &data_frame, &key);
 
-	return 0;
+	return ret < 0 ? ret : 0;
 }
 
 
@@ -472,6 +957,15 @@ uecp_set_ms(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t ms)
 {
 	struct uecp_data_frame data_frame;
 	struct uecp_message *msg = &data_frame.msg;
+	struct rds_fcache_key key;
+	int ret = 0;
+
+	/* Same thing sent before ? */
+	rds_fcache_key_init(&key, enc, UECP_MEC_MS, dsn, psn,
+						&ms, 1);
+	ret = uecp_send_cached(enc, &key);
+	if(ret != -ENOENT)
+		return ret < 0 ? ret : 0;
 
 	memset(&data_frame, 0, sizeof(struct uecp_data_frame));
 
@@ -484,9 +978,9 @@ uecp_set_ms(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t ms)
 	/* Don't include mel_len */
 	data_frame.msg_len = 3 + 1;
 
-	uecp_send_frame_to_enc(enc, &data_frame);
+	ret = uecp_send_frame_to_enc(enc, &data_frame, &key);
 
-	return 0;
+	return ret < 0 ? ret : 0;
 }
 
 
@@ -502,6 +996,15 @@ uecp_set_pty(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t pty)
 {
 	struct uecp_data_frame data_frame;
 	struct uecp_message *msg = &data_frame.msg;
+	struct rds_fcache_key key;
+	int ret = 0;
+
+	/* Same thing sent before ? */
+	rds_fcache_key_init(&key, enc, UECP_MEC_PTY, dsn, psn,
+						&pty, 1);
+	ret = uecp_send_cached(enc, &key);
+	if(ret != -ENOENT)
+		return ret < 0 ? ret : 0;
 
 	memset(&data_frame, 0, sizeof(struct uecp_data_frame));
 
@@ -514,9 +1017,9 @@ uecp_set_pty(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, uint8_t pty)
 	/* Don't include mel_len */
 	data_frame.msg_len = 3 + 1;
 
-	uecp_send_frame_to_enc(enc, &data_frame);
+	ret = uecp_send_frame_to_enc(enc, &data_frame, &key);
 
-	return 0;
+	return ret < 0 ? ret : 0;
 }
 
 
@@ -532,8 +1035,17 @@ uecp_set_ptyn(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, char* ptyn)
 {
 	struct uecp_data_frame data_frame;
 	struct uecp_message *msg = &data_frame.msg;
+	struct rds_fcache_key key;
+	int ret = 0;
 	int i = 0;
 
+	/* Same thing sent before ? */
+	rds_fcache_key_init(&key, enc, UECP_MEC_PTYN, dsn, psn,
+						ptyn, strnlen(ptyn, RDS_PTYN_LEN));
+	ret = uecp_send_cached(enc, &key);
+	if(ret != -ENOENT)
+		return ret < 0 ? ret : 0;
+
 	memset(&data_frame, 0, sizeof(struct uecp_data_frame));
 
 	msg->mec = UECP_MEC_PTYN;
@@ -547,8 +1059,8 @@ uecp_set_ptyn(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, char* ptyn)
 		if(ptyn[i] == '\0')
 			break;
 
-		/* Non-ASCII character */
-		else if (ptyn[i] < 0x20 || ptyn[i] > 0x7E)
+		/* Control code */
+		else if (!RDS_G0_PRINTABLE(ptyn[i]))
 			msg->mel_data[i] = ' ';
 		else
 			msg->mel_data[i] = ptyn[i];
@@ -564,9 +1076,9 @@ uecp_set_ptyn(struct rds_encoder *enc, uint8_t dsn, uint8_t psn, char* ptyn)
 	/* Don't include mel_len */
 	data_frame.msg_len = 3 + 8;
 
-	uecp_send_frame_to_enc(enc, &data_frame);
+	ret = uecp_send_frame_to_enc(enc, &data_frame, &key);
 
-	return 0;
+	return ret < 0 ? ret : 0;
 }
 
 
@@ -580,6 +1092,15 @@ uecp_set_ct(struct rds_encoder *enc, uint8_t ct)
 {
 	struct uecp_data_frame data_frame;
 	struct uecp_message *msg = &data_frame.msg;
+	struct rds_fcache_key key;
+	int ret = 0;
+
+	/* Same thing sent before ? */
+	rds_fcache_key_init(&key, enc, UECP_MEC_CT, 0, 0,
+						&ct, 1);
+	ret = uecp_send_cached(enc, &key);
+	if(ret != -ENOENT)
+		return ret < 0 ? ret : 0;
 
 	memset(&data_frame, 0, sizeof(struct uecp_data_frame));
 
@@ -587,9 +1108,9 @@ uecp_set_ct(struct rds_encoder *enc, uint8_t ct)
 	msg->mel_len = UECP_MSG_MEL_NA;
 	msg->mel_data[0] = (ct & 0x01) ? 1 : 0;
 	
-	uecp_send_frame_to_enc(enc, &data_frame);
+	ret = uecp_send_frame_to_enc(enc, &data_frame, &key);
 
-	return 0;
+	return ret < 0 ? ret : 0;
 }
 
 
@@ -603,10 +1124,12 @@ uecp_set_rtc(struct rds_encoder *enc, struct rds_rtc *rtc)
 {
 	struct uecp_data_frame data_frame;
 	struct uecp_message *msg = &data_frame.msg;
-	int sign = 0;
+	uint8_t offset = 0;
+	int ret = 0;
 
 	memset(&data_frame, 0, sizeof(struct uecp_data_frame));
 
+	data_frame.msg_len = 1 + 8;
 	msg->mec = UECP_MEC_RTC;
 	msg->mel_len = UECP_MSG_MEL_NA;
 
@@ -619,20 +1142,23 @@ uecp_set_rtc(struct rds_encoder *enc, struct rds_rtc *rtc)
 
 	msg->mel_data[0] = rtc->year % 100;	/* Last 2 digits of Year in hex */
 	msg->mel_data[1] = rtc->month;
-	msg->mel_data[2] = rtc->hours;
-	msg->mel_data[3] = rtc->minutes;
-	msg->mel_data[4] = rtc->seconds;
-	msg->mel_data[5] = rtc->centiseconds;
+	msg->mel_data[2] = rtc->day;
+	msg->mel_data[3] = rtc->hours;
+	msg->mel_data[4] = rtc->minutes;
+	msg->mel_data[5] = rtc->seconds;
+	msg->mel_data[6] = rtc->centiseconds;
 
-	sign = (rtc->offset & 0x80) >> 2; /* Sign is on the 6th bit */
-	rtc->offset = rtc->offset * 2;	/* Offset is in half-hour increments
-					 * so max value is 28 */
+	/* Offset is in half-hour increments so max value
+	 * is 28, sign is on the 6th bit */
+	offset = ((rtc->offset < 0) ? -rtc->offset : rtc->offset) * 2;
+	if(rtc->offset < 0)
+		offset |= 0x20;
 
-	msg->mel_data[6] = (rtc->offset | sign) & 0x3F;
+	msg->mel_data[7] = offset & 0x3F;
 
-	uecp_send_frame_to_enc(enc, &data_frame);
+	ret = uecp_send_frame_to_enc(enc, &data_frame, NULL);
 
-	return 0;
+	return ret < 0 ? ret : 0;
 }
 
 
@@ -646,6 +1172,15 @@ uecp_set_rds_on(struct rds_encoder *enc, uint8_t on)
 {
 	struct uecp_data_frame data_frame;
 	struct uecp_message *msg = &data_frame.msg;
+	struct rds_fcache_key key;
+	int ret = 0;
+
+	/* Same thing sent before ? */
+	rds_fcache_key_init(&key, enc, UECP_MEC_RDSON, 0, 0,
+						&on, 1);
+	ret = uecp_send_cached(enc, &key);
+	if(ret != -ENOENT)
+		return ret < 0 ? ret : 0;
 
 	memset(&data_frame, 0, sizeof(struct uecp_data_frame));
 
@@ -653,9 +1188,125 @@ uecp_set_rds_on(struct rds_encoder *enc, uint8_t on)
 	msg->mel_len = UECP_MSG_MEL_NA;
 	msg->mel_data[0] = (on & 0x01) ? 1 : 0;
 	
-	uecp_send_frame_to_enc(enc, &data_frame);
+	ret = uecp_send_frame_to_enc(enc, &data_frame, &key);
 
-	return 0;
+	return ret < 0 ? ret : 0;
+}
+
+/**
+ * uecp_set_dsn - Switch the encoder to another data set
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: the data set (1 - 253)
+ */
+static int
+uecp_set_dsn(struct rds_encoder *enc, uint8_t dsn)
+{
+	struct uecp_data_frame data_frame;
+	struct uecp_message *msg = &data_frame.msg;
+	struct rds_fcache_key key;
+	int ret = 0;
+
+	/* Same thing sent before ? */
+	rds_fcache_key_init(&key, enc, UECP_MEC_DSN_SELECT, 0, 0,
+						&dsn, 1);
+	ret = uecp_send_cached(enc, &key);
+	if(ret != -ENOENT)
+		return ret < 0 ? ret : 0;
+
+	memset(&data_frame, 0, sizeof(struct uecp_data_frame));
+
+	msg->mec = UECP_MEC_DSN_SELECT;
+	msg->mel_len = UECP_MSG_MEL_NA;
+	msg->mel_data[0] = dsn;
+
+	/* Don't include mel_len */
+	data_frame.msg_len = 1 + 1;
+
+	ret = uecp_send_frame_to_enc(enc, &data_frame, &key);
+
+	return ret < 0 ? ret : 0;
+}
+
+/**
+ * uecp_set_psn_on - Enable / disable a service on the encoder
+ * @enc: pointer to &struct rds_encoder
+ * @dsn: Data Segment Number
+ * @psn: Program Service Number
+ * @on: 1 to put it on air, 0 to take it off
+ */
+static int
+uecp_set_psn_on(struct rds_encoder *enc, uint8_t dsn, uint8_t psn,
+							uint8_t on)
+{
+	struct uecp_data_frame data_frame;
+	struct uecp_message *msg = &data_frame.msg;
+	struct rds_fcache_key key;
+	int ret = 0;
+
+	on = on ? UECP_PSN_ENABLE : UECP_PSN_DISABLE;
+
+	/* Same thing sent before ? */
+	rds_fcache_key_init(&key, enc, UECP_MEC_PSN_ENABLE, dsn, psn,
+								&on, 1);
+	ret = uecp_send_cached(enc, &key);
+	if(ret != -ENOENT)
+		return ret < 0 ? ret : 0;
+
+	memset(&data_frame, 0, sizeof(struct uecp_data_frame));
+
+	msg->mec = UECP_MEC_PSN_ENABLE;
+	msg->dsn = dsn;
+	msg->psn = psn;
+	msg->mel_len = UECP_MSG_MEL_NA;
+	msg->mel_data[0] = on;
+
+	/* Don't include mel_len */
+	data_frame.msg_len = 3 + 1;
+
+	ret = uecp_send_frame_to_enc(enc, &data_frame, &key);
+
+	return ret < 0 ? ret : 0;
+}
+
+/**
+ * uecp_set_unit_addr - Add / remove a site or encoder address
+ *			the unit(s) we talk to answer to
+ * @enc: pointer to &struct rds_encoder
+ * @op: one of RDS_ADDR_OP_ADD_SITE / DEL_SITE / ADD_ENC / DEL_ENC
+ * @addr: the site (1 - 1023) or encoder (1 - 63) address
+ *
+ * The frame goes to enc->addr, so with a broadcast site / encoder
+ * address there every unit of a region gets the new address at
+ * once. Address 0 is broadcast, units always answer to it.
+ */
+static int
+uecp_set_unit_addr(struct rds_encoder *enc, uint8_t op, uint16_t addr)
+{
+	uint8_t msg[6];
+	int len = 0;
+	int ret = 0;
+	uint8_t site = 0;
+
+	site = (op == RDS_ADDR_OP_ADD_SITE || op == RDS_ADDR_OP_DEL_SITE);
+
+	if(!addr || addr > (site ? UECP_SITE_ADDRESS_MAX :
+					UECP_ENC_ADDRESS_MAX))
+		return -EINVAL;
+
+	msg[len++] = site ? UECP_MEC_SET_SITE_ADDR : UECP_MEC_SET_ENC_ADDR;
+	msg[len++] = site ? 3 : 2;
+	msg[len++] = (op == RDS_ADDR_OP_ADD_SITE ||
+			op == RDS_ADDR_OP_ADD_ENC) ? UECP_ADDR_CONF_ADD :
+						UECP_ADDR_CONF_REMOVE;
+	if(site)
+		msg[len++] = (addr & 0xFF00) >> 8;
+	msg[len++] = addr & 0xFF;
+
+	/* Not something to resend from the cache, the unit's
+	 * address list is not ours to track */
+	ret = uecp_send_msgs_to_enc(enc, msg, len, NULL);
+
+	return ret < 0 ? ret : 0;
 }
 
 
@@ -690,5 +1341,12 @@ uecp_init(struct rds_encoder *enc)
 	enc->set_rtc = &uecp_set_rtc;
 	enc->get_rds_on = NULL;
 	enc->set_rds_on = &uecp_set_rds_on;
+	enc->get_rtplus = NULL;
+	enc->set_rtplus = &uecp_set_rtplus;
+	enc->set_af = &uecp_set_af;
+	enc->set_eon = &uecp_set_eon;
+	enc->set_dsn = &uecp_set_dsn;
+	enc->set_psn_on = &uecp_set_psn_on;
+	enc->set_unit_addr = &uecp_set_unit_addr;
 	return 0;
 }
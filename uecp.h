@@ -57,6 +57,7 @@ struct uecp_message {
 #define UECP_MEC_TA_TP		0x03 /* Traffic Anouncement / Traffic Programme */
 #define UECP_MEC_MS		0x05 /* Music / Speech switch */
 #define UECP_MEC_PTY		0x07 /* Programme Type */
+#define UECP_MEC_AF		0x13 /* Alternative Frequencies list */
 #define UECP_MEC_PTYN		0x3E /* Programme Type Name */
 #define UECP_MEC_RT		0x0A /* RadioText */
 #define UECP_MEC_RTC		0x0D /* Real Time Clock */
@@ -69,6 +70,8 @@ struct uecp_message {
 #define UECP_MEC_MSG_REQUEST	0x17 /* Request data from the encoder */
 #define UECP_MEC_MSG_ACK	0x18 /* ACK of a received message */
 #define UECP_MEC_SET_COMM_MODE	0x2C /* Set communication mode for the encoder */
+#define UECP_MEC_ODA_CONF	0x40 /* ODA configuration (AID, group type, 3A message) */
+#define UECP_MEC_ODA_FREE	0x42 /* ODA free-format group (B/C/D data of a group) */
 
 /* DSN allows us to target a data set or set of data sets
  * within an encoder. Current data set is the RDS's output */
@@ -131,7 +134,27 @@ struct uecp_data_frame {
 #define UECP_DF_SEQ_DISABLED	0
 
 /* max message length + data frame fields + start + stop */
-#define UECP_DF_MAX_LEN		UECP_MSG_LEN_MAX + 6 + 2
+#define UECP_DF_MAX_LEN		(UECP_MSG_LEN_MAX + 6 + 2)
+
+/* Byte-stuffing, 0xFD - 0xFF in the payload become
+ * 0xFD followed by 0x00 - 0x02 */
+#define UECP_DF_STUFF_BYTE	0xFD
+
+/* Response codes of UECP_MEC_MSG_ACK */
+#define UECP_ACK_OK			0
+#define UECP_ACK_CRC_ERROR		1
+#define UECP_ACK_MSG_INCOMPLETE		2
+#define UECP_ACK_MSG_UNKNOWN		3
+#define UECP_ACK_DSN_ERROR		4
+#define UECP_ACK_PSN_ERROR		5
+#define UECP_ACK_PARAM_RANGE		6
+#define UECP_ACK_MEL_LEN_ERROR		7
+#define UECP_ACK_MSG_LEN_ERROR		8
+#define UECP_ACK_MSG_NOT_ACCEPTABLE	9
+#define UECP_ACK_END_MISSING		10
+#define UECP_ACK_BUFFER_OVERFLOW	11
+#define UECP_ACK_BAD_STUFFING		12
+#define UECP_ACK_UNEXPECTED_END		13
 
 
 /**********\
@@ -155,9 +178,40 @@ struct uecp_data_frame {
 #define UECP_RTC_OFFSET_MASK		0x3F
 #define UECP_RTC_OFFSET_UNCHANGED	0xFF
 
+/* ODA free-format group config: send it cyclically,
+ * replacing the previous one */
+#define UECP_ODA_FREE_CYCLIC		0x00
+
+/* AF message config byte, followed by the list's location
+ * (2 bytes) and its entries as they go on air (no count code
+ * or filler, see rds_af.h) */
+#define UECP_AF_CONF_ADD		0x00	/* Add the entries */
+#define UECP_AF_CONF_DEL		0x01	/* Remove the entries */
+#define UECP_AF_CONF_REPLACE		0x02	/* Replace the list with the
+						 * entries (none clears it) */
+
+/* UECP_MEC_PSN_ENABLE data */
+#define UECP_PSN_DISABLE		0x00
+#define UECP_PSN_ENABLE			0x01
+
+/* Site / encoder address message config byte, followed by
+ * the address (2 bytes for sites, 1 for encoders) */
+#define UECP_ADDR_CONF_REMOVE		0x00	/* Stop answering to it */
+#define UECP_ADDR_CONF_ADD		0x01	/* Answer to it too */
+
+/* AF list locations, method B lists are located by the
+ * code of their tuned frequency */
+#define UECP_AF_LOC_METHOD_A		0x0000
+#define UECP_AF_LOC_ALL			0xFFFF
+
 
 /************\
 * PROTOTYPES *
 \************/
 
 int uecp_init(struct rds_encoder *enc);
+
+/* Also used by the UECP server (see uecp_srv.c) */
+uint16_t uecp_crc16_ccitt(const unsigned char* data, int len);
+int uecp_is_global_mec(uint8_t mec);
+int uecp_stuff(const unsigned char *buf, int len, uint8_t *out);
@@ -0,0 +1,953 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * uecp_srv.c -	UECP server, accepts UECP from playout systems
+ *		and drives any encoder
+ */
+
+#define _GNU_SOURCE	/* For accept4() */
+#include <stdint.h>	/* For sized integers */
+#include <errno.h>	/* For error numbers */
+#include <stdlib.h>	/* For malloc/free */
+#include <string.h>	/* For memset() / memcpy() */
+#include <stdio.h>	/* For snprintf() */
+#include <unistd.h>	/* For read() / write() / close() */
+#include <sys/socket.h>	/* For socket() / bind() / listen() */
+#include <sys/un.h>	/* For struct sockaddr_un */
+#include <sys/epoll.h>	/* For epoll_*() */
+#include <netinet/in.h>	/* For IPPROTO_TCP */
+#include <netinet/tcp.h>	/* For TCP_NODELAY */
+#include <netdb.h>	/* For getaddrinfo() */
+#include "rds.h"
+#include "rds_thread.h"
+#include "rds_queue.h"
+#include "uecp.h"
+#include "uecp_srv.h"
+
+/* What an epoll event is about, on the upper bits of data.u32,
+ * the lower ones hold the client / listener index */
+#define UECP_SRV_EV_CLIENT	0x00000
+#define UECP_SRV_EV_LISTEN	0x10000
+#define UECP_SRV_EV_CMD_DONE	0x20000
+#define UECP_SRV_EV_TYPE_MASK	0xF0000
+#define UECP_SRV_EV_IDX_MASK	0x0FFFF
+
+
+/******************\
+* HELPER FUNCTIONS *
+\******************/
+
+/**
+ * uecp_srv_data_len - Get the length of a message element's data
+ * @mec: the Message Element Code
+ * @data: the data (after MEC / DSN / PSN)
+ * @left: bytes left on the message
+ *
+ * Returns: the length of the data including MEL (if any), or -1
+ * if we don't know this MEC
+ */
+static int
+uecp_srv_data_len(uint8_t mec, const uint8_t *data, int left)
+{
+	switch(mec) {
+	case UECP_MEC_TA_TP:
+	case UECP_MEC_DI_PTYI:
+	case UECP_MEC_MS:
+	case UECP_MEC_PTY:
+	case UECP_MEC_PSN_ENABLE:
+	case UECP_MEC_CT:
+	case UECP_MEC_DSN_SELECT:
+	case UECP_MEC_RDSON:
+	case UECP_MEC_SET_COMM_MODE:
+		return 1;
+	case UECP_MEC_PI:
+	case UECP_MEC_PIN:
+	case UECP_MEC_MSG_ACK:
+		return 2;
+	case UECP_MEC_RTC:
+		return 8;
+	case UECP_MEC_PS:
+	case UECP_MEC_PTYN:
+		return 8;
+	/* These ones carry MEL */
+	case UECP_MEC_RT:
+	case UECP_MEC_AF:
+	case UECP_MEC_SET_SITE_ADDR:
+	case UECP_MEC_SET_ENC_ADDR:
+	case UECP_MEC_MSG_REQUEST:
+		if(left < 1)
+			return 1;
+		return 1 + data[0];
+	default:
+		return -1;
+	}
+}
+
+/**
+ * uecp_srv_copy_text - Copy fixed length text out of a message
+ * @out: the buffer to fill, len + 1 long
+ * @data: the text on the message
+ * @len: its length
+ */
+static void
+uecp_srv_copy_text(char *out, const uint8_t *data, int len)
+{
+	memcpy(out, data, len);
+	out[len] = '\0';
+}
+
+
+/******************\
+* COMMAND HANDLING *
+\******************/
+
+/**
+ * uecp_srv_queue - Queue a command for the encoder
+ * @srv: the &struct uecp_srv
+ * @cmd: the &struct rds_cmd (copied)
+ *
+ * Returns: a UECP_ACK_* code
+ */
+static int
+uecp_srv_queue(struct uecp_srv *srv, const struct rds_cmd *cmd)
+{
+	/* Nobody waits for the result, the ACK goes out now */
+	if(rds_queue_push(srv->queue, cmd, 0) < 0)
+		return UECP_ACK_BUFFER_OVERFLOW;
+
+	return UECP_ACK_OK;
+}
+
+/**
+ * uecp_srv_handle_msg - Map a message element to commands and queue them
+ * @srv: the &struct uecp_srv
+ * @mec: Message Element Code
+ * @dsn: Data Set Number (0 for global MECs)
+ * @psn: Programme Service Number (0 for global MECs)
+ * @data: the data, including MEL (if any), its length was checked
+ *	by the caller
+ *
+ * Returns: a UECP_ACK_* code
+ */
+static int
+uecp_srv_handle_msg(struct uecp_srv *srv, uint8_t mec, uint8_t dsn,
+				uint8_t psn, const uint8_t *data)
+{
+	struct rds_cmd cmd;
+	uint16_t pi_val = 0;
+	int ret = 0;
+
+	switch(mec) {
+	case UECP_MEC_PI:
+		rds_cmd_init(&cmd, RDS_CMD_SET_PI, dsn, psn);
+		pi_val = (data[0] << 8) | data[1];
+		cmd.arg.pi.ccode = (pi_val & 0xF000) >> 4;
+		cmd.arg.pi.coverage = (pi_val & 0x0F00) >> 8;
+		cmd.arg.pi.prn = pi_val & 0xFF;
+		break;
+	case UECP_MEC_PS:
+		rds_cmd_init(&cmd, RDS_CMD_SET_PS, dsn, psn);
+		uecp_srv_copy_text(cmd.arg.ps, data, RDS_PS_LEN);
+		break;
+	case UECP_MEC_PTYN:
+		rds_cmd_init(&cmd, RDS_CMD_SET_PTYN, dsn, psn);
+		uecp_srv_copy_text(cmd.arg.ptyn, data, RDS_PTYN_LEN);
+		break;
+	case UECP_MEC_RT:
+		/* MEL, config byte and up to 64 characters */
+		if(data[0] < 1 || data[0] > RDS_RT_MSG_LEN_MAX)
+			return UECP_ACK_MEL_LEN_ERROR;
+		rds_cmd_init(&cmd, RDS_CMD_SET_RT, dsn, psn);
+		cmd.arg.rt.ab_flag = (data[1] & 0x1) ? RDS_RT_METHOD_B :
+							RDS_RT_METHOD_A;
+		cmd.arg.rt.retransmissions = (data[1] >> 1) & 0xF;
+		cmd.arg.rt.buffer_config = (data[1] >> 5) & 0x3;
+		memcpy(cmd.arg.rt.msg, data + 2, data[0] - 1);
+		cmd.arg.rt.msg[data[0] - 1] = '\0';
+		break;
+	case UECP_MEC_TA_TP:
+		rds_cmd_init(&cmd, RDS_CMD_SET_TA_TP, dsn, psn);
+		/* Note: UECP_TATP_* flags match RDS_TATP_* flags */
+		cmd.arg.val = data[0] & 0x3;
+		break;
+	case UECP_MEC_DI_PTYI:
+		/* Two fields for us */
+		rds_cmd_init(&cmd, RDS_CMD_SET_DI, dsn, psn);
+		cmd.arg.val = data[0] & UECP_DI_DYNPTY_DI_MASK;
+		ret = uecp_srv_queue(srv, &cmd);
+		if(ret != UECP_ACK_OK)
+			return ret;
+
+		rds_cmd_init(&cmd, RDS_CMD_SET_DYNPTY, dsn, psn);
+		cmd.arg.val = (data[0] & UECP_DI_DYNPTY_DYNAMIC_PTY) ? 1 : 0;
+		break;
+	case UECP_MEC_MS:
+		rds_cmd_init(&cmd, RDS_CMD_SET_MS, dsn, psn);
+		cmd.arg.val = (data[0] & 0x1) ? RDS_MS_MUSIC : RDS_MS_SPEECH;
+		break;
+	case UECP_MEC_PTY:
+		if(data[0] > 0x1F)
+			return UECP_ACK_PARAM_RANGE;
+		rds_cmd_init(&cmd, RDS_CMD_SET_PTY, dsn, psn);
+		cmd.arg.val = data[0];
+		break;
+	case UECP_MEC_CT:
+		rds_cmd_init(&cmd, RDS_CMD_SET_CT, 0, 0);
+		cmd.arg.val = data[0] & 0x1;
+		break;
+	case UECP_MEC_RDSON:
+		rds_cmd_init(&cmd, RDS_CMD_SET_RDS_ON, 0, 0);
+		cmd.arg.val = data[0] & 0x1;
+		break;
+	case UECP_MEC_RTC:
+		if(data[1] < 1 || data[1] > 12 || data[2] < 1 ||
+		data[2] > 31 || data[3] > 23 || data[4] > 59 ||
+		data[5] > 59 || data[6] > 99)
+			return UECP_ACK_PARAM_RANGE;
+		rds_cmd_init(&cmd, RDS_CMD_SET_RTC, 0, 0);
+		cmd.arg.rtc.year = 2000 + (data[0] % 100);
+		cmd.arg.rtc.month = data[1];
+		cmd.arg.rtc.day = data[2];
+		cmd.arg.rtc.hours = data[3];
+		cmd.arg.rtc.minutes = data[4];
+		cmd.arg.rtc.seconds = data[5];
+		cmd.arg.rtc.centiseconds = data[6];
+		/* Offset is in half hours, sign is on the 6th bit */
+		cmd.arg.rtc.offset = (data[7] & 0x1F) / 2;
+		if(data[7] & 0x20)
+			cmd.arg.rtc.offset = -cmd.arg.rtc.offset;
+		break;
+	case UECP_MEC_MSG_ACK:
+		/* Nothing to do */
+		return UECP_ACK_OK;
+	default:
+		/* No rds_set_* for these */
+		return UECP_ACK_MSG_NOT_ACCEPTABLE;
+	}
+
+	return uecp_srv_queue(srv, &cmd);
+}
+
+
+/****************\
+* FRAME HANDLING *
+\****************/
+
+/**
+ * uecp_srv_send_ack - Queue an ACK to a client and try to send it
+ * @srv: the &struct uecp_srv
+ * @cl: the &struct uecp_srv_client
+ * @code: UECP_ACK_* response code
+ * @seq: sequence number of the frame we ACK
+ *
+ * If the client doesn't read its ACKs and we run out of space, the
+ * ACK is dropped, losing the connection over it would be worse.
+ *
+ * Returns: 0 on success or a negative error code if the connection
+ * is broken
+ */
+static int
+uecp_srv_send_ack(struct uecp_srv *srv, struct uecp_srv_client *cl,
+						uint8_t code, uint8_t seq)
+{
+	uint8_t buf[UECP_DF_MAX_LEN];
+	uint8_t out[2 * 9 + 2];
+	uint16_t addr = 0;
+	uint16_t crc = 0;
+	ssize_t ret = 0;
+	int len = 0;
+
+	addr = (srv->site_addr << UECP_DF_SITE_ADDR_SHIFT) |
+			(srv->enc_addr & UECP_DF_ENC_ADDR_MASK);
+
+	buf[len++] = (addr & 0xFF00) >> 8;
+	buf[len++] = addr & 0xFF;
+	buf[len++] = UECP_DF_SEQ_DISABLED;
+	buf[len++] = 3;
+	buf[len++] = UECP_MEC_MSG_ACK;
+	buf[len++] = code;
+	buf[len++] = seq;
+
+	crc = uecp_crc16_ccitt(buf, len);
+	buf[len++] = (crc & 0xFF00) >> 8;
+	buf[len++] = crc & 0xFF;
+
+	len = uecp_stuff(buf, len, out);
+
+	if(cl->tx_len + len > UECP_SRV_TX_BUF_LEN)
+		return 0;
+
+	memcpy(cl->tx + cl->tx_len, out, len);
+	cl->tx_len += len;
+
+	/* Try to push it out now, if the socket is full the
+	 * rest goes out on EPOLLOUT */
+	do {
+		ret = write(cl->fd, cl->tx, cl->tx_len);
+	} while(ret < 0 && errno == EINTR);
+
+	if(ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+		return -errno;
+	if(ret < 0)
+		ret = 0;
+
+	memmove(cl->tx, cl->tx + ret, cl->tx_len - ret);
+	cl->tx_len -= ret;
+
+	return 0;
+}
+
+/**
+ * uecp_srv_handle_frame - Check a received (destuffed) frame and
+ *			   handle its messages
+ * @srv: the &struct uecp_srv
+ * @cl: the &struct uecp_srv_client it came from
+ *
+ * Returns: 0, or a negative error code if the client should be dropped
+ */
+static int
+uecp_srv_handle_frame(struct uecp_srv *srv, struct uecp_srv_client *cl)
+{
+	const uint8_t *frame = cl->rx;
+	const uint8_t *msg = NULL;
+	uint16_t addr = 0;
+	uint16_t site = 0;
+	uint8_t enc = 0;
+	uint8_t seq = 0;
+	uint8_t msg_len = 0;
+	uint8_t mec = 0;
+	uint8_t dsn = 0;
+	uint8_t psn = 0;
+	int code = UECP_ACK_OK;
+	int pos = 0;
+	int ret = 0;
+
+	/* Address, sequence, length and CRC at least */
+	if(cl->rx_len < 6) {
+		srv->stats.bad_frames++;
+		return 0;
+	}
+
+	addr = (frame[0] << 8) | frame[1];
+	seq = frame[2];
+	msg_len = frame[3];
+
+	site = (addr & UECP_DF_SITE_ADDR_MASK) >> UECP_DF_SITE_ADDR_SHIFT;
+	enc = (addr & UECP_DF_ENC_ADDR_MASK) >> UECP_DF_ENC_ADDR_SHIFT;
+
+	if(cl->rx_err)
+		code = cl->rx_err;
+	else if(cl->rx_len != msg_len + 6)
+		code = UECP_ACK_MSG_LEN_ERROR;
+	else if(uecp_crc16_ccitt(frame, cl->rx_len - 2) !=
+			((frame[cl->rx_len - 2] << 8) | frame[cl->rx_len - 1]))
+		code = UECP_ACK_CRC_ERROR;
+
+	if(code != UECP_ACK_OK) {
+		srv->stats.bad_frames++;
+		goto ack;
+	}
+
+	/* Not for us */
+	if((site != UECP_SITE_ADDRESS_BCAST && site != srv->site_addr) ||
+	(enc != UECP_ENC_ADDRESS_BCAST && enc != srv->enc_addr))
+		return 0;
+
+	srv->stats.frames++;
+
+	/* A frame may carry more than one message element */
+	msg = frame + 4;
+	while(pos < msg_len && code == UECP_ACK_OK) {
+		mec = msg[pos++];
+		dsn = psn = 0;
+
+		if(!uecp_is_global_mec(mec)) {
+			if(pos + 2 > msg_len) {
+				code = UECP_ACK_UNEXPECTED_END;
+				break;
+			}
+			dsn = msg[pos++];
+			psn = msg[pos++];
+		}
+
+		ret = uecp_srv_data_len(mec, msg + pos, msg_len - pos);
+		if(ret < 0) {
+			/* We can't tell where the next one starts */
+			code = UECP_ACK_MSG_UNKNOWN;
+			break;
+		}
+		if(pos + ret > msg_len) {
+			code = UECP_ACK_UNEXPECTED_END;
+			break;
+		}
+
+		code = uecp_srv_handle_msg(srv, mec, dsn, psn, msg + pos);
+		if(code == UECP_ACK_OK)
+			srv->stats.messages++;
+		pos += ret;
+	}
+
+ ack:
+	if(!srv->ack)
+		return 0;
+
+	return uecp_srv_send_ack(srv, cl, code, seq);
+}
+
+/**
+ * uecp_srv_rx - Feed received bytes to a client's frame state machine
+ * @srv: the &struct uecp_srv
+ * @cl: the &struct uecp_srv_client
+ * @buf: the bytes
+ * @len: how many
+ *
+ * Returns: 0, or a negative error code if the client should be dropped
+ */
+static int
+uecp_srv_rx(struct uecp_srv *srv, struct uecp_srv_client *cl,
+					const uint8_t *buf, int len)
+{
+	uint8_t byte = 0;
+	int ret = 0;
+	int i = 0;
+
+	for(i = 0; i < len; i++) {
+		byte = buf[i];
+
+		/* A new start resyncs us, even in the middle of a frame */
+		if(byte == UECP_DF_START_BYTE) {
+			cl->in_frame = 1;
+			cl->rx_len = 0;
+			cl->escape = 0;
+			cl->rx_err = 0;
+			continue;
+		}
+
+		/* Garbage between frames */
+		if(!cl->in_frame)
+			continue;
+
+		if(byte == UECP_DF_STOP_BYTE) {
+			if(cl->escape)
+				cl->rx_err = UECP_ACK_BAD_STUFFING;
+			cl->in_frame = 0;
+
+			ret = uecp_srv_handle_frame(srv, cl);
+			if(ret < 0)
+				return ret;
+			continue;
+		}
+
+		if(byte == UECP_DF_STUFF_BYTE) {
+			if(cl->escape)
+				cl->rx_err = UECP_ACK_BAD_STUFFING;
+			cl->escape = 1;
+			continue;
+		}
+
+		if(cl->escape) {
+			cl->escape = 0;
+			if(byte > 2) {
+				cl->rx_err = UECP_ACK_BAD_STUFFING;
+				continue;
+			}
+			byte += UECP_DF_STUFF_BYTE;
+		}
+
+		if(cl->rx_len >= sizeof(cl->rx)) {
+			cl->rx_err = UECP_ACK_BUFFER_OVERFLOW;
+			continue;
+		}
+
+		cl->rx[cl->rx_len++] = byte;
+	}
+
+	return 0;
+}
+
+
+/*****************\
+* CLIENT HANDLING *
+\*****************/
+
+/**
+ * uecp_srv_drop_client - Close a client's connection
+ * @srv: the &struct uecp_srv
+ * @idx: the client's index
+ */
+static void
+uecp_srv_drop_client(struct uecp_srv *srv, int idx)
+{
+	struct uecp_srv_client *cl = srv->clients[idx];
+
+	if(!cl)
+		return;
+
+	epoll_ctl(srv->epoll_fd, EPOLL_CTL_DEL, cl->fd, NULL);
+	close(cl->fd);
+	free(cl);
+	srv->clients[idx] = NULL;
+}
+
+/**
+ * uecp_srv_accept - Accept pending connections on a listening socket
+ * @srv: the &struct uecp_srv
+ * @fd: the listening socket
+ */
+static void
+uecp_srv_accept(struct uecp_srv *srv, int fd)
+{
+	struct uecp_srv_client *cl = NULL;
+	struct epoll_event ev;
+	int one = 1;
+	int cfd = 0;
+	int i = 0;
+
+	for(;;) {
+		cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if(cfd < 0)
+			return;
+
+		/* Fails on Unix sockets, no harm done */
+		setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		for(i = 0; i < UECP_SRV_CLIENTS_MAX; i++)
+			if(!srv->clients[i])
+				break;
+
+		if(i == UECP_SRV_CLIENTS_MAX) {
+			close(cfd);
+			continue;
+		}
+
+		cl = malloc(sizeof(struct uecp_srv_client));
+		if(!cl) {
+			close(cfd);
+			continue;
+		}
+		memset(cl, 0, sizeof(struct uecp_srv_client));
+		cl->fd = cfd;
+
+		memset(&ev, 0, sizeof(struct epoll_event));
+		ev.events = EPOLLIN;
+		ev.data.u32 = UECP_SRV_EV_CLIENT | i;
+		if(epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, cfd, &ev) < 0) {
+			close(cfd);
+			free(cl);
+			continue;
+		}
+
+		srv->clients[i] = cl;
+	}
+}
+
+/**
+ * uecp_srv_client_event - Handle an epoll event on a client
+ * @srv: the &struct uecp_srv
+ * @idx: the client's index
+ * @events: EPOLL* flags
+ */
+static void
+uecp_srv_client_event(struct uecp_srv *srv, int idx, uint32_t events)
+{
+	struct uecp_srv_client *cl = srv->clients[idx];
+	struct epoll_event ev;
+	uint8_t buf[2 * UECP_DF_MAX_LEN];
+	ssize_t ret = 0;
+
+	if(!cl)
+		return;
+
+	if(events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+		do {
+			ret = read(cl->fd, buf, sizeof(buf));
+		} while(ret < 0 && errno == EINTR);
+
+		if(ret == 0 || (ret < 0 && errno != EAGAIN &&
+						errno != EWOULDBLOCK))
+			goto drop;
+
+		if(ret > 0 && uecp_srv_rx(srv, cl, buf, ret) < 0)
+			goto drop;
+	}
+
+	if((events & EPOLLOUT) && cl->tx_len) {
+		do {
+			ret = write(cl->fd, cl->tx, cl->tx_len);
+		} while(ret < 0 && errno == EINTR);
+
+		if(ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+			goto drop;
+
+		if(ret > 0) {
+			memmove(cl->tx, cl->tx + ret, cl->tx_len - ret);
+			cl->tx_len -= ret;
+		}
+	}
+
+	/* Only ask for EPOLLOUT while we have something to write */
+	if(!!cl->tx_len != cl->want_out) {
+		cl->want_out = !!cl->tx_len;
+		memset(&ev, 0, sizeof(struct epoll_event));
+		ev.events = EPOLLIN | (cl->want_out ? EPOLLOUT : 0);
+		ev.data.u32 = UECP_SRV_EV_CLIENT | idx;
+		epoll_ctl(srv->epoll_fd, EPOLL_CTL_MOD, cl->fd, &ev);
+	}
+
+	return;
+
+ drop:
+	uecp_srv_drop_client(srv, idx);
+}
+
+/**
+ * uecp_srv_add_listener - Start listening on a bound socket
+ * @srv: the &struct uecp_srv
+ * @fd: the socket
+ *
+ * Closes @fd on failure
+ */
+static int
+uecp_srv_add_listener(struct uecp_srv *srv, int fd)
+{
+	struct epoll_event ev;
+	int ret = 0;
+
+	if(listen(fd, UECP_SRV_LISTEN_BACKLOG) < 0) {
+		ret = -errno;
+		close(fd);
+		return ret;
+	}
+
+	memset(&ev, 0, sizeof(struct epoll_event));
+	ev.events = EPOLLIN;
+	ev.data.u32 = UECP_SRV_EV_LISTEN | srv->num_listen;
+	if(epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		ret = -errno;
+		close(fd);
+		return ret;
+	}
+
+	srv->listen_fds[srv->num_listen++] = fd;
+
+	return 0;
+}
+
+
+/**************\
+* ENTRY POINTS *
+\**************/
+
+/**
+ * uecp_srv_listen_tcp - Accept clients on a TCP port
+ * @srv: the &struct uecp_srv
+ * @host: address to bind to, NULL for all
+ * @port: the TCP port
+ */
+int
+uecp_srv_listen_tcp(struct uecp_srv *srv, const char *host, uint16_t port)
+{
+	struct addrinfo hints;
+	struct addrinfo *res = NULL;
+	char service[6];
+	int one = 1;
+	int fd = 0;
+	int ret = 0;
+
+	if(!srv)
+		return -EINVAL;
+
+	if(srv->num_listen >= UECP_SRV_LISTEN_MAX)
+		return -ENOSPC;
+
+	memset(&hints, 0, sizeof(struct addrinfo));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+	snprintf(service, sizeof(service), "%u", port);
+
+	ret = getaddrinfo(host, service, &hints, &res);
+	if(ret != 0)
+		return -EADDRNOTAVAIL;
+
+	fd = socket(res->ai_family, res->ai_socktype | SOCK_NONBLOCK |
+					SOCK_CLOEXEC, res->ai_protocol);
+	if(fd < 0) {
+		ret = -errno;
+		goto cleanup;
+	}
+
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	if(bind(fd, res->ai_addr, res->ai_addrlen) < 0) {
+		ret = -errno;
+		close(fd);
+		goto cleanup;
+	}
+
+	ret = uecp_srv_add_listener(srv, fd);
+
+ cleanup:
+	freeaddrinfo(res);
+	return ret;
+}
+
+/**
+ * uecp_srv_listen_unix - Accept clients on a Unix socket
+ * @srv: the &struct uecp_srv
+ * @path: the socket's path, replaced if it exists and
+ *	unlinked on uecp_srv_destroy()
+ */
+int
+uecp_srv_listen_unix(struct uecp_srv *srv, const char *path)
+{
+	struct sockaddr_un sun;
+	int fd = 0;
+	int ret = 0;
+
+	if(!srv || !path || srv->unix_path)
+		return -EINVAL;
+
+	if(strlen(path) >= sizeof(sun.sun_path))
+		return -ENAMETOOLONG;
+
+	if(srv->num_listen >= UECP_SRV_LISTEN_MAX)
+		return -ENOSPC;
+
+	memset(&sun, 0, sizeof(struct sockaddr_un));
+	sun.sun_family = AF_UNIX;
+	strcpy(sun.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(fd < 0)
+		return -errno;
+
+	unlink(path);
+	if(bind(fd, (struct sockaddr *) &sun, sizeof(struct sockaddr_un)) < 0) {
+		ret = -errno;
+		close(fd);
+		return ret;
+	}
+
+	ret = uecp_srv_add_listener(srv, fd);
+	if(ret < 0) {
+		unlink(path);
+		return ret;
+	}
+
+	srv->unix_path = strdup(path);
+
+	return 0;
+}
+
+/**
+ * uecp_srv_set_ack - Enable / disable ACKs
+ * @srv: the &struct uecp_srv
+ * @on: 1 -> send an ACK for every frame (default), 0 -> don't
+ */
+int
+uecp_srv_set_ack(struct uecp_srv *srv, uint8_t on)
+{
+	if(!srv)
+		return -EINVAL;
+
+	srv->ack = on ? 1 : 0;
+	return 0;
+}
+
+/**
+ * uecp_srv_get_fd - Get a file descriptor for the caller's event loop
+ * @srv: the &struct uecp_srv
+ *
+ * It becomes readable when uecp_srv_run() has work to do
+ * (it's the server's epoll fd).
+ */
+int
+uecp_srv_get_fd(struct uecp_srv *srv)
+{
+	if(!srv)
+		return -EINVAL;
+
+	return srv->epoll_fd;
+}
+
+/**
+ * uecp_srv_run - Handle pending events
+ * @srv: the &struct uecp_srv
+ * @timeout_ms: how long to wait for events, -1 -> forever,
+ *	0 -> don't wait
+ *
+ * Returns: number of events handled or a negative error code
+ */
+int
+uecp_srv_run(struct uecp_srv *srv, int timeout_ms)
+{
+	struct epoll_event events[UECP_SRV_EVENTS_MAX];
+	uint32_t idx = 0;
+	int num_events = 0;
+	int i = 0;
+
+	if(!srv)
+		return -EINVAL;
+
+	/* Retry a submission that found the ring full */
+	if(srv->queue->len && !srv->queue->busy && timeout_ms != 0)
+		timeout_ms = 1;
+
+	num_events = epoll_wait(srv->epoll_fd, events, UECP_SRV_EVENTS_MAX,
+								timeout_ms);
+	if(num_events < 0)
+		return (errno == EINTR) ? 0 : -errno;
+
+	for(i = 0; i < num_events; i++) {
+		idx = events[i].data.u32 & UECP_SRV_EV_IDX_MASK;
+
+		switch(events[i].data.u32 & UECP_SRV_EV_TYPE_MASK) {
+		case UECP_SRV_EV_LISTEN:
+			uecp_srv_accept(srv, srv->listen_fds[idx]);
+			break;
+		case UECP_SRV_EV_CMD_DONE:
+			rds_queue_complete(srv->queue);
+			break;
+		default:
+			uecp_srv_client_event(srv, idx, events[i].events);
+			break;
+		}
+	}
+
+	if(srv->queue->len && !srv->queue->busy)
+		rds_queue_complete(srv->queue);
+
+	return num_events;
+}
+
+/**
+ * uecp_srv_get_stats - Get the server's counters
+ * @srv: the &struct uecp_srv
+ * @stats: the &struct uecp_srv_stats to fill
+ */
+int
+uecp_srv_get_stats(struct uecp_srv *srv, struct uecp_srv_stats *stats)
+{
+	if(!srv || !stats)
+		return -EINVAL;
+
+	*stats = srv->stats;
+	stats->coalesced = srv->queue->stats.coalesced;
+	stats->cmd_errors = srv->queue->stats.errors;
+	return 0;
+}
+
+/**
+ * uecp_srv_create - Create a UECP server for an encoder
+ * @enc: the &struct rds_encoder to drive (see rds_queue_create())
+ * @site_addr: the site address we answer to (besides broadcast)
+ * @enc_addr: the encoder address we answer to (besides broadcast)
+ *
+ * Returns: a &struct uecp_srv with no listeners yet, or NULL
+ * and errno set
+ */
+struct uecp_srv *
+uecp_srv_create(struct rds_encoder *enc, uint16_t site_addr,
+						uint8_t enc_addr)
+{
+	struct uecp_srv *srv = NULL;
+	struct epoll_event ev;
+	int ret = 0;
+
+	if(!enc || site_addr > UECP_SITE_ADDRESS_MAX ||
+	enc_addr > UECP_ENC_ADDRESS_MAX) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	srv = malloc(sizeof(struct uecp_srv));
+	if(!srv) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(srv, 0, sizeof(struct uecp_srv));
+
+	srv->enc = enc;
+	srv->site_addr = site_addr;
+	srv->enc_addr = enc_addr;
+	srv->ack = 1;
+
+	srv->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if(srv->epoll_fd < 0) {
+		ret = errno;
+		goto cleanup;
+	}
+
+	srv->queue = rds_queue_create(enc);
+	if(!srv->queue) {
+		ret = errno;
+		goto cleanup;
+	}
+
+	memset(&ev, 0, sizeof(struct epoll_event));
+	ev.events = EPOLLIN;
+	ev.data.u32 = UECP_SRV_EV_CMD_DONE;
+	if(epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD,
+			rds_queue_get_fd(srv->queue), &ev) < 0) {
+		ret = errno;
+		goto cleanup;
+	}
+
+	return srv;
+
+ cleanup:
+	rds_queue_destroy(srv->queue);
+	if(srv->epoll_fd >= 0)
+		close(srv->epoll_fd);
+	free(srv);
+	errno = ret;
+	return NULL;
+}
+
+/**
+ * uecp_srv_destroy - Close all connections and free the server
+ * @srv: the &struct uecp_srv
+ *
+ * Waits for the command the encoder runs (if any), queued ones
+ * are dropped (see rds_queue_destroy()).
+ */
+void
+uecp_srv_destroy(struct uecp_srv *srv)
+{
+	int i = 0;
+
+	if(!srv)
+		return;
+
+	for(i = 0; i < UECP_SRV_CLIENTS_MAX; i++)
+		uecp_srv_drop_client(srv, i);
+
+	for(i = 0; i < srv->num_listen; i++)
+		close(srv->listen_fds[i]);
+
+	if(srv->unix_path) {
+		unlink(srv->unix_path);
+		free(srv->unix_path);
+	}
+
+	rds_queue_destroy(srv->queue);
+	close(srv->epoll_fd);
+	free(srv);
+}
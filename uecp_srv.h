@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2013 Nick Kossifidis
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * uecp_srv.h -	UECP server, accepts UECP from playout systems
+ *		and drives any encoder
+ */
+
+/**
+ * DOC: UECP server
+ *
+ * Playout systems usually speak UECP over TCP, the server lets them
+ * drive any &struct rds_encoder (Prais, UECP or the software one)
+ * as if it was a UECP encoder on the network.
+ *
+ * It listens on TCP and / or Unix sockets and runs all clients on a
+ * single epoll loop, either through uecp_srv_run() or by adding
+ * uecp_srv_get_fd() to the caller's own loop. Incoming bytes go
+ * through a per-client state machine that finds frame boundaries
+ * and undoes byte-stuffing, complete frames are checked for
+ * length / CRC / address and their message elements are mapped to
+ * &struct rds_cmd.
+ *
+ * Commands are never run on the event loop, they go through a
+ * &struct rds_queue (see rds_queue.h) where a newer command for
+ * the same field (and DSN / PSN) replaces the queued one, so a
+ * playout system that updates RT faster than the serial link can
+ * take it only gets its latest RT out instead of a growing backlog.
+ *
+ * Each frame is answered with a UECP_MEC_MSG_ACK message carrying
+ * the frame's sequence number, once it has been queued (not when
+ * the encoder applies it, we don't want the ACK to wait on the
+ * serial link). Frames for other site / encoder addresses are
+ * dropped silently.
+ */
+
+#define UECP_SRV_CLIENTS_MAX	64
+#define UECP_SRV_LISTEN_MAX	4
+#define UECP_SRV_EVENTS_MAX	32
+
+/* Pending ACKs of a client that doesn't read them */
+#define UECP_SRV_TX_BUF_LEN	1024
+
+#define UECP_SRV_LISTEN_BACKLOG	16
+
+struct uecp_srv_client {
+	int fd;
+
+	/* Frame being received, after destuffing */
+	uint8_t rx[UECP_DF_MAX_LEN];
+	uint16_t rx_len;
+	uint8_t in_frame;
+	uint8_t escape;			/* Got a UECP_DF_STUFF_BYTE */
+	uint8_t rx_err;			/* UECP_ACK_* to reply with */
+
+	/* ACKs not written yet */
+	uint8_t tx[UECP_SRV_TX_BUF_LEN];
+	uint16_t tx_len;
+	uint8_t want_out;		/* Registered for EPOLLOUT */
+};
+
+struct uecp_srv_stats {
+	uint32_t frames;		/* Frames for us */
+	uint32_t bad_frames;		/* Frames with CRC / length errors */
+	uint32_t messages;		/* Message elements accepted */
+	uint32_t coalesced;		/* Commands replaced by newer ones */
+	uint32_t cmd_errors;		/* Commands the encoder failed */
+};
+
+struct uecp_srv {
+	struct rds_encoder *enc;
+	struct rds_queue *queue;
+	uint16_t site_addr;
+	uint8_t enc_addr;
+	uint8_t ack;			/* Send ACKs */
+
+	int epoll_fd;
+	int listen_fds[UECP_SRV_LISTEN_MAX];
+	uint8_t num_listen;
+	char *unix_path;		/* Unlinked on destroy */
+	struct uecp_srv_client *clients[UECP_SRV_CLIENTS_MAX];
+
+	struct uecp_srv_stats stats;
+};
+
+
+/************\
+* PROTOTYPES *
+\************/
+
+struct uecp_srv *uecp_srv_create(struct rds_encoder *enc,
+				uint16_t site_addr, uint8_t enc_addr);
+void uecp_srv_destroy(struct uecp_srv *srv);
+int uecp_srv_listen_tcp(struct uecp_srv *srv, const char *host,
+							uint16_t port);
+int uecp_srv_listen_unix(struct uecp_srv *srv, const char *path);
+int uecp_srv_set_ack(struct uecp_srv *srv, uint8_t on);
+int uecp_srv_get_fd(struct uecp_srv *srv);
+int uecp_srv_run(struct uecp_srv *srv, int timeout_ms);
+int uecp_srv_get_stats(struct uecp_srv *srv, struct uecp_srv_stats *stats);